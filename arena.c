@@ -0,0 +1,74 @@
+/**
+ * Arena allocator for the ART file packer and unpacker
+ * Scratch memory which is allocated piecewise and freed all at once, e.g. the buffers of one picture
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena.h"
+
+static size_t arena_align(const size_t size) {
+	return (size + (ARENA_ALIGNMENT-1)) & ~(size_t)(ARENA_ALIGNMENT-1);
+}
+
+void arena_init(Arena* arena) {
+	memset(arena, 0, sizeof(*arena));
+}
+
+static void arena_free_overflow(Arena* arena) {
+	while (arena->overflow) {
+		ArenaOverflowBlock* next = arena->overflow->next;
+		free(arena->overflow);
+		arena->overflow = next;
+	}
+}
+
+void arena_free(Arena* arena) {
+	arena_free_overflow(arena);
+	free(arena->base);
+	memset(arena, 0, sizeof(*arena));
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+	size = arena_align(size > 0 ? size : 1);
+	if (size > ((size_t)-1) - arena->requested) return NULL;
+	arena->requested += size;
+
+	if (size <= arena->capacity - arena->used) {
+		void* ptr = arena->base + arena->used;
+		arena->used += size;
+		return ptr;
+	}
+
+	// The main block cannot be moved while it is in use, so the memory comes from an overflow block.
+	// The main block grows at the next reset.
+	ArenaOverflowBlock* block = (ArenaOverflowBlock*)malloc(arena_align(sizeof(ArenaOverflowBlock)) + size);
+	if (!block) return NULL;
+	block->next = arena->overflow;
+	arena->overflow = block;
+	return (unsigned char*)block + arena_align(sizeof(ArenaOverflowBlock));
+}
+
+void* arena_zero_alloc(Arena* arena, size_t size) {
+	void* ptr = arena_alloc(arena, size);
+	if (ptr) memset(ptr, 0, size);
+	return ptr;
+}
+
+void arena_reset(Arena* arena) {
+	if (arena->overflow) {
+		arena_free_overflow(arena);
+		unsigned char* newBase = (unsigned char*)malloc(arena->requested);
+		if (newBase) {
+			free(arena->base);
+			arena->base = newBase;
+			arena->capacity = arena->requested;
+		}
+	}
+	arena->used = 0;
+	arena->requested = 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * Arena allocator for the ART file packer and unpacker
+ * Scratch memory which is allocated piecewise and freed all at once, e.g. the buffers of one picture
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__arena
+#define __inc__arena
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define ARENA_ALIGNMENT 16
+
+// Memory which did not fit into the main block. It is only kept until the next arena_reset().
+typedef struct tagArenaOverflowBlock {
+	struct tagArenaOverflowBlock* next;
+} ArenaOverflowBlock;
+
+// The main block grows to the biggest amount of memory which was needed between two resets,
+// so that it is reused without further allocations once the biggest picture has been seen
+typedef struct tagArena {
+	unsigned char* base;
+	size_t capacity;
+	size_t used;
+	size_t requested;              // total size since the last reset (including the overflow blocks)
+	ArenaOverflowBlock* overflow;
+} Arena;
+
+void arena_init(Arena* arena);
+void arena_free(Arena* arena);
+
+// Returns NULL if there is not enough memory. The memory is valid until the next arena_reset().
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_zero_alloc(Arena* arena, size_t size);
+
+// Frees all memory which was allocated from the arena at once
+void arena_reset(Arena* arena);
+
+#endif // #ifndef __inc__arena
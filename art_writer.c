@@ -0,0 +1,241 @@
+/**
+ * Buffered output of the ART file packer
+ * All data goes through one large buffer, and the position is counted instead of asked from the file.
+ * The directory at the beginning of the file is written last, with one positional write.
+ * In memory mode, the buffer grows instead, e.g. to compress a picture before it is known where it goes in the file.
+ * In counter mode, nothing is stored at all, and only the position is counted (simulation mode of the packer).
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+// Required for pwrite() and pread()
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "art_writer.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static bool art_writer_error(ArtWriter* writer) {
+	if (writer->bOK) fprintf(stderr, "ERROR: Cannot write %s (%s)\n", writer->szFilename, strerror(errno));
+	writer->bOK = false;
+	return false;
+}
+
+static bool art_writer_write_fully(ArtWriter* writer, const unsigned char* data, size_t len) {
+	while (len > 0) {
+		const size_t chunk = (len > 0x40000000) ? 0x40000000 : len;
+		const int64_t n = write(writer->fd, data, chunk);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return art_writer_error(writer);
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool art_writer_flush(ArtWriter* writer) {
+	if (writer->fd < 0) return writer->bOK; // memory mode or counter mode
+	const size_t len = writer->bufUsed;
+	writer->bufUsed = 0;
+	return writer->bOK && art_writer_write_fully(writer, writer->buf, len);
+}
+
+// Memory mode: makes room for len more bytes
+static bool art_writer_grow(ArtWriter* writer, const size_t len) {
+	size_t newCapacity = writer->bufCapacity;
+	while (newCapacity < writer->bufUsed+len) newCapacity *= 2;
+	unsigned char* newBuf = (unsigned char*)realloc(writer->buf, newCapacity);
+	if (!newBuf) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", writer->szFilename);
+		writer->bOK = false;
+		return false;
+	}
+	writer->buf = newBuf;
+	writer->bufCapacity = newCapacity;
+	return true;
+}
+
+ArtWriter* new_art_writer(const char* szFilename) {
+	ArtWriter* writer = (ArtWriter*)calloc(1, sizeof(ArtWriter));
+	unsigned char* buf = (unsigned char*)malloc(ART_WRITER_BUFFER_SIZE);
+	if (!writer || !buf) {
+		fprintf(stderr, "FATAL: Cannot allocate the output buffer for %s\n", szFilename);
+		free(writer);
+		free(buf);
+		return NULL;
+	}
+	writer->fd = open(szFilename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (writer->fd < 0) {
+		fprintf(stderr, "FATAL: Cannot open %s for writing\n", szFilename);
+		free(writer);
+		free(buf);
+		return NULL;
+	}
+	snprintf(writer->szFilename, sizeof(writer->szFilename), "%s", szFilename);
+	writer->buf = buf;
+	writer->bufCapacity = ART_WRITER_BUFFER_SIZE;
+	writer->bOK = true;
+	return writer;
+}
+
+ArtWriter* new_art_writer_memory(const char* szName, const size_t initialCapacity) {
+	const size_t capacity = (initialCapacity > 0) ? initialCapacity : 1;
+	ArtWriter* writer = (ArtWriter*)calloc(1, sizeof(ArtWriter));
+	unsigned char* buf = (unsigned char*)malloc(capacity);
+	if (!writer || !buf) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", szName);
+		free(writer);
+		free(buf);
+		return NULL;
+	}
+	writer->fd = -1;
+	snprintf(writer->szFilename, sizeof(writer->szFilename), "%s", szName);
+	writer->buf = buf;
+	writer->bufCapacity = capacity;
+	writer->bOK = true;
+	return writer;
+}
+
+ArtWriter* new_art_writer_counter(const char* szName) {
+	ArtWriter* writer = (ArtWriter*)calloc(1, sizeof(ArtWriter));
+	if (!writer) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", szName);
+		return NULL;
+	}
+	writer->fd = -1;
+	snprintf(writer->szFilename, sizeof(writer->szFilename), "%s", szName);
+	writer->bOK = true;
+	writer->bCounter = true;
+	return writer;
+}
+
+bool del_art_writer(ArtWriter* writer) {
+	art_writer_flush(writer);
+	if ((writer->fd >= 0) && (close(writer->fd) != 0) && writer->bOK) art_writer_error(writer);
+	const bool bOK = writer->bOK;
+	free(writer->buf);
+	free(writer);
+	return bOK;
+}
+
+bool art_writer_write(ArtWriter* writer, const void* data, const size_t len) {
+	writer->pos += len;
+	if (!writer->bOK || writer->bCounter) return writer->bOK;
+	if (writer->bufUsed+len > writer->bufCapacity) {
+		if (writer->fd < 0) {
+			if (!art_writer_grow(writer, len)) return false;
+		} else {
+			// Big blocks are not copied into the buffer
+			if (!art_writer_flush(writer)) return false;
+			if (len >= writer->bufCapacity/2) return art_writer_write_fully(writer, (const unsigned char*)data, len);
+		}
+	}
+	memcpy(writer->buf+writer->bufUsed, data, len);
+	writer->bufUsed += len;
+	return true;
+}
+
+bool art_writer_put_byte(ArtWriter* writer, const unsigned char b) {
+	writer->pos++;
+	if (!writer->bOK || writer->bCounter) return writer->bOK;
+	if (writer->bufUsed == writer->bufCapacity) {
+		if (writer->fd < 0) {
+			if (!art_writer_grow(writer, 1)) return false;
+		} else if (!art_writer_flush(writer)) {
+			return false;
+		}
+	}
+	writer->buf[writer->bufUsed++] = b;
+	return true;
+}
+
+const unsigned char* art_writer_memory_data(const ArtWriter* writer) {
+	return writer->buf;
+}
+
+uint64_t art_writer_tell(const ArtWriter* writer) {
+	return writer->pos;
+}
+
+void art_writer_count(ArtWriter* writer, const uint64_t len) {
+	writer->pos += len;
+}
+
+bool art_writer_compare(ArtWriter* writer, const uint64_t offset, const void* data, const size_t len) {
+	if (writer->bCounter) return true;
+	if (!writer->bOK || (offset+len > writer->pos)) return false;
+	if (writer->fd < 0) return memcmp(writer->buf+offset, data, len) == 0;
+
+	// The file contains everything before the buffer, the buffer contains the rest
+	const uint64_t bufStart = writer->pos - writer->bufUsed;
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t o = offset;
+	size_t left = len;
+	unsigned char chunk[0x10000];
+	while ((left > 0) && (o < bufStart)) {
+		size_t n = (bufStart-o < left) ? (size_t)(bufStart-o) : left;
+		if (n > sizeof(chunk)) n = sizeof(chunk);
+		#ifdef _WIN32
+		// Windows has no pread(). The file position is set back to the end of the written data.
+		const bool bRead = (_lseeki64(writer->fd, o, SEEK_SET) >= 0) && (read(writer->fd, chunk, n) == (int)n) && (_lseeki64(writer->fd, bufStart, SEEK_SET) >= 0);
+		#else
+		const bool bRead = pread(writer->fd, chunk, n, o) == (ssize_t)n;
+		#endif
+		if (!bRead || (memcmp(chunk, p, n) != 0)) return false;
+		p += n;
+		o += n;
+		left -= n;
+	}
+	return (left == 0) || (memcmp(writer->buf+(o-bufStart), p, left) == 0);
+}
+
+bool art_writer_patch(ArtWriter* writer, const uint64_t offset, const void* data, const size_t len) {
+	if (!art_writer_flush(writer)) return false;
+	if (writer->bCounter) return true;
+	if (writer->fd < 0) {
+		if (offset+len > writer->bufUsed) return false;
+		memcpy(writer->buf+offset, data, len);
+		return true;
+	}
+	#ifdef _WIN32
+	// Windows has no pwrite(). The file position is not needed afterwards, because the buffer is empty.
+	if (_lseeki64(writer->fd, offset, SEEK_SET) < 0) return art_writer_error(writer);
+	if (!art_writer_write_fully(writer, (const unsigned char*)data, len)) return false;
+	if (_lseeki64(writer->fd, writer->pos, SEEK_SET) < 0) return art_writer_error(writer);
+	return true;
+	#else
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t o = offset;
+	size_t left = len;
+	while (left > 0) {
+		const ssize_t n = pwrite(writer->fd, p, left, o);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return art_writer_error(writer);
+		}
+		p += n;
+		o += n;
+		left -= n;
+	}
+	return true;
+	#endif
+}
@@ -0,0 +1,57 @@
+/**
+ * Buffered output of the ART file packer
+ * All data goes through one large buffer, and the position is counted instead of asked from the file.
+ * The directory at the beginning of the file is written last, with one positional write.
+ * In memory mode, the buffer grows instead, e.g. to compress a picture before it is known where it goes in the file.
+ * In counter mode, nothing is stored at all, and only the position is counted (simulation mode of the packer).
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__art_writer
+#define __inc__art_writer
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ART_WRITER_BUFFER_SIZE (4*1024*1024)
+#define ART_WRITER_FILENAME_SIZE 1024
+
+typedef struct tagArtWriter {
+	int fd;                // -1 in memory mode and in counter mode
+	char szFilename[ART_WRITER_FILENAME_SIZE]; // for messages
+	unsigned char* buf;
+	size_t bufUsed;
+	size_t bufCapacity;
+	uint64_t pos;          // number of bytes written so far, i.e. the offset of the next byte
+	bool bOK;              // false after the first error. Further writes are ignored.
+	bool bCounter;         // counter mode: the data is discarded, buf is NULL
+} ArtWriter;
+
+// Returns NULL (and prints an error) if the file cannot be created
+ArtWriter* new_art_writer(const char* szFilename);
+// Returns NULL (and prints an error) if there is not enough memory. szName is only used for messages.
+ArtWriter* new_art_writer_memory(const char* szName, const size_t initialCapacity);
+// Returns NULL (and prints an error) if there is not enough memory. szName is only used for messages.
+ArtWriter* new_art_writer_counter(const char* szName);
+// Writes the rest of the buffer and closes the file. Returns false if something could not be written.
+bool del_art_writer(ArtWriter* writer);
+
+// All data which was written in memory mode (art_writer_tell() bytes). Valid until del_art_writer(). NULL in counter mode.
+const unsigned char* art_writer_memory_data(const ArtWriter* writer);
+
+bool art_writer_write(ArtWriter* writer, const void* data, const size_t len);
+bool art_writer_put_byte(ArtWriter* writer, const unsigned char b);
+uint64_t art_writer_tell(const ArtWriter* writer);
+// Counter mode: advances the position by len bytes, whose data was never produced (e.g. the size of a compressed stream which was only computed)
+void art_writer_count(ArtWriter* writer, const uint64_t len);
+
+// Returns true if the data at the given offset, which was written before, is equal to data (e.g. to verify a hash match).
+// In counter mode, nothing was stored, so true is returned. Returns false if the data cannot be read back.
+bool art_writer_compare(ArtWriter* writer, const uint64_t offset, const void* data, const size_t len);
+
+// Writes the buffer, and then the data at the given offset (e.g. the directory, which was reserved with zeros at the beginning)
+bool art_writer_patch(ArtWriter* writer, const uint64_t offset, const void* data, const size_t len);
+
+#endif // #ifndef __inc__art_writer
@@ -0,0 +1,427 @@
+/**
+ * Asynchronous file output for the ART file unpacker
+ * Writes complete files (e.g. bitmaps) in the background with Linux io_uring, so that opening, writing and closing
+ * the files overlaps with decoding the next pictures. Falls back to synchronous output where io_uring is not available.
+ * Can also append the files to a tar stream.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+// Required for syscall() and MAP_POPULATE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "async_output.h"
+
+// The system calls are used directly, so that no liburing is needed
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_OUTPUT_IO_URING
+#endif
+#endif
+
+#ifdef ASYNC_OUTPUT_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Files which are queued or in flight. Every file has at most one operation in flight, so this is also the size of the submission queue.
+#define ASYNC_OUTPUT_MAX_PENDING 64
+
+// A single write operation is limited to 32 bits
+#define ASYNC_OUTPUT_MAX_WRITE (1u << 30)
+
+#define ASYNC_OUTPUT_STATE_OPENING 0
+#define ASYNC_OUTPUT_STATE_WRITING 1
+#define ASYNC_OUTPUT_STATE_CLOSING 2
+
+typedef struct tagAsyncOutputRequest {
+	struct tagAsyncOutputRequest* next;
+	AsyncOutputGroup* group;
+	char* szFilename;
+	unsigned char* data;
+	size_t len;
+	size_t written;
+	int fd;
+	int state;        // ASYNC_OUTPUT_STATE_*
+	int error;        // errno of the first failed operation, or 0
+	bool* pbOK;
+} AsyncOutputRequest;
+
+struct tagAsyncOutput {
+	pthread_mutex_t mutex;
+	pthread_cond_t requestQueued; // for the output thread
+	pthread_cond_t requestDone;   // for the threads which submit files or wait for a group
+	AsyncOutputRequest* queueHead;
+	AsyncOutputRequest* queueTail;
+	int numPending;
+	bool bShutdown;
+	bool bAsync;
+	TarWriter* tar;               // or NULL
+	pthread_t thread;
+	#ifdef ASYNC_OUTPUT_IO_URING
+	int ringFd;
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	struct io_uring_sqe* sqes;
+	size_t sqesSize;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned sqEntries;
+	unsigned sqLocalTail;
+	unsigned numToSubmit;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	struct io_uring_cqe* cqes;
+	#endif
+};
+
+static bool async_output_write_sync(const char* szFilename, const unsigned char* data, const size_t len) {
+	FILE* fobFile = fopen(szFilename, "wb");
+	if (!fobFile) {
+		fprintf(stderr, "FATAL: Cannot open %s for writing\n", szFilename);
+		return false;
+	}
+	const bool bWritten = (len == 0) || (fwrite(data, len, 1, fobFile) == 1);
+	if ((fclose(fobFile) != 0) || !bWritten) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", szFilename);
+		return false;
+	}
+	return true;
+}
+
+// Called by the output thread when the file is closed (or could not be opened)
+static void async_output_finish(AsyncOutput* out, AsyncOutputRequest* req) {
+	if (req->error != 0) {
+		if (req->state == ASYNC_OUTPUT_STATE_OPENING) {
+			fprintf(stderr, "FATAL: Cannot open %s for writing (%s)\n", req->szFilename, strerror(req->error));
+		} else {
+			fprintf(stderr, "ERROR: Cannot write %s (%s)\n", req->szFilename, strerror(req->error));
+		}
+	}
+
+	pthread_mutex_lock(&out->mutex);
+	if (req->error != 0) *req->pbOK = false;
+	out->numPending--;
+	req->group->pendingFiles--;
+	pthread_cond_broadcast(&out->requestDone);
+	pthread_mutex_unlock(&out->mutex);
+
+	free(req->data);
+	free(req->szFilename);
+	free(req);
+}
+
+#ifdef ASYNC_OUTPUT_IO_URING
+
+static bool async_output_setup_ring(AsyncOutput* out) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	out->ringFd = syscall(__NR_io_uring_setup, ASYNC_OUTPUT_MAX_PENDING, &params);
+	if (out->ringFd < 0) return false;
+
+	out->sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+	out->cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (out->cqRingSize > out->sqRingSize) out->sqRingSize = out->cqRingSize;
+		out->cqRingSize = out->sqRingSize;
+	}
+	out->sqRing = mmap(NULL, out->sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, out->ringFd, IORING_OFF_SQ_RING);
+	if (out->sqRing == MAP_FAILED) {
+		close(out->ringFd);
+		return false;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		out->cqRing = out->sqRing;
+	} else {
+		out->cqRing = mmap(NULL, out->cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, out->ringFd, IORING_OFF_CQ_RING);
+		if (out->cqRing == MAP_FAILED) {
+			munmap(out->sqRing, out->sqRingSize);
+			close(out->ringFd);
+			return false;
+		}
+	}
+	out->sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+	out->sqes = (struct io_uring_sqe*)mmap(NULL, out->sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, out->ringFd, IORING_OFF_SQES);
+	if (out->sqes == MAP_FAILED) {
+		if (out->cqRing != out->sqRing) munmap(out->cqRing, out->cqRingSize);
+		munmap(out->sqRing, out->sqRingSize);
+		close(out->ringFd);
+		return false;
+	}
+
+	unsigned char* sq = (unsigned char*)out->sqRing;
+	out->sqHead  = (unsigned*)(sq + params.sq_off.head);
+	out->sqTail  = (unsigned*)(sq + params.sq_off.tail);
+	out->sqMask  = (unsigned*)(sq + params.sq_off.ring_mask);
+	out->sqArray = (unsigned*)(sq + params.sq_off.array);
+	out->sqEntries = params.sq_entries;
+	out->sqLocalTail = *out->sqTail;
+	out->numToSubmit = 0;
+
+	unsigned char* cq = (unsigned char*)out->cqRing;
+	out->cqHead = (unsigned*)(cq + params.cq_off.head);
+	out->cqTail = (unsigned*)(cq + params.cq_off.tail);
+	out->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	out->cqes   = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	return true;
+}
+
+static void async_output_close_ring(AsyncOutput* out) {
+	munmap(out->sqes, out->sqesSize);
+	if (out->cqRing != out->sqRing) munmap(out->cqRing, out->cqRingSize);
+	munmap(out->sqRing, out->sqRingSize);
+	close(out->ringFd);
+}
+
+// There is always a free entry, because every pending file has at most one operation in flight
+static struct io_uring_sqe* async_output_get_sqe(AsyncOutput* out, AsyncOutputRequest* req) {
+	const unsigned idx = out->sqLocalTail & *out->sqMask;
+	struct io_uring_sqe* sqe = &out->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uint64_t)(uintptr_t)req;
+	out->sqArray[idx] = idx;
+	out->sqLocalTail++;
+	out->numToSubmit++;
+	return sqe;
+}
+
+static void async_output_queue_next_operation(AsyncOutput* out, AsyncOutputRequest* req) {
+	struct io_uring_sqe* sqe = async_output_get_sqe(out, req);
+	switch (req->state) {
+		case ASYNC_OUTPUT_STATE_OPENING:
+			sqe->opcode = IORING_OP_OPENAT;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uint64_t)(uintptr_t)req->szFilename;
+			sqe->len = 0666;
+			sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+			break;
+		case ASYNC_OUTPUT_STATE_WRITING: {
+			const size_t remaining = req->len - req->written;
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->fd = req->fd;
+			sqe->addr = (uint64_t)(uintptr_t)(req->data + req->written);
+			sqe->len = (remaining > ASYNC_OUTPUT_MAX_WRITE) ? ASYNC_OUTPUT_MAX_WRITE : remaining;
+			sqe->off = req->written;
+			break;
+		}
+		case ASYNC_OUTPUT_STATE_CLOSING:
+			sqe->opcode = IORING_OP_CLOSE;
+			sqe->fd = req->fd;
+			break;
+	}
+}
+
+// Processes the result of the operation which was in flight. Returns false when the file is finished.
+static bool async_output_complete_operation(AsyncOutput* out, AsyncOutputRequest* req, const int res) {
+	switch (req->state) {
+		case ASYNC_OUTPUT_STATE_OPENING:
+			if (res == -EINVAL) {
+				// The kernel is too old for IORING_OP_OPENAT (before Linux 5.6)
+				if (!async_output_write_sync(req->szFilename, req->data, req->len)) *req->pbOK = false;
+				return false;
+			}
+			if (res < 0) {
+				req->error = -res;
+				return false;
+			}
+			req->fd = res;
+			req->state = (req->len > 0) ? ASYNC_OUTPUT_STATE_WRITING : ASYNC_OUTPUT_STATE_CLOSING;
+			break;
+		case ASYNC_OUTPUT_STATE_WRITING:
+			if (res <= 0) {
+				req->error = (res < 0) ? -res : EIO;
+				req->state = ASYNC_OUTPUT_STATE_CLOSING;
+				break;
+			}
+			req->written += res;
+			if (req->written == req->len) req->state = ASYNC_OUTPUT_STATE_CLOSING;
+			break;
+		case ASYNC_OUTPUT_STATE_CLOSING:
+			if ((res < 0) && (req->error == 0)) req->error = -res;
+			// Keep the state, so that the error is reported as write error
+			if (req->error != 0) req->state = ASYNC_OUTPUT_STATE_WRITING;
+			return false;
+	}
+	async_output_queue_next_operation(out, req);
+	return true;
+}
+
+static void* async_output_thread(void* arg) {
+	AsyncOutput* out = (AsyncOutput*)arg;
+	int numInFlight = 0;
+
+	while (1) {
+		pthread_mutex_lock(&out->mutex);
+		while (!out->queueHead && (numInFlight == 0) && !out->bShutdown) {
+			pthread_cond_wait(&out->requestQueued, &out->mutex);
+		}
+		if (!out->queueHead && (numInFlight == 0)) {
+			// Shutdown, and nothing is pending anymore
+			pthread_mutex_unlock(&out->mutex);
+			break;
+		}
+		AsyncOutputRequest* newRequests = out->queueHead;
+		out->queueHead = NULL;
+		out->queueTail = NULL;
+		pthread_mutex_unlock(&out->mutex);
+
+		while (newRequests) {
+			AsyncOutputRequest* req = newRequests;
+			newRequests = req->next;
+			async_output_queue_next_operation(out, req);
+			numInFlight++;
+		}
+
+		// Submit the new operations, and wait for at least one completion.
+		// Files which are queued in the meantime are picked up after the next completion.
+		__atomic_store_n(out->sqTail, out->sqLocalTail, __ATOMIC_RELEASE);
+		if (syscall(__NR_io_uring_enter, out->ringFd, out->numToSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if (errno == EINTR) {
+				// The operations were not submitted yet (or only partially); the kernel takes the rest with the next call
+				out->numToSubmit = out->sqLocalTail - __atomic_load_n(out->sqHead, __ATOMIC_ACQUIRE);
+				continue;
+			}
+			fprintf(stderr, "FATAL: io_uring_enter failed (%s)\n", strerror(errno));
+			abort();
+		}
+		out->numToSubmit = 0;
+
+		unsigned head = *out->cqHead;
+		const unsigned tail = __atomic_load_n(out->cqTail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			const struct io_uring_cqe* cqe = &out->cqes[head & *out->cqMask];
+			AsyncOutputRequest* req = (AsyncOutputRequest*)(uintptr_t)cqe->user_data;
+			const int res = cqe->res;
+			head++;
+			if (!async_output_complete_operation(out, req, res)) {
+				numInFlight--;
+				async_output_finish(out, req);
+			}
+		}
+		__atomic_store_n(out->cqHead, head, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+#endif // #ifdef ASYNC_OUTPUT_IO_URING
+
+AsyncOutput* new_async_output(const bool bUseIoUring) {
+	AsyncOutput* out = (AsyncOutput*)calloc(1, sizeof(AsyncOutput));
+	if (!out) return NULL;
+	pthread_mutex_init(&out->mutex, NULL);
+	pthread_cond_init(&out->requestQueued, NULL);
+	pthread_cond_init(&out->requestDone, NULL);
+
+	#ifdef ASYNC_OUTPUT_IO_URING
+	if (bUseIoUring && async_output_setup_ring(out)) {
+		if (pthread_create(&out->thread, NULL, async_output_thread, out) == 0) {
+			out->bAsync = true;
+		} else {
+			async_output_close_ring(out);
+		}
+	}
+	#endif
+
+	return out;
+}
+
+AsyncOutput* new_async_output_tar(TarWriter* tar) {
+	AsyncOutput* out = new_async_output(false);
+	if (out) out->tar = tar;
+	return out;
+}
+
+void del_async_output(AsyncOutput* out) {
+	if (!out) return;
+	if (out->bAsync) {
+		pthread_mutex_lock(&out->mutex);
+		out->bShutdown = true;
+		pthread_cond_signal(&out->requestQueued);
+		pthread_mutex_unlock(&out->mutex);
+		pthread_join(out->thread, NULL);
+		#ifdef ASYNC_OUTPUT_IO_URING
+		async_output_close_ring(out);
+		#endif
+	}
+	pthread_cond_destroy(&out->requestDone);
+	pthread_cond_destroy(&out->requestQueued);
+	pthread_mutex_destroy(&out->mutex);
+	free(out);
+}
+
+bool async_output_is_async(const AsyncOutput* out) {
+	return out->bAsync;
+}
+
+bool async_output_is_tar(const AsyncOutput* out) {
+	return out->tar != NULL;
+}
+
+void async_output_write_file(AsyncOutput* out, AsyncOutputGroup* group, const char* szFilename, unsigned char* data, size_t len, bool* pbOK) {
+	if (out->tar) {
+		// The files of the tar stream must not be interleaved
+		pthread_mutex_lock(&out->mutex);
+		if (!tar_write_file(out->tar, szFilename, data, len)) *pbOK = false;
+		pthread_mutex_unlock(&out->mutex);
+		free(data);
+		return;
+	}
+
+	AsyncOutputRequest* req = out->bAsync ? (AsyncOutputRequest*)calloc(1, sizeof(AsyncOutputRequest)) : NULL;
+	char* szFilenameCopy = req ? (char*)malloc(strlen(szFilename)+1) : NULL;
+	if (!req || !szFilenameCopy) {
+		// Synchronous output
+		if (!async_output_write_sync(szFilename, data, len)) *pbOK = false;
+		free(szFilenameCopy);
+		free(req);
+		free(data);
+		return;
+	}
+	strcpy(szFilenameCopy, szFilename);
+	req->group = group;
+	req->szFilename = szFilenameCopy;
+	req->data = data;
+	req->len = len;
+	req->fd = -1;
+	req->state = ASYNC_OUTPUT_STATE_OPENING;
+	req->pbOK = pbOK;
+
+	pthread_mutex_lock(&out->mutex);
+	while (out->numPending >= ASYNC_OUTPUT_MAX_PENDING) {
+		pthread_cond_wait(&out->requestDone, &out->mutex);
+	}
+	out->numPending++;
+	group->pendingFiles++;
+	if (out->queueTail) {
+		out->queueTail->next = req;
+	} else {
+		out->queueHead = req;
+	}
+	out->queueTail = req;
+	pthread_cond_signal(&out->requestQueued);
+	pthread_mutex_unlock(&out->mutex);
+}
+
+void async_output_wait(AsyncOutput* out, AsyncOutputGroup* group) {
+	pthread_mutex_lock(&out->mutex);
+	while (group->pendingFiles > 0) {
+		pthread_cond_wait(&out->requestDone, &out->mutex);
+	}
+	pthread_mutex_unlock(&out->mutex);
+}
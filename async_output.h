@@ -0,0 +1,43 @@
+/**
+ * Asynchronous file output for the ART file unpacker
+ * Writes complete files (e.g. bitmaps) in the background with Linux io_uring, so that opening, writing and closing
+ * the files overlaps with decoding the next pictures. Falls back to synchronous output where io_uring is not available.
+ * Can also append the files to a tar stream.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__async_output
+#define __inc__async_output
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "tar_stream.h"
+
+// A group of files which can be waited for, e.g. all bitmaps of one ART file
+typedef struct tagAsyncOutputGroup {
+	int pendingFiles;
+} AsyncOutputGroup;
+
+typedef struct tagAsyncOutput AsyncOutput;
+
+// bUseIoUring=false, or if io_uring is not available: The files are written synchronously by async_output_write_file()
+AsyncOutput* new_async_output(const bool bUseIoUring);
+void del_async_output(AsyncOutput* out); // waits for all files
+bool async_output_is_async(const AsyncOutput* out);
+
+// All files are appended to a tar stream instead of being written into the file system (--tar).
+// The files are written synchronously, one after the other. The names should be relative.
+AsyncOutput* new_async_output_tar(TarWriter* tar);
+bool async_output_is_tar(const AsyncOutput* out);
+
+// Writes data (allocated with malloc, async_output takes the ownership) into a new file.
+// If this fails, an error is printed and *pbOK is set to false. pbOK must stay valid until the group was waited for.
+// Blocks if too many files are pending.
+void async_output_write_file(AsyncOutput* out, AsyncOutputGroup* group, const char* szFilename, unsigned char* data, size_t len, bool* pbOK);
+
+// Waits until all files of the group are written and closed
+void async_output_wait(AsyncOutput* out, AsyncOutputGroup* group);
+
+#endif // #ifndef __inc__async_output
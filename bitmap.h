@@ -15,6 +15,7 @@
 // These parts were extracted from WinGDI.h and WinDef.h
 
 #define BI_RGB 0
+#define BI_BITFIELDS 3
 
 #pragma pack(push,2)
 typedef struct tagBITMAPFILEHEADER {
@@ -0,0 +1,57 @@
+/**
+ * Deduplication of identical stored pictures for the ART file packer
+ * Remembers the pictures which were written into the ART file, by the hash of their stored data,
+ * so that the directory entry of an identical picture points to the same data instead of a second copy
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "blob_dedup.h"
+
+#define BLOB_DEDUP_EXPECTED_ENTRIES 32
+
+static bool blob_dedup_equal(const void* entry, const void* key) {
+	return ((const BlobDedupEntry*)entry)->size == *(const uint64_t*)key;
+}
+
+BlobDedup* new_blob_dedup() {
+	BlobDedup* dedup = (BlobDedup*)calloc(1, sizeof(BlobDedup));
+	if (!dedup) return NULL;
+	if (!hash_table_init(&dedup->table, sizeof(BlobDedupEntry), BLOB_DEDUP_EXPECTED_ENTRIES, blob_dedup_equal)) {
+		free(dedup);
+		return NULL;
+	}
+	return dedup;
+}
+
+void del_blob_dedup(BlobDedup* dedup) {
+	if (!dedup) return;
+	hash_table_free(&dedup->table);
+	free(dedup);
+}
+
+bool blob_dedup_find(BlobDedup* dedup, const uint64_t hash, const void* data, const uint64_t size, ArtWriter* output, uint64_t* offset) {
+	if (size == 0) return false;
+	const BlobDedupEntry* entry = (const BlobDedupEntry*)hash_table_find(&dedup->table, hash, &size);
+	// On a hash collision, the data is written again, and the earlier data stays in the table
+	if (!entry || !art_writer_compare(output, entry->offset, data, size)) return false;
+	*offset = entry->offset;
+	dedup->numLinked++;
+	dedup->bytesSaved += size;
+	return true;
+}
+
+void blob_dedup_add(BlobDedup* dedup, const uint64_t hash, const uint64_t size, const uint64_t offset) {
+	if (size == 0) return;
+	// Nothing is lost if the table cannot grow: the data is just not deduplicated
+	bool bNew;
+	BlobDedupEntry* entry = (BlobDedupEntry*)hash_table_insert(&dedup->table, hash, &size, &bNew);
+	if (!entry || !bNew) return;
+	entry->size = size;
+	entry->offset = offset;
+}
@@ -0,0 +1,40 @@
+/**
+ * Deduplication of identical stored pictures for the ART file packer
+ * Remembers the pictures which were written into the ART file, by the hash of their stored data,
+ * so that the directory entry of an identical picture points to the same data instead of a second copy
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__blob_dedup
+#define __inc__blob_dedup
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "art_writer.h"
+#include "hash_table.h"
+
+typedef struct tagBlobDedupEntry {
+	uint64_t size;         // of the stored data, as it is written into the ART file (picture header, compressed data and palette)
+	uint64_t offset;       // in the ART file
+} BlobDedupEntry;
+
+// Used by the thread which writes the ART file only
+typedef struct tagBlobDedup {
+	HashTable table;       // of BlobDedupEntry, by the hash of the stored data
+	int numLinked;
+	uint64_t bytesSaved;
+} BlobDedup;
+
+BlobDedup* new_blob_dedup();
+void del_blob_dedup(BlobDedup* dedup);
+
+// If identical data was already written into output, its offset is returned in *offset, and true is returned.
+// A hash match is only accepted if the data which was written is equal (in simulation mode, nothing was written to compare).
+// Otherwise, the caller writes the data and calls blob_dedup_add().
+bool blob_dedup_find(BlobDedup* dedup, const uint64_t hash, const void* data, const uint64_t size, ArtWriter* output, uint64_t* offset);
+void blob_dedup_add(BlobDedup* dedup, const uint64_t hash, const uint64_t size, const uint64_t offset);
+
+#endif // #ifndef __inc__blob_dedup
@@ -0,0 +1,110 @@
+/**
+ * Read-only view of a bitmap file for the ART file packer
+ * The file is memory mapped (or taken from the memory of a tar stream), and the headers are checked once.
+ * The palette and the pixel rows are pointers into the file, nothing is copied.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+// Required for mmap()
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "bmp_view.h"
+#include "utils.h"
+
+#define EXIT_ERROR(msg) { snprintf(view->error, sizeof(view->error), "%s", msg); return false; }
+
+static bool bmp_view_parse(BmpView* view) {
+	if ((view->size < sizeof(BITMAPFILEHEADER)+sizeof(BITMAPINFOHEADER))) EXIT_ERROR("Not a bitmap file");
+	memcpy(&view->fileHeader, view->data, sizeof(BITMAPFILEHEADER));
+	memcpy(&view->infoHeader, view->data+sizeof(BITMAPFILEHEADER), sizeof(BITMAPINFOHEADER));
+	const BITMAPINFOHEADER* bih = &view->infoHeader;
+
+	if ((view->fileHeader.bfType != BI_SIGNATURE) ||
+	    (bih->biSize < sizeof(BITMAPINFOHEADER)) || (bih->biSize > view->size-sizeof(BITMAPFILEHEADER)) ||
+	    (view->fileHeader.bfOffBits > view->size)) {
+		EXIT_ERROR("Not a bitmap file");
+	}
+	if ((bih->biWidth < 0) || (bih->biHeight == INT32_MIN)) EXIT_ERROR("Invalid dimensions");
+
+	view->colorTable = (const RGBQUAD*)(view->data + sizeof(BITMAPFILEHEADER) + bih->biSize);
+	view->pixels = view->data + view->fileHeader.bfOffBits;
+	view->width = bih->biWidth;
+	view->height = (bih->biHeight < 0) ? -bih->biHeight : bih->biHeight;
+	view->bBottomUp = bih->biHeight > 0;
+	view->stride = (((uint64_t)view->width*bih->biBitCount + 31) / 32) * 4; // http://stackoverflow.com/a/2022194/3544341
+	view->error[0] = 0;
+	return true;
+}
+
+bool bmp_view_open_file(BmpView* view, const char* szFilename) {
+	memset(view, 0, sizeof(*view));
+
+	FILE* fibBitmap = fopen(szFilename, "rb");
+	if (!fibBitmap) EXIT_ERROR("Cannot open the file");
+	const uint64_t size = file_size(fibBitmap);
+	if (size > SIZE_MAX) {
+		fclose(fibBitmap);
+		EXIT_ERROR("The file is too big");
+	}
+
+	#ifndef _WIN32
+	// An empty file cannot be mapped, but it is not a bitmap anyway
+	if (size > 0) {
+		void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fibBitmap), 0);
+		if (mapping != MAP_FAILED) {
+			fclose(fibBitmap);
+			view->data = (const unsigned char*)mapping;
+			view->size = size;
+			view->storage = BMP_VIEW_STORAGE_MAPPED;
+			return bmp_view_parse(view);
+		}
+	}
+	#endif
+
+	// Without mmap(), the file is read into memory
+	unsigned char* data = (unsigned char*)malloc(size > 0 ? size : 1);
+	if (!data || ((size > 0) && (fread(data, size, 1, fibBitmap) != 1))) {
+		free(data);
+		fclose(fibBitmap);
+		EXIT_ERROR("Cannot read the file");
+	}
+	fclose(fibBitmap);
+	view->data = data;
+	view->size = size;
+	view->storage = BMP_VIEW_STORAGE_ALLOCATED;
+	return bmp_view_parse(view);
+}
+
+bool bmp_view_open_memory(BmpView* view, const void* data, const size_t size) {
+	memset(view, 0, sizeof(*view));
+	view->data = (const unsigned char*)data;
+	view->size = size;
+	view->storage = BMP_VIEW_STORAGE_BORROWED;
+	return bmp_view_parse(view);
+}
+
+void bmp_view_close(BmpView* view) {
+	#ifndef _WIN32
+	if (view->storage == BMP_VIEW_STORAGE_MAPPED) munmap((void*)view->data, view->size);
+	#endif
+	if (view->storage == BMP_VIEW_STORAGE_ALLOCATED) free((void*)view->data);
+	view->data = NULL;
+	view->size = 0;
+	view->storage = BMP_VIEW_STORAGE_NONE;
+}
+
+size_t bmp_view_available(const BmpView* view, const void* p) {
+	const unsigned char* q = (const unsigned char*)p;
+	return ((q >= view->data) && (q <= view->data+view->size)) ? (size_t)(view->data+view->size-q) : 0;
+}
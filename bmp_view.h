@@ -0,0 +1,47 @@
+/**
+ * Read-only view of a bitmap file for the ART file packer
+ * The file is memory mapped (or taken from the memory of a tar stream), and the headers are checked once.
+ * The palette and the pixel rows are pointers into the file, nothing is copied.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__bmp_view
+#define __inc__bmp_view
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bitmap.h"
+
+#define BMP_VIEW_STORAGE_NONE 0
+#define BMP_VIEW_STORAGE_MAPPED 1    // mmap(), released with munmap()
+#define BMP_VIEW_STORAGE_ALLOCATED 2 // read into memory (no mmap() on Windows, or an empty file)
+#define BMP_VIEW_STORAGE_BORROWED 3  // memory of the caller (e.g. a tar stream), which must stay valid
+
+typedef struct tagBmpView {
+	const unsigned char* data;        // the whole file
+	size_t size;
+	int storage;                      // BMP_VIEW_STORAGE_*
+	BITMAPFILEHEADER fileHeader;      // copies, because the headers are not aligned in the file
+	BITMAPINFOHEADER infoHeader;
+	const RGBQUAD* colorTable;        // directly behind the info header. The number of entries is not checked.
+	const unsigned char* pixels;      // at bfOffBits. The size of the pixel data is not checked, because it depends on the format.
+	uint32_t width;
+	uint32_t height;                  // always positive
+	bool bBottomUp;                   // the first row in the file is the lowest row of the picture (most usual)
+	size_t stride;                    // bytes per row in the file, including the padding to 4 bytes
+	char error[255];
+} BmpView;
+
+// Returns false (and sets view->error) if the file cannot be read, or if it is not a bitmap file. The view must be closed anyway.
+bool bmp_view_open_file(BmpView* view, const char* szFilename);
+// The data is not copied, and must stay valid until the view is closed
+bool bmp_view_open_memory(BmpView* view, const void* data, const size_t size);
+void bmp_view_close(BmpView* view);
+
+// Number of bytes from the pointer to the end of the file
+size_t bmp_view_available(const BmpView* view, const void* p);
+
+#endif // #ifndef __inc__bmp_view
@@ -0,0 +1,138 @@
+/**
+ * Checksums for the ART file packer and unpacker
+ * XXH64 (xxHash, 64 bit variant by Yann Collet), used to compare decoded pictures between runs
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checksum.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t xxh_rotl64(const uint64_t x, const int r) {
+	return (x << r) | (x >> (64-r));
+}
+
+// Like the file formats, the checksum is defined on little endian values
+static uint64_t xxh_read64(const unsigned char* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t xxh_read32(const unsigned char* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, const uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	acc = xxh_rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, const uint64_t val) {
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+void checksum_xxh64_reset(ChecksumXxh64State* state, uint64_t seed) {
+	memset(state, 0, sizeof(*state));
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+	state->seed = seed;
+}
+
+static void xxh64_stripe(uint64_t* v, const unsigned char* p) {
+	v[0] = xxh64_round(v[0], xxh_read64(p));
+	v[1] = xxh64_round(v[1], xxh_read64(p+8));
+	v[2] = xxh64_round(v[2], xxh_read64(p+16));
+	v[3] = xxh64_round(v[3], xxh_read64(p+24));
+}
+
+void checksum_xxh64_update(ChecksumXxh64State* state, const void* data, size_t len) {
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* const end = p + len;
+	state->totalLen += len;
+
+	// Complete the stripe which was started by the previous call
+	if (state->bufLen > 0) {
+		const size_t n = (len < 32-state->bufLen) ? len : 32-state->bufLen;
+		memcpy(state->buf+state->bufLen, p, n);
+		state->bufLen += n;
+		p += n;
+		if (state->bufLen < 32) return;
+		xxh64_stripe(state->v, state->buf);
+		state->bufLen = 0;
+	}
+
+	// 4 independent lanes over 32 byte stripes
+	while (p+32 <= end) {
+		xxh64_stripe(state->v, p);
+		p += 32;
+	}
+
+	memcpy(state->buf, p, end-p);
+	state->bufLen = end-p;
+}
+
+uint64_t checksum_xxh64_digest(const ChecksumXxh64State* state) {
+	const unsigned char* p = state->buf;
+	const unsigned char* const end = p + state->bufLen;
+	uint64_t h;
+
+	if (state->totalLen >= 32) {
+		const uint64_t* v = state->v;
+		h = xxh_rotl64(v[0], 1) + xxh_rotl64(v[1], 7) + xxh_rotl64(v[2], 12) + xxh_rotl64(v[3], 18);
+		h = xxh64_merge_round(h, v[0]);
+		h = xxh64_merge_round(h, v[1]);
+		h = xxh64_merge_round(h, v[2]);
+		h = xxh64_merge_round(h, v[3]);
+	} else {
+		h = state->seed + XXH_PRIME64_5;
+	}
+
+	h += state->totalLen;
+
+	while (p+8 <= end) {
+		h ^= xxh64_round(0, xxh_read64(p));
+		h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p+4 <= end) {
+		h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+		h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	// Avalanche
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t checksum_xxh64(const void* data, size_t len, uint64_t seed) {
+	ChecksumXxh64State state;
+	checksum_xxh64_reset(&state, seed);
+	checksum_xxh64_update(&state, data, len);
+	return checksum_xxh64_digest(&state);
+}
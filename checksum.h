@@ -0,0 +1,31 @@
+/**
+ * Checksums for the ART file packer and unpacker
+ * XXH64 (xxHash, 64 bit variant by Yann Collet), used to compare decoded pictures between runs
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__checksum
+#define __inc__checksum
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// State of an XXH64 checksum which is computed piecewise, e.g. row by row
+typedef struct tagChecksumXxh64State {
+	uint64_t v[4];
+	uint64_t seed;
+	uint64_t totalLen;
+	unsigned char buf[32]; // incomplete stripe
+	size_t bufLen;
+} ChecksumXxh64State;
+
+// Checksums of several buffers can be chained by passing the checksum of the previous buffer as seed
+uint64_t checksum_xxh64(const void* data, size_t len, uint64_t seed);
+
+// Piecewise variant. The result is the same as checksum_xxh64() of all pieces concatenated.
+void checksum_xxh64_reset(ChecksumXxh64State* state, uint64_t seed);
+void checksum_xxh64_update(ChecksumXxh64State* state, const void* data, size_t len);
+uint64_t checksum_xxh64_digest(const ChecksumXxh64State* state);
+
+#endif // #ifndef __inc__checksum
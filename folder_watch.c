@@ -0,0 +1,121 @@
+/**
+ * Watches a folder for changed files (--watch of the ART file packer)
+ * Only supported on Linux (inotify). Subfolders are not watched.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "folder_watch.h"
+
+#ifdef __linux__
+
+static volatile sig_atomic_t folder_watch_stopped = 0;
+
+static void folder_watch_signal_handler(int sig) {
+	folder_watch_stopped = 1;
+}
+
+FolderWatch* new_folder_watch(const char* szFolder) {
+	FolderWatch* watch = (FolderWatch*)malloc(sizeof(FolderWatch));
+	if (!watch) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for watching %s\n", szFolder);
+		return NULL;
+	}
+	watch->fd = inotify_init();
+	if (watch->fd == -1) {
+		fprintf(stderr, "FATAL: Cannot watch %s: %s\n", szFolder, strerror(errno));
+		free(watch);
+		return NULL;
+	}
+	// Bitmaps are usually saved in place (IN_CLOSE_WRITE), or written to a temporary file and renamed (IN_MOVED_TO)
+	watch->wd = inotify_add_watch(watch->fd, szFolder, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+	if (watch->wd == -1) {
+		fprintf(stderr, "FATAL: Cannot watch %s: %s\n", szFolder, strerror(errno));
+		close(watch->fd);
+		free(watch);
+		return NULL;
+	}
+	folder_watch_stopped = 0;
+	signal(SIGINT, folder_watch_signal_handler);
+	return watch;
+}
+
+void del_folder_watch(FolderWatch* watch) {
+	if (!watch) return;
+	signal(SIGINT, SIG_DFL);
+	close(watch->fd);
+	free(watch);
+}
+
+// Reads all pending events. Returns false on error.
+static bool folder_watch_read_events(FolderWatch* watch, StringList* changed, bool* bOverflow) {
+	// Aligned like struct inotify_event, as recommended by inotify(7)
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const ssize_t len = read(watch->fd, buf, sizeof(buf));
+	if (len <= 0) return false;
+
+	const char* p = buf;
+	while (p < buf+len) {
+		const struct inotify_event* event = (const struct inotify_event*)p;
+		if (event->mask & IN_Q_OVERFLOW) {
+			*bOverflow = true;
+		} else if (event->len > 0) {
+			if (!string_list_add(changed, event->name)) *bOverflow = true;
+		}
+		p += sizeof(struct inotify_event) + event->len;
+	}
+	return true;
+}
+
+bool folder_watch_wait(FolderWatch* watch, const int quietMs, StringList* changed, bool* bOverflow) {
+	struct pollfd pfd;
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+
+	bool bChanged = false;
+	while (!folder_watch_stopped) {
+		// Without changes, there is nothing to wait for. Afterwards, every new change restarts the quiet period.
+		pfd.revents = 0;
+		const int res = poll(&pfd, 1, bChanged ? quietMs : -1);
+		if (res == -1) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "ERROR: Cannot wait for changes: %s\n", strerror(errno));
+			return false;
+		}
+		if (res == 0) return true;
+		if (!folder_watch_read_events(watch, changed, bOverflow)) {
+			fprintf(stderr, "ERROR: Cannot read the changes: %s\n", strerror(errno));
+			return false;
+		}
+		bChanged = true;
+	}
+	return false;
+}
+
+#else
+
+FolderWatch* new_folder_watch(const char* szFolder) {
+	fprintf(stderr, "FATAL: Watching %s is only supported on Linux\n", szFolder);
+	return NULL;
+}
+
+void del_folder_watch(FolderWatch* watch) {
+}
+
+bool folder_watch_wait(FolderWatch* watch, const int quietMs, StringList* changed, bool* bOverflow) {
+	return false;
+}
+
+#endif
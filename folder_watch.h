@@ -0,0 +1,31 @@
+/**
+ * Watches a folder for changed files (--watch of the ART file packer)
+ * Only supported on Linux (inotify). Subfolders are not watched.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__folder_watch
+#define __inc__folder_watch
+
+#include <stdbool.h>
+
+#include "utils.h"
+
+typedef struct tagFolderWatch {
+	int fd;                // of inotify
+	int wd;                // watch descriptor of the folder
+} FolderWatch;
+
+// Returns NULL (and prints an error) if the folder cannot be watched.
+// Ctrl+C (SIGINT) does not terminate the program anymore, but stops the watch (folder_watch_wait() returns false).
+FolderWatch* new_folder_watch(const char* szFolder);
+void del_folder_watch(FolderWatch* watch);
+
+// Waits until files of the folder were written, moved or deleted, and then until no more changes follow for quietMs
+// (e.g. while a paint program saves a bitmap in several steps). The names of the changed files are added to changed.
+// bOverflow is set if changes were lost, then any file may have changed.
+// Returns false if the watch was stopped (Ctrl+C) or fails.
+bool folder_watch_wait(FolderWatch* watch, const int quietMs, StringList* changed, bool* bOverflow);
+
+#endif // #ifndef __inc__folder_watch
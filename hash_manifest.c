@@ -0,0 +1,100 @@
+/**
+ * Hash manifest for the ART file packer and unpacker
+ * The unpacker writes it next to index.txt. It records the checksum of every extracted picture and where it came from,
+ * so that the packer can copy the stored data of unchanged pictures from the old ART file (--base) instead of compressing them again.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hash_manifest.h"
+
+void hash_manifest_write_header(FILE* fotManifest, const uint64_t artFileSize, const uint64_t directoryChecksum) {
+	fprintf(fotManifest, "art %" PRIu64 " %016" PRIx64 "\n", artFileSize, directoryChecksum);
+}
+
+void hash_manifest_write_entry(FILE* fotManifest, const uint64_t checksum, const int entryNo, const char* szFilename) {
+	fprintf(fotManifest, "%016" PRIx64 " %d %s\n", checksum, entryNo, szFilename);
+}
+
+static int hash_manifest_compare_entry(const void* a, const void* b) {
+	return strcmp(((const HashManifestEntry*)a)->szFilename, ((const HashManifestEntry*)b)->szFilename);
+}
+
+HashManifest* hash_manifest_read(FILE* fitManifest, const char* szFilename) {
+	HashManifest* manifest = (HashManifest*)calloc(1, sizeof(HashManifest));
+	if (!manifest) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", szFilename);
+		return NULL;
+	}
+
+	int capacity = 0;
+	char line[HASH_MANIFEST_FILENAME_SIZE+64];
+	int lineNo = 0;
+	bool bHeader = false;
+	while (fgets(line, sizeof(line), fitManifest)) {
+		lineNo++;
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == 0) continue;
+
+		#define INVALID_RETURN { fprintf(stderr, "ERROR: Invalid line %d in %s\n", lineNo, szFilename); del_hash_manifest(manifest); return NULL; }
+
+		if (!bHeader) {
+			unsigned long long artFileSize, directoryChecksum;
+			if (sscanf(line, "art %llu %16llx", &artFileSize, &directoryChecksum) != 2) INVALID_RETURN;
+			manifest->artFileSize = artFileSize;
+			manifest->directoryChecksum = directoryChecksum;
+			bHeader = true;
+			continue;
+		}
+
+		if (manifest->numEntries == capacity) {
+			capacity = (capacity == 0) ? 256 : capacity*2;
+			HashManifestEntry* newEntries = (HashManifestEntry*)realloc(manifest->entries, capacity*sizeof(HashManifestEntry));
+			if (!newEntries) {
+				fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", szFilename);
+				del_hash_manifest(manifest);
+				return NULL;
+			}
+			manifest->entries = newEntries;
+		}
+
+		HashManifestEntry* entry = &manifest->entries[manifest->numEntries];
+		unsigned long long checksum;
+		int entryNo;
+		int n = 0;
+		if ((sscanf(line, "%16llx %d %n", &checksum, &entryNo, &n) != 2) || (n == 0) || (entryNo < 0) ||
+		    (strlen(line+n) == 0) || (strlen(line+n) >= sizeof(entry->szFilename))) INVALID_RETURN;
+		entry->checksum = checksum;
+		entry->entryNo = entryNo;
+		strcpy(entry->szFilename, line+n);
+		manifest->numEntries++;
+	}
+	if (!bHeader) {
+		fprintf(stderr, "ERROR: %s is empty\n", szFilename);
+		del_hash_manifest(manifest);
+		return NULL;
+	}
+
+	qsort(manifest->entries, manifest->numEntries, sizeof(HashManifestEntry), hash_manifest_compare_entry);
+	return manifest;
+}
+
+void del_hash_manifest(HashManifest* manifest) {
+	if (!manifest) return;
+	free(manifest->entries);
+	free(manifest);
+}
+
+const HashManifestEntry* hash_manifest_find(const HashManifest* manifest, const char* szFilename) {
+	HashManifestEntry key;
+	if (strlen(szFilename) >= sizeof(key.szFilename)) return NULL;
+	strcpy(key.szFilename, szFilename);
+	return (const HashManifestEntry*)bsearch(&key, manifest->entries, manifest->numEntries, sizeof(HashManifestEntry), hash_manifest_compare_entry);
+}
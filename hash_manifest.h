@@ -0,0 +1,47 @@
+/**
+ * Hash manifest for the ART file packer and unpacker
+ * The unpacker writes it next to index.txt. It records the checksum of every extracted picture and where it came from,
+ * so that the packer can copy the stored data of unchanged pictures from the old ART file (--base) instead of compressing them again.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__hash_manifest
+#define __inc__hash_manifest
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HASH_MANIFEST_FILENAME "hashes.txt"
+#define HASH_MANIFEST_FILENAME_SIZE 256
+
+// Format:
+// First line "art <size of the ART file> <xxh64 of the directory in hex>", to detect if the manifest belongs to another ART file
+// One line "<xxh64 in hex> <number of the directory entry> <bitmap filename>" per picture
+// The checksum is the same as the one of --save-checksums: XXH64 of the pixels (top down), seeded with XXH64 of the attached palette.
+
+typedef struct tagHashManifestEntry {
+	char szFilename[HASH_MANIFEST_FILENAME_SIZE];
+	uint64_t checksum;
+	int entryNo;            // 0 = first picture of the directory
+} HashManifestEntry;
+
+typedef struct tagHashManifest {
+	uint64_t artFileSize;
+	uint64_t directoryChecksum;
+	int numEntries;
+	HashManifestEntry* entries; // sorted by file name
+} HashManifest;
+
+void hash_manifest_write_header(FILE* fotManifest, const uint64_t artFileSize, const uint64_t directoryChecksum);
+void hash_manifest_write_entry(FILE* fotManifest, const uint64_t checksum, const int entryNo, const char* szFilename);
+
+// szFilename is only used for messages. Returns NULL (and prints an error) if the manifest is invalid.
+HashManifest* hash_manifest_read(FILE* fitManifest, const char* szFilename);
+void del_hash_manifest(HashManifest* manifest);
+
+// Returns NULL if the bitmap is not in the manifest
+const HashManifestEntry* hash_manifest_find(const HashManifest* manifest, const char* szFilename);
+
+#endif // #ifndef __inc__hash_manifest
@@ -0,0 +1,96 @@
+/**
+ * Hash table for the ART file packer and unpacker
+ * Open addressing with linear probing over fixed size entries, which are laid out by the caller.
+ * The table keeps the hash of every slot, the caller compares the keys. Entries are never removed.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+#define HASH_TABLE_MIN_CAPACITY 16
+
+// Returns the slot of the key, or the free slot where it belongs. key = NULL finds a free slot (all keys are different while resizing).
+static size_t hash_table_find_slot(const HashTable* table, const uint64_t hash, const void* key) {
+	size_t slot = (size_t)(hash ^ (hash >> 32)) & (table->capacity-1);
+	while (table->used[slot] && (!key || (table->hashes[slot] != hash) || !table->equal(&table->entries[slot*table->entrySize], key))) {
+		slot = (slot+1) & (table->capacity-1);
+	}
+	return slot;
+}
+
+static bool hash_table_resize(HashTable* table, const size_t newCapacity) {
+	HashTable newTable = *table;
+	newTable.capacity = newCapacity;
+	newTable.entries = (unsigned char*)calloc(newCapacity, table->entrySize);
+	newTable.hashes = (uint64_t*)malloc(newCapacity*sizeof(uint64_t));
+	newTable.used = (bool*)calloc(newCapacity, sizeof(bool));
+	if (!newTable.entries || !newTable.hashes || !newTable.used) {
+		free(newTable.entries);
+		free(newTable.hashes);
+		free(newTable.used);
+		return false;
+	}
+
+	size_t i;
+	for (i=0; i<table->capacity; ++i) {
+		if (!table->used[i]) continue;
+		const size_t slot = hash_table_find_slot(&newTable, table->hashes[i], NULL);
+		memcpy(&newTable.entries[slot*table->entrySize], &table->entries[i*table->entrySize], table->entrySize);
+		newTable.hashes[slot] = table->hashes[i];
+		newTable.used[slot] = true;
+	}
+
+	free(table->entries);
+	free(table->hashes);
+	free(table->used);
+	*table = newTable;
+	return true;
+}
+
+bool hash_table_init(HashTable* table, const size_t entrySize, const size_t expectedEntries, HashTableEqualFunc equal) {
+	memset(table, 0x00, sizeof(HashTable));
+	table->entrySize = entrySize;
+	table->equal = equal;
+
+	// Keep the load factor below 50%
+	size_t capacity = HASH_TABLE_MIN_CAPACITY;
+	while (capacity < expectedEntries*2) capacity <<= 1;
+	return hash_table_resize(table, capacity);
+}
+
+void hash_table_free(HashTable* table) {
+	free(table->entries);
+	free(table->hashes);
+	free(table->used);
+	memset(table, 0x00, sizeof(HashTable));
+}
+
+void* hash_table_find(const HashTable* table, const uint64_t hash, const void* key) {
+	const size_t slot = hash_table_find_slot(table, hash, key);
+	return table->used[slot] ? &table->entries[slot*table->entrySize] : NULL;
+}
+
+void* hash_table_insert(HashTable* table, const uint64_t hash, const void* key, bool* bNew) {
+	size_t slot = hash_table_find_slot(table, hash, key);
+	*bNew = !table->used[slot];
+	if (*bNew) {
+		if ((table->numEntries+1)*2 > table->capacity) {
+			if (!hash_table_resize(table, table->capacity*2)) return NULL;
+			slot = hash_table_find_slot(table, hash, NULL);
+		}
+		table->hashes[slot] = hash;
+		table->used[slot] = true;
+		table->numEntries++;
+	}
+	return &table->entries[slot*table->entrySize];
+}
+
+void* hash_table_entry(const HashTable* table, const size_t slot) {
+	return table->used[slot] ? &table->entries[slot*table->entrySize] : NULL;
+}
@@ -0,0 +1,43 @@
+/**
+ * Hash table for the ART file packer and unpacker
+ * Open addressing with linear probing over fixed size entries, which are laid out by the caller.
+ * The table keeps the hash of every slot, the caller compares the keys. Entries are never removed.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__hash_table
+#define __inc__hash_table
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Returns true if the entry has the key. Only called for entries with the same hash.
+typedef bool (*HashTableEqualFunc)(const void* entry, const void* key);
+
+typedef struct tagHashTable {
+	size_t entrySize;
+	size_t capacity;       // number of slots, always a power of 2
+	size_t numEntries;
+	unsigned char* entries; // capacity*entrySize bytes
+	uint64_t* hashes;
+	bool* used;
+	HashTableEqualFunc equal;
+} HashTable;
+
+// The table does not need to grow until it holds expectedEntries. Returns false if there is not enough memory.
+bool hash_table_init(HashTable* table, const size_t entrySize, const size_t expectedEntries, HashTableEqualFunc equal);
+// The caller frees what its entries point to before
+void hash_table_free(HashTable* table);
+
+// Returns NULL if the key is not in the table
+void* hash_table_find(const HashTable* table, const uint64_t hash, const void* key);
+// Returns the entry of the key. If it is new (*bNew = true), it is zero filled and the caller sets its key.
+// Returns NULL if the table cannot grow (not enough memory).
+void* hash_table_insert(HashTable* table, const uint64_t hash, const void* key, bool* bNew);
+
+// Iteration over all slots 0 .. capacity-1. Returns NULL for an unused slot.
+void* hash_table_entry(const HashTable* table, const size_t slot);
+
+#endif // #ifndef __inc__hash_table
@@ -14,6 +14,7 @@
 #include <assert.h>
 
 #include "ipe16_bmpexport.h"
+#include "utils.h"
 
 #define BMP_LINE_PADDING 4
 
@@ -29,50 +30,30 @@ RGBQUAD ipe16_rgb_to_rgbquad(Ipe16ColorTableEntry cte) {
 	return ret;
 }
 
-void ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, unsigned char* imagedata, size_t imagedata_len, Ipe16ColorTable ct) {
+static size_t ipe16_bmp_padded_width(const unsigned int width) {
+	// Each line must be padded to a multiple of 4
+	return ((size_t)width + (BMP_LINE_PADDING-1)) & ~(size_t)(BMP_LINE_PADDING-1);
+}
 
-	#ifdef USE_BOTTOMUP
-	const size_t bmpDataSize = width*height;
-	unsigned char* bmpData = (unsigned char*)malloc(bmpDataSize);
-	assert(bmpData != NULL);
-	int h;
-	for (h=0; h<height; ++h) {
-		int idx_dest = (height-1)-h;
-		int idx_src  = h;
-		assert(idx_src*width >= 0);
-		assert(idx_dest*width >= 0);
-		memcpy(bmpData+idx_dest*width, imagedata+idx_src*width, width);
-	}
-	imagedata = bmpData;
-	#endif
+#define IPE16_BMP_HEADER_SIZE (sizeof(BITMAPFILEHEADER)+sizeof(BITMAPINFOHEADER)+256*sizeof(RGBQUAD))
 
-	// Each line must be padded to a multiple of 4
-	int pad = (BMP_LINE_PADDING - (width % BMP_LINE_PADDING)) % BMP_LINE_PADDING;
-	int newwidth = width+pad;
-	int newsize = newwidth * height;
-	unsigned char* padded_imagedata = (unsigned char*)malloc(newsize);
-	int i;
-	for (i=0; i<height; ++i) {
-		int offset = newwidth*i;
-		memcpy(&padded_imagedata[offset], imagedata, width);
-		memset(&padded_imagedata[offset+width], 0, pad);
-		imagedata += width;
-	}
+uint64_t ipe16_bmp_file_size(unsigned int width, unsigned int height) {
+	const uint64_t bmpSize = IPE16_BMP_HEADER_SIZE + (uint64_t)ipe16_bmp_padded_width(width) * height;
+	return (bmpSize > UINT32_MAX) ? 0 : bmpSize;
+}
 
-	// Color table in a bitmap is BGR0, while Blown Away uses RGB
-	const unsigned int NUM_COLORS = sizeof(ct.colors)/sizeof(ct.colors[0]);
-	RGBQUAD rgba_colortable[NUM_COLORS];
-	for (i=0; i<NUM_COLORS; ++i) {
-		rgba_colortable[i] = ipe16_rgb_to_rgbquad(ct.colors[i]);
-	}
+bool ipe16_write_bmp_header_to_memory(unsigned char* output, unsigned int width, unsigned int height, Ipe16ColorTable ct) {
+	const uint64_t bmpSize = ipe16_bmp_file_size(width, height);
+	if (bmpSize == 0) return false;
 
 	BITMAPFILEHEADER bfh;
 	bfh.bfType = BI_SIGNATURE;
-	bfh.bfSize = sizeof(BITMAPFILEHEADER)+sizeof(BITMAPINFOHEADER)+sizeof(rgba_colortable)+newsize;
+	bfh.bfSize = bmpSize;
 	bfh.bfReserved1 = 0;
 	bfh.bfReserved2 = 0;
-	bfh.bfOffBits = sizeof(BITMAPFILEHEADER)+sizeof(BITMAPINFOHEADER)+sizeof(rgba_colortable);
-	fwrite(&bfh, sizeof(bfh), 1, output);
+	bfh.bfOffBits = IPE16_BMP_HEADER_SIZE;
+	memcpy(output, &bfh, sizeof(bfh));
+	output += sizeof(bfh);
 
 	BITMAPINFOHEADER bih;
 	bih.biSize = sizeof(BITMAPINFOHEADER);
@@ -80,7 +61,7 @@ void ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, unsi
 	#ifdef USE_BOTTOMUP
 	bih.biHeight = height; // (positive = "bottom-up"-Bitmap)
 	#else
-	bih.biHeight = -height; // (negative = "top-down"-Bitmap)
+	bih.biHeight = -(int32_t)height; // (negative = "top-down"-Bitmap)
 	#endif
 	bih.biPlanes = 1;
 	bih.biBitCount = 8;
@@ -90,17 +71,88 @@ void ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, unsi
 	bih.biYPelsPerMeter = 0;
 	bih.biClrUsed = 0;
 	bih.biClrImportant = 0;
-	fwrite(&bih, sizeof(bih), 1, output);
+	memcpy(output, &bih, sizeof(bih));
+	output += sizeof(bih);
 
-	// Color table
-	fwrite(rgba_colortable, sizeof(rgba_colortable), 1, output);
+	// Color table in a bitmap is BGR0, while Blown Away uses RGB
+	const unsigned int NUM_COLORS = sizeof(ct.colors)/sizeof(ct.colors[0]);
+	int i;
+	for (i=0; i<NUM_COLORS; ++i) {
+		const RGBQUAD quad = ipe16_rgb_to_rgbquad(ct.colors[i]);
+		memcpy(output, &quad, sizeof(quad));
+		output += sizeof(quad);
+	}
+	return true;
+}
+
+bool ipe16_write_bmp_header(FILE* output, unsigned int width, unsigned int height, Ipe16ColorTable ct) {
+	unsigned char header[IPE16_BMP_HEADER_SIZE];
+	if (!ipe16_write_bmp_header_to_memory(header, width, height, ct)) return false;
+	return fwrite(header, sizeof(header), 1, output) == 1;
+}
+
+bool ipe16_write_bmp_to_memory(unsigned char* output, unsigned int width, unsigned int height, const unsigned char* imagedata, Ipe16ColorTable ct) {
+	if (!ipe16_write_bmp_header_to_memory(output, width, height, ct)) return false;
+	output += IPE16_BMP_HEADER_SIZE;
+
+	const size_t newwidth = ipe16_bmp_padded_width(width);
+	unsigned int i;
+	for (i=0; i<height; ++i) {
+		#ifdef USE_BOTTOMUP
+		const size_t idx_src = (height-1)-i;
+		#else
+		const size_t idx_src = i;
+		#endif
+		memcpy(output, imagedata+idx_src*width, width);
+		memset(output+width, 0, newwidth-width);
+		output += newwidth;
+	}
+	return true;
+}
+
+void ipe16_write_bmp_row_to_memory(unsigned char* output, unsigned int width, unsigned int height, unsigned int y, const unsigned char* row) {
+	const size_t newwidth = ipe16_bmp_padded_width(width);
+	#ifdef USE_BOTTOMUP
+	const size_t line = (height-1)-y;
+	#else
+	const size_t line = y;
+	#endif
+	output += IPE16_BMP_HEADER_SIZE + line*newwidth;
+	memcpy(output, row, width);
+	memset(output+width, 0, newwidth-width);
+}
 
-	// Image data
-	fwrite(padded_imagedata, newsize, 1, output);
+bool ipe16_write_bmp_row(FILE* output, unsigned int width, unsigned int height, unsigned int y, const unsigned char* row) {
+	const size_t newwidth = ipe16_bmp_padded_width(width);
+	const unsigned char padding[BMP_LINE_PADDING] = {0};
 
-	free(padded_imagedata);
 	#ifdef USE_BOTTOMUP
-	free(bmpData);
+	const uint64_t line = (height-1)-y;
+	#else
+	const uint64_t line = y;
 	#endif
+	const uint64_t offset = IPE16_BMP_HEADER_SIZE + line*newwidth;
+	if (!file_seek64(output, offset)) return false;
+	if ((width > 0) && (fwrite(row, width, 1, output) != 1)) return false;
+	if ((newwidth > width) && (fwrite(padding, newwidth-width, 1, output) != 1)) return false;
+	return true;
 }
 
+bool ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, const unsigned char* imagedata, size_t imagedata_len, Ipe16ColorTable ct) {
+	if (!ipe16_write_bmp_header(output, width, height, ct)) return false;
+
+	// The rows are written directly from the image data, so that no flipped or padded copy is needed
+	const size_t newwidth = ipe16_bmp_padded_width(width);
+	const unsigned char padding[BMP_LINE_PADDING] = {0};
+	unsigned int i;
+	for (i=0; i<height; ++i) {
+		#ifdef USE_BOTTOMUP
+		const size_t idx_src = (height-1)-i;
+		#else
+		const size_t idx_src = i;
+		#endif
+		if ((width > 0) && (fwrite(imagedata+idx_src*width, width, 1, output) != 1)) return false;
+		if ((newwidth > width) && (fwrite(padding, newwidth-width, 1, output) != 1)) return false;
+	}
+	return true;
+}
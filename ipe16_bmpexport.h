@@ -13,11 +13,25 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 #include "bitmap.h"
 #include "ipe16_artfile.h"
 
-void ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, unsigned char* imagedata, size_t imagedata_len, Ipe16ColorTable ct);
+// Returns false if the bitmap cannot be written (e.g. if it is too big for the BMP format)
+bool ipe16_write_bmp(FILE* output, unsigned int width, unsigned int height, const unsigned char* imagedata, size_t imagedata_len, Ipe16ColorTable ct);
+
+// Streaming variant for huge pictures: Writes the header and the color table first, then every row
+// (y counted from the top) at its position in the bottom-up bitmap. Memory is only needed for one row.
+bool ipe16_write_bmp_header(FILE* output, unsigned int width, unsigned int height, Ipe16ColorTable ct);
+bool ipe16_write_bmp_row(FILE* output, unsigned int width, unsigned int height, unsigned int y, const unsigned char* row);
+
+// In-memory variant (e.g. for asynchronous output): The buffer must have ipe16_bmp_file_size() bytes.
+// ipe16_bmp_file_size() returns 0 if the bitmap is too big for the BMP format.
+uint64_t ipe16_bmp_file_size(unsigned int width, unsigned int height);
+bool ipe16_write_bmp_to_memory(unsigned char* output, unsigned int width, unsigned int height, const unsigned char* imagedata, Ipe16ColorTable ct);
+bool ipe16_write_bmp_header_to_memory(unsigned char* output, unsigned int width, unsigned int height, Ipe16ColorTable ct);
+void ipe16_write_bmp_row_to_memory(unsigned char* output, unsigned int width, unsigned int height, unsigned int y, const unsigned char* row);
 
 #endif // #ifndef __inc__ipe16_bmpexport
 
@@ -16,6 +16,7 @@
 
 #include "bitmap.h"
 #include "ipe16_bmpimport.h"
+#include "palette_quantizer.h"
 
 Ipe16ColorTableEntry rgbquad_to_ipe16_rgb(RGBQUAD rq) {
 	Ipe16ColorTableEntry cte;
@@ -25,75 +26,114 @@ Ipe16ColorTableEntry rgbquad_to_ipe16_rgb(RGBQUAD rq) {
 	return cte;
 }
 
-bool ipe16_bmp_import(FILE* fibBitmap, Ipe16BmpImportData* result) {
-	BITMAPFILEHEADER bitmapFileHeader;
-	BITMAPINFOHEADER bitmapInfoHeader;
+#define EXIT_ERROR(msg) { sprintf(result->error, msg); return false; }
 
-	#define EXIT_ERROR(msg) { sprintf(result->error, msg); return false; }
+// 32 bit bitmaps are often saved with bit masks (e.g. with an alpha channel). Only the usual masks (BGRA) are understood.
+static bool ipe16_bmp_standard_masks(const BmpView* view) {
+	const unsigned char* masks = view->data + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	const DWORD standardMasks[3] = { 0x00FF0000, 0x0000FF00, 0x000000FF };
+	return (bmp_view_available(view, masks) >= sizeof(standardMasks)) && (memcmp(masks, standardMasks, sizeof(standardMasks)) == 0);
+}
+
+// The palette is made from the colors of the picture
+static bool ipe16_bmp_import_truecolor(Ipe16BmpImportData* result) {
+	const BmpView* view = &result->view;
+	const unsigned int bytesPerPixel = view->infoHeader.biBitCount / 8;
+	const uint32_t realwidth = view->width;
+	const uint32_t realheight = view->height;
+	const size_t bmpDataSize = (size_t)realwidth*realheight;
+	if ((realheight > 0) && (bmp_view_available(view, view->pixels) < view->stride*(realheight-1)+realwidth*bytesPerPixel)) {
+		EXIT_ERROR("Error while reading pixel data.");
+	}
 
-	fseek(fibBitmap, 0, SEEK_SET);
+	Ipe16ColorTable* ct = malloc(sizeof(Ipe16ColorTable));
+	assert(ct != NULL);
+	result->colorTable = ct;
+	unsigned char* bmpData = (unsigned char*)malloc(bmpDataSize > 0 ? bmpDataSize : 1);
+	assert(bmpData != NULL);
+	result->bmpData = bmpData;
+	result->bmpDataBuffer = bmpData;
 
-	if (!fread(&bitmapFileHeader, sizeof(BITMAPFILEHEADER), 1, fibBitmap) ||
-	    (bitmapFileHeader.bfType != BI_SIGNATURE) ||
-	    !fread(&bitmapInfoHeader, sizeof(BITMAPINFOHEADER), 1, fibBitmap)) {
-		EXIT_ERROR("Not a bitmap file");
+	// The rows are read in the order of the picture, so "bottom-up" is read backwards
+	const unsigned char* firstRow = (view->bBottomUp && (realheight > 0)) ? view->pixels + view->stride*(realheight-1) : view->pixels;
+	const ptrdiff_t rowStride = view->bBottomUp ? -(ptrdiff_t)view->stride : (ptrdiff_t)view->stride;
+	RGBQUAD palette[PALETTE_QUANTIZER_COLORS];
+	if (!palette_quantize(firstRow, rowStride, realwidth, realheight, bytesPerPixel, palette, bmpData)) {
+		EXIT_ERROR("Not enough memory to reduce the colors.");
+	}
+	int i;
+	for (i=0; i<PALETTE_QUANTIZER_COLORS; ++i) {
+		ct->colors[i] = rgbquad_to_ipe16_rgb(palette[i]);
 	}
 
-	if (bitmapInfoHeader.biCompression != BI_RGB) {
+	result->bmpDataSize = bmpDataSize;
+	result->width = realwidth;
+	result->height = realheight;
+	result->bTruecolor = true;
+	result->error[0] = 0;
+	return true;
+}
+
+bool ipe16_bmp_import(BmpView* view, Ipe16BmpImportData* result) {
+	result->view = *view;
+	memset(view, 0x00, sizeof(*view));
+	view = &result->view;
+	const BITMAPINFOHEADER* bitmapInfoHeader = &view->infoHeader;
+
+	const bool bStandardBitfields = (bitmapInfoHeader->biCompression == BI_BITFIELDS) && (bitmapInfoHeader->biBitCount == 32) && ipe16_bmp_standard_masks(view);
+	if ((bitmapInfoHeader->biCompression != BI_RGB) && !bStandardBitfields) {
 		EXIT_ERROR("At the moment, only uncompressed files can be read.");
 	}
 
-	if (bitmapInfoHeader.biBitCount != 8) {
-		EXIT_ERROR("The color depth has to be 8 bpp.");
+	if ((bitmapInfoHeader->biBitCount != 8) && (bitmapInfoHeader->biBitCount != 24) && (bitmapInfoHeader->biBitCount != 32)) {
+		EXIT_ERROR("The color depth has to be 8, 24 or 32 bpp.");
 	}
 
-	Ipe16ColorTable* ct = malloc(sizeof(Ipe16ColorTable));
+	// The picture header of the ART file has 16 bit dimensions
+	if ((view->width > 0xFFFF) || (view->height > 0xFFFF)) {
+		EXIT_ERROR("The picture may not be bigger than 65535x65535 pixels.");
+	}
+
+	if (bitmapInfoHeader->biBitCount != 8) return ipe16_bmp_import_truecolor(result);
+
 	#define NUM_COLORS 256
-	RGBQUAD rgba_colortable[NUM_COLORS];
-	if (!fread(&rgba_colortable, sizeof(rgba_colortable), 1, fibBitmap)) {
+	if (bmp_view_available(view, view->colorTable) < NUM_COLORS*sizeof(RGBQUAD)) {
 		EXIT_ERROR("Error reading color table.");
 	}
+	Ipe16ColorTable* ct = malloc(sizeof(Ipe16ColorTable));
+	assert(ct != NULL);
 	int i;
 	for (i=0; i<NUM_COLORS; ++i) {
-		Ipe16ColorTableEntry x;
-		x = rgbquad_to_ipe16_rgb(rgba_colortable[i]);
-		ct->colors[i] = x;
+		ct->colors[i] = rgbquad_to_ipe16_rgb(view->colorTable[i]);
 	}
+	result->colorTable = ct;
 
-	fseek(fibBitmap, bitmapFileHeader.bfOffBits, SEEK_SET);
+	const uint32_t realwidth = view->width;
+	const uint32_t realheight = view->height;
+	const size_t bmpDataSize = (size_t)realwidth*realheight;
+	if ((realheight > 0) && (bmp_view_available(view, view->pixels) < view->stride*(realheight-1)+realwidth)) {
+		EXIT_ERROR("Error while reading pixel data.");
+	}
 
-	const uint32_t realwidth = bitmapInfoHeader.biWidth;
-	const uint32_t realheight = abs(bitmapInfoHeader.biHeight);
-	const size_t bmpDataSize = realwidth*realheight;
-	unsigned char* bmpData = (unsigned char*)malloc(bmpDataSize);
-	assert(bmpData != NULL);
-	const int padded_width = (bitmapInfoHeader.biWidth + 3) & ~0x03; // http://stackoverflow.com/a/2022194/3544341
-	unsigned char* bmpLine = (unsigned char*)malloc(padded_width);
-	assert(bmpLine != NULL);
-	int h;
-	for (h=0; h<realheight; ++h) {
-		if (fread(bmpLine, padded_width, 1, fibBitmap) != 1) {
-			free(bmpLine);
-			free(bmpData);
-			free(ct);
-			EXIT_ERROR("Error while reading pixel data.");
-		}
-		int idx;
-		if (bitmapInfoHeader.biHeight > 0) {
-			// "bottom-up" (most usual)
-			// Convert to "top-down":
-			idx = (realheight-1)-h;
-		} else {
-			// "top-down"
-			idx = h;
+	if (!view->bBottomUp && (view->stride == realwidth)) {
+		// "top-down" without padding: the rows are already in the right order
+		result->bmpData = view->pixels;
+	} else {
+		// One pass over the rows, which drops the padding, and converts "bottom-up" (most usual) to "top-down".
+		// memcpy() moves every row with vector instructions.
+		unsigned char* bmpData = (unsigned char*)malloc(bmpDataSize > 0 ? bmpDataSize : 1);
+		assert(bmpData != NULL);
+		const unsigned char* bmpLine = view->pixels;
+		uint32_t h;
+		for (h=0; h<realheight; ++h) {
+			const size_t idx = view->bBottomUp ? (realheight-1)-h : h;
+			memcpy(bmpData+idx*realwidth, bmpLine, realwidth);
+			bmpLine += view->stride;
 		}
-		assert(idx*realwidth >= 0);
-		memcpy(bmpData+idx*realwidth, bmpLine, realwidth);
+		result->bmpData = bmpData;
+		result->bmpDataBuffer = bmpData;
 	}
-	free(bmpLine);
 
-	result->colorTable = ct;
-	result->bmpData = bmpData;
 	result->bmpDataSize = bmpDataSize;
 	result->width = realwidth;
 	result->height = realheight;
@@ -103,6 +143,98 @@ bool ipe16_bmp_import(FILE* fibBitmap, Ipe16BmpImportData* result) {
 
 void ipe16_free_bmpimport_result(Ipe16BmpImportData *res) {
 	if (res->colorTable) free(res->colorTable);
-	if (res->bmpData) free(res->bmpData);
+	if (res->bmpDataBuffer) free(res->bmpDataBuffer);
+	bmp_view_close(&res->view);
+}
+
+
+// Number of transparent pixels at the start of p (at most len). 8 pixels are compared at once.
+static size_t ipe16_transparent_prefix(const unsigned char* p, const size_t len, const uint64_t pattern, const unsigned char transparentIndex) {
+	size_t i = 0;
+	uint64_t word;
+	while (i+sizeof(word) <= len) {
+		memcpy(&word, p+i, sizeof(word));
+		if (word != pattern) break;
+		i += sizeof(word);
+	}
+	while ((i < len) && (p[i] == transparentIndex)) i++;
+	return i;
+}
+
+// Number of transparent pixels at the end of p (at most len)
+static size_t ipe16_transparent_suffix(const unsigned char* p, const size_t len, const uint64_t pattern, const unsigned char transparentIndex) {
+	size_t i = 0;
+	uint64_t word;
+	while (i+sizeof(word) <= len) {
+		memcpy(&word, p+len-i-sizeof(word), sizeof(word));
+		if (word != pattern) break;
+		i += sizeof(word);
+	}
+	while ((i < len) && (p[len-i-1] == transparentIndex)) i++;
+	return i;
+}
+
+void ipe16_bmp_opaque_box(const Ipe16BmpImportData* data, const unsigned char transparentIndex, unsigned int* left, unsigned int* top, unsigned int* width, unsigned int* height) {
+	const uint64_t pattern = transparentIndex * UINT64_C(0x0101010101010101);
+	const unsigned int w = data->width;
+	const unsigned int h = data->height;
+	#define ROW(y) (data->bmpData+(size_t)(y)*w)
+
+	// The transparent rows at the top and at the bottom
+	unsigned int y0 = 0;
+	while ((y0 < h) && (ipe16_transparent_prefix(ROW(y0), w, pattern, transparentIndex) == w)) y0++;
+	if (y0 == h) {
+		*left = 0;
+		*top = 0;
+		*width = (w > 0) ? 1 : 0;
+		*height = (h > 0) ? 1 : 0;
+		return;
+	}
+	unsigned int y1 = h;
+	while (ipe16_transparent_prefix(ROW(y1-1), w, pattern, transparentIndex) == w) y1--;
+
+	// The columns: every row only has to be scanned up to the edges which the rows above already found
+	unsigned int x0 = w;
+	unsigned int x1 = 0;
+	unsigned int y;
+	for (y=y0; y<y1; ++y) {
+		const unsigned char* row = ROW(y);
+		const unsigned int rowLeft = ipe16_transparent_prefix(row, x0, pattern, transparentIndex);
+		if (rowLeft < x0) x0 = rowLeft;
+		const unsigned int rowRight = w - ipe16_transparent_suffix(row+x1, w-x1, pattern, transparentIndex);
+		if (rowRight > x1) x1 = rowRight;
+	}
+	#undef ROW
+
+	*left = x0;
+	*top = y0;
+	*width = x1-x0;
+	*height = y1-y0;
 }
 
+void ipe16_bmp_crop(Ipe16BmpImportData* data, const unsigned int left, const unsigned int top, const unsigned int width, const unsigned int height) {
+	assert((left+width <= data->width) && (top+height <= data->height));
+	const unsigned char* src = data->bmpData + (size_t)top*data->width + left;
+
+	if (width == data->width) {
+		// Only rows are removed, the remaining rows stay where they are
+		data->bmpData = src;
+	} else {
+		// The rows move to the front. In the own buffer, this can be done in place, because they only move backwards.
+		unsigned char* dst = data->bmpDataBuffer;
+		if (!dst) {
+			dst = (unsigned char*)malloc((size_t)width*height > 0 ? (size_t)width*height : 1);
+			assert(dst != NULL);
+			data->bmpDataBuffer = dst;
+		}
+		unsigned int y;
+		for (y=0; y<height; ++y) {
+			memmove(dst+(size_t)y*width, src+(size_t)y*data->width, width);
+		}
+		data->bmpData = dst;
+	}
+
+	data->width = width;
+	data->height = height;
+	data->bmpDataSize = (size_t)width*height;
+}
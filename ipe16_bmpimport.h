@@ -16,19 +16,31 @@
 #include <stdlib.h>
 
 #include "bitmap.h"
+#include "bmp_view.h"
 #include "ipe16_artfile.h"
 
 typedef struct tagIpe16BmpImportData {
+	BmpView view;                 // the bitmap file, which bmpData may point into
 	Ipe16ColorTable* colorTable;
-	unsigned char* bmpData;
+	const unsigned char* bmpData; // top-down rows without padding
+	unsigned char* bmpDataBuffer; // NULL if the rows of the file could be used as they are
 	size_t bmpDataSize;
 	unsigned int width;
 	unsigned int height;
+	bool bTruecolor;              // 24 or 32 bpp: the colors were reduced to the palette by palette_quantize()
 	char error[255];
 } Ipe16BmpImportData;
 
-bool ipe16_bmp_import(FILE* fibBitmap, Ipe16BmpImportData* result);
+// result must be zeroed. The view is taken over (also on failure), and closed by ipe16_free_bmpimport_result().
+// 24 and 32 bit bitmaps are reduced to 256 colors, so they can only be stored with an attached palette.
+bool ipe16_bmp_import(BmpView* view, Ipe16BmpImportData* result);
 void ipe16_free_bmpimport_result(Ipe16BmpImportData *res);
 
+// Bounding box of the pixels which are not transparent (transparentIndex), for cropping the transparent border (--crop).
+// If all pixels are transparent, the box is the first pixel, because a picture cannot be empty.
+void ipe16_bmp_opaque_box(const Ipe16BmpImportData* data, const unsigned char transparentIndex, unsigned int* left, unsigned int* top, unsigned int* width, unsigned int* height);
+// Reduces the picture to the box. The rows are only copied if the width changes.
+void ipe16_bmp_crop(Ipe16BmpImportData* data, const unsigned int left, const unsigned int top, const unsigned int width, const unsigned int height);
+
 #endif // #ifndef __inc__ipe16_bmpimport
 
@@ -41,7 +41,17 @@ void ipe16lzw_init_decoder(Ipe16LZWDecoder* decoder) {
 	}
 }
 
-int ipe16lzw_read_code(FILE* inFile, Ipe16LZWDecoder* decoder) {
+static unsigned char ipe16lzw_read_byte(Ipe16LZWDecoder* decoder) {
+	if (decoder->input_pos >= decoder->input_length) {
+		// Like read_byte() at EOF: Reading beyond the compressed data gives zeros
+		if (!decoder->refill || !decoder->refill(decoder->refillArg, &decoder->input, &decoder->input_length)) return 0;
+		decoder->input_pos = 0;
+		if (decoder->input_length == 0) return 0;
+	}
+	return decoder->input[decoder->input_pos++];
+}
+
+int ipe16lzw_read_code(Ipe16LZWDecoder* decoder) {
 	int code;
 	unsigned char next_byte;
 	static int code_masks[] = {
@@ -52,7 +62,7 @@ int ipe16lzw_read_code(FILE* inFile, Ipe16LZWDecoder* decoder) {
 	};
 
 	while (decoder->shift_state < decoder->running_bits) {
-		next_byte = read_byte(inFile);
+		next_byte = ipe16lzw_read_byte(decoder);
 		decoder->shift_data |=
 		  ((unsigned long) next_byte) << decoder->shift_state;
 		decoder->shift_state += 8;
@@ -81,37 +91,48 @@ static int ipe16lzw_trace_prefix(unsigned int* prefix, int code, int clear_code)
 	return code;
 }
 
-// We don't do unsigned, because we want to have <0 as error result
-/*unsigned*/ int ipe16lzw_decode(FILE* inFile, Ipe16LZWDecoder* decoder, unsigned char* output, int outputLength) {
-	int i = 0, j;
+void ipe16lzw_decode_begin(Ipe16LZWDecoder* decoder, const unsigned char* input, size_t inputLength, size_t outputLength) {
+	ipe16lzw_init_decoder(decoder);
+	decoder->input            = input;
+	decoder->input_length     = inputLength;
+	decoder->input_pos        = 0;
+	decoder->stack_ptr        = 0;
+	decoder->prev_code        = NO_SUCH_CODE;
+	decoder->output_remaining = outputLength;
+	decoder->refill           = NULL;
+	decoder->refillArg        = NULL;
+}
+
+int64_t ipe16lzw_decode_next(Ipe16LZWDecoder* decoder, unsigned char* output, size_t outputLength) {
+	size_t i = 0;
+	int j;
 	int current_code;
 	int current_prefix;
-	int stack_ptr = 0;
-	int prev_code = NO_SUCH_CODE;
+	int stack_ptr = decoder->stack_ptr;
+	int prev_code = decoder->prev_code;
 	unsigned char* stack;
 	unsigned int* prefix;
 	unsigned int* suffix;
-	unsigned int bytes_written = 0;
-
-	ipe16lzw_init_decoder(decoder);
+	int64_t bytes_written = 0;
 
 	prefix		= decoder->prefix;
 	suffix		= decoder->suffix;
 	stack		= decoder->stack;
 
-	/* Pop the stack */
+	#define IPE16LZW_ERROR(x) { decoder->stack_ptr = 0; return (x); }
+
+	/* Pop the stack (which is left over from the previous call) */
 	while (stack_ptr != 0 && i < outputLength) {
 		output[i++] = stack[--stack_ptr];
-		//if (i > bytes_written) bytes_written = i;
 		++bytes_written;
 	}
 
 	while (i < outputLength) {
-		current_code = ipe16lzw_read_code(inFile, decoder);
+		current_code = ipe16lzw_read_code(decoder);
 
 		if (current_code == END_CODE) {
-			if (i != outputLength - 1) //  || decoder->pixel_count != 0
-				return -1; /* unexpected eof */
+			if (decoder->output_remaining - i != 1) //  || decoder->pixel_count != 0
+				IPE16LZW_ERROR(-1); /* unexpected eof */
 			i++;
 		} else if (current_code == CLEAR_CODE) {
 			for (j = 0; j <= LZ_MAX_CODE; j++) {
@@ -124,11 +145,10 @@ static int ipe16lzw_trace_prefix(unsigned int* prefix, int code, int clear_code)
 		} else {
 			if (current_code < CLEAR_CODE) {
 				output[i++] = current_code;
-				//if (i > bytes_written) bytes_written = i;
 				++bytes_written;
 			} else {
 				if ((current_code < 0) || (current_code > LZ_MAX_CODE))
-					return -2; /* image defect */
+					IPE16LZW_ERROR(-2); /* image defect */
 				if (prefix[current_code] == NO_SUCH_CODE) {
 					if (current_code == decoder->running_code - 2) {
 						current_prefix = prev_code;
@@ -136,7 +156,7 @@ static int ipe16lzw_trace_prefix(unsigned int* prefix, int code, int clear_code)
 							= stack[stack_ptr++]
 							= ipe16lzw_trace_prefix(prefix, prev_code, CLEAR_CODE);
 					} else {
-						return -3; /* image defect */
+						IPE16LZW_ERROR(-3); /* image defect */
 					}
 				} else {
 					current_prefix = current_code;
@@ -147,20 +167,19 @@ static int ipe16lzw_trace_prefix(unsigned int* prefix, int code, int clear_code)
 					current_prefix = prefix[current_prefix];
 				}
 				if (j >= LZ_MAX_CODE || current_prefix > LZ_MAX_CODE)
-					return -4; /* image defect */
+					IPE16LZW_ERROR(-4); /* image defect */
 
 				stack[stack_ptr++] = current_prefix;
 
 				while (stack_ptr != 0 && i < outputLength) {
 					output[i++] = stack[--stack_ptr];
-					//if (i > bytes_written) bytes_written = i;
 					++bytes_written;
 				}
 			}
 			if (prev_code != NO_SUCH_CODE) {
 				if ((decoder->running_code < 2) ||
 				   (decoder->running_code > LZ_MAX_CODE+2))
-					return -5; /* image defect */
+					IPE16LZW_ERROR(-5); /* image defect */
 				prefix[decoder->running_code - 2] = prev_code;
 
 				if (current_code == decoder->running_code - 2) {
@@ -175,5 +194,14 @@ static int ipe16lzw_trace_prefix(unsigned int* prefix, int code, int clear_code)
 		}
 	}
 
+	decoder->stack_ptr = stack_ptr;
+	decoder->prev_code = prev_code;
+	decoder->output_remaining -= i;
 	return bytes_written;
 }
+
+// We don't do unsigned, because we want to have <0 as error result
+int64_t ipe16lzw_decode(Ipe16LZWDecoder* decoder, unsigned char* output, size_t outputLength, const unsigned char* input, size_t inputLength) {
+	ipe16lzw_decode_begin(decoder, input, inputLength, outputLength);
+	return ipe16lzw_decode_next(decoder, output, outputLength);
+}
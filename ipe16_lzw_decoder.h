@@ -17,7 +17,9 @@
 #define __inc__ipe16_lzw_decoder
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define LZ_MIN_BITS     9
 #define LZ_MAX_BITS     12
@@ -35,14 +37,31 @@ typedef struct tagIpe16LZWDecoder {
 	int max_code_plus_one;
     int shift_state;
     unsigned long shift_data;
+    const unsigned char* input;
+    size_t input_length;
+    size_t input_pos;
     unsigned char stack[LZ_MAX_CODE+1];
     unsigned int  suffix[LZ_MAX_CODE+1];
     unsigned int  prefix[LZ_MAX_CODE+1];
+    // State between the calls of ipe16lzw_decode_next()
+    int stack_ptr;
+    int prev_code;
+    size_t output_remaining; // bytes of the whole picture which were not decoded yet
+    // Optional: Called when the input is exhausted, to get the next piece of the compressed data. Returns false at the end of the data.
+    bool (*refill)(void* refillArg, const unsigned char** input, size_t* inputLength);
+    void* refillArg;
   } Ipe16LZWDecoder;
 
 Ipe16LZWDecoder* new_ipe16lzw_decoder(void);
 void del_ipe16lzw_decoder(Ipe16LZWDecoder* decoder);
-/*unsigned*/ int ipe16lzw_decode(FILE* outFile, Ipe16LZWDecoder *decoder, unsigned char *input, int inputLength);
+// Returns: Bytes written, or <0 when an error occurs
+int64_t ipe16lzw_decode(Ipe16LZWDecoder *decoder, unsigned char *output, size_t outputLength, const unsigned char *input, size_t inputLength);
+
+// Streaming variant, e.g. to decode a huge picture row by row: ipe16lzw_decode_begin() takes the size of the whole
+// picture, then every call of ipe16lzw_decode_next() continues where the previous one stopped.
+// The refill callback (if set after ipe16lzw_decode_begin()) can provide the compressed data piecewise.
+void ipe16lzw_decode_begin(Ipe16LZWDecoder *decoder, const unsigned char *input, size_t inputLength, size_t outputLength);
+int64_t ipe16lzw_decode_next(Ipe16LZWDecoder *decoder, unsigned char *output, size_t outputLength);
 
 #endif // #ifndef __inc__ipe16_lzw_decoder
 
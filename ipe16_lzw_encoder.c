@@ -28,11 +28,19 @@ void del_ipe16lzw_encoder(Ipe16LZWEncoder* encoder) {
 	free(encoder);
 }
 
-void ipe16lzw_write_code(FILE* outFile, Ipe16LZWEncoder* encoder, int code) {
-	if (code == FLUSH_OUTPUT) {
+// output is NULL if the size is only counted
+void ipe16lzw_write_code(ArtWriter* output, Ipe16LZWEncoder* encoder, int code) {
+	if (!output) {
+		if (code == FLUSH_OUTPUT) {
+			/* the last byte is filled up */
+			encoder->bit_count = (encoder->bit_count + 7) & ~(uint64_t)7;
+		} else {
+			encoder->bit_count += encoder->running_bits;
+		}
+	} else if (code == FLUSH_OUTPUT) {
 		/* write all remaining data */
 		while (encoder->shift_state > 0) {
-			fputc(encoder->shift_data & 0xff, outFile);
+			art_writer_put_byte(output, encoder->shift_data & 0xff);
 			encoder->shift_data >>= 8;
 			encoder->shift_state -= 8;
 		}
@@ -43,7 +51,7 @@ void ipe16lzw_write_code(FILE* outFile, Ipe16LZWEncoder* encoder, int code) {
 
 		while (encoder->shift_state >= 8) {
 			/* write full bytes */
-			fputc(encoder->shift_data & 0xff, outFile);
+			art_writer_put_byte(output, encoder->shift_data & 0xff);
 			encoder->shift_data >>= 8;
 			encoder->shift_state -= 8;
 		}
@@ -67,6 +75,7 @@ void ipe16lzw_init_encoder(Ipe16LZWEncoder* encoder) {
 	encoder->max_code_plus_one = 1 << encoder->running_bits;
 	encoder->shift_state  = 0;
 	encoder->shift_data   = 0;
+	encoder->bit_count    = 0;
 }
 
 static int ipe16lzw_hash_key(unsigned long key) {
@@ -96,7 +105,7 @@ static void ipe16lzw_add_hash_entry(unsigned long* hash_table, unsigned long key
 	hash_table[hkey] = HT_PUT_KEY(key) | HT_PUT_CODE(code);
 }
 
-void ipe16lzw_encode(FILE* outFile, Ipe16LZWEncoder* encoder, unsigned char* input, int inputLength) {
+void ipe16lzw_encode(ArtWriter* output, Ipe16LZWEncoder* encoder, const unsigned char* input, int inputLength) {
 	int i = 0, current_code, new_code;
 	unsigned long new_key;
 	unsigned char pixval;
@@ -104,7 +113,7 @@ void ipe16lzw_encode(FILE* outFile, Ipe16LZWEncoder* encoder, unsigned char* inp
 	/* Init stuff */
 	ipe16lzw_init_encoder(encoder);
 	ipe16lzw_clear_hash_table(encoder->hash_table);
-	ipe16lzw_write_code(outFile, encoder, CLEAR_CODE);	
+	ipe16lzw_write_code(output, encoder, CLEAR_CODE);	
 
 	if (inputLength == 0) return;
 	current_code = input[i++];
@@ -116,11 +125,11 @@ void ipe16lzw_encode(FILE* outFile, Ipe16LZWEncoder* encoder, unsigned char* inp
 		if ((new_code = ipe16lzw_lookup_hash(encoder->hash_table, new_key)) >= 0) {
 			current_code = new_code;
 		} else {
-			ipe16lzw_write_code(outFile, encoder, current_code);
+			ipe16lzw_write_code(output, encoder, current_code);
 			current_code = pixval;
 
 			if (encoder->running_code >= LZ_MAX_CODE) {
-				ipe16lzw_write_code(outFile, encoder, CLEAR_CODE);
+				ipe16lzw_write_code(output, encoder, CLEAR_CODE);
 				encoder->running_code = FIRST_CODE;
 				encoder->running_bits = LZ_MIN_BITS;
 				encoder->max_code_plus_one = 1 << encoder->running_bits;
@@ -133,8 +142,13 @@ void ipe16lzw_encode(FILE* outFile, Ipe16LZWEncoder* encoder, unsigned char* inp
 	}
 
 	/* Flush */
-	ipe16lzw_write_code(outFile, encoder, current_code);
-	ipe16lzw_write_code(outFile, encoder, END_CODE);
-	ipe16lzw_write_code(outFile, encoder, FLUSH_OUTPUT);
+	ipe16lzw_write_code(output, encoder, current_code);
+	ipe16lzw_write_code(output, encoder, END_CODE);
+	ipe16lzw_write_code(output, encoder, FLUSH_OUTPUT);
 }
 
+uint64_t ipe16lzw_encoded_size(Ipe16LZWEncoder* encoder, const unsigned char* input, int inputLength) {
+	ipe16lzw_encode(NULL, encoder, input, inputLength);
+	/* Without a flush (empty input), the incomplete last byte would not be written either */
+	return encoder->bit_count / 8;
+}
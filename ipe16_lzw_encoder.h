@@ -18,6 +18,9 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "art_writer.h"
 
 #define LZ_MIN_BITS     9
 
@@ -43,11 +46,14 @@ typedef struct tagIpe16LZWEncoder {
 	int shift_state;
     unsigned long shift_data;
     unsigned long hash_table[HT_SIZE];
+    uint64_t bit_count;              /* Size only: bits which would have been written */
   } Ipe16LZWEncoder;
 
 Ipe16LZWEncoder* new_ipe16lzw_encoder(void);
 void del_ipe16lzw_encoder(Ipe16LZWEncoder* encoder);
-void ipe16lzw_encode(FILE* outFile, Ipe16LZWEncoder* encoder, unsigned char* input, int inputLength);
+void ipe16lzw_encode(ArtWriter* output, Ipe16LZWEncoder* encoder, const unsigned char* input, int inputLength);
+// Returns the number of bytes which ipe16lzw_encode() would write. The codes are only counted, not packed into bytes.
+uint64_t ipe16lzw_encoded_size(Ipe16LZWEncoder* encoder, const unsigned char* input, int inputLength);
 
 #endif // #ifndef __inc__ipe16_lzw_encoder
 
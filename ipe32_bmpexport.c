@@ -15,7 +15,7 @@
 #include "bitmap.h"
 #include "ipe32_bmpexport.h"
 
-void ipe32_write_bmp(FILE* output, unsigned char* imagedata, size_t imagedata_len) {
+void ipe32_fill_bmp_header(unsigned char* output, size_t imagedata_len) {
 	BITMAPFILEHEADER bh={0};
 	bh.bfType = BI_SIGNATURE;
 	bh.bfSize = sizeof(bh) + imagedata_len;
@@ -23,7 +23,14 @@ void ipe32_write_bmp(FILE* output, unsigned char* imagedata, size_t imagedata_le
 	bh.bfReserved2 = 0;
 	bh.bfOffBits = 0x436;
 
-	fwrite(&bh, 1, sizeof(bh), output);
-	fwrite(imagedata, 1, imagedata_len, output);
+	memcpy(output, &bh, sizeof(bh));
+}
+
+bool ipe32_write_bmp(FILE* output, unsigned char* imagedata, size_t imagedata_len) {
+	unsigned char bh[IPE32_BMP_FILE_HEADER_SIZE];
+	ipe32_fill_bmp_header(bh, imagedata_len);
+
+	if (fwrite(bh, 1, sizeof(bh), output) != sizeof(bh)) return false;
+	return fwrite(imagedata, 1, imagedata_len, output) == imagedata_len;
 }
 
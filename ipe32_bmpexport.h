@@ -13,8 +13,14 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
-void ipe32_write_bmp(FILE* output, unsigned char* imagedata, size_t imagedata_len);
+// Returns false if the bitmap cannot be written (e.g. the disk is full)
+bool ipe32_write_bmp(FILE* output, unsigned char* imagedata, size_t imagedata_len);
+
+// In-memory variant: Fills the file header (IPE32_BMP_FILE_HEADER_SIZE bytes) in front of the image data
+#define IPE32_BMP_FILE_HEADER_SIZE 14
+void ipe32_fill_bmp_header(unsigned char* output, size_t imagedata_len);
 
 #endif // #ifndef __inc__ipe32_bmpexport
 
@@ -17,8 +17,6 @@
 #include "utils.h"
 #include "ipe32_bmpimport.h"
 
-#define BI_BITFIELDS 3
-
 bool bmp_has_gap1(BITMAPFILEHEADER bitmapFileHeader, BITMAPINFOHEADER bitmapInfoHeader) {
 	int expected = 0;
 	expected = sizeof(bitmapFileHeader) + bitmapInfoHeader.biSize;
@@ -42,21 +40,14 @@ bool bmp_has_gap1(BITMAPFILEHEADER bitmapFileHeader, BITMAPINFOHEADER bitmapInfo
 	return bitmapFileHeader.bfOffBits != expected;
 }
 
-bool ipe32_bmp_import(FILE* fibBitmap, Ipe32BmpImportData* result) {
-	BITMAPFILEHEADER bitmapFileHeader;
-	BITMAPINFOHEADER bitmapInfoHeader;
+bool ipe32_bmp_import(BmpView* view, Ipe32BmpImportData* result) {
+	result->view = *view;
+	memset(view, 0x00, sizeof(*view));
+	view = &result->view;
 
 	#define EXIT_ERROR(msg) { sprintf(result->error, msg); return false; }
 
-	fseek(fibBitmap, 0, SEEK_SET);
-
-	if (!fread(&bitmapFileHeader, sizeof(BITMAPFILEHEADER), 1, fibBitmap) ||
-	    (bitmapFileHeader.bfType != BI_SIGNATURE) ||
-	    !fread(&bitmapInfoHeader, sizeof(BITMAPINFOHEADER), 1, fibBitmap)) {
-		EXIT_ERROR("Not a bitmap file");
-	}
-
-	if (bmp_has_gap1(bitmapFileHeader, bitmapInfoHeader)) {
+	if (bmp_has_gap1(view->fileHeader, view->infoHeader)) {
 		EXIT_ERROR("Picture may not have a gap between header and bitmap data");
 	}
 
@@ -71,13 +62,18 @@ bool ipe32_bmp_import(FILE* fibBitmap, Ipe32BmpImportData* result) {
 	}
 	*/
 
-	fseek(fibBitmap, sizeof(bitmapFileHeader), SEEK_SET);
+	// The uncompressed size in the ART file has 32 bits
+	const uint64_t dataSize = view->size-sizeof(BITMAPFILEHEADER);
+	if (dataSize > UINT32_MAX) {
+		EXIT_ERROR("The picture may not be bigger than 4 GiB.");
+	}
 
 	result->error[0] = 0;
-	result->dataSize = file_size(fibBitmap)-sizeof(bitmapFileHeader);
+	result->data = view->data+sizeof(BITMAPFILEHEADER);
+	result->dataSize = dataSize;
 	return true;
 }
 
 void ipe32_free_bmpimport_result(Ipe32BmpImportData *res) {
+	bmp_view_close(&res->view);
 }
-
@@ -15,12 +15,17 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "bmp_view.h"
+
 typedef struct tagIpe32BmpImportData {
+	BmpView view;
+	const unsigned char* data;    // everything behind the bitmap file header, as it is stored in the ART file (points into the view)
 	size_t dataSize;
 	char error[255];
 } Ipe32BmpImportData;
 
-bool ipe32_bmp_import(FILE* fibBitmap, Ipe32BmpImportData* result);
+// result must be zeroed. The view is taken over (also on failure), and closed by ipe32_free_bmpimport_result().
+bool ipe32_bmp_import(BmpView* view, Ipe32BmpImportData* result);
 void ipe32_free_bmpimport_result(Ipe32BmpImportData *res);
 
 #endif // #ifndef __inc__ipe32_bmpimport
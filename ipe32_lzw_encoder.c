@@ -65,7 +65,15 @@ unsigned int find_match(Ipe32LZWEncoder *encoder, int hash_prefix, unsigned int
 	}
 }
 
+// outBuf is NULL if the size is only counted
 void output_code(Ipe32LZWEncoder *encoder, unsigned int code, unsigned char* outBuf, size_t* compressedPos) {
+	if (!outBuf) {
+		encoder->output_bit_count += encoder->num_bits;
+		(*compressedPos) += encoder->output_bit_count >> 3;
+		encoder->bytes_out += encoder->output_bit_count >> 3;
+		encoder->output_bit_count &= 7;
+		return;
+	}
 	encoder->output_bit_buffer |= (uint32_t) code << (32 - encoder->num_bits - encoder->output_bit_count);
 	encoder->output_bit_count += encoder->num_bits;
 	while (encoder->output_bit_count >= 8) {
@@ -97,7 +105,7 @@ void ipe32lzw_reset_encoder(Ipe32LZWEncoder *encoder) {
 }
 
 // Returns: Bytes written, or -1 if compression failed
-int ipe32lzw_encode(Ipe32LZWEncoder *encoder, unsigned char* compressedData, const size_t compressedBufLen, unsigned char* uncompressedData, const size_t uncompressedSize) {
+int ipe32lzw_encode(Ipe32LZWEncoder *encoder, unsigned char* compressedData, const size_t compressedBufLen, const unsigned char* uncompressedData, const size_t uncompressedSize) {
 	unsigned int next_code=FIRST_CODE;
 	unsigned int index;
 	int i,                 /* All purpose integer */
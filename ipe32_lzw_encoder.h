@@ -30,7 +30,8 @@ typedef struct tagIpe32LZWEncoder {
 } Ipe32LZWEncoder;
 
 // Returns: Bytes written, or -1 if compression failed
-int ipe32lzw_encode(Ipe32LZWEncoder *encoder, unsigned char* compressedData, const size_t compressedBufLen, unsigned char* uncompressedData, const size_t uncompressedSize);
+// If compressedData is NULL, nothing is written, and only the size is computed (compressedBufLen is still the limit)
+int ipe32lzw_encode(Ipe32LZWEncoder *encoder, unsigned char* compressedData, const size_t compressedBufLen, const unsigned char* uncompressedData, const size_t uncompressedSize);
 
 Ipe32LZWEncoder* new_ipe32lzw_encoder(void);
 void ipe32lzw_init_encoder(Ipe32LZWEncoder *encoder);
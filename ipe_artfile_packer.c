@@ -14,17 +14,30 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 #include <math.h>
 #include <getopt.h>
 
 #include "ipe_artfile_packer_ipe16_ba.h"
 #include "ipe_artfile_packer_ipe16_pip.h"
+#include "ipe_artfile_packer_ipe16_common.h"
 #include "ipe_artfile_packer_ipe32.h"
 
+#include "utils.h"
+#include "name_counter.h"
+#include "thread_pool.h"
+#include "tar_stream.h"
+#include "art_writer.h"
+#include "pack_cache.h"
+#include "folder_watch.h"
+
 #define VERSION "2018-02-21"
 
 void print_syntax() {
-	fprintf(stderr, "Syntax: [-v] -t <type> -i <input dir> -o <output artfile>\n");
+	fprintf(stderr, "Syntax: [-v] [-j <threads>] [--base <old artfile>] [--dedup] [--crop[=<index>]] -t <type> (-i <input dir> [-i <input dir> ...] [-b <listfile>] [<input dir> ...] | --tar <tarfile>) [-o <output artfile>]\n");
+	fprintf(stderr, "        [-v] [-j <threads>] [--base <old artfile>] [--dedup] [--crop[=<index>]] -t <type> --watch -i <input dir> -o <output artfile>\n");
+	fprintf(stderr, "        [-v] -t <type> [--replace <name>=<bitmap> ...] [--compact] -o <artfile>\n");
+	fprintf(stderr, "        [-v] -t <type> --merge [-n <name> ...] [-x <name> ...] [--duplicates all|first|last] [--dedup] [-o <output artfile>] (-i <artfile> [-i <artfile> ...] [-b <listfile>] [<artfile> ...])\n");
 	fprintf(stderr, "   -t : ba (Blown Away)\n");
 	fprintf(stderr, "        pip (Panic in the Park)\n");
 	fprintf(stderr, "        waldo (Where's Waldo? At the Circus)\n");
@@ -32,6 +45,21 @@ void print_syntax() {
 	fprintf(stderr, "        eraser (Eraser Turnabout)\n");
 	fprintf(stderr, "        knex (Virtual K'Nex)\n");
 	fprintf(stderr, "   -v : verbose output\n");
+	fprintf(stderr, "   -j : number of threads. Batch mode: ART files which are packed in parallel, otherwise: pictures which are read and compressed in parallel (BA, PiP, Waldo)\n");
+	fprintf(stderr, "   -b : read the input dirs from this list file (one dir per line)\n");
+	fprintf(stderr, "   --tar : read the input dir from a tar stream (- for stdin)\n");
+	fprintf(stderr, "   --base : copy the pictures which did not change since the input dir was extracted from this ART file, instead of compressing them again\n");
+	fprintf(stderr, "   --dedup : identical pictures are stored only once, and all their directory entries point to the same data\n");
+	fprintf(stderr, "   --crop : cut off the transparent border (palette index 0, or <index>) of every picture, and add it to the offsets of the picture (PiP, Waldo)\n");
+	fprintf(stderr, "   --replace : replace one picture of an existing ART file. Its new data overwrites the old data if it fits, otherwise it is appended.\n");
+	fprintf(stderr, "   --compact : remove the dead space which --replace left behind in an existing ART file\n");
+	fprintf(stderr, "   --merge : copy the stored pictures of the input ART files into one ART file, without compressing them again\n");
+	fprintf(stderr, "   -n : --merge: only copy pictures with this name (wildcards * ? [...] allowed, can be repeated)\n");
+	fprintf(stderr, "   -x : --merge: do not copy pictures with this name (wildcards allowed, can be repeated)\n");
+	fprintf(stderr, "   --duplicates : --merge: if a name exists more than once, keep all pictures (default), or only the first or the last one\n");
+	fprintf(stderr, "   --watch : keep running, and pack the ART file again whenever index.txt or a bitmap of the input dir changes. Only the changed pictures are compressed again. (Linux only)\n");
+	fprintf(stderr, "If more than one input dir is given (batch mode), -o is the output directory, and every input dir is packed into <output dir>/<input dir name>.ART\n");
+	fprintf(stderr, "Runs in simulation mode if no output file is defined: no ART file is written, and the size of every picture and of the ART file is printed.\n");
 }
 
 #define GAME_UNKNOWN 0
@@ -42,18 +70,308 @@ void print_syntax() {
 #define GAME_ERASER 5
 #define GAME_KNEX 6
 
+#define MAX_FILE 256
+
+// --watch: a bitmap is often saved in several steps, which should cause only one run
+#define WATCH_QUIET_MS 50
+
+static void temp_file_name(const char* szArtFile, char* szTempFile, const size_t size) {
+	snprintf(szTempFile, size, "%s.tmp", szArtFile);
+}
+
+// The ART file is written next to szArtFile, and replaces it only if everything was packed (see del_output()).
+// So the old ART file stays intact if something fails, and it can also be read while it is packed again (e.g. --base).
+// In simulation mode, the ART file is only counted, and szArtFile is only used for messages
+static ArtWriter* new_output(const char* szArtFile, const IpePackOptions* options) {
+	if (options->bSimulate) return new_art_writer_counter(szArtFile);
+	char szTempFile[MAX_FILE*3];
+	temp_file_name(szArtFile, szTempFile, sizeof(szTempFile));
+	ArtWriter* output = new_art_writer(szTempFile);
+	// The messages name the ART file
+	if (output) snprintf(output->szFilename, sizeof(output->szFilename), "%s", szArtFile);
+	return output;
+}
+
+// Closes the output, and replaces the ART file by it if bOK. In simulation mode, the size which the ART file would have is printed.
+// Returns false if something failed.
+static bool del_output(ArtWriter* output, const char* szArtFile, bool bOK) {
+	if (output->bCounter) {
+		printf("%s: %" PRIu64 " bytes projected\n", output->szFilename, art_writer_tell(output));
+		return del_art_writer(output) && bOK;
+	}
+	if (!del_art_writer(output)) bOK = false;
+
+	char szTempFile[MAX_FILE*3];
+	temp_file_name(szArtFile, szTempFile, sizeof(szTempFile));
+	if (bOK && !file_replace(szTempFile, szArtFile)) {
+		fprintf(stderr, "ERROR: Cannot rename %s to %s\n", szTempFile, szArtFile);
+		bOK = false;
+	}
+	if (!bOK) {
+		remove(szTempFile);
+		fprintf(stderr, "ERROR: %s was not written\n", szArtFile);
+	}
+	return bOK;
+}
+
+// pool is used for the pictures of the IPE16 games. It may be NULL, then the pictures are processed one after the other.
+static bool pack_art(const int game, const IpePackInput* input, const char* szArtFile, ThreadPool* pool, const IpePackOptions* options) {
+	ArtWriter* output = new_output(szArtFile, options);
+	if (!output) return false;
+
+	bool bOK = false;
+	switch (game) {
+		case GAME_BA:
+			bOK = ba_pack_art(input, output, pool, options);
+			break;
+		case GAME_PIP:
+		case GAME_WALDO_CIRCUS:
+			bOK = pip_pack_art(input, output, pool, options);
+			break;
+		case GAME_WALDO_GEOGRAPHY:
+		case GAME_ERASER:
+		case GAME_KNEX:
+			bOK = ipe32_pack_art(input, output, options);
+			break;
+	}
+
+	return del_output(output, szArtFile, bOK);
+}
+
+// szSpec is "<name>=<bitmap>"
+static bool replace_picture(const int game, const char* szArtFile, const char* szSpec, const IpePackOptions* options) {
+	const char* szBitmapFile = strchr(szSpec, '=');
+	if (!szBitmapFile || (szBitmapFile == szSpec) || (szBitmapFile-szSpec > MAX_FILE-1)) {
+		fprintf(stderr, "ERROR: Invalid argument '%s' for --replace (expected <name>=<bitmap>)\n", szSpec);
+		return false;
+	}
+	char szName[MAX_FILE];
+	memcpy(szName, szSpec, szBitmapFile-szSpec);
+	szName[szBitmapFile-szSpec] = 0;
+	szBitmapFile++;
+
+	switch (game) {
+		case GAME_BA:
+			return ba_replace_picture(szArtFile, szName, szBitmapFile, options);
+		case GAME_PIP:
+		case GAME_WALDO_CIRCUS:
+			return pip_replace_picture(szArtFile, szName, szBitmapFile, options);
+		case GAME_WALDO_GEOGRAPHY:
+		case GAME_ERASER:
+		case GAME_KNEX:
+			return ipe32_replace_picture(szArtFile, szName, szBitmapFile, options);
+	}
+	return false;
+}
+
+// --merge and --compact
+static bool merge_art(const int game, const char** szInputs, const int numInputs, const char* szArtFile, const IpeMergeOptions* merge, const IpePackOptions* options) {
+	ArtWriter* output = new_output(szArtFile, options);
+	if (!output) return false;
+
+	bool bOK = false;
+	switch (game) {
+		case GAME_BA:
+		case GAME_PIP:
+		case GAME_WALDO_CIRCUS:
+			bOK = ipe16_merge_art(szInputs, numInputs, output, merge, options);
+			break;
+		case GAME_WALDO_GEOGRAPHY:
+		case GAME_ERASER:
+		case GAME_KNEX:
+			bOK = ipe32_merge_art(szInputs, numInputs, output, merge, options);
+			break;
+	}
+
+	return del_output(output, szArtFile, bOK);
+}
+
+// The ART file is merged into itself. Like every ART file, the compacted file replaces it only if everything was copied
+static bool compact_art(const int game, const char* szArtFile, const IpePackOptions* options) {
+	uint64_t oldSize = 0, newSize = 0;
+	FILE* fp = fopen(szArtFile, "rb");
+	if (fp) {
+		oldSize = file_size(fp);
+		fclose(fp);
+	}
+
+	const StringList noPatterns = {0};
+	IpeMergeOptions merge = {0};
+	merge.includePatterns = &noPatterns;
+	merge.excludePatterns = &noPatterns;
+	merge.duplicates = IPE_MERGE_DUPLICATES_ALL;
+	merge.bKeepEmpty = true;
+	if (!merge_art(game, &szArtFile, 1, szArtFile, &merge, options)) return false;
+
+	fp = fopen(szArtFile, "rb");
+	if (fp) {
+		newSize = file_size(fp);
+		fclose(fp);
+	}
+	if (options->verbosity >= 1) printf("%s: %llu bytes of dead space removed\n", szArtFile, (unsigned long long)(oldSize-newSize));
+	return true;
+}
+
+// --watch: the ART file is packed, and packed again whenever index.txt or a bitmap of the input dir changes.
+// The stored pictures are kept in memory, so only the changed ones are compressed again.
+// Like every ART file, it is written next to the ART file, which is replaced only if everything was packed, so that a running game never sees a broken file.
+// Returns when the watch is stopped (Ctrl+C).
+static bool watch_art(const int game, const IpePackInput* input, const char* szArtFile, ThreadPool* pool, IpePackOptions* options) {
+	// The folder is watched before the first run, so that no change gets lost
+	FolderWatch* watch = new_folder_watch(input->szSrcFolder);
+	if (!watch) return false;
+	PackCache* cache = new_pack_cache();
+	if (!cache) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the cache\n");
+		del_folder_watch(watch);
+		return false;
+	}
+	options->cache = cache;
+
+	StringList changed = {0};
+	bool bRun = true;
+	bool bLastOK = true;
+	while (true) {
+		if (bRun) {
+			const uint64_t startTime = clock_ms();
+			pack_cache_begin_run(cache);
+			bLastOK = pack_art(game, input, szArtFile, pool, options);
+			pack_cache_end_run(cache);
+			if (bLastOK) printf("%s packed in %" PRIu64 " ms (%d pictures compressed, %d unchanged)\n", szArtFile, clock_ms()-startTime, cache->numMisses, cache->numHits);
+			printf("Watching %s for changes (Ctrl+C to stop)\n", input->szSrcFolder);
+			fflush(stdout);
+		}
+
+		string_list_free(&changed);
+		bool bOverflow = false;
+		if (!folder_watch_wait(watch, WATCH_QUIET_MS, &changed, &bOverflow)) break;
+
+		// Changes of other files (e.g. the ART file itself, if it is written into the input dir) are ignored.
+		// After a failed run, every change might fix it (e.g. a missing bitmap was added).
+		bRun = !bLastOK;
+		if (bOverflow) {
+			pack_cache_invalidate_all(cache);
+			bRun = true;
+		}
+		int i;
+		for (i=0; i<changed.numStrings; ++i) {
+			if (strcmp(changed.strings[i], "index.txt") == 0) bRun = true;
+			if (pack_cache_invalidate(cache, changed.strings[i]) > 0) bRun = true;
+		}
+	}
+
+	string_list_free(&changed);
+	options->cache = NULL;
+	del_pack_cache(cache);
+	del_folder_watch(watch);
+	return true;
+}
+
+// Simulation mode: the name of the ART file in the messages, like the batch mode would name it
+static char* simulated_art_file(const char* szInput, const bool bStripExtension, char* szArtFile, const size_t size) {
+	char szName[MAX_FILE];
+	path_stem(szInput, bStripExtension, szName, MAX_FILE-16);
+	snprintf(szArtFile, size, "%s.ART", szName);
+	return szArtFile;
+}
+
+// One input folder of the batch mode
+typedef struct tagPackJob {
+	int game;
+	const IpePackOptions* options;
+	IpePackInput input;
+	char szArtFile[MAX_FILE*3];
+	bool bOK;
+} PackJob;
+
+static void pack_art_job(void* arg, int workerId) {
+	PackJob* job = (PackJob*)arg;
+	// The job runs inside the thread pool, and must not wait for other jobs. Therefore the pictures are processed serially.
+	job->bOK = pack_art(job->game, &job->input, job->szArtFile, NULL, job->options);
+}
+
 int main(int argc, char *argv[]) {
-	int verbosity = 0;
-	char* szSrcFolder = "";
+	IpePackOptions options = {0};
+	int numThreads = 1;
+	StringList srcFolders = {0};
+	StringList replacements = {0};
+	bool bCompact = false;
+	bool bMerge = false;
+	bool bWatch = false;
+	StringList includePatterns = {0};
+	StringList excludePatterns = {0};
+	int duplicates = IPE_MERGE_DUPLICATES_ALL;
+	const char* szListFile = NULL;
 	char* szArtFile = "";
+	const char* szTarFile = NULL;
 	int c;
 
-	#define PRINT_SYNTAX { print_syntax(); return 0; }
+	#define FREE_LISTS { string_list_free(&srcFolders); string_list_free(&replacements); string_list_free(&includePatterns); string_list_free(&excludePatterns); }
+	#define PRINT_SYNTAX { print_syntax(); FREE_LISTS; return 0; }
 
 	int game = GAME_UNKNOWN;
 
-	while ((c = getopt(argc, argv, "Vvi:o:t:")) != -1) {
+	static struct option longOptions[] = {
+		{ "tar", required_argument, 0, 1 },
+		{ "base", required_argument, 0, 2 },
+		{ "replace", required_argument, 0, 3 },
+		{ "compact", no_argument, 0, 4 },
+		{ "dedup", no_argument, 0, 5 },
+		{ "merge", no_argument, 0, 6 },
+		{ "duplicates", required_argument, 0, 7 },
+		{ "watch", no_argument, 0, 8 },
+		{ "crop", optional_argument, 0, 9 },
+		{ 0, 0, 0, 0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "Vvi:o:t:j:b:n:x:", longOptions, NULL)) != -1) {
 		switch (c) {
+			case 1:
+				szTarFile = optarg;
+				break;
+			case 2:
+				options.szBaseArtFile = optarg;
+				break;
+			case 3:
+				string_list_add(&replacements, optarg);
+				break;
+			case 4:
+				bCompact = true;
+				break;
+			case 5:
+				options.bDedup = true;
+				break;
+			case 6:
+				bMerge = true;
+				break;
+			case 7:
+				if (strcmp(optarg, "all") == 0) {
+					duplicates = IPE_MERGE_DUPLICATES_ALL;
+				} else if (strcmp(optarg, "first") == 0) {
+					duplicates = IPE_MERGE_DUPLICATES_FIRST;
+				} else if (strcmp(optarg, "last") == 0) {
+					duplicates = IPE_MERGE_DUPLICATES_LAST;
+				} else {
+					PRINT_SYNTAX;
+				}
+				break;
+			case 8:
+				bWatch = true;
+				break;
+			case 9:
+				options.bCrop = true;
+				if (optarg) {
+					const int cropIndex = atoi(optarg);
+					if ((cropIndex < 0) || (cropIndex > 255)) PRINT_SYNTAX;
+					options.cropIndex = cropIndex;
+				}
+				break;
+			case 'n':
+				string_list_add(&includePatterns, optarg);
+				break;
+			case 'x':
+				string_list_add(&excludePatterns, optarg);
+				break;
 			case 't':
 				if (strcmp(optarg, "ba")     == 0) game = GAME_BA;
 				if (strcmp(optarg, "pip")    == 0) game = GAME_PIP;
@@ -63,13 +381,21 @@ int main(int argc, char *argv[]) {
 				if (strcmp(optarg, "knex")   == 0) game = GAME_KNEX;
 				break;
 			case 'v':
-				verbosity++;
+				options.verbosity++;
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				if (numThreads < 1) PRINT_SYNTAX;
 				break;
 			case 'V':
 				fprintf(stdout, "IPE artfile packer, revision %s\n", VERSION);
+				FREE_LISTS;
 				return 0;
 			case 'i':
-				szSrcFolder = optarg;
+				string_list_add(&srcFolders, optarg);
+				break;
+			case 'b':
+				szListFile = optarg;
 				break;
 			case 'o':
 				szArtFile = optarg;
@@ -79,29 +405,171 @@ int main(int argc, char *argv[]) {
 				break;
 		}
 	}
-	if (optind < argc) PRINT_SYNTAX;
+	const bool bBatch = (srcFolders.numStrings > 1) || (optind < argc) || szListFile;
+	while (optind < argc) string_list_add(&srcFolders, argv[optind++]);
+	if (szListFile && !string_list_read_file(&srcFolders, szListFile)) {
+		FREE_LISTS;
+		return 1;
+	}
 	if (game == GAME_UNKNOWN) {
 		fprintf(stderr, "Please specify the game\n");
 		PRINT_SYNTAX;
 	}
+	// Only the pictures of PiP and Waldo have offsets
+	if (options.bCrop && (game != GAME_PIP) && (game != GAME_WALDO_CIRCUS)) {
+		fprintf(stderr, "FATAL: --crop is only supported for PiP and Waldo\n");
+		FREE_LISTS;
+		return 1;
+	}
 
-	if (strlen(szArtFile) == 0) PRINT_SYNTAX;
-	if (strlen(szSrcFolder) == 0) PRINT_SYNTAX;
+	// Like the unpacker, which runs in simulation mode if no output directory is defined
+	options.bSimulate = (strlen(szArtFile) == 0);
+	char szSimulatedArtFile[MAX_FILE*3];
 
-	FILE* fobArt = fopen(szArtFile, "wb");
+	if ((replacements.numStrings > 0) || bCompact) {
+		// The existing ART file (-o) is modified, nothing is packed
+		if (bWatch || options.bCrop || (srcFolders.numStrings > 0) || szTarFile || options.szBaseArtFile || options.bSimulate) PRINT_SYNTAX;
+		bool bOK = true;
+		int i;
+		for (i=0; (i<replacements.numStrings) && bOK; ++i) {
+			bOK = replace_picture(game, szArtFile, replacements.strings[i], &options);
+		}
+		if (bOK && bCompact) bOK = compact_art(game, szArtFile, &options);
+		FREE_LISTS;
+		return bOK ? 0 : 1;
+	}
 
-	switch (game) {
-		case GAME_BA:
-			return ba_pack_art(szSrcFolder, fobArt, verbosity) ? 0 : 1;
-			break;
-		case GAME_PIP:
-		case GAME_WALDO_CIRCUS:
-			return pip_pack_art(szSrcFolder, fobArt, verbosity) ? 0 : 1;
-			break;
-		case GAME_WALDO_GEOGRAPHY:
-		case GAME_ERASER:
-		case GAME_KNEX:
-			return ipe32_pack_art(szSrcFolder, fobArt, verbosity) ? 0 : 1;
-			break;
+	if (bMerge) {
+		// The input ART files are given like the input dirs of the batch mode
+		if ((srcFolders.numStrings == 0) || szTarFile || options.szBaseArtFile || bWatch || options.bCrop) PRINT_SYNTAX;
+		if (options.bSimulate) szArtFile = "merged.ART";
+		IpeMergeOptions merge = {0};
+		merge.includePatterns = &includePatterns;
+		merge.excludePatterns = &excludePatterns;
+		merge.duplicates = duplicates;
+		const bool bOK = merge_art(game, (const char**)srcFolders.strings, srcFolders.numStrings, szArtFile, &merge, &options);
+		FREE_LISTS;
+		return bOK ? 0 : 1;
+	}
+	if ((includePatterns.numStrings > 0) || (excludePatterns.numStrings > 0) || (duplicates != IPE_MERGE_DUPLICATES_ALL)) PRINT_SYNTAX;
+
+	if (options.szBaseArtFile && bBatch) {
+		// The old ART file only matches one input dir
+		fprintf(stderr, "FATAL: --base cannot be used in batch mode\n");
+		FREE_LISTS;
+		return 1;
+	}
+
+	if (bWatch) {
+		// Only a folder can be watched, and the ART file must be written
+		if (bBatch || szTarFile || (srcFolders.numStrings != 1) || options.bSimulate) PRINT_SYNTAX;
+		IpePackInput input;
+		ipe_pack_input_folder(&input, srcFolders.strings[0]);
+		ThreadPool* pool = new_thread_pool(numThreads);
+		const bool bOK = watch_art(game, &input, szArtFile, pool, &options);
+		del_thread_pool(pool);
+		string_list_free(&srcFolders);
+		return bOK ? 0 : 1;
 	}
+
+	if (szTarFile) {
+		// The whole stream is read first, because the bitmaps can be in any order
+		if (srcFolders.numStrings > 0) PRINT_SYNTAX;
+		FILE* fibTar = stdin;
+		if (strcmp(szTarFile, "-") == 0) {
+			file_set_binary_mode(fibTar);
+		} else {
+			fibTar = fopen(szTarFile, "rb");
+			if (!fibTar) {
+				fprintf(stderr, "FATAL: Cannot open %s\n", szTarFile);
+				return 1;
+			}
+		}
+		TarArchive tar;
+		const bool bRead = tar_read_archive(fibTar, szTarFile, &tar);
+		if (fibTar != stdin) fclose(fibTar);
+		if (!bRead) return 1;
+
+		IpePackInput input;
+		ThreadPool* pool = new_thread_pool(numThreads);
+		if (options.bSimulate) szArtFile = simulated_art_file(szTarFile, true, szSimulatedArtFile, sizeof(szSimulatedArtFile));
+		const bool bOK = ipe_pack_input_tar(&input, szTarFile, &tar) && pack_art(game, &input, szArtFile, pool, &options);
+		del_thread_pool(pool);
+		tar_free_archive(&tar);
+		return bOK ? 0 : 1;
+	}
+
+	if (srcFolders.numStrings == 0) PRINT_SYNTAX;
+
+	if (!bBatch) {
+		IpePackInput input;
+		ipe_pack_input_folder(&input, srcFolders.strings[0]);
+		ThreadPool* pool = new_thread_pool(numThreads);
+		if (options.bSimulate) szArtFile = simulated_art_file(srcFolders.strings[0], false, szSimulatedArtFile, sizeof(szSimulatedArtFile));
+		const bool bOK = pack_art(game, &input, szArtFile, pool, &options);
+		del_thread_pool(pool);
+		string_list_free(&srcFolders);
+		return bOK ? 0 : 1;
+	}
+
+	// Batch mode: -o is the output directory
+	const char* szOutputDir = szArtFile;
+	if (!options.bSimulate && !make_directory(szOutputDir)) {
+		fprintf(stderr, "FATAL: Cannot create folder %s\n", szOutputDir);
+		string_list_free(&srcFolders);
+		return 1;
+	}
+
+	PackJob* jobs = (PackJob*)calloc(srcFolders.numStrings, sizeof(PackJob));
+	ThreadPool* pool = new_thread_pool(numThreads);
+	NameCounter* nc = new_name_counter(MAX_FILE, srcFolders.numStrings);
+	if (!jobs || !pool || !nc) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the batch mode\n");
+		free(jobs);
+		del_thread_pool(pool);
+		del_name_counter(nc);
+		string_list_free(&srcFolders);
+		return 1;
+	}
+
+	// Every ART file is one job. The biggest folders should be submitted first, but their size is not known before they are packed.
+	ThreadPoolGroup group = {0};
+	int i;
+	for (i=0; i<srcFolders.numStrings; ++i) {
+		PackJob* job = &jobs[i];
+		job->game = game;
+		job->options = &options;
+		ipe_pack_input_folder(&job->input, srcFolders.strings[i]);
+		char szName[MAX_FILE] = {0}; // zero padded, because it is the key of the name counter
+		path_stem(job->input.szSrcFolder, false, szName, MAX_FILE-16);
+		const int nameCount = name_counter_add(nc, szName);
+		// In simulation mode, the names are only used for messages
+		const char* szSeparator = options.bSimulate ? "" : "/";
+		if (nameCount > 1) {
+			snprintf(job->szArtFile, sizeof(job->szArtFile), "%s%s%s__%d.ART", szOutputDir, szSeparator, szName, nameCount);
+		} else {
+			snprintf(job->szArtFile, sizeof(job->szArtFile), "%s%s%s.ART", szOutputDir, szSeparator, szName);
+		}
+		thread_pool_submit(pool, &group, pack_art_job, job);
+	}
+	thread_pool_wait(pool, &group);
+	del_name_counter(nc);
+	del_thread_pool(pool);
+
+	// Per file summary
+	int numOK = 0;
+	for (i=0; i<srcFolders.numStrings; ++i) {
+		if (jobs[i].bOK) {
+			numOK++;
+			fprintf(stdout, "OK     %s -> %s\n", jobs[i].input.szSrcFolder, jobs[i].szArtFile);
+		} else {
+			fprintf(stdout, "FAILED %s\n", jobs[i].input.szSrcFolder);
+		}
+	}
+	fprintf(stdout, "%d of %d ART files OK\n", numOK, srcFolders.numStrings);
+	const bool bAllOK = numOK == srcFolders.numStrings;
+
+	free(jobs);
+	string_list_free(&srcFolders);
+	return bAllOK ? 0 : 1;
 }
@@ -0,0 +1,417 @@
+/**
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Functionality which is shared between the IPE16 and IPE32 packers
+ * Revision: 2026-10-19
+ **/
+
+// Required for fmemopen()
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "ipe_artfile_packer_common.h"
+#include "utils.h"
+#include "name_counter.h"
+#include "checksum.h"
+#include "blob_dedup.h"
+
+#define MAX_FILE 256
+
+void ipe_pack_input_folder(IpePackInput* input, const char* szSrcFolder) {
+	memset(input, 0, sizeof(*input));
+	input->szSrcFolder = szSrcFolder;
+}
+
+bool ipe_pack_input_tar(IpePackInput* input, const char* szTarName, const TarArchive* tar) {
+	memset(input, 0, sizeof(*input));
+	input->szSrcFolder = szTarName;
+	input->tar = tar;
+	if (tar_find_entry(tar, "index.txt")) return true;
+
+	const TarEntry* index = NULL;
+	int i;
+	for (i=0; i<tar->numEntries; ++i) {
+		const char* szName = tar->entries[i].szName;
+		const char* slash = strchr(szName, '/');
+		if (!slash || (strcmp(slash+1, "index.txt") != 0)) continue;
+		if (index && (strcmp(index->szName, szName) != 0)) {
+			fprintf(stderr, "FATAL: %s contains more than one index.txt\n", szTarName);
+			return false;
+		}
+		index = &tar->entries[i];
+	}
+	if (!index) {
+		fprintf(stderr, "FATAL: %s does not contain an index.txt\n", szTarName);
+		return false;
+	}
+	const size_t prefixLen = strlen(index->szName) - strlen("index.txt");
+	if (prefixLen >= sizeof(input->szTarPrefix)) {
+		fprintf(stderr, "FATAL: The folder of index.txt in %s has a too long name\n", szTarName);
+		return false;
+	}
+	memcpy(input->szTarPrefix, index->szName, prefixLen);
+	input->szTarPrefix[prefixLen] = 0;
+	return true;
+}
+
+static const TarEntry* ipe_pack_input_find_tar_entry(const IpePackInput* input, const char* szFilename) {
+	char szName[IPE_PACK_TAR_PREFIX_SIZE+MAX_FILE];
+	snprintf(szName, sizeof(szName), "%s%s", input->szTarPrefix, szFilename);
+	return tar_find_entry(input->tar, szName);
+}
+
+FILE* ipe_pack_input_open(const IpePackInput* input, const char* szFilename, const bool bText) {
+	if (!input->tar) {
+		char szPath[MAX_FILE*2];
+		snprintf(szPath, sizeof(szPath), "%s/%s", input->szSrcFolder, szFilename);
+		return fopen(szPath, bText ? "rt" : "rb");
+	}
+
+	const TarEntry* entry = ipe_pack_input_find_tar_entry(input, szFilename);
+	if (!entry) return NULL;
+
+	// The file is read directly from the memory of the tar stream.
+	// fmemopen() is not available on Windows, and does not accept empty buffers everywhere, so a temporary file is used there.
+	#ifndef _WIN32
+	if (entry->size > 0) return fmemopen(entry->data, entry->size, "rb");
+	#endif
+	FILE* fp = tmpfile();
+	if (!fp) return NULL;
+	if ((entry->size > 0) && (fwrite(entry->data, entry->size, 1, fp) != 1)) {
+		fclose(fp);
+		return NULL;
+	}
+	rewind(fp);
+	return fp;
+}
+
+bool ipe_pack_input_map_bitmap(const IpePackInput* input, const char* szFilename, BmpView* view) {
+	if (!input->tar) {
+		char szPath[MAX_FILE*2];
+		snprintf(szPath, sizeof(szPath), "%s/%s", input->szSrcFolder, szFilename);
+		return bmp_view_open_file(view, szPath);
+	}
+
+	const TarEntry* entry = ipe_pack_input_find_tar_entry(input, szFilename);
+	if (!entry) {
+		memset(view, 0, sizeof(*view));
+		snprintf(view->error, sizeof(view->error), "Cannot open the file");
+		return false;
+	}
+	return bmp_view_open_memory(view, entry->data, entry->size);
+}
+
+static bool ipe_pack_index_add_line(IpePackIndex* index, const IpePackIndexLine* line) {
+	if (index->numLines == index->capacity) {
+		const int newCapacity = (index->capacity == 0) ? 64 : index->capacity*2;
+		IpePackIndexLine* newLines = (IpePackIndexLine*)realloc(index->lines, newCapacity*sizeof(IpePackIndexLine));
+		if (!newLines) return false;
+		index->lines = newLines;
+		index->capacity = newCapacity;
+	}
+	index->lines[index->numLines++] = *line;
+	return true;
+}
+
+bool ipe_pack_index_read(const IpePackInput* input, IpePackIndex* index) {
+	memset(index, 0, sizeof(*index));
+	snprintf(index->szFilename, sizeof(index->szFilename), "%s/index.txt", input->szSrcFolder);
+	FILE* fitIndex = ipe_pack_input_open(input, "index.txt", true);
+	if (!fitIndex) {
+		fprintf(stderr, "Cannot open %s\n", index->szFilename);
+		return false;
+	}
+
+	// The whole file is read into memory, and the fields are split in place
+	size_t size = 0;
+	size_t capacity = 0;
+	while (1) {
+		if (capacity-size < 2) {
+			const size_t newCapacity = (capacity == 0) ? 64*1024 : capacity*2;
+			char* newText = (char*)realloc(index->text, newCapacity);
+			if (!newText) {
+				fprintf(stderr, "FATAL: Cannot allocate memory for %s\n", index->szFilename);
+				fclose(fitIndex);
+				ipe_pack_index_free(index);
+				return false;
+			}
+			index->text = newText;
+			capacity = newCapacity;
+		}
+		const size_t n = fread(index->text+size, 1, capacity-size-1, fitIndex);
+		if (n == 0) break;
+		size += n;
+	}
+	const bool bReadError = ferror(fitIndex) != 0;
+	fclose(fitIndex);
+	if (bReadError) {
+		fprintf(stderr, "Cannot read %s\n", index->szFilename);
+		ipe_pack_index_free(index);
+		return false;
+	}
+	index->text[size] = 0;
+
+	char* p = index->text;
+	int lineNo = 0;
+	while (*p) {
+		IpePackIndexLine line = {0};
+		line.lineNo = ++lineNo;
+		while (*p && (*p != '\n')) {
+			if ((*p == ' ') || (*p == '\t') || (*p == '\r')) {
+				*p++ = 0;
+				continue;
+			}
+			if (line.numFields < IPE_PACK_INDEX_MAX_FIELDS) line.fields[line.numFields++] = p;
+			while (*p && (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n')) ++p;
+		}
+		if (*p == '\n') *p++ = 0;
+		if (line.numFields == 0) continue; // blank line
+		if (!ipe_pack_index_add_line(index, &line)) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for %s\n", index->szFilename);
+			ipe_pack_index_free(index);
+			return false;
+		}
+	}
+	return true;
+}
+
+void ipe_pack_index_free(IpePackIndex* index) {
+	free(index->text);
+	free(index->lines);
+	memset(index, 0, sizeof(*index));
+}
+
+uint64_t ipe_pack_replace_offset(const uint64_t oldOffset, const uint64_t oldSize, const uint64_t newSize, const uint64_t fileSize, const bool bShared) {
+	if (bShared) return fileSize;
+	if (newSize <= oldSize) return oldOffset;
+	if (oldOffset+oldSize == fileSize) return oldOffset;
+	return fileSize;
+}
+
+bool ipe_pack_write_at(FILE* fp, const char* szFilename, const uint64_t offset, const void* data, const size_t len) {
+	if (!file_seek64(fp, offset) || (fwrite(data, 1, len, fp) != len)) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", szFilename);
+		return false;
+	}
+	return true;
+}
+
+bool ipe_pack_copy_data(FILE* fibArt, const char* szArtFile, const uint64_t offset, const uint64_t size, ArtWriter* output) {
+	if (!file_seek64(fibArt, offset)) {
+		fprintf(stderr, "ERROR: Cannot read %s\n", szArtFile);
+		return false;
+	}
+	unsigned char buf[64*1024];
+	uint64_t remaining = size;
+	while (remaining > 0) {
+		const size_t len = (remaining > sizeof(buf)) ? sizeof(buf) : (size_t)remaining;
+		if (fread(buf, 1, len, fibArt) != len) {
+			fprintf(stderr, "ERROR: Cannot read %s\n", szArtFile);
+			return false;
+		}
+		if (!art_writer_write(output, buf, len)) return false;
+		remaining -= len;
+	}
+	return true;
+}
+
+HashManifest* ipe_pack_read_base_manifest(const IpePackInput* input, const char* szArtFile, const uint64_t artFileSize, const uint64_t directoryChecksum) {
+	char szManifest[IPE_PACK_INDEX_FILENAME_SIZE];
+	snprintf(szManifest, sizeof(szManifest), "%s/%s", input->szSrcFolder, HASH_MANIFEST_FILENAME);
+	FILE* fitManifest = ipe_pack_input_open(input, HASH_MANIFEST_FILENAME, true);
+	if (!fitManifest) {
+		fprintf(stderr, "WARNING: %s does not exist. All pictures are compressed again.\n", szManifest);
+		return NULL;
+	}
+	HashManifest* manifest = hash_manifest_read(fitManifest, szManifest);
+	fclose(fitManifest);
+	if (!manifest) {
+		fprintf(stderr, "WARNING: All pictures are compressed again.\n");
+		return NULL;
+	}
+	if ((manifest->artFileSize != artFileSize) || (manifest->directoryChecksum != directoryChecksum)) {
+		fprintf(stderr, "WARNING: %s was not extracted from %s. All pictures are compressed again.\n", szManifest, szArtFile);
+		del_hash_manifest(manifest);
+		return NULL;
+	}
+	return manifest;
+}
+
+static bool ipe_merge_pattern_match(const StringList* patterns, const char* szName, bool* patternMatched) {
+	bool bMatch = false;
+	int i;
+	for (i=0; i<patterns->numStrings; ++i) {
+		if (wildcard_match(patterns->strings[i], szName)) {
+			bMatch = true;
+			if (patternMatched) patternMatched[i] = true;
+		}
+	}
+	return bMatch;
+}
+
+int ipe_merge_select(IpeMergeEntry* entries, const int numEntries, const IpeMergeOptions* merge) {
+	bool* patternMatched = (bool*)calloc(merge->includePatterns->numStrings+1, sizeof(bool));
+	NameCounter* seen = new_name_counter(IPE_MERGE_NAME_SIZE, numEntries);
+	if (!patternMatched || !seen) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", numEntries);
+		free(patternMatched);
+		del_name_counter(seen);
+		return -1;
+	}
+
+	int i;
+	for (i=0; i<numEntries; ++i) {
+		IpeMergeEntry* entry = &entries[i];
+		if (entry->size == 0) {
+			entry->bSelected = merge->bKeepEmpty;
+			continue;
+		}
+		entry->bSelected =
+			((merge->includePatterns->numStrings == 0) || ipe_merge_pattern_match(merge->includePatterns, entry->szName, patternMatched)) &&
+			!ipe_merge_pattern_match(merge->excludePatterns, entry->szName, NULL);
+	}
+
+	// The same name in two input files (or twice in one file, like in Eraser): the order of the input files decides.
+	// For the last one, the entries are visited backwards.
+	if (merge->duplicates != IPE_MERGE_DUPLICATES_ALL) {
+		const bool bBackwards = (merge->duplicates == IPE_MERGE_DUPLICATES_LAST);
+		for (i=0; i<numEntries; ++i) {
+			IpeMergeEntry* entry = &entries[bBackwards ? numEntries-1-i : i];
+			if (!entry->bSelected || (entry->size == 0)) continue;
+			const int occurrence = name_counter_add(seen, entry->szName);
+			if (occurrence == 0) {
+				fprintf(stderr, "FATAL: Cannot allocate memory for the picture names\n");
+				free(patternMatched);
+				del_name_counter(seen);
+				return -1;
+			}
+			entry->bSelected = (occurrence == 1);
+		}
+	}
+
+	int numSelected = 0;
+	for (i=0; i<numEntries; ++i) {
+		if (entries[i].bSelected) numSelected++;
+	}
+	for (i=0; i<merge->includePatterns->numStrings; ++i) {
+		if (!patternMatched[i]) {
+			fprintf(stderr, "ERROR: No picture matches %s\n", merge->includePatterns->strings[i]);
+			numSelected = -1;
+		}
+	}
+
+	free(patternMatched);
+	del_name_counter(seen);
+	return numSelected;
+}
+
+// The stored data of a selected entry, to find the entries which share their data
+typedef struct tagIpeMergeStoredData {
+	int input;
+	uint64_t offset;
+	uint64_t size;
+	int entryNo;           // in the array of all entries
+} IpeMergeStoredData;
+
+static int ipe_merge_compare_stored_data(const void* a, const void* b) {
+	const IpeMergeStoredData* da = (const IpeMergeStoredData*)a;
+	const IpeMergeStoredData* db = (const IpeMergeStoredData*)b;
+	if (da->input != db->input) return da->input - db->input;
+	if (da->offset != db->offset) return (da->offset < db->offset) ? -1 : 1;
+	if (da->size != db->size) return (da->size < db->size) ? -1 : 1;
+	return da->entryNo - db->entryNo;
+}
+
+bool ipe_merge_copy(FILE** fibInputs, const char** szInputs, IpeMergeEntry* entries, const int numEntries, ArtWriter* output, const IpePackOptions* options) {
+	// firstUser[i] is the first entry which has the same data as entry i
+	IpeMergeStoredData* sorted = (IpeMergeStoredData*)malloc((numEntries+1)*sizeof(IpeMergeStoredData));
+	int* firstUser = (int*)malloc((numEntries+1)*sizeof(int));
+	BlobDedup* dedup = options->bDedup ? new_blob_dedup() : NULL;
+	if (!sorted || !firstUser || (options->bDedup && !dedup)) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", numEntries);
+		free(sorted);
+		free(firstUser);
+		del_blob_dedup(dedup);
+		return false;
+	}
+	int i;
+	int numSorted = 0;
+	for (i=0; i<numEntries; ++i) {
+		firstUser[i] = i;
+		if (!entries[i].bSelected || (entries[i].size == 0)) continue;
+		sorted[numSorted].input = entries[i].input;
+		sorted[numSorted].offset = entries[i].offset;
+		sorted[numSorted].size = entries[i].size;
+		sorted[numSorted].entryNo = i;
+		numSorted++;
+	}
+	qsort(sorted, numSorted, sizeof(IpeMergeStoredData), ipe_merge_compare_stored_data);
+	for (i=1; i<numSorted; ++i) {
+		if ((sorted[i].input == sorted[i-1].input) && (sorted[i].offset == sorted[i-1].offset) && (sorted[i].size == sorted[i-1].size)) {
+			firstUser[sorted[i].entryNo] = firstUser[sorted[i-1].entryNo];
+		}
+	}
+	free(sorted);
+
+	bool bOK = true;
+	for (i=0; (i<numEntries) && bOK; ++i) {
+		IpeMergeEntry* entry = &entries[i];
+		if (!entry->bSelected || (entry->size == 0)) continue; // the offset of empty entries is set below
+		if (firstUser[i] != i) {
+			entry->newOffset = entries[firstUser[i]].newOffset; // already copied
+			continue;
+		}
+
+		// The offsets and sizes in the ART file have 32 bits
+		entry->newOffset = art_writer_tell(output);
+		if (entry->newOffset+entry->size > UINT32_MAX) {
+			fprintf(stderr, "ERROR: The ART file exceeds the maximum size of 4 GiB\n");
+			bOK = false;
+			break;
+		}
+
+		if (!dedup) {
+			if (options->verbosity >= 1) printf("Copy %s from %s at offset %" PRIx64 " to offset %" PRIx64 "\n", entry->szName, szInputs[entry->input], entry->offset, entry->newOffset);
+			bOK = ipe_pack_copy_data(fibInputs[entry->input], szInputs[entry->input], entry->offset, entry->size, output);
+			continue;
+		}
+
+		// With --dedup, the data is hashed before it is written
+		unsigned char* blob = (unsigned char*)malloc(entry->size);
+		if (!blob || !file_seek64(fibInputs[entry->input], entry->offset) || (fread(blob, entry->size, 1, fibInputs[entry->input]) != 1)) {
+			fprintf(stderr, "ERROR: Cannot read %s from %s\n", entry->szName, szInputs[entry->input]);
+			free(blob);
+			bOK = false;
+			break;
+		}
+		const uint64_t hash = checksum_xxh64(blob, entry->size, 0);
+		uint64_t linkedOffset;
+		const bool bLinked = blob_dedup_find(dedup, hash, blob, entry->size, output, &linkedOffset);
+		if (bLinked) {
+			entry->newOffset = linkedOffset;
+		} else {
+			blob_dedup_add(dedup, hash, entry->size, entry->newOffset);
+			bOK = art_writer_write(output, blob, entry->size);
+		}
+		if (options->verbosity >= 1) printf("Copy %s from %s at offset %" PRIx64 " to offset %" PRIx64 "%s\n", entry->szName, szInputs[entry->input], entry->offset, entry->newOffset, bLinked ? " (identical to an earlier picture)" : "");
+		free(blob);
+	}
+	free(firstUser);
+
+	// Empty entries keep the offset 0, otherwise they point to the end of the file (like the original ART files)
+	const uint64_t totalFileSize = art_writer_tell(output);
+	for (i=0; i<numEntries; ++i) {
+		if (entries[i].bSelected && (entries[i].size == 0)) entries[i].newOffset = (entries[i].offset == 0) ? 0 : totalFileSize;
+	}
+
+	if (dedup) {
+		fprintf(stdout, "%s: %d pictures were identical to an earlier picture and not stored again (%" PRIu64 " bytes saved)\n", output->szFilename, dedup->numLinked, dedup->bytesSaved);
+		del_blob_dedup(dedup);
+	}
+	return bOK;
+}
@@ -0,0 +1,118 @@
+/**
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Functionality which is shared between the IPE16 and IPE32 packers
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__ipe_artfile_packer_common
+#define __inc__ipe_artfile_packer_common
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tar_stream.h"
+#include "art_writer.h"
+#include "utils.h"
+#include "bmp_view.h"
+#include "hash_manifest.h"
+
+#define IPE_PACK_TAR_PREFIX_SIZE 256
+#define IPE_PACK_INDEX_FILENAME_SIZE 1024
+#define IPE_PACK_INDEX_MAX_FIELDS 8
+#define IPE_MERGE_NAME_SIZE 24 // enough for the names of IPE16 and IPE32
+
+#define IPE_MERGE_DUPLICATES_ALL 0
+#define IPE_MERGE_DUPLICATES_FIRST 1
+#define IPE_MERGE_DUPLICATES_LAST 2
+
+// Where the packers read index.txt and the bitmaps from: a folder, or a tar stream which was read into memory (--tar)
+typedef struct tagIpePackInput {
+	const char* szSrcFolder;  // the folder, or the name of the tar stream (only for messages)
+	const TarArchive* tar;    // NULL if the files are read from the folder
+	char szTarPrefix[IPE_PACK_TAR_PREFIX_SIZE]; // folder of index.txt inside the tar stream, e.g. "FOO/", or "" if it is at the top level
+} IpePackInput;
+
+struct tagPackCache;
+
+typedef struct tagIpePackOptions {
+	int verbosity;
+	const char* szBaseArtFile; // old ART file, whose stored pictures are copied if they did not change (--base), or NULL
+	bool bDedup;               // identical stored pictures are written only once (--dedup)
+	bool bSimulate;            // no ART file is written, only the sizes are computed and printed (no -o)
+	bool bCrop;                // the transparent border of the pictures is cut off, and added to their offsets (--crop, PiP and Waldo)
+	unsigned char cropIndex;   // the transparent palette index of --crop
+	struct tagPackCache* cache; // stored pictures of the previous run, which are reused if their line and bitmap did not change (--watch), or NULL
+} IpePackOptions;
+
+void ipe_pack_input_folder(IpePackInput* input, const char* szSrcFolder);
+// index.txt may be at the top level of the tar stream, or in its only folder (e.g. "tar -cf - FOO")
+bool ipe_pack_input_tar(IpePackInput* input, const char* szTarName, const TarArchive* tar);
+
+// Opens a file of the input for reading (relative to the folder of index.txt). Returns NULL if it does not exist.
+FILE* ipe_pack_input_open(const IpePackInput* input, const char* szFilename, const bool bText);
+// Opens a bitmap of the input as a view: memory mapped, or directly in the memory of the tar stream.
+// Returns false (and sets view->error) if it cannot be read or is not a bitmap file. The view must be closed anyway.
+bool ipe_pack_input_map_bitmap(const IpePackInput* input, const char* szFilename, BmpView* view);
+
+// One picture of index.txt: a line, split into fields at blanks. The meaning of the fields depends on the packer.
+typedef struct tagIpePackIndexLine {
+	int lineNo;            // in index.txt (for messages)
+	int numFields;         // fields after IPE_PACK_INDEX_MAX_FIELDS are ignored
+	const char* fields[IPE_PACK_INDEX_MAX_FIELDS]; // point into the text of the index
+} IpePackIndexLine;
+
+// index.txt, read in one pass. Blank lines are skipped, so every line is a picture.
+typedef struct tagIpePackIndex {
+	char szFilename[IPE_PACK_INDEX_FILENAME_SIZE]; // for messages
+	char* text;
+	int numLines;
+	int capacity;
+	IpePackIndexLine* lines;
+} IpePackIndex;
+
+// Returns false (and prints an error) if index.txt cannot be read
+bool ipe_pack_index_read(const IpePackInput* input, IpePackIndex* index);
+void ipe_pack_index_free(IpePackIndex* index);
+
+// Replacing a picture in an existing ART file (--replace): where its new data goes.
+// Over the old data, if it fits there, or if the old data is at the end of the file (then the file grows).
+// Otherwise at the end of the file, and the old data stays as dead space until the file is compacted (--compact).
+// bShared: another directory entry uses the old data, too, so it must not be overwritten.
+uint64_t ipe_pack_replace_offset(const uint64_t oldOffset, const uint64_t oldSize, const uint64_t newSize, const uint64_t fileSize, const bool bShared);
+// Returns false (and prints an error) if the data cannot be written
+bool ipe_pack_write_at(FILE* fp, const char* szFilename, const uint64_t offset, const void* data, const size_t len);
+// Copies stored data of an ART file verbatim into the output (--compact). Returns false (and prints an error) if it cannot be read.
+bool ipe_pack_copy_data(FILE* fibArt, const char* szArtFile, const uint64_t offset, const uint64_t size, ArtWriter* output);
+// Reads the hash manifest of the input, which the unpacker wrote when it extracted the old ART file (--base).
+// The ART file is recognized by its size and the checksum of its directory. Returns NULL (and prints a warning)
+// if the manifest is missing or belongs to another ART file. Then nothing is reused, but packing continues.
+HashManifest* ipe_pack_read_base_manifest(const IpePackInput* input, const char* szArtFile, const uint64_t artFileSize, const uint64_t directoryChecksum);
+
+// Which pictures of the input ART files are copied by --merge. --compact copies everything of one ART file.
+typedef struct tagIpeMergeOptions {
+	const StringList* includePatterns; // -n: only pictures which match one of the patterns, or all if empty
+	const StringList* excludePatterns; // -x: pictures which match one of the patterns are skipped
+	int duplicates;                    // IPE_MERGE_DUPLICATES_*: if a name exists more than once, keep all pictures, or only the first or last one
+	bool bKeepEmpty;                   // empty directory entries are copied, too (--compact)
+} IpeMergeOptions;
+
+// One directory entry of an input ART file of --merge
+typedef struct tagIpeMergeEntry {
+	int input;             // number of the input file
+	int entryNo;           // in the directory of the input file
+	char szName[IPE_MERGE_NAME_SIZE]; // zero padded
+	uint64_t offset;       // of the stored data in the input file
+	uint64_t size;         // of the stored data, 0 = empty entry
+	bool bSelected;
+	uint64_t newOffset;    // in the output file
+} IpeMergeEntry;
+
+// Applies the patterns and the duplicate rule to the entries of all input files (in the order of the input files and their directories).
+// Returns the number of selected entries, or -1 (and prints an error) if a pattern matches nothing or there is not enough memory.
+int ipe_merge_select(IpeMergeEntry* entries, const int numEntries, const IpeMergeOptions* merge);
+// Copies the stored data of the selected entries verbatim into the output, in their order, and sets newOffset.
+// Entries which share their data in an input file still share it in the output. Empty entries point to offset 0, or to the end of the output.
+bool ipe_merge_copy(FILE** fibInputs, const char** szInputs, IpeMergeEntry* entries, const int numEntries, ArtWriter* output, const IpePackOptions* options);
+
+#endif // #ifndef __inc__ipe_artfile_packer_common
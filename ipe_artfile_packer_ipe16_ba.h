@@ -11,6 +11,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-bool ba_pack_art(const char* szSrcFolder, FILE* fobArt, const int verbosity);
+#include "ipe_artfile_packer_common.h"
+#include "art_writer.h"
+#include "thread_pool.h"
+
+bool ba_pack_art(const IpePackInput* input, ArtWriter* output, ThreadPool* pool, const IpePackOptions* options);
+bool ba_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const IpePackOptions* options);
 
 #endif // #ifndef __inc__ipe_artfile_packer_ipe16_ba
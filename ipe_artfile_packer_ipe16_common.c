@@ -0,0 +1,588 @@
+/**
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Functionality which is shared between the IPE16 packers (BA and PiP)
+ * The pictures are read and compressed in parallel into memory, and written in the order of index.txt
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "ipe_artfile_packer_ipe16_common.h"
+#include "checksum.h"
+#include "utils.h"
+
+// Number of pictures per thread which may be read and compressed ahead of the writer
+#define IPE16_PACK_ITEMS_PER_SLOT 4
+
+// Reads the file header and the directory of an existing ART file. *pehs must be freed.
+// Returns false (and prints an error) if it is not a valid ART file.
+static bool ipe16_read_directory(FILE* fibArt, const char* szArtFile, Ipe16FileHeader* bfh, Ipe16PictureEntryHeader** pehs) {
+	*pehs = NULL;
+	const uint64_t fileSize = file_size(fibArt);
+	if (!file_seek64(fibArt, 0) ||
+		(fread(bfh, sizeof(*bfh), 1, fibArt) != 1) ||
+		(strcmp(bfh->magic, IPE16_MAGIC_ART) != 0) ||
+		(bfh->totalFileSize != fileSize) ||
+		(bfh->numHeaderEntries == 0) ||
+		((uint64_t)bfh->numHeaderEntries*sizeof(Ipe16PictureEntryHeader) > fileSize)) {
+		fprintf(stderr, "FATAL: %s is not a valid ART file\n", szArtFile);
+		return false;
+	}
+	const int numPictures = bfh->numHeaderEntries-1;
+	*pehs = (Ipe16PictureEntryHeader*)malloc((numPictures+1)*sizeof(Ipe16PictureEntryHeader));
+	if (!*pehs || (fread(*pehs, sizeof(Ipe16PictureEntryHeader), numPictures, fibArt) != numPictures)) {
+		fprintf(stderr, "FATAL: Cannot read the directory of %s\n", szArtFile);
+		free(*pehs);
+		*pehs = NULL;
+		return false;
+	}
+	return true;
+}
+
+static void del_ipe16_pack_base(Ipe16PackBase* base) {
+	if (!base) return;
+	if (base->fibArt) fclose(base->fibArt);
+	pthread_mutex_destroy(&base->fileMutex);
+	free(base->pehs);
+	del_hash_manifest(base->manifest);
+	free(base);
+}
+
+// Returns NULL (and prints an error) if the old ART file cannot be read.
+// If the hash manifest of the input is missing or belongs to another ART file, nothing will be reused, but packing continues.
+static Ipe16PackBase* new_ipe16_pack_base(const char* szArtFile, const IpePackInput* input) {
+	Ipe16PackBase* base = (Ipe16PackBase*)calloc(1, sizeof(Ipe16PackBase));
+	if (!base) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %s\n", szArtFile);
+		return NULL;
+	}
+	pthread_mutex_init(&base->fileMutex, NULL);
+	base->szFilename = szArtFile;
+
+	base->fibArt = fopen(szArtFile, "rb");
+	if (!base->fibArt) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szArtFile);
+		del_ipe16_pack_base(base);
+		return NULL;
+	}
+	base->fileSize = file_size(base->fibArt);
+
+	Ipe16FileHeader bfh;
+	if (!ipe16_read_directory(base->fibArt, szArtFile, &bfh, &base->pehs)) {
+		del_ipe16_pack_base(base);
+		return NULL;
+	}
+	base->numPictures = bfh.numHeaderEntries-1;
+
+	// The unpacker recorded the size and the checksum of the directory of the ART file which it extracted
+	ChecksumXxh64State directoryChecksum;
+	checksum_xxh64_reset(&directoryChecksum, 0);
+	checksum_xxh64_update(&directoryChecksum, &bfh, sizeof(bfh));
+	checksum_xxh64_update(&directoryChecksum, base->pehs, base->numPictures*sizeof(Ipe16PictureEntryHeader));
+
+	base->manifest = ipe_pack_read_base_manifest(input, szArtFile, base->fileSize, checksum_xxh64_digest(&directoryChecksum));
+	return base;
+}
+
+// Copies the stored picture from the old ART file (--base) into item->blob, if the hash manifest shows that the bitmap did not change.
+// Returns false if the picture has to be compressed.
+static bool ipe16_pack_reuse_picture(Ipe16PackItem* item, const void* pictureHeader, const size_t pictureHeaderSize, const Ipe16BmpImportData* bitmap) {
+	Ipe16PackBase* base = item->pipeline->base;
+	if (!base || !base->manifest) return false;
+
+	const HashManifestEntry* entry = hash_manifest_find(base->manifest, item->line->fields[3]);
+	if (!entry || (entry->entryNo >= base->numPictures)) return false;
+	const Ipe16PictureEntryHeader* peh = &base->pehs[entry->entryNo];
+	if ((strncmp(peh->name, item->szName, IPE16_NAME_SIZE) != 0) || (peh->paletteType != item->paletteType)) return false;
+	if ((peh->size < pictureHeaderSize) || ((uint64_t)peh->offset+peh->size > base->fileSize)) return false;
+
+	// The same checksum as the unpacker computes: the pixels, seeded with the attached palette
+	const uint64_t seed = (item->paletteType == IPE16_PALETTETYPE_ATTACHED) ? checksum_xxh64(bitmap->colorTable, sizeof(*bitmap->colorTable), 0) : 0;
+	if (checksum_xxh64(bitmap->bmpData, bitmap->bmpDataSize, seed) != entry->checksum) return false;
+
+	unsigned char* stored = (unsigned char*)malloc(peh->size);
+	if (!stored) return false;
+	pthread_mutex_lock(&base->fileMutex);
+	const bool bRead = file_seek64(base->fibArt, peh->offset) && (fread(stored, peh->size, 1, base->fibArt) == 1);
+	pthread_mutex_unlock(&base->fileMutex);
+
+	// The compression type is the first field of the picture header, and the dimensions are the last ones.
+	// The other fields (the offsets of PiP) are taken from the index, because they are not part of the picture data.
+	const unsigned char* newHeader = (const unsigned char*)pictureHeader;
+	const size_t dimensionsSize = 2*sizeof(uint16_t);
+	if (!bRead || (stored[0] != newHeader[0]) ||
+		(memcmp(stored+pictureHeaderSize-dimensionsSize, newHeader+pictureHeaderSize-dimensionsSize, dimensionsSize) != 0)) {
+		free(stored);
+		return false;
+	}
+
+	item->blob = new_art_writer_memory(item->szName, peh->size);
+	if (!item->blob) {
+		free(stored);
+		return false;
+	}
+	art_writer_write(item->blob, pictureHeader, pictureHeaderSize);
+	art_writer_write(item->blob, stored+pictureHeaderSize, peh->size-pictureHeaderSize);
+	free(stored);
+	item->bReused = true;
+	return true;
+}
+
+static void ipe16_pack_job(void* arg, int workerId) {
+	Ipe16PackItem* item = (Ipe16PackItem*)arg;
+	Ipe16PackPipeline* pipeline = item->pipeline;
+
+	// Neither the line nor the bitmap changed since the last run (--watch), so the line was already checked
+	if (pipeline->cache) item->blob = pack_cache_get(pipeline->cache, item->line, NULL);
+	if (item->blob) {
+		strcpy(item->szName, item->line->fields[2]);
+		item->paletteType = *item->line->fields[0];
+		item->bCached = true;
+		item->bOK = true;
+		if (pipeline->bDedup) item->blobHash = checksum_xxh64(art_writer_memory_data(item->blob), art_writer_tell(item->blob), 0);
+		return;
+	}
+
+	// Every slot has its own encoder, because the hash table of the encoder is modified while a picture is compressed
+	if (!pipeline->encoders[workerId]) pipeline->encoders[workerId] = new_ipe16lzw_encoder();
+	if (!pipeline->encoders[workerId]) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for the LZW encoder\n");
+		item->bOK = false;
+		return;
+	}
+
+	item->bOK = pipeline->prepare(item, pipeline->encoders[workerId]);
+	if (item->bOK && pipeline->bDedup) item->blobHash = checksum_xxh64(art_writer_memory_data(item->blob), art_writer_tell(item->blob), 0);
+}
+
+bool ipe16_pack_pictures(const IpePackInput* input, const IpePackIndex* index, ArtWriter* output, ThreadPool* pool, Ipe16PackPrepareFunc prepare, Ipe16PictureEntryHeader* peh, const IpePackOptions* options) {
+	const int cItems = index->numLines;
+	const int numSlots = pool ? thread_pool_num_slots(pool) : 1;
+
+	Ipe16PackBase* base = NULL;
+	if (options->szBaseArtFile) {
+		base = new_ipe16_pack_base(options->szBaseArtFile, input);
+		if (!base) return false;
+	}
+
+	Ipe16PackItem* items = (Ipe16PackItem*)calloc(cItems+1, sizeof(Ipe16PackItem));
+	Ipe16LZWEncoder** encoders = (Ipe16LZWEncoder**)calloc(numSlots, sizeof(Ipe16LZWEncoder*));
+	BlobDedup* dedup = options->bDedup ? new_blob_dedup() : NULL;
+	if (!items || !encoders || (options->bDedup && !dedup)) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", cItems);
+		free(items);
+		free(encoders);
+		del_blob_dedup(dedup);
+		del_ipe16_pack_base(base);
+		return false;
+	}
+
+	Ipe16PackPipeline pipeline;
+	pipeline.prepare = prepare;
+	pipeline.options = options;
+	pipeline.encoders = encoders;
+	pipeline.base = base;
+	pipeline.bDedup = options->bDedup;
+	pipeline.bCountOnly = output->bCounter && !options->bDedup;
+	pipeline.cache = output->bCounter ? NULL : options->cache;
+
+	int curItem;
+	for (curItem=0; curItem<cItems; ++curItem) {
+		items[curItem].line = &index->lines[curItem];
+		items[curItem].input = input;
+		items[curItem].index = index;
+		items[curItem].pipeline = &pipeline;
+	}
+
+	// Only a few pictures are kept in memory: the next ones are submitted while the writer waits for the oldest one.
+	// thread_pool_wait() runs other pictures in the meantime, so the calling thread is busy, too.
+	const int window = IPE16_PACK_ITEMS_PER_SLOT*numSlots;
+	int numSubmitted = 0;
+	int numReused = 0;
+	bool bEverythingOK = true;
+	for (curItem=0; curItem<cItems; ++curItem) {
+		Ipe16PackItem* item = &items[curItem];
+		if (pool) {
+			while ((numSubmitted < cItems) && (numSubmitted < curItem+window)) {
+				thread_pool_submit(pool, &items[numSubmitted].group, ipe16_pack_job, &items[numSubmitted]);
+				numSubmitted++;
+			}
+			thread_pool_wait(pool, &item->group);
+		} else {
+			ipe16_pack_job(item, 0);
+		}
+
+		// If something fails, we discard the item (its directory entry stays empty), but continue in building the file!
+		#define FAIL_CONTINUE { memset(&peh[curItem], 0x00, sizeof(peh[curItem])); bEverythingOK=false; if (item->blob) del_art_writer(item->blob); item->blob=NULL; continue; }
+
+		if (!item->bOK) FAIL_CONTINUE;
+
+		// The offsets and sizes in the ART file have 32 bits
+		const uint64_t offset = art_writer_tell(output);
+		if (offset > UINT32_MAX) {
+			fprintf(stderr, "ERROR: %s is beyond the maximum ART file size of 4 GiB\n", item->szName);
+			FAIL_CONTINUE;
+		}
+
+		const uint64_t size = art_writer_tell(item->blob);
+		uint64_t linkedOffset;
+		const bool bLinked = dedup && blob_dedup_find(dedup, item->blobHash, art_writer_memory_data(item->blob), size, output, &linkedOffset);
+		memcpy(peh[curItem].name, item->szName, IPE16_NAME_SIZE);
+		peh[curItem].paletteType = item->paletteType;
+		peh[curItem].offset = bLinked ? linkedOffset : offset;
+		peh[curItem].size = size;
+
+		if (options->verbosity >= 1) printf("Process %s at offset %x%s\n", item->szName, peh[curItem].offset, bLinked ? " (identical to an earlier picture)" : (item->bReused || item->bCached) ? " (unchanged)" : "");
+		if (output->bCounter) printf("%s: %s %" PRIu64 " bytes%s\n", output->szFilename, item->szName, size, bLinked ? " (identical to an earlier picture, not stored again)" : "");
+		if (item->bReused) numReused++;
+
+		if (!bLinked) {
+			if (dedup) blob_dedup_add(dedup, item->blobHash, size, offset);
+			art_writer_write(output, art_writer_memory_data(item->blob), size);
+		}
+		if (pipeline.cache && !item->bCached) pack_cache_put(pipeline.cache, item->line, item->line->fields[3], art_writer_memory_data(item->blob), size, 0);
+		del_art_writer(item->blob);
+		item->blob = NULL;
+	}
+
+	int i;
+	for (i=0; i<numSlots; ++i) {
+		if (encoders[i]) del_ipe16lzw_encoder(encoders[i]);
+	}
+	free(encoders);
+	free(items);
+
+	if (base) {
+		if (options->verbosity >= 1) printf("%d of %d pictures were copied from %s\n", numReused, cItems, base->szFilename);
+		del_ipe16_pack_base(base);
+	}
+	if (dedup) {
+		fprintf(stdout, "%s: %d pictures were identical to an earlier picture and not stored again (%" PRIu64 " bytes saved)\n", output->szFilename, dedup->numLinked, dedup->bytesSaved);
+		del_blob_dedup(dedup);
+	}
+	return bEverythingOK;
+}
+
+bool ipe16_pack_check_line(Ipe16PackItem* item, const char chCompressionLZW, const char chCompressionNone) {
+	const IpePackIndexLine* line = item->line;
+
+	if (line->numFields < 4) {
+		fprintf(stderr, "ERROR: Line %d of %s has too few arguments\n", line->lineNo, item->index->szFilename);
+		return false;
+	}
+	const char* szPaletteType     = line->fields[0];
+	const char* szCompressionType = line->fields[1];
+	const char* szName            = line->fields[2];
+
+	if (strlen(szPaletteType) != 1) {
+		fprintf(stderr, "ERROR: Palette type (argument 1) at line %d is not valid (must be 1 char)\n", line->lineNo);
+		return false;
+	}
+	const char chPaletteType = *szPaletteType;
+
+	if ((chPaletteType != IPE16_PALETTETYPE_ATTACHED) && (chPaletteType != IPE16_PALETTETYPE_PARENT)) {
+		fprintf(stderr, "ERROR: Unknown palette type '%c' at line %d\n", chPaletteType, line->lineNo);
+		return false;
+	}
+
+	if (strlen(szCompressionType) != 1) {
+		fprintf(stderr, "ERROR: Compression type (argument 2) at line %d is not valid (must be 1 char)\n", line->lineNo);
+		return false;
+	}
+	const char chCompressionType = *szCompressionType;
+
+	// Checked before the bitmap is read, so that no work is wasted
+	if ((chCompressionType != chCompressionLZW) && (chCompressionType != chCompressionNone)) {
+		fprintf(stderr, "Unknown compression type '%c' at line %d\n", chCompressionType, line->lineNo);
+		return false;
+	}
+
+	if (strlen(szName) > IPE16_NAME_SIZE) {
+		fprintf(stderr, "ERROR: Name %s is too long (max %d chars allowed)\n", szName, IPE16_NAME_SIZE);
+		return false;
+	}
+
+	strcpy(item->szName, szName);
+	item->paletteType = chPaletteType;
+	return true;
+}
+
+bool ipe16_pack_import_bitmap(Ipe16PackItem* item, Ipe16BmpImportData* result) {
+	const char* szFilename = item->line->fields[3];
+
+	BmpView view;
+	if (!ipe_pack_input_map_bitmap(item->input, szFilename, &view)) {
+		fprintf(stderr, "Error at %s: %s\n", szFilename, view.error);
+		bmp_view_close(&view);
+		return false;
+	}
+
+	memset(result, 0x00, sizeof(*result));
+	if (!ipe16_bmp_import(&view, result)) {
+		fprintf(stderr, "Error at %s: %s\n", szFilename, result->error);
+		ipe16_free_bmpimport_result(result);
+		return false;
+	}
+	// The reduced colors only exist in the attached palette
+	if (result->bTruecolor && (item->paletteType != IPE16_PALETTETYPE_ATTACHED)) {
+		fprintf(stderr, "Error at %s: A 24 or 32 bit bitmap needs an attached palette (palette type %c)\n", szFilename, IPE16_PALETTETYPE_ATTACHED);
+		ipe16_free_bmpimport_result(result);
+		return false;
+	}
+	return true;
+}
+
+bool ipe16_pack_write_blob(Ipe16PackItem* item, Ipe16LZWEncoder* encoder, const void* pictureHeader, const size_t pictureHeaderSize, const Ipe16BmpImportData* bitmap, const bool bCompress) {
+	if (ipe16_pack_reuse_picture(item, pictureHeader, pictureHeaderSize, bitmap)) return item->blob->bOK;
+
+	const bool colorTableExisting = (item->paletteType == IPE16_PALETTETYPE_ATTACHED);
+	const size_t colorTableSize = colorTableExisting ? sizeof(*bitmap->colorTable) : 0;
+
+	// Mostly, the compressed data is smaller than the uncompressed data, so the buffer does not need to grow
+	if (item->pipeline->bCountOnly) {
+		item->blob = new_art_writer_counter(item->szName);
+	} else {
+		item->blob = new_art_writer_memory(item->szName, pictureHeaderSize + bitmap->bmpDataSize + colorTableSize);
+	}
+	if (!item->blob) return false;
+
+	art_writer_write(item->blob, pictureHeader, pictureHeaderSize);
+	if (bCompress && item->blob->bCounter) {
+		art_writer_count(item->blob, ipe16lzw_encoded_size(encoder, bitmap->bmpData, bitmap->bmpDataSize));
+	} else if (bCompress) {
+		ipe16lzw_encode(item->blob, encoder, bitmap->bmpData, bitmap->bmpDataSize);
+	} else {
+		art_writer_write(item->blob, bitmap->bmpData, bitmap->bmpDataSize);
+	}
+	if (colorTableExisting) {
+		art_writer_write(item->blob, bitmap->colorTable, colorTableSize);
+	}
+
+	return item->blob->bOK;
+}
+
+bool ipe16_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const size_t pictureHeaderSize, const char chCompressionLZW, const IpePackOptions* options) {
+	if (strlen(szName) > IPE16_NAME_SIZE) {
+		fprintf(stderr, "ERROR: Name %s is too long (max %d chars allowed)\n", szName, IPE16_NAME_SIZE);
+		return false;
+	}
+
+	FILE* fibArt = fopen(szArtFile, "r+b");
+	if (!fibArt) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szArtFile);
+		return false;
+	}
+	Ipe16FileHeader bfh;
+	Ipe16PictureEntryHeader* pehs;
+	if (!ipe16_read_directory(fibArt, szArtFile, &bfh, &pehs)) {
+		fclose(fibArt);
+		return false;
+	}
+	const int numPictures = bfh.numHeaderEntries-1;
+	const uint64_t fileSize = bfh.totalFileSize;
+
+	#define REPLACE_FAIL_RETURN { free(pehs); fclose(fibArt); return false; }
+
+	// If a name exists more than once, the first one is replaced
+	int iPicNo;
+	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
+		if ((pehs[iPicNo].size > 0) && (strncmp(pehs[iPicNo].name, szName, IPE16_NAME_SIZE) == 0)) break;
+	}
+	if (iPicNo == numPictures) {
+		fprintf(stderr, "ERROR: %s does not contain a picture %s\n", szArtFile, szName);
+		REPLACE_FAIL_RETURN;
+	}
+	Ipe16PictureEntryHeader* peh = &pehs[iPicNo];
+
+	// The compression type and the other fields of the picture header (e.g. the PiP offsets) are kept, only the dimensions change
+	unsigned char pictureHeader[IPE16_PICTURE_HEADER_MAX_SIZE];
+	if ((pictureHeaderSize > sizeof(pictureHeader)) || (peh->size < pictureHeaderSize) || ((uint64_t)peh->offset+peh->size > fileSize) ||
+		!file_seek64(fibArt, peh->offset) || (fread(pictureHeader, pictureHeaderSize, 1, fibArt) != 1)) {
+		fprintf(stderr, "ERROR: Cannot read the picture header of %s\n", szName);
+		REPLACE_FAIL_RETURN;
+	}
+
+	BmpView view;
+	if (!bmp_view_open_file(&view, szBitmapFile)) {
+		fprintf(stderr, "Error at %s: %s\n", szBitmapFile, view.error);
+		bmp_view_close(&view);
+		REPLACE_FAIL_RETURN;
+	}
+	Ipe16BmpImportData result;
+	memset(&result, 0x00, sizeof(result));
+	if (!ipe16_bmp_import(&view, &result)) {
+		fprintf(stderr, "Error at %s: %s\n", szBitmapFile, result.error);
+		ipe16_free_bmpimport_result(&result);
+		REPLACE_FAIL_RETURN;
+	}
+	if (result.bTruecolor && (peh->paletteType != IPE16_PALETTETYPE_ATTACHED)) {
+		fprintf(stderr, "Error at %s: A 24 or 32 bit bitmap needs an attached palette (palette type %c)\n", szBitmapFile, IPE16_PALETTETYPE_ATTACHED);
+		ipe16_free_bmpimport_result(&result);
+		REPLACE_FAIL_RETURN;
+	}
+	uint16_t dimensions[2] = { result.width, result.height };
+	memcpy(pictureHeader+pictureHeaderSize-sizeof(dimensions), dimensions, sizeof(dimensions));
+
+	// The picture is written like one item of the pipeline, without threads and without --base
+	Ipe16PackPipeline pipeline = {0};
+	Ipe16PackItem item = {0};
+	item.pipeline = &pipeline;
+	strncpy(item.szName, szName, IPE16_NAME_SIZE);
+	item.paletteType = peh->paletteType;
+	Ipe16LZWEncoder* encoder = new_ipe16lzw_encoder();
+	const bool bWritten = encoder && ipe16_pack_write_blob(&item, encoder, pictureHeader, pictureHeaderSize, &result, pictureHeader[0] == chCompressionLZW);
+	if (encoder) del_ipe16lzw_encoder(encoder);
+	ipe16_free_bmpimport_result(&result);
+	if (!bWritten) {
+		fprintf(stderr, "ERROR: Cannot compress %s\n", szBitmapFile);
+		if (item.blob) del_art_writer(item.blob);
+		REPLACE_FAIL_RETURN;
+	}
+	const uint64_t newSize = art_writer_tell(item.blob);
+
+	// Pictures which were linked to the same data (e.g. by --dedup) keep the old data
+	bool bShared = false;
+	int i;
+	for (i=0; i<numPictures; ++i) {
+		if ((i == iPicNo) || (pehs[i].size == 0)) continue;
+		if ((pehs[i].offset < peh->offset+peh->size) && (peh->offset < (uint64_t)pehs[i].offset+pehs[i].size)) bShared = true;
+	}
+	const uint64_t newOffset = ipe_pack_replace_offset(peh->offset, peh->size, newSize, fileSize, bShared);
+	const uint64_t newFileSize = (newOffset+newSize > fileSize) ? newOffset+newSize : fileSize;
+	if (newFileSize > UINT32_MAX) {
+		fprintf(stderr, "ERROR: The ART file exceeds the maximum size of 4 GiB\n");
+		del_art_writer(item.blob);
+		REPLACE_FAIL_RETURN;
+	}
+	if (options->verbosity >= 1) printf("Replace %s at offset %x by %s at offset %x\n", szName, peh->offset, szBitmapFile, (uint32_t)newOffset);
+
+	// The data is written before the directory entry, so that the entry never points to incomplete data
+	bool bOK = ipe_pack_write_at(fibArt, szArtFile, newOffset, art_writer_memory_data(item.blob), newSize);
+	del_art_writer(item.blob);
+	peh->offset = newOffset;
+	peh->size = newSize;
+	if (bOK) bOK = ipe_pack_write_at(fibArt, szArtFile, sizeof(Ipe16FileHeader)+(uint64_t)iPicNo*sizeof(Ipe16PictureEntryHeader), peh, sizeof(*peh));
+	if (bOK && (newFileSize != fileSize)) {
+		bfh.totalFileSize = newFileSize;
+		bOK = ipe_pack_write_at(fibArt, szArtFile, offsetof(Ipe16FileHeader, totalFileSize), &bfh.totalFileSize, sizeof(bfh.totalFileSize));
+	}
+	if ((fclose(fibArt) != 0) && bOK) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", szArtFile);
+		bOK = false;
+	}
+	free(pehs);
+	return bOK;
+}
+
+// The directories of all input files are read. The data is copied, and the new directory is written.
+// The file header of the first input file is the template of the new one.
+static bool ipe16_merge_directories(FILE** fibInputs, const char** szInputs, Ipe16PictureEntryHeader** inputPehs, const int* numInputPictures, const int numInputs, const Ipe16FileHeader* firstHeader, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options) {
+	int numEntries = 0;
+	int i, j;
+	for (i=0; i<numInputs; ++i) numEntries += numInputPictures[i];
+	IpeMergeEntry* entries = (IpeMergeEntry*)calloc(numEntries+1, sizeof(IpeMergeEntry));
+	if (!entries) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", numEntries);
+		return false;
+	}
+	int curEntry = 0;
+	for (i=0; i<numInputs; ++i) {
+		for (j=0; j<numInputPictures[i]; ++j) {
+			IpeMergeEntry* entry = &entries[curEntry++];
+			entry->input = i;
+			entry->entryNo = j;
+			memcpy(entry->szName, inputPehs[i][j].name, IPE16_NAME_SIZE);
+			entry->offset = inputPehs[i][j].offset;
+			entry->size = inputPehs[i][j].size;
+		}
+	}
+
+	const int numSelected = ipe_merge_select(entries, numEntries, merge);
+	if (numSelected < 0) {
+		free(entries);
+		return false;
+	}
+
+	// The directory is kept in memory as it is laid out in the file: the file header, followed by the picture entries
+	const size_t directorySize = sizeof(Ipe16FileHeader) + (size_t)numSelected*sizeof(Ipe16PictureEntryHeader);
+	unsigned char* directory = (unsigned char*)calloc(1, directorySize);
+	if (!directory) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the directory of %d pictures\n", numSelected);
+		free(entries);
+		return false;
+	}
+	art_writer_write(output, directory, directorySize);
+
+	bool bOK = ipe_merge_copy(fibInputs, szInputs, entries, numEntries, output, options);
+
+	Ipe16FileHeader bfh = *firstHeader;
+	bfh.numHeaderEntries = numSelected+1;
+	bfh.totalFileSize = art_writer_tell(output);
+	memcpy(directory, &bfh, sizeof(bfh));
+
+	Ipe16PictureEntryHeader* peh = (Ipe16PictureEntryHeader*)(directory + sizeof(Ipe16FileHeader));
+	for (i=0; i<numEntries; ++i) {
+		if (!entries[i].bSelected) continue;
+		*peh = inputPehs[entries[i].input][entries[i].entryNo];
+		peh->offset = entries[i].newOffset;
+		peh++;
+	}
+	if (options->verbosity >= 1) printf("%d of %d pictures were copied into %s\n", numSelected, numEntries, output->szFilename);
+	if (!art_writer_patch(output, 0, directory, directorySize)) bOK = false;
+
+	free(directory);
+	free(entries);
+	return bOK;
+}
+
+bool ipe16_merge_art(const char** szInputs, const int numInputs, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options) {
+	FILE** fibInputs = (FILE**)calloc(numInputs+1, sizeof(FILE*));
+	Ipe16PictureEntryHeader** inputPehs = (Ipe16PictureEntryHeader**)calloc(numInputs+1, sizeof(Ipe16PictureEntryHeader*));
+	int* numInputPictures = (int*)calloc(numInputs+1, sizeof(int));
+	bool bOK = fibInputs && inputPehs && numInputPictures;
+	if (!bOK) fprintf(stderr, "FATAL: Cannot allocate memory for %d ART files\n", numInputs);
+
+	// All directories are read first, because the size of the new directory must be known before the data is copied
+	Ipe16FileHeader firstHeader;
+	int i, j;
+	for (i=0; (i<numInputs) && bOK; ++i) {
+		fibInputs[i] = fopen(szInputs[i], "rb");
+		if (!fibInputs[i]) {
+			fprintf(stderr, "FATAL: Cannot open %s\n", szInputs[i]);
+			bOK = false;
+			break;
+		}
+		Ipe16FileHeader bfh;
+		if (!ipe16_read_directory(fibInputs[i], szInputs[i], &bfh, &inputPehs[i])) {
+			bOK = false;
+			break;
+		}
+		if (i == 0) firstHeader = bfh;
+		numInputPictures[i] = bfh.numHeaderEntries-1;
+		for (j=0; j<numInputPictures[i]; ++j) {
+			const Ipe16PictureEntryHeader* peh = &inputPehs[i][j];
+			if ((uint64_t)peh->offset+peh->size > bfh.totalFileSize) {
+				fprintf(stderr, "ERROR: The data of %.*s is beyond the end of %s\n", IPE16_NAME_SIZE, peh->name, szInputs[i]);
+				bOK = false;
+			}
+		}
+		// Mostly, the pictures are stored in the order of the directory
+		file_advise_sequential(fibInputs[i]);
+	}
+	if (bOK) bOK = ipe16_merge_directories(fibInputs, szInputs, inputPehs, numInputPictures, numInputs, &firstHeader, output, merge, options);
+
+	for (i=0; i<numInputs; ++i) {
+		if (fibInputs && fibInputs[i]) fclose(fibInputs[i]);
+		if (inputPehs) free(inputPehs[i]);
+	}
+	free(fibInputs);
+	free(inputPehs);
+	free(numInputPictures);
+	return bOK;
+}
@@ -0,0 +1,91 @@
+/**
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Functionality which is shared between the IPE16 packers (BA and PiP)
+ * The pictures are read and compressed in parallel into memory, and written in the order of index.txt
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__ipe_artfile_packer_ipe16_common
+#define __inc__ipe_artfile_packer_ipe16_common
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ipe_artfile_packer_common.h"
+#include "ipe16_artfile.h"
+#include "ipe16_lzw_encoder.h"
+#include "ipe16_bmpimport.h"
+#include "art_writer.h"
+#include "thread_pool.h"
+#include "hash_manifest.h"
+#include "blob_dedup.h"
+#include "pack_cache.h"
+
+// Size of the largest picture header (PiP)
+#define IPE16_PICTURE_HEADER_MAX_SIZE sizeof(PipPictureHeader)
+
+// One line of index.txt on its way through the pipeline
+typedef struct tagIpe16PackItem {
+	const IpePackIndexLine* line;
+	const IpePackInput* input;
+	const IpePackIndex* index;
+	struct tagIpe16PackPipeline* pipeline;
+	ThreadPoolGroup group;            // the job of this item, so that the writer can wait for exactly this item
+	bool bOK;                         // false if the item is discarded (its directory entry stays empty)
+	char szName[IPE16_NAME_SIZE+1];
+	char paletteType;
+	ArtWriter* blob;                  // picture header, picture data and optional palette, as they are written to the ART file (only counted if bCountOnly)
+	bool bReused;                     // the picture data was copied from the old ART file (--base)
+	bool bCached;                     // the blob was taken from the cache of the previous run (--watch)
+	uint64_t blobHash;                // of the blob, only with --dedup
+} Ipe16PackItem;
+
+// Reads the bitmap of the item and writes the picture into item->blob. Runs in a worker thread.
+// Returns false (and prints an error) if the item has to be discarded.
+typedef bool (*Ipe16PackPrepareFunc)(Ipe16PackItem* item, Ipe16LZWEncoder* encoder);
+
+// The old ART file of --base. Its stored pictures are reused if the hash manifest of the input shows that they did not change.
+typedef struct tagIpe16PackBase {
+	const char* szFilename;
+	FILE* fibArt;
+	pthread_mutex_t fileMutex;
+	uint64_t fileSize;
+	int numPictures;
+	Ipe16PictureEntryHeader* pehs;
+	HashManifest* manifest;           // NULL if the input has no hash manifest of this ART file. Then nothing is reused.
+} Ipe16PackBase;
+
+typedef struct tagIpe16PackPipeline {
+	Ipe16PackPrepareFunc prepare;
+	const IpePackOptions* options;
+	Ipe16LZWEncoder** encoders;       // one per thread pool slot, created when needed
+	Ipe16PackBase* base;              // NULL if there is no --base
+	bool bDedup;                      // the blobs are hashed in the worker threads (--dedup)
+	bool bCountOnly;                  // simulation mode: the blobs are counters, because only their size is needed (not with --dedup, which compares the data)
+	PackCache* cache;                 // NULL if there is no --watch
+} Ipe16PackPipeline;
+
+// Packs all pictures of the index behind the directory, which must already be reserved in the output.
+// The entries of the directory (peh) are filled. pool may be NULL, then all pictures are processed in the calling thread.
+bool ipe16_pack_pictures(const IpePackInput* input, const IpePackIndex* index, ArtWriter* output, ThreadPool* pool, Ipe16PackPrepareFunc prepare, Ipe16PictureEntryHeader* peh, const IpePackOptions* options);
+
+// Used by the prepare functions. They print an error and return false if the item has to be discarded.
+// Checks the fields which are equal for all IPE16 games, and sets the name and palette type of the item
+bool ipe16_pack_check_line(Ipe16PackItem* item, const char chCompressionLZW, const char chCompressionNone);
+// On success, result must be freed with ipe16_free_bmpimport_result()
+bool ipe16_pack_import_bitmap(Ipe16PackItem* item, Ipe16BmpImportData* result);
+// Writes the picture header, the (compressed) picture data and the palette (if attached) into item->blob.
+// The width and height must be the last fields of the picture header.
+bool ipe16_pack_write_blob(Ipe16PackItem* item, Ipe16LZWEncoder* encoder, const void* pictureHeader, const size_t pictureHeaderSize, const Ipe16BmpImportData* bitmap, const bool bCompress);
+
+// Replaces the picture szName of an existing ART file by a bitmap (--replace). Only the new data, its directory entry and the file size are written.
+// The palette type, the compression type and the other fields of the picture header (e.g. the PiP offsets) are kept.
+bool ipe16_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const size_t pictureHeaderSize, const char chCompressionLZW, const IpePackOptions* options);
+
+// Copies the stored pictures of ART files verbatim into a new ART file (--merge), and writes a new directory.
+// Also used to remove the dead space, which replaced pictures left behind (--compact): then there is only one input file, and everything is copied.
+bool ipe16_merge_art(const char** szInputs, const int numInputs, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options);
+
+#endif // #ifndef __inc__ipe_artfile_packer_ipe16_common
@@ -12,6 +12,11 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-bool pip_pack_art(const char* szSrcFolder, FILE* fobArt, const int verbosity);
+#include "ipe_artfile_packer_common.h"
+#include "art_writer.h"
+#include "thread_pool.h"
+
+bool pip_pack_art(const IpePackInput* input, ArtWriter* output, ThreadPool* pool, const IpePackOptions* options);
+bool pip_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const IpePackOptions* options);
 
 #endif // #ifndef __inc__ipe_artfile_packer_ipe16_pip
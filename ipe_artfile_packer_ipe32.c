@@ -10,35 +10,195 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <inttypes.h>
 
 #include "ipe_artfile_packer_ipe32.h"
 #include "ipe32_artfile.h"
 #include "ipe32_bmpimport.h"
 #include "ipe32_lzw_encoder.h"
+#include "utils.h"
+#include "checksum.h"
+#include "blob_dedup.h"
+#include "pack_cache.h"
+#include "hash_manifest.h"
 
-#define MAX_FILE 256
+// Writes the bitmap data in chunks. Each chunk is compressed, unless the compressed data would not be smaller.
+// The chunks are read directly from the view of the bitmap file (everything behind the bitmap file header).
+// If the output is a counter (simulation mode), the chunks are not compressed into memory, only their size is computed.
+static void ipe32_write_chunks(ArtWriter* output, Ipe32LZWEncoder* encoder, const unsigned char* data, const size_t dataSize, const char* szFilename, const IpePackOptions* options) {
+	int chunkNo = 0;
+	unsigned char compressedChunk[0x3FFE];
+	size_t pos = 0;
+	while (pos < dataSize) {
+		if (options->verbosity >= 2) fprintf(stdout, "Bitmap %s: Write chunk %d.\n", szFilename, chunkNo);
 
-bool ipe32_pack_art(const char* szSrcFolder, FILE* fobArt, const int verbosity) {
-	bool bEverythingOK = true;
+		const unsigned char* uncompressedChunk = data+pos;
+		int uncompressedSize = (dataSize-pos > sizeof(compressedChunk)) ? sizeof(compressedChunk) : dataSize-pos;
+		pos += uncompressedSize;
+
+		int compressedSize = ipe32lzw_encode(encoder, output->bCounter ? NULL : compressedChunk, sizeof(compressedChunk), uncompressedChunk, uncompressedSize);
+
+		uint16_t len;
+
+		if ((compressedSize == -1) || (compressedSize >= uncompressedSize)) {
+			// Choose uncompressed chunk
+			len = 0x8000 | uncompressedSize;
+			art_writer_write(output, &len, sizeof(len));
+			art_writer_write(output, uncompressedChunk, uncompressedSize);
+		} else {
+			// Choose compressed chunk
+			len = compressedSize;
+			art_writer_write(output, &len, sizeof(len));
+			art_writer_write(output, compressedChunk, compressedSize);
+		}
+
+		chunkNo++;
+	}
+}
 
-	char szIndexFilename[MAX_FILE];
-	sprintf(szIndexFilename, "%s/index.txt", szSrcFolder);
-	FILE* fitIndex = fopen(szIndexFilename, "rt");
-	if (!fitIndex) {
-		fprintf(stderr, "Cannot open %s\n", szIndexFilename);
+// Reads the file header and the directory of an existing ART file. *pehs must be freed.
+// Returns false (and prints an error) if it is not a valid ART file.
+static bool ipe32_read_directory(FILE* fibArt, const char* szArtFile, Ipe32FileHeader* efh, Ipe32PictureEntryHeader** pehs) {
+	*pehs = NULL;
+	const uint64_t fileSize = file_size(fibArt);
+	if (!file_seek64(fibArt, 0) ||
+		(fread(efh, sizeof(*efh), 1, fibArt) != 1) ||
+		(memcmp(efh->magic, IPE32_MAGIC_ART, IPE32_NAME_SIZE) != 0) ||
+		(efh->reserved != 0) ||
+		(efh->totalHeaderSize < sizeof(*efh)) ||
+		(efh->totalHeaderSize > fileSize)) {
+		fprintf(stderr, "FATAL: %s is not a valid ART file\n", szArtFile);
+		return false;
+	}
+	const int numPictures = efh->totalHeaderSize/sizeof(*efh) - 1;
+	*pehs = (Ipe32PictureEntryHeader*)malloc((numPictures+1)*sizeof(Ipe32PictureEntryHeader));
+	if (!*pehs || (fread(*pehs, sizeof(Ipe32PictureEntryHeader), numPictures, fibArt) != numPictures)) {
+		fprintf(stderr, "FATAL: Cannot read the directory of %s\n", szArtFile);
+		free(*pehs);
+		*pehs = NULL;
+		return false;
+	}
+	return true;
+}
+
+// The directory does not contain the stored size of a picture, so the chunk lengths are followed until the uncompressed size is reached.
+// Returns false (and prints an error) if a chunk is beyond the end of the file.
+static bool ipe32_measure_stored_size(FILE* fibArt, const char* szArtFile, const Ipe32PictureEntryHeader* peh, const uint64_t fileSize, uint64_t* storedSize) {
+	uint64_t pos = peh->offset;
+	uint32_t remaining = peh->uncompressedSize;
+	while (remaining > 0) {
+		uint16_t len;
+		if ((pos+sizeof(len) > fileSize) || !file_seek64(fibArt, pos) || (fread(&len, sizeof(len), 1, fibArt) != 1)) break;
+		pos += sizeof(len);
+		if (len < 0x8000) {
+			// Each chunk (except the last one) has 0x3FFE bytes of uncompressed data
+			remaining -= (remaining > 0x3FFE) ? 0x3FFE : remaining;
+		} else {
+			len &= 0x7FFF;
+			if (len > remaining) break;
+			remaining -= len;
+		}
+		pos += len;
+	}
+	if ((remaining > 0) || (pos > fileSize)) {
+		fprintf(stderr, "ERROR: The data of %.*s is beyond the end of %s\n", IPE32_NAME_SIZE, peh->name, szArtFile);
 		return false;
 	}
+	*storedSize = pos-peh->offset;
+	return true;
+}
+
+// The old ART file (--base)
+typedef struct tagIpe32PackBase {
+	const char* szFilename;
+	FILE* fibArt;
+	uint64_t fileSize;
+	int numPictures;
+	Ipe32PictureEntryHeader* pehs;
+	HashManifest* manifest;           // NULL if the input has no hash manifest of this ART file. Then nothing is reused.
+} Ipe32PackBase;
+
+static void del_ipe32_pack_base(Ipe32PackBase* base) {
+	if (!base) return;
+	if (base->fibArt) fclose(base->fibArt);
+	free(base->pehs);
+	del_hash_manifest(base->manifest);
+	free(base);
+}
 
-	#define MAX_LINE 1024
-	char line[MAX_LINE];
-	int cItems = 0;
-	while (fgets(line, sizeof(line), fitIndex)) {
-		if (strlen(line) == 0) continue;
-		++cItems;
+// Returns NULL (and prints an error) if the old ART file cannot be read.
+// If the hash manifest of the input is missing or belongs to another ART file, nothing will be reused, but packing continues.
+static Ipe32PackBase* new_ipe32_pack_base(const char* szArtFile, const IpePackInput* input) {
+	Ipe32PackBase* base = (Ipe32PackBase*)calloc(1, sizeof(Ipe32PackBase));
+	if (!base) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %s\n", szArtFile);
+		return NULL;
 	}
-	if (verbosity >= 1) printf("%s contains %d entries\n", szIndexFilename, cItems); // TODO: don't print double /
+	base->szFilename = szArtFile;
+
+	base->fibArt = fopen(szArtFile, "rb");
+	if (!base->fibArt) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szArtFile);
+		del_ipe32_pack_base(base);
+		return NULL;
+	}
+	base->fileSize = file_size(base->fibArt);
+
+	Ipe32FileHeader efh;
+	if (!ipe32_read_directory(base->fibArt, szArtFile, &efh, &base->pehs)) {
+		del_ipe32_pack_base(base);
+		return NULL;
+	}
+	base->numPictures = efh.totalHeaderSize/sizeof(efh) - 1;
+
+	// The unpacker recorded the size and the checksum of the directory of the ART file which it extracted
+	ChecksumXxh64State directoryChecksum;
+	checksum_xxh64_reset(&directoryChecksum, 0);
+	checksum_xxh64_update(&directoryChecksum, &efh, sizeof(efh));
+	checksum_xxh64_update(&directoryChecksum, base->pehs, base->numPictures*sizeof(Ipe32PictureEntryHeader));
+
+	base->manifest = ipe_pack_read_base_manifest(input, szArtFile, base->fileSize, checksum_xxh64_digest(&directoryChecksum));
+	return base;
+}
+
+// Copies the stored chunks of the picture from the old ART file (--base), if the hash manifest shows that the bitmap did not change.
+// Returns NULL if the picture has to be compressed.
+static ArtWriter* ipe32_pack_reuse_picture(Ipe32PackBase* base, const char* szName, const char* szFilename, const Ipe32BmpImportData* bitmap) {
+	if (!base->manifest) return NULL;
+
+	const HashManifestEntry* entry = hash_manifest_find(base->manifest, szFilename);
+	if (!entry || (entry->entryNo >= base->numPictures)) return NULL;
+	const Ipe32PictureEntryHeader* peh = &base->pehs[entry->entryNo];
+	if ((strncmp(peh->name, szName, IPE32_NAME_SIZE) != 0) || (peh->uncompressedSize != bitmap->dataSize)) return NULL;
+
+	// The same checksum as the unpacker computes: the bitmap without its file header, as it is stored
+	if (checksum_xxh64(bitmap->data, bitmap->dataSize, 0) != entry->checksum) return NULL;
+
+	uint64_t storedSize;
+	if (!ipe32_measure_stored_size(base->fibArt, base->szFilename, peh, base->fileSize, &storedSize)) return NULL;
+	unsigned char* stored = (unsigned char*)malloc(storedSize > 0 ? storedSize : 1);
+	if (!stored) return NULL;
+	if (!file_seek64(base->fibArt, peh->offset) || ((storedSize > 0) && (fread(stored, storedSize, 1, base->fibArt) != 1))) {
+		free(stored);
+		return NULL;
+	}
+
+	ArtWriter* blob = new_art_writer_memory(szName, storedSize);
+	if (blob) art_writer_write(blob, stored, storedSize);
+	free(stored);
+	return blob;
+}
+
+bool ipe32_pack_art(const IpePackInput* input, ArtWriter* output, const IpePackOptions* options) {
+	bool bEverythingOK = true;
+
+	IpePackIndex index;
+	if (!ipe_pack_index_read(input, &index)) return false;
+	const int cItems = index.numLines;
+	if (options->verbosity >= 1) printf("%s contains %d entries\n", index.szFilename, cItems); // TODO: don't print double /
 
 	Ipe32FileHeader efh;
 	memset(&efh, 0x00, sizeof(efh));
@@ -46,98 +206,358 @@ bool ipe32_pack_art(const char* szSrcFolder, FILE* fobArt, const int verbosity)
 	efh.reserved = 0;
 	efh.totalHeaderSize = (cItems+1)*sizeof(efh);
 
-	Ipe32PictureEntryHeader peh[cItems];
-	memset(&peh, 0x00, sizeof(peh));
+	// The directory is kept in memory as it is laid out in the file: the file header, followed by the picture entries
+	const size_t directorySize = sizeof(Ipe32FileHeader) + (size_t)cItems*sizeof(Ipe32PictureEntryHeader);
+	unsigned char* directory = (unsigned char*)calloc(1, directorySize + sizeof(Ipe32PictureEntryHeader));
+	Ipe32PictureEntryHeader* peh = (Ipe32PictureEntryHeader*)(directory + sizeof(Ipe32FileHeader));
+	if (!directory) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the directory of %d pictures\n", cItems);
+		ipe_pack_index_free(&index);
+		return false;
+	}
+
+	// The space of the directory is reserved, so that the offsets of the pictures are known while they are written.
+	// It is filled after all pictures are processed.
+	art_writer_write(output, directory, directorySize);
+
+	BlobDedup* dedup = NULL;
+	if (options->bDedup) {
+		dedup = new_blob_dedup();
+		if (!dedup) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", cItems);
+			free(directory);
+			ipe_pack_index_free(&index);
+			return false;
+		}
+	}
+
+	// Not in simulation mode, because the blobs would be counters
+	PackCache* cache = output->bCounter ? NULL : options->cache;
 
-	// These headers are currently just dummies. They will be rewritten after all pictures are processed
-	fwrite(&efh, sizeof(efh), 1, fobArt);
-	fwrite(&peh, sizeof(peh), 1, fobArt);
+	Ipe32PackBase* base = NULL;
+	if (options->szBaseArtFile) {
+		base = new_ipe32_pack_base(options->szBaseArtFile, input);
+		if (!base) {
+			del_blob_dedup(dedup);
+			free(directory);
+			ipe_pack_index_free(&index);
+			return false;
+		}
+	}
+	int numReused = 0;
 
 	Ipe32LZWEncoder *encoder = new_ipe32lzw_encoder();
 	ipe32lzw_init_encoder(encoder);
-	fseek(fitIndex, 0, SEEK_SET);
-	int curItem = 0;
-	while (fgets(line, sizeof(line), fitIndex)) {
-		// If something fails, we discard the item, but continue in building the file!
-		#define FAIL_CONTINUE { memset(&peh[curItem], 0x00, sizeof(peh[curItem])); bEverythingOK=false; continue; }
-
-		const char* szDelimiters = " \t\r\n";
-		char* szName                = strtok(&line[0], szDelimiters);
-		/* char* szNumCompressedChunks = */ strtok(NULL, szDelimiters);
-		/* char* szNumRawChunks        = */ strtok(NULL, szDelimiters);
-		char* szFilename            = strtok(NULL, szDelimiters);
+	int curItem;
+	for (curItem=0; curItem<cItems; ++curItem) {
+		const IpePackIndexLine* line = &index.lines[curItem];
+		Ipe32BmpImportData result={0};
+		ArtWriter* blob = NULL;
+
+		// If something fails, we discard the item (its directory entry stays empty), but continue in building the file!
+		#define FAIL_CONTINUE { memset(&peh[curItem], 0x00, sizeof(peh[curItem])); bEverythingOK=false; ipe32_free_bmpimport_result(&result); if (blob) del_art_writer(blob); continue; }
+
+		if (line->numFields < 4) {
+			fprintf(stderr, "ERROR: Line %d of %s has too few arguments\n", line->lineNo, index.szFilename);
+			FAIL_CONTINUE;
+		}
+		const char* szName                = line->fields[0];
+		/* const char* szNumCompressedChunks = line->fields[1]; */
+		/* const char* szNumRawChunks        = line->fields[2]; */
+		const char* szFilename            = line->fields[3];
 
 		if (strlen(szName) > IPE32_NAME_SIZE) {
 			fprintf(stderr, "ERROR: Name %s is too long (max %d chars allowed)\n", szName, IPE32_NAME_SIZE);
 			FAIL_CONTINUE;
 		}
 
-		char szBitmapFilename[MAX_FILE];
-		sprintf(szBitmapFilename, "%s/%s", szSrcFolder, szFilename);
-		FILE* fibBitmap = fopen(szBitmapFilename, "rb");
-		if (!fibBitmap) {
-			fprintf(stderr, "ERROR: cannot open '%s'\n", szFilename);
-			FAIL_CONTINUE;
+		// Neither the line nor the bitmap changed since the last run (--watch), so the bitmap is not read at all
+		uint64_t dataSize = 0;
+		if (cache) blob = pack_cache_get(cache, line, &dataSize);
+		const bool bCached = (blob != NULL);
+
+		if (!bCached) {
+			BmpView view;
+			if (!ipe_pack_input_map_bitmap(input, szFilename, &view)) {
+				fprintf(stderr, "Error at %s: %s\n", szFilename, view.error);
+				bmp_view_close(&view);
+				FAIL_CONTINUE;
+			}
+
+			if (!ipe32_bmp_import(&view, &result)) {
+				fprintf(stderr, "Error at %s: %s\n", szFilename, result.error);
+				FAIL_CONTINUE;
+			}
+			dataSize = result.dataSize;
+
+			// The bitmap did not change since it was extracted from the old ART file, so its stored chunks are copied
+			if (base) blob = ipe32_pack_reuse_picture(base, szName, szFilename, &result);
 		}
+		const bool bReused = !bCached && (blob != NULL);
+		if (bReused) numReused++;
 
-		Ipe32BmpImportData result={0};
-		if (!ipe32_bmp_import(fibBitmap, &result)) { // This function moves the file pointer to the bitmap info header
-			fprintf(stderr, "Error at %s: %s\n", szFilename, result.error);
-			fclose(fibBitmap);
-			ipe32_free_bmpimport_result(&result);
+		// The offsets and sizes in the ART file have 32 bits
+		const uint64_t offset = art_writer_tell(output);
+		if (offset > UINT32_MAX) {
+			fprintf(stderr, "ERROR: %s is beyond the maximum ART file size of 4 GiB\n", szName);
 			FAIL_CONTINUE;
 		}
 
 		strcpy(peh[curItem].name, szName);
-		peh[curItem].offset = ftell(fobArt);
-		peh[curItem].uncompressedSize = result.dataSize;
-		if (verbosity >= 1) printf("Process %s at offset %x\n", szName, peh[curItem].offset);
+		peh[curItem].offset = offset;
+		peh[curItem].uncompressedSize = dataSize;
 
 		// Now write the chunks
+		uint64_t size;
+		bool bLinked = false;
+		if (!dedup && !cache && !blob) {
+			if (options->verbosity >= 1) printf("Process %s at offset %x\n", szName, peh[curItem].offset);
+			ipe32_write_chunks(output, encoder, result.data, result.dataSize, szFilename, options);
+			size = art_writer_tell(output)-offset;
+		} else {
+			// The chunks are collected in memory first, because they are not written if identical chunks were already written,
+			// and because they are kept for the next run (--watch)
+			if (!blob) {
+				blob = new_art_writer_memory(szName, result.dataSize);
+				if (!blob) FAIL_CONTINUE;
+				ipe32_write_chunks(blob, encoder, result.data, result.dataSize, szFilename, options);
+			}
+			if (cache && !bCached && blob->bOK) pack_cache_put(cache, line, szFilename, art_writer_memory_data(blob), art_writer_tell(blob), dataSize);
+			size = art_writer_tell(blob);
+			uint64_t hash = 0;
+			uint64_t linkedOffset;
+			if (dedup) {
+				hash = checksum_xxh64(art_writer_memory_data(blob), size, 0);
+				bLinked = blob_dedup_find(dedup, hash, art_writer_memory_data(blob), size, output, &linkedOffset);
+			}
+			if (bLinked) {
+				peh[curItem].offset = linkedOffset;
+			} else {
+				if (dedup) blob_dedup_add(dedup, hash, size, offset);
+				art_writer_write(output, art_writer_memory_data(blob), size);
+			}
+			if (options->verbosity >= 1) printf("Process %s at offset %x%s\n", szName, peh[curItem].offset, bLinked ? " (identical to an earlier picture)" : (bCached || bReused) ? " (unchanged)" : "");
+			del_art_writer(blob);
+		}
+		if (output->bCounter) printf("%s: %s %" PRIu64 " bytes%s\n", output->szFilename, szName, size, bLinked ? " (identical to an earlier picture, not stored again)" : "");
 
-		int chunkNo = 0;
-		unsigned char uncompressedChunk[0x3FFE];
-		unsigned char compressedChunk[0x3FFE];
-		while (1) {
-			if (verbosity >= 2) fprintf(stdout, "Bitmap %s: Write chunk %d.\n", szFilename, chunkNo);
+		// Free and continue
 
-			int uncompressedSize = fread(uncompressedChunk, 1, sizeof(uncompressedChunk), fibBitmap);
-			if (uncompressedSize == 0) break; // done
+		ipe32_free_bmpimport_result(&result);
+	}
+	ipe32lzw_free_encoder(encoder);
 
-			int compressedSize = ipe32lzw_encode(encoder, compressedChunk, sizeof(compressedChunk), uncompressedChunk, uncompressedSize);
+	if (base) {
+		if (options->verbosity >= 1) printf("%d of %d pictures were copied from %s\n", numReused, cItems, base->szFilename);
+		del_ipe32_pack_base(base);
+	}
+	if (dedup) {
+		fprintf(stdout, "%s: %d pictures were identical to an earlier picture and not stored again (%" PRIu64 " bytes saved)\n", output->szFilename, dedup->numLinked, dedup->bytesSaved);
+		del_blob_dedup(dedup);
+	}
 
-			uint16_t len;
+	memcpy(directory, &efh, sizeof(efh));
+	if (!art_writer_patch(output, 0, directory, directorySize)) bEverythingOK = false;
 
-			if ((compressedSize == -1) || (compressedSize >= uncompressedSize)) {
-				// Choose uncompressed chunk
-				len = 0x8000 | uncompressedSize;
-				fwrite(&len, sizeof(len), 1, fobArt);
-				fwrite(uncompressedChunk, uncompressedSize, 1, fobArt);
-			} else {
-				// Choose compressed chunk
-				len = compressedSize;
-				fwrite(&len, sizeof(len), 1, fobArt);
-				fwrite(compressedChunk, compressedSize, 1, fobArt);
-			}
+	free(directory);
+	ipe_pack_index_free(&index);
+	return bEverythingOK;
+}
 
-			chunkNo++;
-		}
+bool ipe32_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const IpePackOptions* options) {
+	if (strlen(szName) > IPE32_NAME_SIZE) {
+		fprintf(stderr, "ERROR: Name %s is too long (max %d chars allowed)\n", szName, IPE32_NAME_SIZE);
+		return false;
+	}
 
-		// Free and continue
+	FILE* fibArt = fopen(szArtFile, "r+b");
+	if (!fibArt) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szArtFile);
+		return false;
+	}
+	Ipe32FileHeader efh;
+	Ipe32PictureEntryHeader* pehs;
+	if (!ipe32_read_directory(fibArt, szArtFile, &efh, &pehs)) {
+		fclose(fibArt);
+		return false;
+	}
+	const int numPictures = efh.totalHeaderSize/sizeof(efh) - 1;
+	const uint64_t fileSize = file_size(fibArt);
 
-		fclose(fibBitmap);
-		ipe32_free_bmpimport_result(&result);
+	#define REPLACE_FAIL_RETURN { free(pehs); fclose(fibArt); return false; }
+
+	// In ERASER, a few names exist more than once. The first one is replaced.
+	int iPicNo;
+	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
+		if (strncmp(pehs[iPicNo].name, szName, IPE32_NAME_SIZE) == 0) break;
+	}
+	if (iPicNo == numPictures) {
+		fprintf(stderr, "ERROR: %s does not contain a picture %s\n", szArtFile, szName);
+		REPLACE_FAIL_RETURN;
+	}
+	Ipe32PictureEntryHeader* peh = &pehs[iPicNo];
+	uint64_t oldSize;
+	if (!ipe32_measure_stored_size(fibArt, szArtFile, peh, fileSize, &oldSize)) REPLACE_FAIL_RETURN;
 
-		++curItem;
+	BmpView view;
+	if (!bmp_view_open_file(&view, szBitmapFile)) {
+		fprintf(stderr, "Error at %s: %s\n", szBitmapFile, view.error);
+		bmp_view_close(&view);
+		REPLACE_FAIL_RETURN;
 	}
-	fclose(fitIndex);
+	Ipe32BmpImportData result={0};
+	if (!ipe32_bmp_import(&view, &result)) {
+		fprintf(stderr, "Error at %s: %s\n", szBitmapFile, result.error);
+		ipe32_free_bmpimport_result(&result);
+		REPLACE_FAIL_RETURN;
+	}
+	ArtWriter* blob = new_art_writer_memory(szName, result.dataSize);
+	if (!blob) {
+		ipe32_free_bmpimport_result(&result);
+		REPLACE_FAIL_RETURN;
+	}
+	Ipe32LZWEncoder *encoder = new_ipe32lzw_encoder();
+	ipe32lzw_init_encoder(encoder);
+	ipe32_write_chunks(blob, encoder, result.data, result.dataSize, szBitmapFile, options);
 	ipe32lzw_free_encoder(encoder);
+	const uint32_t uncompressedSize = result.dataSize;
+	ipe32_free_bmpimport_result(&result);
+	if (!blob->bOK) {
+		del_art_writer(blob);
+		REPLACE_FAIL_RETURN;
+	}
+	const uint64_t newSize = art_writer_tell(blob);
 
-	fseek(fobArt, 0, SEEK_SET);
-	fwrite(&efh, sizeof(efh), 1, fobArt);
-	fwrite(&peh, sizeof(peh), 1, fobArt);
+	// Other directory entries which point into the old data keep it
+	bool bShared = false;
+	int i;
+	for (i=0; i<numPictures; ++i) {
+		if ((i == iPicNo) || (pehs[i].uncompressedSize == 0)) continue;
+		if ((pehs[i].offset >= peh->offset) && (pehs[i].offset < peh->offset+oldSize)) bShared = true;
+	}
+	const uint64_t newOffset = ipe_pack_replace_offset(peh->offset, oldSize, newSize, fileSize, bShared);
+	if (newOffset+newSize > UINT32_MAX) {
+		fprintf(stderr, "ERROR: The ART file exceeds the maximum size of 4 GiB\n");
+		del_art_writer(blob);
+		REPLACE_FAIL_RETURN;
+	}
+	if (options->verbosity >= 1) printf("Replace %.*s at offset %x by %s at offset %x\n", IPE32_NAME_SIZE, peh->name, peh->offset, szBitmapFile, (uint32_t)newOffset);
 
-	fclose(fobArt);
+	// The data is written before the directory entry, so that the entry never points to incomplete data.
+	// The file header does not contain the file size.
+	bool bOK = ipe_pack_write_at(fibArt, szArtFile, newOffset, art_writer_memory_data(blob), newSize);
+	del_art_writer(blob);
+	peh->offset = newOffset;
+	peh->uncompressedSize = uncompressedSize;
+	if (bOK) bOK = ipe_pack_write_at(fibArt, szArtFile, sizeof(Ipe32FileHeader)+(uint64_t)iPicNo*sizeof(Ipe32PictureEntryHeader), peh, sizeof(*peh));
+	if ((fclose(fibArt) != 0) && bOK) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", szArtFile);
+		bOK = false;
+	}
+	free(pehs);
+	return bOK;
+}
 
-	return bEverythingOK;
+// The directories of all input files are read. The data is copied, and the new directory is written.
+static bool ipe32_merge_directories(FILE** fibInputs, const char** szInputs, Ipe32PictureEntryHeader** inputPehs, const int* numInputPictures, const int numInputs, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options) {
+	int numEntries = 0;
+	int i, j;
+	for (i=0; i<numInputs; ++i) numEntries += numInputPictures[i];
+	IpeMergeEntry* entries = (IpeMergeEntry*)calloc(numEntries+1, sizeof(IpeMergeEntry));
+	if (!entries) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for %d pictures\n", numEntries);
+		return false;
+	}
+
+	// The directory does not contain the stored sizes, so the chunks are followed
+	bool bOK = true;
+	int curEntry = 0;
+	for (i=0; i<numInputs; ++i) {
+		const uint64_t fileSize = file_size(fibInputs[i]);
+		for (j=0; j<numInputPictures[i]; ++j) {
+			const Ipe32PictureEntryHeader* peh = &inputPehs[i][j];
+			IpeMergeEntry* entry = &entries[curEntry++];
+			entry->input = i;
+			entry->entryNo = j;
+			memcpy(entry->szName, peh->name, IPE32_NAME_SIZE);
+			entry->offset = peh->offset;
+			if ((peh->uncompressedSize > 0) && !ipe32_measure_stored_size(fibInputs[i], szInputs[i], peh, fileSize, &entry->size)) bOK = false;
+		}
+	}
+
+	const int numSelected = bOK ? ipe_merge_select(entries, numEntries, merge) : -1;
+	if (numSelected < 0) {
+		free(entries);
+		return false;
+	}
+
+	// The directory is kept in memory as it is laid out in the file: the file header, followed by the picture entries
+	const size_t directorySize = sizeof(Ipe32FileHeader) + (size_t)numSelected*sizeof(Ipe32PictureEntryHeader);
+	unsigned char* directory = (unsigned char*)calloc(1, directorySize);
+	if (!directory) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the directory of %d pictures\n", numSelected);
+		free(entries);
+		return false;
+	}
+	art_writer_write(output, directory, directorySize);
+
+	bOK = ipe_merge_copy(fibInputs, szInputs, entries, numEntries, output, options);
+
+	Ipe32FileHeader efh;
+	memset(&efh, 0x00, sizeof(efh));
+	memcpy(efh.magic, IPE32_MAGIC_ART, IPE32_NAME_SIZE);
+	efh.reserved = 0;
+	efh.totalHeaderSize = (numSelected+1)*sizeof(efh);
+	memcpy(directory, &efh, sizeof(efh));
+
+	Ipe32PictureEntryHeader* peh = (Ipe32PictureEntryHeader*)(directory + sizeof(Ipe32FileHeader));
+	for (i=0; i<numEntries; ++i) {
+		if (!entries[i].bSelected) continue;
+		*peh = inputPehs[entries[i].input][entries[i].entryNo];
+		peh->offset = entries[i].newOffset;
+		peh++;
+	}
+	if (options->verbosity >= 1) printf("%d of %d pictures were copied into %s\n", numSelected, numEntries, output->szFilename);
+	if (!art_writer_patch(output, 0, directory, directorySize)) bOK = false;
+
+	free(directory);
+	free(entries);
+	return bOK;
+}
+
+bool ipe32_merge_art(const char** szInputs, const int numInputs, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options) {
+	FILE** fibInputs = (FILE**)calloc(numInputs+1, sizeof(FILE*));
+	Ipe32PictureEntryHeader** inputPehs = (Ipe32PictureEntryHeader**)calloc(numInputs+1, sizeof(Ipe32PictureEntryHeader*));
+	int* numInputPictures = (int*)calloc(numInputs+1, sizeof(int));
+	bool bOK = fibInputs && inputPehs && numInputPictures;
+	if (!bOK) fprintf(stderr, "FATAL: Cannot allocate memory for %d ART files\n", numInputs);
+
+	// All directories are read first, because the size of the new directory must be known before the data is copied
+	int i;
+	for (i=0; (i<numInputs) && bOK; ++i) {
+		fibInputs[i] = fopen(szInputs[i], "rb");
+		if (!fibInputs[i]) {
+			fprintf(stderr, "FATAL: Cannot open %s\n", szInputs[i]);
+			bOK = false;
+			break;
+		}
+		Ipe32FileHeader efh;
+		if (!ipe32_read_directory(fibInputs[i], szInputs[i], &efh, &inputPehs[i])) {
+			bOK = false;
+			break;
+		}
+		numInputPictures[i] = efh.totalHeaderSize/sizeof(efh) - 1;
+		// Mostly, the pictures are stored in the order of the directory
+		file_advise_sequential(fibInputs[i]);
+	}
+	if (bOK) bOK = ipe32_merge_directories(fibInputs, szInputs, inputPehs, numInputPictures, numInputs, output, merge, options);
+
+	for (i=0; i<numInputs; ++i) {
+		if (fibInputs && fibInputs[i]) fclose(fibInputs[i]);
+		if (inputPehs) free(inputPehs[i]);
+	}
+	free(fibInputs);
+	free(inputPehs);
+	free(numInputPictures);
+	return bOK;
 }
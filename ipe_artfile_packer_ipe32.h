@@ -13,7 +13,17 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-bool ipe32_pack_art(const char* szSrcFolder, FILE* fobArt, const int verbosity);
+#include "ipe_artfile_packer_common.h"
+#include "art_writer.h"
+
+bool ipe32_pack_art(const IpePackInput* input, ArtWriter* output, const IpePackOptions* options);
+
+// Replaces the picture szName of an existing ART file by a bitmap (--replace). Only the new data and its directory entry are written.
+bool ipe32_replace_picture(const char* szArtFile, const char* szName, const char* szBitmapFile, const IpePackOptions* options);
+
+// Copies the stored pictures of ART files verbatim into a new ART file (--merge), and writes a new directory.
+// Also used to remove the dead space, which replaced pictures left behind (--compact): then there is only one input file, and everything is copied.
+bool ipe32_merge_art(const char** szInputs, const int numInputs, ArtWriter* output, const IpeMergeOptions* merge, const IpePackOptions* options);
 
 #endif // #ifndef __inc__ipe_artfile_packer_ipe32
 
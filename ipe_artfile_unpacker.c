@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <inttypes.h>
 #include <getopt.h>
 
 #include "ipe16_artfile.h"
@@ -22,32 +23,182 @@
 #include "ipe_artfile_unpacker_ipe16.h"
 #include "ipe_artfile_unpacker_ipe32.h"
 
+#include "utils.h"
+#include "name_counter.h"
+#include "thread_pool.h"
+#include "async_output.h"
+#include "tar_stream.h"
+#include "ipe_cache_file.h"
+#include "picture_dedup.h"
+
 #define VERSION "2018-02-15"
 
+#define MAX_FILE 256
+
 void print_syntax() {
-	fprintf(stderr, "Syntax: -v [-o <outputdir>] -i <artfile>\n");
+	fprintf(stderr, "Syntax: -v [-j <threads>] [-n <name> ...] [-l [-f text|tsv|json]] [--verify [--checksums <file>]] [--save-checksums <file>] [--io-uring] [--dedup] [-o <outputdir> | --tar <tarfile> | --cache <cachefile>] -i <artfile> [-i <artfile> ...] [-b <listfile>] [<artfile> ...]\n");
 	fprintf(stderr, "   -v : verbose output\n");
+	fprintf(stderr, "   -j : number of pictures which are extracted in parallel\n");
+	fprintf(stderr, "   -n : only extract pictures with this name (wildcards * ? [...] allowed, can be repeated)\n");
+	fprintf(stderr, "   -l : only list the pictures (reads the headers only, nothing is extracted)\n");
+	fprintf(stderr, "   -f : format of the list: text (default), tsv or json\n");
+	fprintf(stderr, "   -b : read the ART files from this list file (one file per line)\n");
+	fprintf(stderr, "   --verify : decode all pictures on all cores without writing them, and print a report for every picture\n");
+	fprintf(stderr, "   --checksums : compare the checksums of the decoded pictures with this file (implies --verify)\n");
+	fprintf(stderr, "   --save-checksums : write the checksums of the decoded pictures to this file\n");
+	fprintf(stderr, "   --io-uring : write the bitmaps asynchronously with io_uring while the next pictures are decoded (Linux only)\n");
+	fprintf(stderr, "   --dedup : identical bitmaps become hard links (or reflinks) to the first one instead of being written again\n");
+	fprintf(stderr, "   --tar : write the bitmaps and index.txt into a tar stream instead of the output directory (- for stdout)\n");
+	fprintf(stderr, "   --cache : write all decoded pictures into one cache file which can be memory mapped (one ART file only). Nothing is done if the cache is up to date\n");
 	fprintf(stderr, "Runs in simulation mode if no output directory is defined.\n");
+	fprintf(stderr, "If more than one ART file is given (batch mode), every ART file is extracted into its own subfolder of the output directory.\n");
+}
+
+// One ART file of the batch mode
+typedef struct tagIpeArchive {
+	const char* szArtFile;
+	char szName[MAX_FILE*2];     // name of the subfolder (file name without extension, numbered if it is not unique)
+	char szDestFolder[MAX_FILE*3];
+	IpeUnpackOptions options;    // must live until the extraction has ended
+	FILE* fibArt;
+	Ipe16Extraction* ex16;
+	Ipe32Extraction* ex32;
+	bool bOK;
+} IpeArchive;
+
+// Opens the ART file and submits its pictures to the thread pool. Returns false on a fatal error.
+static bool begin_archive(IpeArchive* archive, ThreadPool* pool) {
+	archive->fibArt = fopen(archive->szArtFile, "rb");
+	if (!archive->fibArt) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", archive->szArtFile);
+		return false;
+	}
+
+	char signature[9]={0};
+	if (fread(&signature, 8, 1, archive->fibArt) != 1) {
+		fprintf(stderr, "FATAL: Cannot read signature of %s\n", archive->szArtFile);
+		return false;
+	}
+	const bool bTar = archive->options.output && async_output_is_tar(archive->options.output);
+	if (archive->options.szArchiveName && (strlen(archive->szDestFolder) > 0) && !bTar && !make_directory(archive->szDestFolder)) {
+		fprintf(stderr, "FATAL: Cannot create folder %s\n", archive->szDestFolder);
+		return false;
+	}
+	if (strcmp(signature, IPE32_MAGIC_ART) == 0) {
+		if (archive->options.verbosity >= 1) fprintf(stdout, "%s: Detected file as IPE32 (Waldo2/Eraser/K'Nex) art file\n", archive->szArtFile);
+		archive->ex32 = ipe32_extract_begin(archive->fibArt, archive->szDestFolder, &archive->options, pool);
+		return archive->ex32 != NULL;
+	} else if (strcmp(signature, IPE16_MAGIC_ART) == 0) {
+		if (archive->options.verbosity >= 1) fprintf(stdout, "%s: Detected file as IPE16 (BA/PiP/Waldo1) art file\n", archive->szArtFile);
+		archive->ex16 = ipe16_extract_begin(archive->fibArt, archive->szDestFolder, &archive->options, pool);
+		return archive->ex16 != NULL;
+	} else {
+		fprintf(stderr, "FATAL: %s is not a valid ART file of Imagination Pilots!\n", archive->szArtFile);
+		return false;
+	}
+}
+
+// Waits for the pictures of the ART file and writes its index.txt
+static void end_archive(IpeArchive* archive) {
+	if (archive->ex32) archive->bOK = ipe32_extract_end(archive->ex32);
+	if (archive->ex16) archive->bOK = ipe16_extract_end(archive->ex16);
+	archive->ex16 = NULL;
+	archive->ex32 = NULL;
+	if (archive->fibArt) fclose(archive->fibArt);
+	archive->fibArt = NULL;
 }
 
 int main(int argc, char *argv[]) {
-	int verbosity = 0;
+	IpeUnpackOptions options = {0};
+	options.numThreads = 1;
+	const char** namePatterns = (const char**)malloc(argc*sizeof(const char*));
+	options.namePatterns = namePatterns;
 	char* szOutputDir = "";
-	char* szArtFile = "";
+	StringList artFiles = {0};
+	const char* szListFile = NULL;
+	int listFormat = IPE_LIST_TEXT;
+	bool bList = false;
+	const char* szChecksumFile = NULL;
+	const char* szSaveChecksumFile = NULL;
+	bool bThreadsDefined = false;
+	bool bIoUring = false;
+	const char* szTarFile = NULL;
+	const char* szCacheFile = NULL;
+	bool bDedup = false;
 	int c;
 
-	#define PRINT_SYNTAX { print_syntax(); return 0; }
+	#define PRINT_SYNTAX { print_syntax(); free(namePatterns); string_list_free(&artFiles); return 0; }
+
+	static struct option longOptions[] = {
+		{ "verify",         no_argument,       0, 1 },
+		{ "checksums",      required_argument, 0, 2 },
+		{ "save-checksums", required_argument, 0, 3 },
+		{ "io-uring",       no_argument,       0, 4 },
+		{ "tar",            required_argument, 0, 5 },
+		{ "cache",          required_argument, 0, 6 },
+		{ "dedup",          no_argument,       0, 7 },
+		{ 0, 0, 0, 0 }
+	};
 
-	while ((c = getopt(argc, argv, "Vvi:o:")) != -1) {
+	while ((c = getopt_long(argc, argv, "Vvi:o:j:n:lf:b:", longOptions, NULL)) != -1) {
 		switch (c) {
+			case 1:
+				options.bVerify = true;
+				break;
+			case 2:
+				options.bVerify = true;
+				szChecksumFile = optarg;
+				break;
+			case 3:
+				szSaveChecksumFile = optarg;
+				break;
+			case 4:
+				bIoUring = true;
+				break;
+			case 5:
+				szTarFile = optarg;
+				break;
+			case 6:
+				szCacheFile = optarg;
+				break;
+			case 7:
+				bDedup = true;
+				break;
 			case 'v':
-				verbosity++;
+				options.verbosity++;
+				break;
+			case 'j':
+				options.numThreads = atoi(optarg);
+				if (options.numThreads < 1) PRINT_SYNTAX;
+				bThreadsDefined = true;
+				break;
+			case 'n':
+				namePatterns[options.numNamePatterns++] = optarg;
+				break;
+			case 'l':
+				bList = true;
+				break;
+			case 'f':
+				if (strcmp(optarg, "text") == 0) {
+					listFormat = IPE_LIST_TEXT;
+				} else if (strcmp(optarg, "tsv") == 0) {
+					listFormat = IPE_LIST_TSV;
+				} else if (strcmp(optarg, "json") == 0) {
+					listFormat = IPE_LIST_JSON;
+				} else {
+					PRINT_SYNTAX;
+				}
 				break;
 			case 'V':
 				fprintf(stdout, "IPE Artfile unpacker, revision %s\n", VERSION);
+				free(namePatterns);
+				string_list_free(&artFiles);
 				return 0;
 			case 'i':
-				szArtFile = optarg;
+				string_list_add(&artFiles, optarg);
+				break;
+			case 'b':
+				szListFile = optarg;
 				break;
 			case 'o':
 				szOutputDir = optarg;
@@ -57,31 +208,246 @@ int main(int argc, char *argv[]) {
 				break;
 		}
 	}
-	if (optind < argc) PRINT_SYNTAX;
+	const bool bBatch = (artFiles.numStrings > 1) || (optind < argc) || szListFile;
+	while (optind < argc) string_list_add(&artFiles, argv[optind++]);
+	if (szListFile && !string_list_read_file(&artFiles, szListFile)) {
+		free(namePatterns);
+		string_list_free(&artFiles);
+		return 1;
+	}
 
-	if (strlen(szArtFile) == 0) PRINT_SYNTAX;
+	if (artFiles.numStrings == 0) PRINT_SYNTAX;
 
-	FILE* fibArt = fopen(szArtFile, "rb");
-	if (!fibArt) {
-		fprintf(stderr, "FATAL: Cannot open %s\n", szArtFile);
-		return 1;
+	if (bList) {
+		if (options.bVerify) PRINT_SYNTAX;
+		options.listFormat = listFormat;
+		// stdout only contains the listing
+		options.verbosity = 0;
 	}
 
-	char signature[9]={0};
-	if (fread(&signature, 8, 1, fibArt) != 1) {
-		fprintf(stderr, "FATAL: Cannot read signature of %s\n", szArtFile);
-		return 1;
+	const bool bTarStdout = szTarFile && (strcmp(szTarFile, "-") == 0);
+	if (szTarFile) {
+		if (bList || options.bVerify || bIoUring || (strlen(szOutputDir) > 0)) PRINT_SYNTAX;
+		// stdout only contains the tar stream
+		if (bTarStdout) options.verbosity = 0;
 	}
-	if (strcmp(signature, IPE32_MAGIC_ART) == 0) {
-		if (verbosity >= 1) fprintf(stdout, "%s: Detected file as IPE32 (Waldo2/Eraser/K'Nex) art file\n", szArtFile);
-		return ipe32_extract_art_to_folder(fibArt, szOutputDir, verbosity) ? 0 : 1;
-	} else if (strcmp(signature, IPE16_MAGIC_ART) == 0) {
-		if (verbosity >= 1) fprintf(stdout, "%s: Detected file as IPE16 (BA/PiP/Waldo1) art file\n", szArtFile);
-		return ipe16_extract_art_to_folder(fibArt, szOutputDir, verbosity) ? 0 : 1;
-	} else {
-		fprintf(stderr, "FATAL: %s is not a valid ART file of Imagination Pilots!\n", szArtFile);
-		return 1;
+
+	if (szCacheFile) {
+		// The cache file replaces the bitmaps and index.txt of one ART file
+		if (bBatch || bList || options.bVerify || bIoUring || szTarFile || (strlen(szOutputDir) > 0)) PRINT_SYNTAX;
+		options.szCacheFile = szCacheFile;
+	}
+
+	// The links are created right after a bitmap is written, so the bitmaps must be written synchronously into the output directory
+	if (bDedup && (bList || options.bVerify || bIoUring || szTarFile || szCacheFile)) PRINT_SYNTAX;
+
+	int ret = 0;
+	FILE* fotChecksums = NULL;
+	FILE* fotTar = NULL;
+	TarWriter tarWriter = {0};
+	bool* patternMatched = NULL;
+	IpeArchive* archives = NULL;
+	ThreadPool* pool = NULL;
+	#define FATAL_RETURN { ret = 1; goto cleanup; }
+
+	if (options.bVerify) {
+		// Nothing is written in verify mode
+		szOutputDir = "";
+		if (!bThreadsDefined) options.numThreads = cpu_count();
+		if (szChecksumFile) {
+			options.manifest = ipe_load_checksum_manifest(szChecksumFile);
+			if (!options.manifest) FATAL_RETURN;
+		}
+	}
+
+	if (szSaveChecksumFile) {
+		fotChecksums = fopen(szSaveChecksumFile, "wt");
+		if (!fotChecksums) {
+			fprintf(stderr, "FATAL: Cannot open %s for writing\n", szSaveChecksumFile);
+			FATAL_RETURN;
+		}
+		options.fotChecksums = fotChecksums;
+	}
+
+	if (szTarFile) {
+		if (bTarStdout) {
+			fotTar = stdout;
+			file_set_binary_mode(fotTar);
+		} else {
+			fotTar = fopen(szTarFile, "wb");
+			if (!fotTar) {
+				fprintf(stderr, "FATAL: Cannot open %s for writing\n", szTarFile);
+				FATAL_RETURN;
+			}
+		}
+		tar_writer_begin(&tarWriter, fotTar);
+		options.output = new_async_output_tar(&tarWriter);
+		if (!options.output) {
+			fprintf(stderr, "FATAL: Cannot create the tar stream\n");
+			FATAL_RETURN;
+		}
+	}
+
+	if (bIoUring && (strlen(szOutputDir) > 0) && !bList) {
+		// Must be created before the options are copied into the archives
+		options.output = new_async_output(true);
+		if (!options.output) {
+			fprintf(stderr, "FATAL: Cannot create the asynchronous output\n");
+			FATAL_RETURN;
+		}
+		if (!async_output_is_async(options.output)) {
+			if (options.verbosity >= 1) fprintf(stdout, "io_uring is not available. The bitmaps are written synchronously.\n");
+			del_async_output(options.output);
+			options.output = NULL;
+		}
+	}
+
+	if (bDedup && (strlen(szOutputDir) > 0)) {
+		// Shared by all ART files of the batch mode, so that identical pictures in different ART files are linked, too
+		options.dedup = new_picture_dedup();
+		if (!options.dedup) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for the deduplication\n");
+			FATAL_RETURN;
+		}
+	}
+
+	if (!bBatch) {
+		// Single ART file: The pictures are extracted directly into the output directory
+		IpeArchive archive = {0};
+		archive.szArtFile = artFiles.strings[0];
+		// In a tar stream, the files are at the top level
+		snprintf(archive.szDestFolder, sizeof(archive.szDestFolder), "%s", szTarFile ? "." : szOutputDir);
+		archive.options = options;
+		if (szCacheFile && (options.numNamePatterns == 0) && !szSaveChecksumFile) {
+			// The invalidation stamp of an existing cache file is compared with the ART file, so that it is only rebuilt if needed
+			IpeCacheView view;
+			FILE* fibArt = fopen(archive.szArtFile, "rb");
+			if (fibArt && ipe_cache_map(&view, szCacheFile)) {
+				const bool bUpToDate = ipe_cache_is_current(&view, fibArt) && !(view.header->flags & IPE_CACHE_FLAG_PARTIAL);
+				ipe_cache_unmap(&view);
+				if (bUpToDate) {
+					if (options.verbosity >= 1) fprintf(stdout, "%s is up to date\n", szCacheFile);
+					fclose(fibArt);
+					goto cleanup;
+				}
+			}
+			if (fibArt) fclose(fibArt);
+		}
+		pool = new_thread_pool(options.numThreads);
+		if (!pool) {
+			fprintf(stderr, "FATAL: Cannot create the thread pool\n");
+			FATAL_RETURN;
+		}
+		if (begin_archive(&archive, pool)) end_archive(&archive);
+		if (archive.fibArt) fclose(archive.fibArt);
+		ret = archive.bOK ? 0 : 1;
+		goto cleanup;
+	}
+
+	// Batch mode: All ART files share one thread pool, so that the cores are also busy if the files have very different sizes
+	archives = (IpeArchive*)calloc(artFiles.numStrings, sizeof(IpeArchive));
+	patternMatched = (bool*)calloc(options.numNamePatterns+1, sizeof(bool));
+	pool = new_thread_pool(options.numThreads);
+	NameCounter* nc = new_name_counter(MAX_FILE, artFiles.numStrings);
+	if (!archives || !patternMatched || !pool || !nc) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the batch mode\n");
+		del_name_counter(nc);
+		FATAL_RETURN;
+	}
+	options.patternMatched = patternMatched;
+	if ((strlen(szOutputDir) > 0) && !make_directory(szOutputDir)) {
+		fprintf(stderr, "FATAL: Cannot create folder %s\n", szOutputDir);
+		del_name_counter(nc);
+		FATAL_RETURN;
+	}
+	int i;
+	for (i=0; i<artFiles.numStrings; ++i) {
+		IpeArchive* archive = &archives[i];
+		archive->szArtFile = artFiles.strings[i];
+		char szStem[MAX_FILE] = {0}; // zero padded, because it is the key of the name counter
+		path_stem(archive->szArtFile, true, szStem, MAX_FILE-16);
+		const int nameCount = name_counter_add(nc, szStem);
+		if (nameCount > 1) {
+			snprintf(archive->szName, sizeof(archive->szName), "%s__%d", szStem, nameCount);
+		} else {
+			snprintf(archive->szName, sizeof(archive->szName), "%s", szStem);
+		}
+		if (szTarFile) {
+			snprintf(archive->szDestFolder, sizeof(archive->szDestFolder), "%s", archive->szName);
+		} else if (strlen(szOutputDir) > 0) {
+			snprintf(archive->szDestFolder, sizeof(archive->szDestFolder), "%s/%s", szOutputDir, archive->szName);
+		}
+		archive->options = options;
+		archive->options.szArchiveName = archive->szName;
+	}
+	del_name_counter(nc);
+
+	const bool bJSON = bList && (listFormat == IPE_LIST_JSON);
+	if (bJSON) fprintf(stdout, "[\n");
+
+	// Only a few ART files are opened at the same time. The next ones are submitted while the pool is still busy with the older ones.
+	const int window = 2*thread_pool_num_slots(pool);
+	int numListed = 0;
+	int iBegin = 0, iEnd = 0;
+	while (iEnd < artFiles.numStrings) {
+		if ((iBegin < artFiles.numStrings) && (iBegin-iEnd < window)) {
+			IpeArchive* archive = &archives[iBegin++];
+			archive->options.bListContinued = numListed > 0;
+			if (bJSON && (numListed > 0)) fprintf(stdout, ",\n");
+			if (begin_archive(archive, pool)) {
+				numListed++;
+			} else if (bJSON && (numListed > 0)) {
+				// Keep the JSON valid if nothing was listed for this file
+				fprintf(stdout, "{}");
+				numListed++;
+			}
+		} else {
+			end_archive(&archives[iEnd++]);
+		}
+	}
+
+	if (bJSON) fprintf(stdout, "]\n");
+
+	bool bPatternsOK = ipe_unpack_check_name_patterns(&options, patternMatched);
+
+	// Per file summary. In list mode, stdout only contains the listing.
+	FILE* fotSummary = (bList || bTarStdout) ? stderr : stdout;
+	int numOK = 0;
+	for (i=0; i<artFiles.numStrings; ++i) {
+		IpeArchive* archive = &archives[i];
+		if (archive->bOK) {
+			numOK++;
+			if (strlen(archive->szDestFolder) > 0) {
+				fprintf(fotSummary, "OK     %s -> %s\n", archive->szArtFile, archive->szDestFolder);
+			} else {
+				fprintf(fotSummary, "OK     %s\n", archive->szArtFile);
+			}
+		} else {
+			fprintf(fotSummary, "FAILED %s\n", archive->szArtFile);
+		}
 	}
+	fprintf(fotSummary, "%d of %d ART files OK\n", numOK, artFiles.numStrings);
+	ret = ((numOK == artFiles.numStrings) && bPatternsOK) ? 0 : 1;
 
-	fclose(fibArt);
+cleanup:
+	if (options.dedup && (options.verbosity >= 1)) {
+		fprintf(stdout, "%d identical pictures were linked instead of written (%" PRIu64 " bytes saved)\n", options.dedup->numLinked, options.dedup->bytesSaved);
+	}
+	del_picture_dedup(options.dedup);
+	del_async_output(options.output);
+	if (fotTar) {
+		if (!tar_writer_end(&tarWriter)) ret = 1;
+		if (!bTarStdout && (fclose(fotTar) != 0)) {
+			fprintf(stderr, "ERROR: Cannot write %s\n", szTarFile);
+			ret = 1;
+		}
+	}
+	del_thread_pool(pool);
+	free(archives);
+	free(patternMatched);
+	if (fotChecksums) fclose(fotChecksums);
+	ipe_del_checksum_manifest(options.manifest);
+	free(namePatterns);
+	string_list_free(&artFiles);
+	return ret;
 }
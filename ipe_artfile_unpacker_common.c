@@ -0,0 +1,337 @@
+/**
+ * ART file unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Functionality which is shared between the IPE16 and IPE32 unpacker
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "ipe_artfile_unpacker_common.h"
+#include "utils.h"
+
+IpeIndexFile* ipe_index_open(const char* szDestFolder, const char* szName, const IpeUnpackOptions* options) {
+	IpeIndexFile* index = (IpeIndexFile*)calloc(1, sizeof(IpeIndexFile));
+	if (!index) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the index\n");
+		return NULL;
+	}
+	snprintf(index->szFilename, sizeof(index->szFilename), "%s/%s", szDestFolder, szName);
+	if (options->output && async_output_is_tar(options->output)) {
+		index->output = options->output;
+		if (memory_file_open(&index->memory)) index->fp = index->memory.fp;
+	} else {
+		index->fp = fopen(index->szFilename, "wt");
+	}
+	if (!index->fp) {
+		fprintf(stderr, "FATAL: Cannot open %s for writing\n", index->szFilename);
+		free(index);
+		return NULL;
+	}
+	return index;
+}
+
+bool ipe_index_close(IpeIndexFile* index) {
+	bool bOK = true;
+	if (index->output) {
+		size_t size;
+		unsigned char* data = memory_file_close(&index->memory, &size);
+		if (data) {
+			AsyncOutputGroup group = {0};
+			async_output_write_file(index->output, &group, index->szFilename, data, size, &bOK);
+			async_output_wait(index->output, &group);
+		} else {
+			fprintf(stderr, "ERROR: Cannot write %s\n", index->szFilename);
+			bOK = false;
+		}
+	} else if (fclose(index->fp) != 0) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", index->szFilename);
+		bOK = false;
+	}
+	free(index);
+	return bOK;
+}
+
+void ipe_unpack_relative_filename(const IpeUnpackOptions* options, const char* szBitmapFilename, char* szRelativeFilename, const size_t size) {
+	if (options->szArchiveName) {
+		snprintf(szRelativeFilename, size, "%s/%s", options->szArchiveName, szBitmapFilename);
+	} else {
+		snprintf(szRelativeFilename, size, "%s", szBitmapFilename);
+	}
+}
+
+bool ipe_unpack_name_selected(const IpeUnpackOptions* options, const char* name, bool* patternMatched) {
+	if (options->numNamePatterns == 0) return true;
+
+	bool bSelected = false;
+	int i;
+	for (i=0; i<options->numNamePatterns; ++i) {
+		if (wildcard_match(options->namePatterns[i], name)) {
+			bSelected = true;
+			if (!patternMatched) break;
+			patternMatched[i] = true;
+		}
+	}
+	return bSelected;
+}
+
+bool ipe_unpack_check_name_patterns(const IpeUnpackOptions* options, const bool* patternMatched) {
+	bool bEverythingOK = true;
+	int i;
+	for (i=0; i<options->numNamePatterns; ++i) {
+		if (!patternMatched[i]) {
+			fprintf(stderr, "ERROR: No picture matches %s\n", options->namePatterns[i]);
+			bEverythingOK = false;
+		}
+	}
+	return bEverythingOK;
+}
+
+static double ipe_list_ratio(const uint64_t uncompressedSize, const uint64_t storedSize) {
+	return (storedSize == 0) ? 0 : (double)uncompressedSize / storedSize;
+}
+
+static void ipe_list_json_string(const char* str) {
+	fputc('"', stdout);
+	for (; *str; ++str) {
+		const unsigned char c = (unsigned char)*str;
+		if ((c == '"') || (c == '\\')) {
+			fprintf(stdout, "\\%c", c);
+		} else if ((c < 0x20) || (c >= 0x7F)) {
+			// Picture names are not UTF-8. Bytes above 0x7F are interpreted as Latin-1
+			fprintf(stdout, "\\u%04x", c);
+		} else {
+			fputc(c, stdout);
+		}
+	}
+	fputc('"', stdout);
+}
+
+void ipe_list_begin(IpeListing* listing, const IpeUnpackOptions* options, const char* szArtFormat) {
+	listing->format = options->listFormat;
+	listing->szArtFormat = szArtFormat;
+	listing->options = options;
+	listing->numEntries = 0;
+	listing->totalStoredSize = 0;
+	listing->totalUncompressedSize = 0;
+
+	switch (listing->format) {
+		case IPE_LIST_TEXT:
+			if (options->szArchiveName) fprintf(stdout, "%s%s:\n", options->bListContinued ? "\n" : "", options->szArchiveName);
+			fprintf(stdout, "%-23s %10s %10s %3s %-10s %11s %10s %6s\n", "Name", "Offset", "Stored", "Pal", "Comp", "Dimensions", "Uncompr.", "Ratio");
+			break;
+		case IPE_LIST_TSV:
+			if (options->bListContinued) break;
+			fprintf(stdout, "format\tname\tfile\toffset\tstored_size\tpalette_type\tcompression_type\twidth\theight\tuncompressed_size\tratio\n");
+			break;
+		case IPE_LIST_JSON:
+			fprintf(stdout, "{");
+			if (options->szArchiveName) {
+				fprintf(stdout, "\"archive\": ");
+				ipe_list_json_string(options->szArchiveName);
+				fprintf(stdout, ", ");
+			}
+			fprintf(stdout, "\"format\": ");
+			ipe_list_json_string(szArtFormat);
+			fprintf(stdout, ", \"pictures\": [");
+			break;
+	}
+}
+
+void ipe_list_entry(IpeListing* listing, const IpeListEntry* entry) {
+	char szFilename[IPE_CHECKSUM_FILENAME_SIZE];
+	ipe_unpack_relative_filename(listing->options, entry->filename, szFilename, sizeof(szFilename));
+	const double ratio = ipe_list_ratio(entry->uncompressedSize, entry->storedSize);
+	char szPaletteType[2] = { entry->paletteType, 0 };
+	char szDimensions[24] = "";
+	if (entry->bHasDimensions) sprintf(szDimensions, "%ux%u", entry->width, entry->height);
+
+	switch (listing->format) {
+		case IPE_LIST_TEXT:
+			fprintf(stdout, "%-23s %10u %10u %3s %-10s %11s %10llu %6.2f\n", entry->name, entry->offset, entry->storedSize,
+			        entry->paletteType ? szPaletteType : "-", entry->compressionType, entry->bHasDimensions ? szDimensions : "-",
+			        (unsigned long long)entry->uncompressedSize, ratio);
+			break;
+		case IPE_LIST_TSV:
+			// Every line contains the ART format, so that the listings of several ART files can be concatenated
+			fprintf(stdout, "%s\t%s\t%s\t%u\t%u\t%s\t%s\t", listing->szArtFormat, entry->name, szFilename, entry->offset, entry->storedSize,
+			        szPaletteType, entry->compressionType);
+			if (entry->bHasDimensions) {
+				fprintf(stdout, "%u\t%u\t", entry->width, entry->height);
+			} else {
+				fprintf(stdout, "\t\t");
+			}
+			fprintf(stdout, "%llu\t%.4f\n", (unsigned long long)entry->uncompressedSize, ratio);
+			break;
+		case IPE_LIST_JSON:
+			fprintf(stdout, "%s\n  {\"name\": ", (listing->numEntries > 0) ? "," : "");
+			ipe_list_json_string(entry->name);
+			fprintf(stdout, ", \"file\": ");
+			ipe_list_json_string(szFilename);
+			fprintf(stdout, ", \"offset\": %u, \"stored_size\": %u, \"palette_type\": ", entry->offset, entry->storedSize);
+			if (entry->paletteType) {
+				ipe_list_json_string(szPaletteType);
+			} else {
+				fprintf(stdout, "null");
+			}
+			fprintf(stdout, ", \"compression_type\": ");
+			ipe_list_json_string(entry->compressionType);
+			if (entry->bHasDimensions) {
+				fprintf(stdout, ", \"width\": %u, \"height\": %u", entry->width, entry->height);
+			} else {
+				fprintf(stdout, ", \"width\": null, \"height\": null");
+			}
+			fprintf(stdout, ", \"uncompressed_size\": %llu, \"ratio\": %.4f}", (unsigned long long)entry->uncompressedSize, ratio);
+			break;
+	}
+
+	listing->numEntries++;
+	listing->totalStoredSize += entry->storedSize;
+	listing->totalUncompressedSize += entry->uncompressedSize;
+}
+
+void ipe_list_end(IpeListing* listing) {
+	const double ratio = ipe_list_ratio(listing->totalUncompressedSize, listing->totalStoredSize);
+	switch (listing->format) {
+		case IPE_LIST_TEXT:
+			fprintf(stdout, "%d pictures, %llu bytes stored, %llu bytes uncompressed, ratio %.2f\n", listing->numEntries,
+			        (unsigned long long)listing->totalStoredSize, (unsigned long long)listing->totalUncompressedSize, ratio);
+			break;
+		case IPE_LIST_JSON:
+			fprintf(stdout, "%s], \"total_stored_size\": %llu, \"total_uncompressed_size\": %llu, \"ratio\": %.4f}\n",
+			        (listing->numEntries > 0) ? "\n" : "", (unsigned long long)listing->totalStoredSize,
+			        (unsigned long long)listing->totalUncompressedSize, ratio);
+			break;
+	}
+}
+
+static int ipe_compare_manifest_entry(const void* a, const void* b) {
+	return strcmp(((const IpeChecksumManifestEntry*)a)->szFilename, ((const IpeChecksumManifestEntry*)b)->szFilename);
+}
+
+IpeChecksumManifest* ipe_load_checksum_manifest(const char* szFilename) {
+	FILE* fitManifest = fopen(szFilename, "rt");
+	if (!fitManifest) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szFilename);
+		return NULL;
+	}
+
+	IpeChecksumManifest* manifest = (IpeChecksumManifest*)calloc(1, sizeof(IpeChecksumManifest));
+	int capacity = 0;
+	char line[IPE_CHECKSUM_FILENAME_SIZE+64];
+	int lineNo = 0;
+	while (fgets(line, sizeof(line), fitManifest)) {
+		lineNo++;
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == 0) continue;
+
+		if (manifest->numEntries == capacity) {
+			capacity = (capacity == 0) ? 256 : capacity*2;
+			IpeChecksumManifestEntry* newEntries = (IpeChecksumManifestEntry*)realloc(manifest->entries, capacity*sizeof(IpeChecksumManifestEntry));
+			if (!newEntries) {
+				fprintf(stderr, "FATAL: Cannot allocate memory for the checksum manifest\n");
+				fclose(fitManifest);
+				ipe_del_checksum_manifest(manifest);
+				return NULL;
+			}
+			manifest->entries = newEntries;
+		}
+
+		IpeChecksumManifestEntry* entry = &manifest->entries[manifest->numEntries];
+		unsigned long long checksum;
+		int n = 0;
+		if ((sscanf(line, "%16llx %n", &checksum, &n) != 1) || (n == 0) || (strlen(line+n) == 0) || (strlen(line+n) >= sizeof(entry->szFilename))) {
+			fprintf(stderr, "FATAL: Invalid line %d in checksum manifest %s\n", lineNo, szFilename);
+			fclose(fitManifest);
+			ipe_del_checksum_manifest(manifest);
+			return NULL;
+		}
+		entry->checksum = checksum;
+		strcpy(entry->szFilename, line+n);
+		entry->bSeen = false;
+		manifest->numEntries++;
+	}
+	fclose(fitManifest);
+
+	qsort(manifest->entries, manifest->numEntries, sizeof(IpeChecksumManifestEntry), ipe_compare_manifest_entry);
+	return manifest;
+}
+
+void ipe_del_checksum_manifest(IpeChecksumManifest* manifest) {
+	if (!manifest) return;
+	free(manifest->entries);
+	free(manifest);
+}
+
+bool ipe_checksums_needed(const IpeUnpackOptions* options) {
+	return options->bVerify || options->manifest || options->fotChecksums || options->dedup;
+}
+
+void ipe_checksum_report_begin(IpeChecksumReport* report, const IpeUnpackOptions* options) {
+	report->options = options;
+	report->numOK = 0;
+	report->numFailed = 0;
+}
+
+bool ipe_checksum_report_picture(IpeChecksumReport* report, const char* szBitmapFilename, const bool bDecoded, const uint64_t checksum) {
+	const IpeUnpackOptions* options = report->options;
+
+	char szFilename[IPE_CHECKSUM_FILENAME_SIZE];
+	ipe_unpack_relative_filename(options, szBitmapFilename, szFilename, sizeof(szFilename));
+
+	IpeChecksumManifestEntry* entry = NULL;
+	if (options->manifest) {
+		IpeChecksumManifestEntry key;
+		// szFilename is never longer than a bitmap filename of the unpacker
+		snprintf(key.szFilename, sizeof(key.szFilename), "%s", szFilename);
+		entry = (IpeChecksumManifestEntry*)bsearch(&key, options->manifest->entries, options->manifest->numEntries, sizeof(IpeChecksumManifestEntry), ipe_compare_manifest_entry);
+		if (entry) entry->bSeen = true;
+	}
+
+	if (!bDecoded) {
+		if (options->bVerify) fprintf(stdout, "FAILED   %16s %s (cannot be decoded)\n", "", szFilename);
+		report->numFailed++;
+		return false;
+	}
+
+	if (options->fotChecksums) fprintf(options->fotChecksums, "%016" PRIx64 " %s\n", checksum, szFilename);
+
+	if (options->manifest && !entry) {
+		if (options->bVerify) fprintf(stdout, "UNKNOWN  %016" PRIx64 " %s (not in the checksum manifest)\n", checksum, szFilename);
+		report->numFailed++;
+		return false;
+	}
+	if (entry && (entry->checksum != checksum)) {
+		if (options->bVerify) fprintf(stdout, "MISMATCH %016" PRIx64 " %s (expected %016" PRIx64 ")\n", checksum, szFilename, entry->checksum);
+		report->numFailed++;
+		return false;
+	}
+
+	if (options->bVerify) fprintf(stdout, "OK       %016" PRIx64 " %s\n", checksum, szFilename);
+	report->numOK++;
+	return true;
+}
+
+bool ipe_checksum_report_end(IpeChecksumReport* report) {
+	const IpeUnpackOptions* options = report->options;
+
+	// If only some pictures are selected (-n), the other pictures of the manifest are not expected.
+	// In batch mode, only the pictures in the subfolder of this ART file are expected.
+	if (options->manifest && (options->numNamePatterns == 0)) {
+		const size_t prefixLen = options->szArchiveName ? strlen(options->szArchiveName) : 0;
+		int i;
+		for (i=0; i<options->manifest->numEntries; ++i) {
+			const IpeChecksumManifestEntry* entry = &options->manifest->entries[i];
+			if (entry->bSeen) continue;
+			if (options->szArchiveName && ((strncmp(entry->szFilename, options->szArchiveName, prefixLen) != 0) || (entry->szFilename[prefixLen] != '/'))) continue;
+			if (options->bVerify) fprintf(stdout, "MISSING  %016" PRIx64 " %s (in the checksum manifest, but not in the ART file)\n", entry->checksum, entry->szFilename);
+			report->numFailed++;
+		}
+	}
+
+	if (options->bVerify) fprintf(stdout, "%d pictures OK, %d failed\n", report->numOK, report->numFailed);
+	return report->numFailed == 0;
+}
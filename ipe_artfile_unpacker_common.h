@@ -0,0 +1,123 @@
+/**
+ * ART file unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Options, listing and verify report which are shared between the IPE16 and IPE32 unpacker
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__ipe_artfile_unpacker_common
+#define __inc__ipe_artfile_unpacker_common
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "async_output.h"
+#include "picture_dedup.h"
+#include "utils.h"
+
+#define IPE_LIST_NONE 0 // extract the pictures
+#define IPE_LIST_TEXT 1 // only list the pictures (-l)
+#define IPE_LIST_TSV  2
+#define IPE_LIST_JSON 3
+
+#define IPE_CHECKSUM_FILENAME_SIZE 256
+#define IPE_INDEX_FILENAME_SIZE 1024
+
+typedef struct tagIpeChecksumManifestEntry {
+	char szFilename[IPE_CHECKSUM_FILENAME_SIZE]; // name of the bitmap file (unique, because duplicate names are numbered)
+	uint64_t checksum;
+	bool bSeen;
+} IpeChecksumManifestEntry;
+
+// Checksums of the decoded pictures from an earlier run, sorted by file name
+typedef struct tagIpeChecksumManifest {
+	int numEntries;
+	IpeChecksumManifestEntry* entries;
+} IpeChecksumManifest;
+
+typedef struct tagIpeUnpackOptions {
+	int verbosity;
+	int numThreads;        // number of pictures which are decoded and written in parallel (-j)
+	const char** namePatterns; // only extract pictures whose name matches one of these patterns (-n). All pictures if there is none.
+	int numNamePatterns;
+	int listFormat;        // IPE_LIST_*
+	bool bVerify;          // decode all pictures, but do not write them. Prints a report for every picture (--verify)
+	IpeChecksumManifest* manifest;   // checksums to compare with (--checksums), or NULL
+	FILE* fotChecksums;              // the checksums of the decoded pictures are written to this file (--save-checksums), or NULL
+	AsyncOutput* output;             // writes the bitmaps in the background (--io-uring), or NULL
+	PictureDedup* dedup;             // identical bitmaps become links to the first one instead of being written again (--dedup), or NULL
+	const char* szCacheFile;         // all decoded pictures are written into this cache file instead of bitmaps (--cache), or NULL
+	// Batch mode (several ART files)
+	const char* szArchiveName;       // name of the subfolder of the ART file. File names in listings and checksums are relative to the output folder. NULL if not in batch mode
+	bool* patternMatched;            // shared by all ART files, so that the name patterns are checked after the last one. NULL if not in batch mode
+	bool bListContinued;             // not the first ART file of the listing
+} IpeUnpackOptions;
+
+// One line of the listing (-l). It is built from the directory and the picture headers only.
+typedef struct tagIpeListEntry {
+	const char* name;
+	const char* filename;      // name of the bitmap file which would be extracted
+	uint32_t offset;
+	uint32_t storedSize;
+	char paletteType;          // 0 if the format has no palette type (IPE32)
+	char compressionType[32];  // IPE16: compression type character, IPE32: number of compressed and raw chunks
+	bool bHasDimensions;       // width and height are only known for IPE16
+	unsigned int width;
+	unsigned int height;
+	uint64_t uncompressedSize; // size of the stored data if it would not be compressed
+} IpeListEntry;
+
+typedef struct tagIpeListing {
+	int format;                // IPE_LIST_*
+	const char* szArtFormat;   // "IPE16" or "IPE32"
+	const IpeUnpackOptions* options;
+	int numEntries;
+	uint64_t totalStoredSize;
+	uint64_t totalUncompressedSize;
+} IpeListing;
+
+// index.txt (or another text file next to it, e.g. the hash manifest) of an ART file.
+// If the output is a tar stream, it is written into memory and appended to the stream when it is closed.
+typedef struct tagIpeIndexFile {
+	FILE* fp;
+	char szFilename[IPE_INDEX_FILENAME_SIZE];
+	AsyncOutput* output; // only if it is written into memory
+	MemoryFile memory;
+} IpeIndexFile;
+
+// Returns NULL (and prints an error) if the index cannot be created
+IpeIndexFile* ipe_index_open(const char* szDestFolder, const char* szName, const IpeUnpackOptions* options);
+bool ipe_index_close(IpeIndexFile* index);
+
+// File name relative to the output folder (in batch mode, the bitmaps are in a subfolder per ART file)
+void ipe_unpack_relative_filename(const IpeUnpackOptions* options, const char* szBitmapFilename, char* szRelativeFilename, const size_t size);
+
+// Checks if a picture is selected by the name patterns. patternMatched (may be NULL) gets marked for every pattern which matches.
+bool ipe_unpack_name_selected(const IpeUnpackOptions* options, const char* name, bool* patternMatched);
+
+// Reports the name patterns which did not match any picture. Returns false if there is one.
+bool ipe_unpack_check_name_patterns(const IpeUnpackOptions* options, const bool* patternMatched);
+
+typedef struct tagIpeChecksumReport {
+	const IpeUnpackOptions* options;
+	int numOK;
+	int numFailed;
+} IpeChecksumReport;
+
+// Checksum manifest format: One line "<xxh64 in hex> <bitmap filename>" per picture
+IpeChecksumManifest* ipe_load_checksum_manifest(const char* szFilename);
+void ipe_del_checksum_manifest(IpeChecksumManifest* manifest);
+
+// Returns true if the checksums of the decoded pictures are needed
+bool ipe_checksums_needed(const IpeUnpackOptions* options);
+
+// Verify report and checksum file. ipe_checksum_report_picture() must be called in directory order for every selected picture
+void ipe_checksum_report_begin(IpeChecksumReport* report, const IpeUnpackOptions* options);
+bool ipe_checksum_report_picture(IpeChecksumReport* report, const char* szFilename, const bool bDecoded, const uint64_t checksum);
+bool ipe_checksum_report_end(IpeChecksumReport* report);
+
+void ipe_list_begin(IpeListing* listing, const IpeUnpackOptions* options, const char* szArtFormat);
+void ipe_list_entry(IpeListing* listing, const IpeListEntry* entry);
+void ipe_list_end(IpeListing* listing);
+
+#endif // #ifndef __inc__ipe_artfile_unpacker_common
@@ -11,16 +11,107 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <inttypes.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "ipe16_bmpexport.h"
 #include "ipe16_artfile.h"
 #include "ipe16_lzw_decoder.h"
+#include "ipe_artfile_unpacker_ipe16.h"
 
 #include "utils.h"
+#include "name_counter.h"
+#include "thread_pool.h"
+#include "checksum.h"
+#include "arena.h"
+#include "ipe_cache_file.h"
+#include "hash_manifest.h"
 
 #define MAX_FILE 256
 
+#ifndef IPE16_STREAMING_THRESHOLD
+// Pictures which are bigger than this (stored or decoded) are read, decoded and written piecewise,
+// so that only a few rows need to be in memory instead of the whole picture
+#define IPE16_STREAMING_THRESHOLD (64*1024*1024)
+#endif
+
+#define IPE16_STREAMING_BUFFER_SIZE (256*1024)
+
+// One entry of the extraction plan. The plan is kept in directory order (for index.txt),
+// but the pictures are extracted in the order of their offsets, so that the ART file is read sequentially
+typedef struct tagIpe16PlanItem {
+	Ipe16PictureEntryHeader peh;
+	int iCopyNumber;
+	bool bExtracted;       // only extracted pictures are listed in index.txt
+	char compressionType;  // the following fields are filled from the picture header
+	uint16_t offsetX;      // (PiP only)
+	uint16_t offsetY;      // (PiP only)
+	uint16_t width;
+	uint16_t height;
+	size_t headerSize;
+	uint64_t checksum;     // of the decoded picture (only if checksums are needed)
+} Ipe16PlanItem;
+
+// Scratch memory of one worker thread. The decoder is reused for all pictures of the ART file,
+// and the buffers of the current picture (stored data, decoded picture, rows) come from the arena, which is reset after every picture.
+typedef struct tagIpe16WorkerScratch {
+	Ipe16LZWDecoder* lzwDecoder;
+	Arena arena;
+} Ipe16WorkerScratch;
+
+// Shared by all worker threads
+typedef struct tagIpe16ExtractContext {
+	FILE* fibArt;
+	pthread_mutex_t fileMutex;
+	uint64_t fileSize;
+	const char* szDestFolder;
+	bool bChecksums;
+	AsyncOutput* output;         // NULL if the bitmaps are written synchronously
+	AsyncOutputGroup outputGroup;
+	IpeCacheWriter* cache;       // NULL if no cache file is written
+	PictureDedup* dedup;         // NULL if the bitmaps are not deduplicated
+	const Ipe16PlanItem* plan;   // to get the directory position of a picture for the cache
+	Ipe16WorkerScratch* scratch; // one per thread pool slot
+} Ipe16ExtractContext;
+
+// Provides the stored picture data piecewise (streaming path). The data is either in memory or read from the ART file.
+typedef struct tagIpe16StreamReader {
+	const unsigned char* data;  // current piece
+	size_t dataLen;
+	size_t dataPos;
+	Ipe16ExtractContext* ctx;   // the following fields are only used if the data is read from the ART file
+	uint64_t fileOffset;        // of the next piece
+	uint64_t fileRemaining;
+	unsigned char* buf;
+	size_t bufSize;
+} Ipe16StreamReader;
+
+typedef struct tagIpe16ExtractJob {
+	Ipe16ExtractContext* ctx;
+	Ipe16PlanItem* item;
+	const Ipe16PlanItem* nextItem; // the picture which will probably be read next (for the readahead hint)
+} Ipe16ExtractJob;
+
+// State of one ART file between ipe16_extract_begin() and ipe16_extract_end()
+struct tagIpe16Extraction {
+	const IpeUnpackOptions* options;
+	ThreadPool* pool;
+	bool bEverythingOK;
+	bool bListOnly;
+	IpeIndexFile* index; // NULL if no index.txt is written
+	IpeIndexFile* hashes; // hash manifest next to index.txt (for the packer option --base), NULL if no index.txt is written
+	int numPictures;
+	Ipe16PlanItem* plan;   // numPictures entries, in directory order
+	int numPlanned;
+	Ipe16ExtractJob* jobs; // numPlanned entries, in extraction order
+	Ipe16ExtractContext ctx;
+	int numSlots;
+	ThreadPoolGroup group;
+	bool bChecksums;
+	IpeChecksumReport report;
+};
+
 void ipe16_generate_gray_table(Ipe16ColorTable *ct) {
 	int i;
 	for (i=0; i<=0xFF; ++i) {
@@ -30,7 +121,516 @@ void ipe16_generate_gray_table(Ipe16ColorTable *ct) {
 	}
 }
 
-bool ipe16_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const int verbosity) {
+static bool ipe16_is_pip_compressiontype(const char compressionType) {
+	return (compressionType == PIP_COMPRESSIONTYPE_LZW) || (compressionType == PIP_COMPRESSIONTYPE_NONE);
+}
+
+static void ipe16_bitmap_filename(char* szBitmapFilename, const Ipe16PlanItem* item) {
+	char szName[IPE16_NAME_SIZE];
+	strcpy(szName, item->peh.name);
+	if (item->iCopyNumber == 1) {
+		sprintf(szBitmapFilename, "%s.bmp", sanitize_filename(szName));
+	} else {
+		sprintf(szBitmapFilename, "%s__%d.bmp", sanitize_filename(szName), item->iCopyNumber);
+	}
+}
+
+// Identical bitmaps have identical pixels, palette and dimensions
+static uint64_t ipe16_dedup_hash(const Ipe16PlanItem* item) {
+	const uint32_t dimensions[2] = { item->width, item->height };
+	return checksum_xxh64(dimensions, sizeof(dimensions), item->checksum);
+}
+
+// Directory entry and palette of a picture in the cache file. Pictures with the parent's palette have none.
+static const IpeCachePaletteEntry* ipe16_cache_entry(IpeCacheEntry* entry, IpeCachePaletteEntry* palette, const Ipe16PlanItem* item, const Ipe16ColorTable* ct, const size_t paletteSize) {
+	memset(entry, 0, sizeof(*entry));
+	strcpy(entry->name, item->peh.name);
+	entry->width = item->width;
+	entry->height = item->height;
+	entry->stride = item->width;
+	entry->bitsPerPixel = 8;
+	entry->offsetX = item->offsetX;
+	entry->offsetY = item->offsetY;
+	entry->paletteType = item->peh.paletteType;
+	entry->compressionType = item->compressionType;
+	if (paletteSize == 0) return NULL;
+
+	int i;
+	for (i=0; i<IPE_CACHE_NUM_COLORS; ++i) {
+		palette[i].r = ct->colors[i].r;
+		palette[i].g = ct->colors[i].g;
+		palette[i].b = ct->colors[i].b;
+		palette[i].reserved = 0;
+	}
+	entry->numColors = IPE_CACHE_NUM_COLORS;
+	return palette;
+}
+
+static int ipe16_compare_job_offset(const void* a, const void* b) {
+	const Ipe16PlanItem* x = ((const Ipe16ExtractJob*)a)->item;
+	const Ipe16PlanItem* y = ((const Ipe16ExtractJob*)b)->item;
+	if (x->peh.offset != y->peh.offset) return (x->peh.offset < y->peh.offset) ? -1 : 1;
+	// Keep the directory order for pictures sharing the same offset
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static int ipe16_compare_job_size(const void* a, const void* b) {
+	const Ipe16PlanItem* x = ((const Ipe16ExtractJob*)a)->item;
+	const Ipe16PlanItem* y = ((const Ipe16ExtractJob*)b)->item;
+	// Largest first, so that no big picture is left over at the end while the other threads are idle
+	if (x->peh.size != y->peh.size) return (x->peh.size > y->peh.size) ? -1 : 1;
+	return ipe16_compare_job_offset(a, b);
+}
+
+// Fills compressionType, offsetX/offsetY, width, height and headerSize of the plan item. buf contains (at least) the beginning of the stored data.
+static bool ipe16_parse_picture_header(Ipe16PlanItem* item, const unsigned char* buf, const size_t len) {
+	const Ipe16PictureEntryHeader* peh = &item->peh;
+	const char compressionType = buf[0];
+	if ((compressionType == BA_COMPRESSIONTYPE_LZW) || (compressionType == BA_COMPRESSIONTYPE_NONE)) {
+		BAPictureHeader ph;
+		if (len < sizeof(ph)) {
+			fprintf(stderr, "ERROR: Cannot read BAPictureHeader of %s\n", peh->name);
+			return false;
+		}
+		memcpy(&ph, buf, sizeof(ph));
+		item->headerSize = sizeof(ph);
+		item->width = ph.width;
+		item->height = ph.height;
+		item->offsetX = 0;
+		item->offsetY = 0;
+	} else if (ipe16_is_pip_compressiontype(compressionType)) {
+		PipPictureHeader ph;
+		if (len < sizeof(ph)) {
+			fprintf(stderr, "ERROR: Cannot read PipPictureHeader of %s\n", peh->name);
+			return false;
+		}
+		memcpy(&ph, buf, sizeof(ph));
+		item->headerSize = sizeof(ph);
+		item->width = ph.width;
+		item->height = ph.height;
+		item->offsetX = ph.offsetX;
+		item->offsetY = ph.offsetY;
+	} else {
+		fprintf(stderr, "ERROR: Unknown compression type 0x%x at %s\n", compressionType, peh->name);
+		return false;
+	}
+	item->compressionType = compressionType;
+	return true;
+}
+
+// Reads the next piece of the picture data from the ART file. Also used as refill callback of the LZW decoder.
+static bool ipe16_stream_refill(void* arg, const unsigned char** data, size_t* dataLen) {
+	Ipe16StreamReader* reader = (Ipe16StreamReader*)arg;
+	if (reader->fileRemaining == 0) return false;
+
+	const size_t n = (reader->fileRemaining < reader->bufSize) ? reader->fileRemaining : reader->bufSize;
+	Ipe16ExtractContext* ctx = reader->ctx;
+	pthread_mutex_lock(&ctx->fileMutex);
+	const bool bOK = ((file_tell64(ctx->fibArt) == reader->fileOffset) || file_seek64(ctx->fibArt, reader->fileOffset)) &&
+	                 (fread(reader->buf, n, 1, ctx->fibArt) == 1);
+	pthread_mutex_unlock(&ctx->fileMutex);
+	if (!bOK) return false;
+
+	reader->fileOffset += n;
+	reader->fileRemaining -= n;
+	*data = reader->buf;
+	*dataLen = n;
+	return true;
+}
+
+static bool ipe16_stream_read(Ipe16StreamReader* reader, unsigned char* dest, size_t len) {
+	while (len > 0) {
+		if (reader->dataPos >= reader->dataLen) {
+			if (!ipe16_stream_refill(reader, &reader->data, &reader->dataLen)) return false;
+			reader->dataPos = 0;
+			continue;
+		}
+		const size_t n = (len < reader->dataLen-reader->dataPos) ? len : reader->dataLen-reader->dataPos;
+		memcpy(dest, reader->data+reader->dataPos, n);
+		reader->dataPos += n;
+		dest += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Streaming path for huge pictures: Decodes one row after the other and writes it directly at its place in the bitmap.
+// data is the picture data in memory, or NULL if it should be read piecewise from the ART file.
+static bool ipe16_extract_picture_streaming(Ipe16ExtractContext* ctx, Ipe16WorkerScratch* scratch, Ipe16PlanItem* item, const Ipe16ColorTable* ct, const size_t paletteSize, const unsigned char* data, const uint64_t data_len) {
+	const Ipe16PictureEntryHeader* peh = &item->peh;
+	const unsigned int width = item->width;
+	const unsigned int height = item->height;
+
+	Ipe16StreamReader reader = {0};
+	reader.ctx = ctx;
+	if (data) {
+		reader.data = data;
+		reader.dataLen = data_len;
+	} else {
+		reader.fileOffset = (uint64_t)peh->offset + item->headerSize;
+		reader.fileRemaining = data_len;
+		reader.bufSize = IPE16_STREAMING_BUFFER_SIZE;
+		reader.buf = (unsigned char*)arena_alloc(&scratch->arena, reader.bufSize);
+	}
+	unsigned char* row = (unsigned char*)arena_alloc(&scratch->arena, width);
+	FILE* fobBitmap = NULL;
+	unsigned char* bmpBuf = NULL; // a tar stream needs the whole bitmap, because the rows are decoded top-down, but stored bottom-up
+	bool bCachePicture = false;   // the rows are appended to the cache file while they are decoded
+	#define STREAMING_FAIL_RETURN { if (fobBitmap) fclose(fobBitmap); free(bmpBuf); if (bCachePicture) ipe_cache_end_picture(ctx->cache, item-ctx->plan); return false; }
+
+	if (!row || (!data && !reader.buf)) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", peh->name);
+		STREAMING_FAIL_RETURN;
+	}
+
+	const bool bLZW = (item->compressionType == BA_COMPRESSIONTYPE_LZW) || (item->compressionType == PIP_COMPRESSIONTYPE_LZW);
+	if (bLZW) {
+		if (!scratch->lzwDecoder) scratch->lzwDecoder = new_ipe16lzw_decoder();
+		ipe16lzw_decode_begin(scratch->lzwDecoder, reader.data, reader.dataLen, (size_t)width*height);
+		if (!data) {
+			scratch->lzwDecoder->refill = ipe16_stream_refill;
+			scratch->lzwDecoder->refillArg = &reader;
+		}
+	} else {
+		const uint64_t expected_uncompressed_len = item->headerSize + (uint64_t)width*height + paletteSize;
+		if (expected_uncompressed_len != peh->size) {
+			fprintf(stderr, "ERROR: Image dimensions/palette (%" PRIu64 ") and defined memory size (%d) does not match for %s\n", expected_uncompressed_len, peh->size, peh->name);
+			STREAMING_FAIL_RETURN;
+		}
+	}
+
+	if (strlen(ctx->szDestFolder) > 0) {
+		char szBitmapFilename[MAX_FILE];
+		ipe16_bitmap_filename(szBitmapFilename, item);
+
+		char szAbsoluteBitmapFilename[MAX_FILE+1];
+		sprintf(szAbsoluteBitmapFilename, "%s/%s", ctx->szDestFolder, szBitmapFilename);
+		if (ctx->output && async_output_is_tar(ctx->output)) {
+			const uint64_t bmpSize = ipe16_bmp_file_size(width, height);
+			bmpBuf = ((bmpSize > 0) && (bmpSize <= SIZE_MAX)) ? (unsigned char*)malloc(bmpSize) : NULL;
+			if (!bmpBuf || !ipe16_write_bmp_header_to_memory(bmpBuf, width, height, *ct)) {
+				fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+				STREAMING_FAIL_RETURN;
+			}
+		} else {
+			// Streamed pictures are not deduplicated, but a link from an earlier run must not be overwritten
+			if (ctx->dedup) remove(szAbsoluteBitmapFilename);
+			fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
+			if (!fobBitmap) {
+				fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
+				STREAMING_FAIL_RETURN;
+			}
+			if (!ipe16_write_bmp_header(fobBitmap, width, height, *ct)) {
+				fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+				STREAMING_FAIL_RETURN;
+			}
+		}
+	}
+
+	if (ctx->cache) {
+		IpeCacheEntry cacheEntry;
+		IpeCachePaletteEntry cachePalette[IPE_CACHE_NUM_COLORS];
+		const IpeCachePaletteEntry* palette = ipe16_cache_entry(&cacheEntry, cachePalette, item, ct, paletteSize);
+		bCachePicture = true;
+		if (!ipe_cache_begin_picture(ctx->cache, &cacheEntry, palette)) STREAMING_FAIL_RETURN;
+	}
+
+	// Pixels and the attached palette
+	ChecksumXxh64State checksum;
+	checksum_xxh64_reset(&checksum, (paletteSize > 0) ? checksum_xxh64(ct, sizeof(*ct), 0) : 0);
+
+	unsigned int y;
+	for (y=0; y<height; ++y) {
+		if (bLZW) {
+			const int64_t bytes_written = ipe16lzw_decode_next(scratch->lzwDecoder, row, width);
+			if (bytes_written < 0) {
+				fprintf(stderr, "ERROR: LZW decompression error at %s\n", peh->name);
+				STREAMING_FAIL_RETURN;
+			}
+			if (bytes_written != width) {
+				fprintf(stderr, "ERROR: Image dimensions and decompressed data size does not match for %s\n", peh->name);
+				STREAMING_FAIL_RETURN;
+			}
+		} else if (!ipe16_stream_read(&reader, row, width)) {
+			fprintf(stderr, "ERROR: Cannot read picture data of %s\n", peh->name);
+			STREAMING_FAIL_RETURN;
+		}
+		if (ctx->bChecksums) checksum_xxh64_update(&checksum, row, width);
+		if (fobBitmap && !ipe16_write_bmp_row(fobBitmap, width, height, y, row)) {
+			fprintf(stderr, "ERROR: Cannot write bitmap of %s\n", peh->name);
+			STREAMING_FAIL_RETURN;
+		}
+		if (bmpBuf) ipe16_write_bmp_row_to_memory(bmpBuf, width, height, y, row);
+		if (bCachePicture && !ipe_cache_write_row(ctx->cache, row)) STREAMING_FAIL_RETURN;
+	}
+	if (ctx->bChecksums) item->checksum = checksum_xxh64_digest(&checksum);
+	if (bCachePicture) {
+		bCachePicture = false;
+		if (!ipe_cache_end_picture(ctx->cache, item-ctx->plan)) STREAMING_FAIL_RETURN;
+	}
+
+	if (fobBitmap) fclose(fobBitmap);
+	if (bmpBuf) {
+		char szBitmapFilename[MAX_FILE];
+		ipe16_bitmap_filename(szBitmapFilename, item);
+
+		char szAbsoluteBitmapFilename[MAX_FILE+1];
+		sprintf(szAbsoluteBitmapFilename, "%s/%s", ctx->szDestFolder, szBitmapFilename);
+		item->bExtracted = true;
+		async_output_write_file(ctx->output, &ctx->outputGroup, szAbsoluteBitmapFilename, bmpBuf, ipe16_bmp_file_size(width, height), &item->bExtracted);
+		return true;
+	}
+
+	item->bExtracted = true;
+	return true;
+}
+
+static bool ipe16_extract_picture_scratch(Ipe16ExtractContext* ctx, Ipe16WorkerScratch* scratch, Ipe16PlanItem* item) {
+	const Ipe16PictureEntryHeader* peh = &item->peh;
+
+	if ((uint64_t)peh->offset+peh->size > ctx->fileSize) {
+		fprintf(stderr, "ERROR: Defined size of %s exceeds file size\n", peh->name);
+		return false;
+	}
+
+	// Read the picture header, the picture data and the palette in one go.
+	// If the stored data is huge, only the picture header and the palette are read here, and the picture data is streamed.
+	Ipe16ColorTable ct;
+	const bool bStreamInput = peh->size > IPE16_STREAMING_THRESHOLD;
+	const size_t blobSize = bStreamInput ? sizeof(PipPictureHeader) : peh->size;
+	unsigned char* blob = (unsigned char*)arena_alloc(&scratch->arena, blobSize);
+	if (!blob) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", peh->name);
+		return false;
+	}
+	pthread_mutex_lock(&ctx->fileMutex);
+	if ((file_tell64(ctx->fibArt) != peh->offset) && !file_seek64(ctx->fibArt, peh->offset)) {
+		pthread_mutex_unlock(&ctx->fileMutex);
+		fprintf(stderr, "ERROR: Error jumping to offset defined for %s\n", peh->name);
+		return false;
+	}
+	if (fread(blob, blobSize, 1, ctx->fibArt) != 1) {
+		pthread_mutex_unlock(&ctx->fileMutex);
+		fprintf(stderr, "ERROR: Cannot read picture data of %s\n", peh->name);
+		return false;
+	}
+	if (bStreamInput && (peh->paletteType == IPE16_PALETTETYPE_ATTACHED)) {
+		if (!file_seek64(ctx->fibArt, (uint64_t)peh->offset+peh->size-sizeof(ct)) || (fread(&ct, sizeof(ct), 1, ctx->fibArt) != 1)) {
+			pthread_mutex_unlock(&ctx->fileMutex);
+			fprintf(stderr, "ERROR: Cannot read palette of %s\n", peh->name);
+			return false;
+		}
+	}
+	pthread_mutex_unlock(&ctx->fileMutex);
+
+	if (!ipe16_parse_picture_header(item, blob, blobSize)) return false;
+	const char compressionType = item->compressionType;
+	const size_t headerSize = item->headerSize;
+	const unsigned int width = item->width;
+	const unsigned int height = item->height;
+
+	size_t paletteSize = 0;
+	if (peh->paletteType == IPE16_PALETTETYPE_ATTACHED) {
+		if (peh->size < headerSize+sizeof(ct)) {
+			fprintf(stderr, "ERROR: Cannot read palette of %s\n", peh->name);
+			return false;
+		}
+		if (!bStreamInput) memcpy(&ct, blob+peh->size-sizeof(ct), sizeof(ct));
+		paletteSize = sizeof(ct);
+	} else if (peh->paletteType == IPE16_PALETTETYPE_PARENT) {
+		ipe16_generate_gray_table(&ct);
+	} else {
+		fprintf(stderr, "ERROR: Unknown palette type 0x%x at %s\n", peh->paletteType, peh->name);
+		return false;
+	}
+
+	const size_t data_len = peh->size-headerSize-paletteSize;
+	const uint64_t imagedata_len = (uint64_t)width * height;
+	if (bStreamInput || (imagedata_len > IPE16_STREAMING_THRESHOLD)) {
+		return ipe16_extract_picture_streaming(ctx, scratch, item, &ct, paletteSize, bStreamInput ? NULL : blob+headerSize, data_len);
+	}
+	const unsigned char* data = blob+headerSize;
+
+	unsigned char* imagedata = (unsigned char*)arena_alloc(&scratch->arena, imagedata_len);
+	if (!imagedata) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", peh->name);
+		return false;
+	}
+
+	int64_t bytes_written;
+	uint64_t expected_uncompressed_len;
+	switch (compressionType) {
+		case BA_COMPRESSIONTYPE_LZW:
+		case PIP_COMPRESSIONTYPE_LZW:
+			if (!scratch->lzwDecoder) scratch->lzwDecoder = new_ipe16lzw_decoder();
+			bytes_written = ipe16lzw_decode(scratch->lzwDecoder, imagedata, imagedata_len, data, data_len);
+			if (bytes_written < 0) {
+				fprintf(stderr, "ERROR: LZW decompression error at %s\n", peh->name);
+				return false;
+			}
+			if (bytes_written != imagedata_len) {
+				fprintf(stderr, "ERROR: Image dimensions and decompressed data size does not match for %s\n", peh->name);
+				return false;
+			}
+			break;
+		case BA_COMPRESSIONTYPE_NONE:
+		case PIP_COMPRESSIONTYPE_NONE:
+			expected_uncompressed_len = headerSize + imagedata_len + paletteSize;
+			if (expected_uncompressed_len != peh->size) {
+				fprintf(stderr, "ERROR: Image dimensions/palette (%" PRIu64 ") and defined memory size (%d) does not match for %s\n", expected_uncompressed_len, peh->size, peh->name);
+				return false;
+			}
+			memcpy(imagedata, data, imagedata_len);
+			break;
+	}
+
+	if (ctx->bChecksums) {
+		// Pixels and the attached palette
+		const uint64_t seed = (paletteSize > 0) ? checksum_xxh64(&ct, sizeof(ct), 0) : 0;
+		item->checksum = checksum_xxh64(imagedata, imagedata_len, seed);
+	}
+
+	if (ctx->cache) {
+		IpeCacheEntry cacheEntry;
+		IpeCachePaletteEntry cachePalette[IPE_CACHE_NUM_COLORS];
+		const IpeCachePaletteEntry* palette = ipe16_cache_entry(&cacheEntry, cachePalette, item, &ct, paletteSize);
+		if (!ipe_cache_write_picture(ctx->cache, item-ctx->plan, &cacheEntry, palette, imagedata, width)) return false;
+	}
+
+	if (strlen(ctx->szDestFolder) > 0) {
+		char szBitmapFilename[MAX_FILE];
+		ipe16_bitmap_filename(szBitmapFilename, item);
+
+		char szAbsoluteBitmapFilename[MAX_FILE+1];
+		sprintf(szAbsoluteBitmapFilename, "%s/%s", ctx->szDestFolder, szBitmapFilename);
+		if (ctx->output) {
+			// The bitmap is built in memory and handed over to the output. If it cannot be written, the output resets bExtracted.
+			const uint64_t bmpSize = ipe16_bmp_file_size(width, height);
+			unsigned char* bmpBuf = (bmpSize > 0) ? (unsigned char*)malloc(bmpSize) : NULL;
+			if (!bmpBuf) {
+				fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+				return false;
+			}
+			ipe16_write_bmp_to_memory(bmpBuf, width, height, imagedata, ct);
+			item->bExtracted = true;
+			async_output_write_file(ctx->output, &ctx->outputGroup, szAbsoluteBitmapFilename, bmpBuf, bmpSize, &item->bExtracted);
+			return true;
+		}
+		if (ctx->dedup) {
+			// The bitmap is built in memory, because it is compared with the bitmap it would be linked to
+			const uint64_t bmpSize = ipe16_bmp_file_size(width, height);
+			unsigned char* bmpBuf = (bmpSize > 0) ? (unsigned char*)arena_alloc(&scratch->arena, bmpSize) : NULL;
+			if (!bmpBuf) {
+				fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+				return false;
+			}
+			ipe16_write_bmp_to_memory(bmpBuf, width, height, imagedata, ct);
+			if (!picture_dedup_link(ctx->dedup, ipe16_dedup_hash(item), bmpBuf, bmpSize, szAbsoluteBitmapFilename)) {
+				FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
+				if (!fobBitmap) {
+					fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
+					return false;
+				}
+				const bool bWritten = fwrite(bmpBuf, 1, bmpSize, fobBitmap) == bmpSize;
+				if ((fclose(fobBitmap) != 0) || !bWritten) {
+					fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+					return false;
+				}
+				picture_dedup_add(ctx->dedup, ipe16_dedup_hash(item), bmpSize, szAbsoluteBitmapFilename);
+			}
+			item->bExtracted = true;
+			return true;
+		}
+		FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
+		if (!fobBitmap) {
+			fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
+			return false;
+		}
+		if (!ipe16_write_bmp(fobBitmap, width, height, imagedata, imagedata_len, ct)) {
+			fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+			fclose(fobBitmap);
+			return false;
+		}
+		fclose(fobBitmap);
+	}
+
+	item->bExtracted = true;
+	return true;
+}
+
+static bool ipe16_extract_picture(Ipe16ExtractContext* ctx, Ipe16WorkerScratch* scratch, Ipe16PlanItem* item) {
+	const bool bOK = ipe16_extract_picture_scratch(ctx, scratch, item);
+	arena_reset(&scratch->arena);
+	return bOK;
+}
+
+static void ipe16_extract_job(void* arg, int workerId) {
+	Ipe16ExtractJob* job = (Ipe16ExtractJob*)arg;
+	if (job->nextItem) file_advise_willneed(job->ctx->fibArt, job->nextItem->peh.offset, job->nextItem->peh.size);
+	ipe16_extract_picture(job->ctx, &job->ctx->scratch[workerId], job->item);
+}
+
+// Lists the pictures (-l). Only the directory and the picture headers are read, the picture data is not decoded.
+static bool ipe16_list_pictures(FILE* fibArt, const uint64_t fileSize, Ipe16ExtractJob* jobs, const int numJobs, Ipe16PlanItem* plan, const int numPictures, const IpeUnpackOptions* options) {
+	bool bEverythingOK = true;
+
+	// The picture headers are read in the order they are stored
+	int i;
+	for (i=0; i<numJobs; ++i) {
+		Ipe16PlanItem* item = jobs[i].item;
+		const Ipe16PictureEntryHeader* peh = &item->peh;
+
+		if ((uint64_t)peh->offset+peh->size > fileSize) {
+			fprintf(stderr, "ERROR: Picture %s is beyond the end of the file\n", peh->name);
+			bEverythingOK = false;
+			continue;
+		}
+
+		unsigned char buf[sizeof(PipPictureHeader)];
+		const size_t len = (peh->size < sizeof(buf)) ? peh->size : sizeof(buf);
+		if (!file_seek64(fibArt, peh->offset) || (fread(buf, len, 1, fibArt) != 1)) {
+			fprintf(stderr, "ERROR: Cannot read picture header of %s\n", peh->name);
+			bEverythingOK = false;
+			continue;
+		}
+		if (!ipe16_parse_picture_header(item, buf, len)) {
+			bEverythingOK = false;
+			continue;
+		}
+		item->bExtracted = true;
+	}
+
+	// The listing is in directory order
+	IpeListing listing;
+	ipe_list_begin(&listing, options, "IPE16");
+	int iPicNo;
+	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
+		const Ipe16PlanItem* item = &plan[iPicNo];
+		if (!item->bExtracted) continue;
+
+		char szBitmapFilename[MAX_FILE];
+		ipe16_bitmap_filename(szBitmapFilename, item);
+
+		IpeListEntry entry = {0};
+		entry.name = item->peh.name;
+		entry.filename = szBitmapFilename;
+		entry.offset = item->peh.offset;
+		entry.storedSize = item->peh.size;
+		entry.paletteType = item->peh.paletteType;
+		entry.compressionType[0] = item->compressionType;
+		entry.bHasDimensions = true;
+		entry.width = item->width;
+		entry.height = item->height;
+		entry.uncompressedSize = item->headerSize + (uint64_t)item->width*item->height;
+		if (item->peh.paletteType == IPE16_PALETTETYPE_ATTACHED) entry.uncompressedSize += sizeof(Ipe16ColorTable);
+		ipe_list_entry(&listing, &entry);
+	}
+	ipe_list_end(&listing);
+
+	return bEverythingOK;
+}
+
+Ipe16Extraction* ipe16_extract_begin(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options, ThreadPool* pool) {
 	bool bEverythingOK = true;
 
 	fseek(fibArt, 0, SEEK_SET);
@@ -38,262 +638,244 @@ bool ipe16_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const i
 	Ipe16FileHeader bfh;
 	if (fread(&bfh, sizeof(bfh), 1, fibArt) != 1) {
 		fprintf(stderr, "FATAL: Cannot read Ipe16FileHeader. It is probably not an art file.\n");
-		return false;
+		return NULL;
 	}
 
 	// The "super header" has some different meanings of the fields
 	// Name and Type are hardcoded
 	// startOffset is the number of header entries (including the super header)
 	// length is the complete file size
-	const size_t fileSize = file_size(fibArt);
+	const uint64_t fileSize = file_size(fibArt);
 	if ((strcmp(bfh.magic, IPE16_MAGIC_ART) != 0) || // better memcpy over all 23 bytes?
 		(bfh.dummy != IPE16_MAGIC_DUMMY) ||
-		(bfh.totalFileSize != fileSize)) {
+		(bfh.totalFileSize != fileSize) ||
+		(bfh.numHeaderEntries == 0) ||
+		((uint64_t)bfh.numHeaderEntries*sizeof(Ipe16PictureEntryHeader) > fileSize)) {
 		fprintf(stderr, "FATAL: Something does not seem to be correct with this art file's header. It is probably not an art file.\n");
-		return false;
+		return NULL;
 	}
 
-	Ipe16LZWDecoder* lzwDecoder = NULL;
-
-	FILE* fotIndex = NULL;
-	if (strlen(szDestFolder) > 0) {
-		char szIndexFilename[MAX_FILE];
-		sprintf(szIndexFilename, "%s/index.txt", szDestFolder);
-		fotIndex = fopen(szIndexFilename, "wt");
-		if (!fotIndex) {
-			fprintf(stderr, "FATAL: Cannot open %s for writing\n", szIndexFilename);
-			return false;
+	IpeIndexFile* index = NULL;
+	IpeIndexFile* hashes = NULL;
+	if ((strlen(szDestFolder) > 0) && (options->listFormat == IPE_LIST_NONE)) {
+		index = ipe_index_open(szDestFolder, "index.txt", options);
+		if (!index) return NULL;
+		hashes = ipe_index_open(szDestFolder, HASH_MANIFEST_FILENAME, options);
+		if (!hashes) {
+			ipe_index_close(index);
+			return NULL;
 		}
 	}
 
+	// Read the whole directory at once
 	const int numPictures = bfh.numHeaderEntries - 1;
-	char knownNames[numPictures][IPE16_NAME_SIZE];
-	memset(&knownNames[0][0], 0, numPictures*IPE16_NAME_SIZE);
+	Ipe16PlanItem* plan = (Ipe16PlanItem*)calloc(numPictures+1, sizeof(Ipe16PlanItem));
+	Ipe16ExtractJob* jobs = (Ipe16ExtractJob*)calloc(numPictures+1, sizeof(Ipe16ExtractJob));
+	Ipe16PictureEntryHeader* pehs = (Ipe16PictureEntryHeader*)malloc((numPictures+1)*sizeof(Ipe16PictureEntryHeader));
+	// In batch mode, the name patterns are checked after all ART files are processed
+	bool* patternMatched = options->patternMatched ? options->patternMatched : (bool*)calloc(options->numNamePatterns+1, sizeof(bool));
+	#define FATAL_RETURN { if (!options->patternMatched) free(patternMatched); free(pehs); free(jobs); free(plan); if (index) ipe_index_close(index); if (hashes) ipe_index_close(hashes); return NULL; }
+	if (fread(pehs, sizeof(Ipe16PictureEntryHeader), numPictures, fibArt) != numPictures) {
+		fprintf(stderr, "FATAL: Cannot read Ipe16PictureEntryHeader.\n");
+		FATAL_RETURN;
+	}
+
+	if (hashes) {
+		// The packer recognizes the ART file by its size and the checksum of its directory
+		ChecksumXxh64State directoryChecksum;
+		checksum_xxh64_reset(&directoryChecksum, 0);
+		checksum_xxh64_update(&directoryChecksum, &bfh, sizeof(bfh));
+		checksum_xxh64_update(&directoryChecksum, pehs, numPictures*sizeof(Ipe16PictureEntryHeader));
+		hash_manifest_write_header(hashes->fp, fileSize, checksum_xxh64_digest(&directoryChecksum));
+	}
+
+	NameCounter* knownNames = new_name_counter(IPE16_NAME_SIZE, numPictures);
+	if (!knownNames) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the picture names.\n");
+		FATAL_RETURN;
+	}
+	int numPlanned = 0;
 	int iPicNo;
 	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
-		Ipe16PictureEntryHeader peh;
-		if (fread(&peh, sizeof(peh), 1, fibArt) != 1) {
-			fprintf(stderr, "FATAL: Cannot read Ipe16PictureEntryHeader.\n");
-			return false;
-		}
+		const Ipe16PictureEntryHeader* peh = &pehs[iPicNo];
 
 		// Begin duplicate check
-		memcpy(&knownNames[iPicNo][0], peh.name, IPE16_NAME_SIZE);
-		int iCopyNumber = 0;
-		int j;
-		for (j=0; j<=iPicNo; ++j) {
-			// TODO: should we rather use strcmp() in IPE16?
-			if (memcmp(&knownNames[j][0], peh.name, IPE16_NAME_SIZE) == 0) ++iCopyNumber;
+		// TODO: should we rather use strcmp() in IPE16?
+		const int iCopyNumber = name_counter_add(knownNames, peh->name);
+		if (iCopyNumber == 0) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for the picture names.\n");
+			del_name_counter(knownNames);
+			FATAL_RETURN;
 		}
-		assert(iCopyNumber > 0);
 		// End duplicate check
 
 		// in the English version of Blown Away (not the Special Edition), there is a header entry
 		// with the fields seh.name='', peh.paletteType=0x00, seh.offset[end of file], seh.size=0
 		// ignore it
-		if (strlen(peh.name) == 0) continue;
-		if (peh.size == 0) continue;
+		if (peh->name[0] == 0) continue;
+		if (peh->size == 0) continue;
 
-		if (strlen(peh.name) > IPE16_NAME_SIZE-1) {
+		if (memchr(peh->name, 0, IPE16_NAME_SIZE) == NULL) {
 			fprintf(stderr, "FATAL: szName at picture %d is breaking the boundaries. The file is probably corrupt.\n", iPicNo);
-			return false;
-		}
-
-		size_t headersPos = ftell(fibArt);
-		#define FAIL_CONTINUE { bEverythingOK = false; fseek(fibArt, headersPos, SEEK_SET); continue; }
-
-		if (fseek(fibArt, peh.offset, SEEK_SET) != 0) {
-			fprintf(stderr, "ERROR: Error jumping to offset defined for %s\n", peh.name);
-			FAIL_CONTINUE;
+			del_name_counter(knownNames);
+			FATAL_RETURN;
 		}
 
-		if (peh.offset+peh.size > fileSize) {
-			fprintf(stderr, "ERROR: Defined size of %s exceeds file size\n", peh.name);
-			FAIL_CONTINUE;
-		}
+		// Only the directory is needed to select the pictures. The data of the other pictures is not read at all.
+		if (!ipe_unpack_name_selected(options, peh->name, patternMatched)) continue;
 
-		unsigned char compressionType;
-		int bakPos = ftell(fibArt);
-		fread(&compressionType, sizeof(compressionType), 1, fibArt);
-		fseek(fibArt, bakPos, SEEK_SET);
+		plan[iPicNo].peh = *peh;
+		plan[iPicNo].iCopyNumber = iCopyNumber;
+		jobs[numPlanned++].item = &plan[iPicNo];
+	}
+	del_name_counter(knownNames);
+	free(pehs);
+	pehs = NULL;
 
-		if ((compressionType == BA_COMPRESSIONTYPE_LZW) || (compressionType == BA_COMPRESSIONTYPE_NONE)) {
-			BAPictureHeader ph;
-			if (fread(&ph, sizeof(ph), 1, fibArt) != 1) {
-				fprintf(stderr, "ERROR: Cannot read BAPictureHeader of %s\n", peh.name);
-				FAIL_CONTINUE;
-			}
+	if (!options->patternMatched) {
+		if (!ipe_unpack_check_name_patterns(options, patternMatched)) bEverythingOK = false;
+		free(patternMatched);
+	}
+	patternMatched = NULL;
+
+	Ipe16Extraction* ex = (Ipe16Extraction*)calloc(1, sizeof(Ipe16Extraction));
+	ex->options = options;
+	ex->pool = pool;
+	ex->index = index;
+	ex->hashes = hashes;
+	ex->numPictures = numPictures;
+	ex->plan = plan;
+	ex->numPlanned = numPlanned;
+	ex->jobs = jobs;
+
+	if (options->listFormat != IPE_LIST_NONE) {
+		// The listing only needs the headers. It is done right away, so the listings of several ART files are not mixed.
+		qsort(jobs, numPlanned, sizeof(Ipe16ExtractJob), ipe16_compare_job_offset);
+		if (!ipe16_list_pictures(fibArt, fileSize, jobs, numPlanned, plan, numPictures, options)) bEverythingOK = false;
+		ex->bListOnly = true;
+		ex->bEverythingOK = bEverythingOK;
+		return ex;
+	}
 
-			size_t imagedata_len = ph.width * ph.height;
-			unsigned char* imagedata = (unsigned char*)malloc(imagedata_len);
+	// A single thread extracts the pictures in the order they are stored, so that the data is read in one sequential pass.
+	// Several threads extract the largest pictures first, to avoid a long tail.
+	if (options->numThreads > 1) {
+		qsort(jobs, numPlanned, sizeof(Ipe16ExtractJob), ipe16_compare_job_size);
+	} else {
+		qsort(jobs, numPlanned, sizeof(Ipe16ExtractJob), ipe16_compare_job_offset);
+		if (options->numNamePatterns == 0) file_advise_sequential(fibArt);
+	}
 
-			Ipe16ColorTable ct;
-			if (peh.paletteType == IPE16_PALETTETYPE_ATTACHED) {
-				if ((fseek(fibArt, peh.offset+peh.size-sizeof(ct), SEEK_SET) != 0) ||
-				    (fread(&ct, sizeof(ct), 1, fibArt) != 1) ||
-				    (fseek(fibArt, peh.offset+sizeof(ph), SEEK_SET) != 0)) {
-					fprintf(stderr, "ERROR: Cannot read palette of %s\n", peh.name);
-					FAIL_CONTINUE;
-				}
-			} else if (peh.paletteType == IPE16_PALETTETYPE_PARENT) {
-				ipe16_generate_gray_table(&ct);
-			} else {
-				fprintf(stderr, "ERROR: Unknown palette type 0x%x at %s\n", peh.paletteType, peh.name);
-				FAIL_CONTINUE;
-			}
+	ex->bChecksums = ipe_checksums_needed(options);
+	if (ex->bChecksums) ipe_checksum_report_begin(&ex->report, options);
+
+	Ipe16ExtractContext* ctx = &ex->ctx;
+	ctx->fibArt = fibArt;
+	pthread_mutex_init(&ctx->fileMutex, NULL);
+	ctx->fileSize = fileSize;
+	ctx->szDestFolder = szDestFolder;
+	ctx->bChecksums = ex->bChecksums || hashes;
+	ctx->output = options->output;
+	ctx->plan = plan;
+	ctx->dedup = options->dedup;
+	if (options->szCacheFile) {
+		ctx->cache = new_ipe_cache_writer(options->szCacheFile, fibArt, IPE_CACHE_FORMAT_IPE16, (options->numNamePatterns > 0) ? IPE_CACHE_FLAG_PARTIAL : 0, numPictures);
+		if (!ctx->cache) bEverythingOK = false;
+	}
+	ex->numSlots = thread_pool_num_slots(pool);
+	ctx->scratch = (Ipe16WorkerScratch*)calloc(ex->numSlots, sizeof(Ipe16WorkerScratch));
 
-			unsigned int bytes_written, expected_uncompressed_len;
-			switch (ph.compressionType) {
-				case BA_COMPRESSIONTYPE_LZW:
-					if (!lzwDecoder) lzwDecoder = new_ipe16lzw_decoder();
-					bytes_written = ipe16lzw_decode(fibArt, lzwDecoder, imagedata, imagedata_len);
-					if (bytes_written < 0) {
-						fprintf(stderr, "ERROR: LZW decompression error at %s\n", peh.name);
-						FAIL_CONTINUE;
-					}
-					if (bytes_written != imagedata_len) {
-						fprintf(stderr, "ERROR: Image dimensions and decompressed data size does not match for %s\n", peh.name);
-						FAIL_CONTINUE;
-					}
-
-					break;
-				case BA_COMPRESSIONTYPE_NONE:
-					expected_uncompressed_len = imagedata_len;
-					if (peh.paletteType == IPE16_PALETTETYPE_ATTACHED) expected_uncompressed_len += sizeof(ct);
-					expected_uncompressed_len += sizeof(ph.compressionType)+sizeof(ph.width)+sizeof(ph.height);
-					if (expected_uncompressed_len != peh.size) {
-						fprintf(stderr, "ERROR: Image dimensions/palette (%d) and defined memory size (%d) does not match for %s\n", expected_uncompressed_len, peh.size, peh.name);
-						FAIL_CONTINUE;
-					}
-					fread(imagedata, imagedata_len, 1, fibArt); // no error checking, because filesize was already checked
-					break;
-			}
+	int i;
+	for (i=0; i<numPlanned; ++i) {
+		jobs[i].ctx = ctx;
+		jobs[i].nextItem = (i+1 < numPlanned) ? jobs[i+1].item : NULL;
+		if (options->szCacheFile && !ctx->cache) continue; // nothing to write to
+		thread_pool_submit(pool, &ex->group, ipe16_extract_job, &jobs[i]);
+	}
 
-			char szBitmapFilename[MAX_FILE];
-			if (iCopyNumber == 1) {
-				sprintf(szBitmapFilename, "%s.bmp", sanitize_filename(peh.name));
-			} else {
-				sprintf(szBitmapFilename, "%s__%d.bmp", sanitize_filename(peh.name), iCopyNumber);
-			}
+	ex->bEverythingOK = bEverythingOK;
+	return ex;
+}
 
-			if (strlen(szDestFolder) > 0) {
-				char szAbsoluteBitmapFilename[MAX_FILE+1];
-				sprintf(szAbsoluteBitmapFilename, "%s/%s", szDestFolder, szBitmapFilename);
-				FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
-				if (!fobBitmap) {
-					fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
-					FAIL_CONTINUE;
-				}
-				ipe16_write_bmp(fobBitmap, ph.width, ph.height, imagedata, imagedata_len, ct);
-				fclose(fobBitmap);
-			}
+bool ipe16_extract_end(Ipe16Extraction* ex) {
+	bool bEverythingOK = ex->bEverythingOK;
+	const int verbosity = ex->options->verbosity;
+	FILE* fotIndex = ex->index ? ex->index->fp : NULL;
+	const Ipe16PlanItem* plan = ex->plan;
+	int i, iPicNo;
+
+	if (ex->bListOnly) {
+		free(ex->jobs);
+		free(ex->plan);
+		free(ex);
+		return bEverythingOK;
+	}
 
-			if (fotIndex) {
-				// We require this index file for 2 reasons
-				// 1. Our packer tool can then know what to pack
-				// 2. The packer tool can know which picture would have a palette appended and which one does not
-				// The index file won't be written in simulation mode (when no output directory is defined)
-				fprintf(fotIndex, "%c %c %s %s\n", peh.paletteType, ph.compressionType, peh.name, szBitmapFilename);
-			}
-			if (verbosity >= 1) {
-				fprintf(stdout, "%c %c %s %s\n", peh.paletteType, ph.compressionType, peh.name, szBitmapFilename);
-			}
+	thread_pool_wait(ex->pool, &ex->group);
+	if (ex->ctx.output) async_output_wait(ex->ctx.output, &ex->ctx.outputGroup);
+	if (ex->ctx.cache && !del_ipe_cache_writer(ex->ctx.cache)) bEverythingOK = false;
 
-			free(imagedata);
-		} else if ((compressionType == PIP_COMPRESSIONTYPE_LZW) || (compressionType == PIP_COMPRESSIONTYPE_NONE)) {
-			PipPictureHeader ph;
-			if (fread(&ph, sizeof(ph), 1, fibArt) != 1) {
-				fprintf(stderr, "ERROR: Cannot read PipPictureHeader of %s\n", peh.name);
-				FAIL_CONTINUE;
-			}
+	for (i=0; i<ex->numSlots; ++i) {
+		if (ex->ctx.scratch[i].lzwDecoder) del_ipe16lzw_decoder(ex->ctx.scratch[i].lzwDecoder);
+		arena_free(&ex->ctx.scratch[i].arena);
+	}
+	free(ex->ctx.scratch);
+	pthread_mutex_destroy(&ex->ctx.fileMutex);
 
-			size_t imagedata_len = ph.width * ph.height;
-			unsigned char* imagedata = (unsigned char*)malloc(imagedata_len);
+	for (i=0; i<ex->numPlanned; ++i) {
+		if (!ex->jobs[i].item->bExtracted) bEverythingOK = false;
+	}
 
-			Ipe16ColorTable ct;
-			if (peh.paletteType == IPE16_PALETTETYPE_ATTACHED) {
-				if ((fseek(fibArt, peh.offset+peh.size-sizeof(ct), SEEK_SET) != 0) ||
-				    (fread(&ct, sizeof(ct), 1, fibArt) != 1) ||
-				    (fseek(fibArt, peh.offset+sizeof(ph), SEEK_SET) != 0)) {
-					fprintf(stderr, "ERROR: Cannot read palette of %s\n", peh.name);
-					FAIL_CONTINUE;
-				}
-			} else if (peh.paletteType == IPE16_PALETTETYPE_PARENT) {
-				ipe16_generate_gray_table(&ct);
-			} else {
-				fprintf(stderr, "ERROR: Unknown palette type 0x%x at %s\n", peh.paletteType, peh.name);
-				FAIL_CONTINUE;
-			}
+	// The index is written in directory order, independent of the extraction order
+	for (iPicNo=0; iPicNo<ex->numPictures; ++iPicNo) {
+		const Ipe16PlanItem* item = &plan[iPicNo];
+		if (item->peh.size == 0) continue; // not planned
 
-			unsigned int bytes_written, expected_uncompressed_len;
-			switch (ph.compressionType) {
-				case PIP_COMPRESSIONTYPE_LZW:
-					if (!lzwDecoder) lzwDecoder = new_ipe16lzw_decoder();
-					bytes_written = ipe16lzw_decode(fibArt, lzwDecoder, imagedata, imagedata_len);
-					if (bytes_written < 0) {
-						fprintf(stderr, "ERROR: LZW decompression error at %s\n", peh.name);
-						FAIL_CONTINUE;
-					}
-					if (bytes_written != imagedata_len) {
-						fprintf(stderr, "ERROR: Image dimensions and decompressed data size does not match for %s\n", peh.name);
-						FAIL_CONTINUE;
-					}
-
-					break;
-				case PIP_COMPRESSIONTYPE_NONE:
-					expected_uncompressed_len = imagedata_len;
-					if (peh.paletteType == IPE16_PALETTETYPE_ATTACHED) expected_uncompressed_len += sizeof(ct);
-					expected_uncompressed_len += sizeof(ph.compressionType)+sizeof(ph.offsetX)+sizeof(ph.offsetY)+sizeof(ph.width)+sizeof(ph.height);
-					if (expected_uncompressed_len != peh.size) {
-						fprintf(stderr, "ERROR: Image dimensions/palette (%d) and defined memory size (%d) does not match for %s\n", expected_uncompressed_len, peh.size, peh.name);
-						FAIL_CONTINUE;
-					}
-					fread(imagedata, imagedata_len, 1, fibArt); // no error checking, because filesize was already checked
-					break;
-			}
+		char szBitmapFilename[MAX_FILE];
+		ipe16_bitmap_filename(szBitmapFilename, item);
 
-			char szBitmapFilename[MAX_FILE];
-			if (iCopyNumber == 1) {
-				sprintf(szBitmapFilename, "%s.bmp", sanitize_filename(peh.name));
-			} else {
-				sprintf(szBitmapFilename, "%s__%d.bmp", sanitize_filename(peh.name), iCopyNumber);
-			}
+		if (ex->bChecksums) ipe_checksum_report_picture(&ex->report, szBitmapFilename, item->bExtracted, item->checksum);
+		if (!item->bExtracted) continue;
 
-			if (strlen(szDestFolder) > 0) {
-				char szAbsoluteBitmapFilename[MAX_FILE+1];
-				sprintf(szAbsoluteBitmapFilename, "%s/%s", szDestFolder, szBitmapFilename);
-				FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
-				if (!fobBitmap) {
-					fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
-					FAIL_CONTINUE;
-				}
-				ipe16_write_bmp(fobBitmap, ph.width, ph.height, imagedata, imagedata_len, ct);
-				fclose(fobBitmap);
-			}
+		if (ex->hashes) hash_manifest_write_entry(ex->hashes->fp, item->checksum, iPicNo, szBitmapFilename);
 
+		if (!ipe16_is_pip_compressiontype(item->compressionType)) {
 			if (fotIndex) {
 				// We require this index file for 2 reasons
 				// 1. Our packer tool can then know what to pack
 				// 2. The packer tool can know which picture would have a palette appended and which one does not
 				// The index file won't be written in simulation mode (when no output directory is defined)
-				fprintf(fotIndex, "%c %c %s %s %d %d\n", peh.paletteType, ph.compressionType, peh.name, szBitmapFilename, ph.offsetX, ph.offsetY);
+				fprintf(fotIndex, "%c %c %s %s\n", item->peh.paletteType, item->compressionType, item->peh.name, szBitmapFilename);
 			}
 			if (verbosity >= 1) {
-				fprintf(stdout, "%c %c %s %s %d %d\n", peh.paletteType, ph.compressionType, peh.name, szBitmapFilename, ph.offsetX, ph.offsetY);
+				fprintf(stdout, "%c %c %s %s\n", item->peh.paletteType, item->compressionType, item->peh.name, szBitmapFilename);
 			}
-
-			free(imagedata);
 		} else {
-			fprintf(stderr, "ERROR: Unknown compression type 0x%x at %s\n", compressionType, peh.name);
-			FAIL_CONTINUE;
+			if (fotIndex) {
+				fprintf(fotIndex, "%c %c %s %s %d %d\n", item->peh.paletteType, item->compressionType, item->peh.name, szBitmapFilename, item->offsetX, item->offsetY);
+			}
+			if (verbosity >= 1) {
+				fprintf(stdout, "%c %c %s %s %d %d\n", item->peh.paletteType, item->compressionType, item->peh.name, szBitmapFilename, item->offsetX, item->offsetY);
+			}
 		}
-
-		fseek(fibArt, headersPos, SEEK_SET); // we were already there, so we don't need to check for errors
 	}
 
-	if (lzwDecoder) del_ipe16lzw_decoder(lzwDecoder);
+	if (ex->bChecksums && !ipe_checksum_report_end(&ex->report)) bEverythingOK = false;
+
+	free(ex->jobs);
+	free(ex->plan);
 
-	if (strlen(szDestFolder) > 0) fclose(fotIndex);
+	if (ex->index && !ipe_index_close(ex->index)) bEverythingOK = false;
+	if (ex->hashes && !ipe_index_close(ex->hashes)) bEverythingOK = false;
+
+	free(ex);
+	return bEverythingOK;
+}
 
+bool ipe16_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options) {
+	ThreadPool* pool = new_thread_pool(options->numThreads);
+	Ipe16Extraction* ex = ipe16_extract_begin(fibArt, szDestFolder, options, pool);
+	const bool bEverythingOK = ex ? ipe16_extract_end(ex) : false;
+	del_thread_pool(pool);
 	return bEverythingOK;
 }
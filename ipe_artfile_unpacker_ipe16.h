@@ -13,6 +13,17 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-bool ipe16_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const int verbosity);
+#include "ipe_artfile_unpacker_common.h"
+#include "thread_pool.h"
+
+typedef struct tagIpe16Extraction Ipe16Extraction;
+
+bool ipe16_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options);
+
+// Two-phase variant for the batch mode, so that the pictures of several ART files can be extracted by the same thread pool:
+// ipe16_extract_begin() reads the directory and submits the pictures to the pool (NULL on a fatal error),
+// ipe16_extract_end() waits for them, writes index.txt and frees everything. fibArt must stay open until then.
+Ipe16Extraction* ipe16_extract_begin(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options, ThreadPool* pool);
+bool ipe16_extract_end(Ipe16Extraction* ex);
 
 #endif // #ifndef __inc__ipe_artfile_packer_ipe16
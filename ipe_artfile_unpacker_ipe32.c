@@ -12,12 +12,21 @@
 #include <assert.h>
 #include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "ipe32_bmpexport.h"
 #include "ipe32_artfile.h"
 #include "ipe32_lzw_decoder.h"
+#include "ipe_artfile_unpacker_ipe32.h"
 
 #include "utils.h"
+#include "name_counter.h"
+#include "thread_pool.h"
+#include "checksum.h"
+#include "arena.h"
+#include "bitmap.h"
+#include "ipe_cache_file.h"
+#include "hash_manifest.h"
 
 #define MAX_FILE 256
 
@@ -27,26 +36,97 @@ typedef struct tagIpe32ReadPictureResult {
 	uint32_t   numRawChunks;
 } Ipe32ReadPictureResult;
 
-Ipe32ReadPictureResult ipe32_read_picture(FILE* hFile, unsigned char* outbuf, const int outputBufLength, bool bVerbose) {
-	unsigned char* lzwbuf = (unsigned char*)malloc(0x8000);
-	int availableOutputBytes = outputBufLength;
+// One entry of the extraction plan. The plan is kept in directory order (for index.txt),
+// but a single thread extracts the pictures in the order of their offsets, so that the ART file is read sequentially
+typedef struct tagIpe32PlanItem {
+	Ipe32PictureEntryHeader peh;
+	char szName[IPE32_NAME_SIZE+1];
+	int iCopyNumber;
+	size_t storedSize;   // upper bound of the stored data, derived from the offset of the next picture
+	bool bSelected;      // selected by the name patterns (-n)
+	bool bExtracted;     // only extracted pictures are listed in index.txt
+	Ipe32ReadPictureResult res;
+	uint64_t checksum;   // of the decoded picture (only if checksums are needed)
+} Ipe32PlanItem;
+
+// Scratch memory of one worker thread. The decoder (and its tables) is reused for all pictures of the ART file,
+// and the buffers of the current picture (stored chunks, chunk buffer, decoded picture) come from the arena, which is reset after every picture.
+typedef struct tagIpe32WorkerScratch {
+	Ipe32LZWDecoder* lzwDecoder;
+	Arena arena;
+} Ipe32WorkerScratch;
+
+// Shared by all worker threads
+typedef struct tagIpe32ExtractContext {
+	FILE* fibArt;
+	pthread_mutex_t fileMutex;
+	uint64_t fileSize;
+	const char* szDestFolder;
+	int verbosity;
+	bool bChecksums;
+	AsyncOutput* output;         // NULL if the bitmaps are written synchronously
+	AsyncOutputGroup outputGroup;
+	IpeCacheWriter* cache;       // NULL if no cache file is written
+	PictureDedup* dedup;         // NULL if the bitmaps are not deduplicated
+	const Ipe32PlanItem* plan;   // to get the directory position of a picture for the cache
+	Ipe32WorkerScratch* scratch; // one per thread pool slot
+} Ipe32ExtractContext;
+
+typedef struct tagIpe32ExtractJob {
+	Ipe32ExtractContext* ctx;
+	Ipe32PlanItem* item;
+	const Ipe32PlanItem* nextItem; // the picture which will probably be read next (for the readahead hint)
+} Ipe32ExtractJob;
+
+// State of one ART file between ipe32_extract_begin() and ipe32_extract_end()
+struct tagIpe32Extraction {
+	const IpeUnpackOptions* options;
+	ThreadPool* pool;
+	bool bEverythingOK;
+	bool bListOnly;
+	IpeIndexFile* index; // NULL if no index.txt is written
+	IpeIndexFile* hashes; // hash manifest next to index.txt (for the packer option --base), NULL if no index.txt is written
+	int numPictures;
+	Ipe32PlanItem* plan;    // numPictures entries, in directory order
+	Ipe32PlanItem** order;  // in the order of the offsets
+	int numJobs;
+	Ipe32ExtractJob* jobs;  // numJobs entries, in extraction order
+	Ipe32ExtractContext ctx;
+	int numSlots;
+	ThreadPoolGroup group;
+	bool bChecksums;
+	IpeChecksumReport report;
+};
+
+// lzwbuf must have 0x8000 bytes
+Ipe32ReadPictureResult ipe32_read_picture(Ipe32LZWDecoder* decoder, unsigned char* lzwbuf, const unsigned char* blob, const size_t blobLength, unsigned char* outbuf, const size_t outputBufLength, bool bVerbose) {
+	size_t availableOutputBytes = outputBufLength;
+	size_t blobPos = 0;
 
 	Ipe32ReadPictureResult res;
 	res.numCompressedChunks = 0;
 	res.numRawChunks = 0;
 	res.writtenBytes = 0;
 
-	Ipe32LZWDecoder *decoder = new_ipe32lzw_decoder();
-	ipe32lzw_init_decoder(decoder);
 	if (outputBufLength != 0) {
 		int chunkNo = 0;
 		do {
 			uint16_t len;
-			fread(&len, 1, 2, hFile);
+			if (blobPos+sizeof(len) > blobLength) {
+				fprintf(stderr, "ERROR: Chunk %d is beyond the end of the picture data!\n", chunkNo);
+				break;
+			}
+			memcpy(&len, blob+blobPos, sizeof(len));
+			blobPos += sizeof(len);
 
-			uint16_t writtenBytes;
+			int writtenBytes;
 			if (len < 0x8000) {
-				fread(lzwbuf, 1, len, hFile);
+				if (blobPos+len > blobLength) {
+					fprintf(stderr, "ERROR: Chunk %d is beyond the end of the picture data!\n", chunkNo);
+					break;
+				}
+				memcpy(lzwbuf, blob+blobPos, len);
+				blobPos += len;
 				res.numCompressedChunks++;
 				if (bVerbose) fprintf(stdout, "Chunk %d (compressed, length: %d) ...\n", chunkNo, len);
 
@@ -56,7 +136,7 @@ Ipe32ReadPictureResult ipe32_read_picture(FILE* hFile, unsigned char* outbuf, co
 				// Requirement 2: The size of the uncompressed data must not exceed the size of the compressed data
 				size_t maxReadBytes = expectedOutputSize;
 
-				writtenBytes = ipe32lzw_decode(decoder, outbuf, outputBufLength, lzwbuf, maxReadBytes); // returns bytes written, or -1
+				writtenBytes = ipe32lzw_decode(decoder, outbuf, availableOutputBytes, lzwbuf, maxReadBytes); // returns bytes written, or -1
 
 				if (writtenBytes == -1) {
 					fprintf(stderr, "ERROR: Fatal error during decompression of chunk %d!\n", chunkNo);
@@ -71,7 +151,12 @@ Ipe32ReadPictureResult ipe32_read_picture(FILE* hFile, unsigned char* outbuf, co
 				len &= 0x7FFF;
 				res.numRawChunks++;
 				if (bVerbose) fprintf(stdout, "Chunk %d (raw, length: %d) ...\n", chunkNo, len);
-				fread(outbuf, 1, len, hFile);
+				if ((blobPos+len > blobLength) || (len > availableOutputBytes)) {
+					fprintf(stderr, "ERROR: Raw chunk %d does not fit into the picture data!\n", chunkNo);
+					break;
+				}
+				memcpy(outbuf, blob+blobPos, len);
+				blobPos += len;
 				writtenBytes = len;
 			}
 			outbuf += writtenBytes;
@@ -79,14 +164,277 @@ Ipe32ReadPictureResult ipe32_read_picture(FILE* hFile, unsigned char* outbuf, co
 			chunkNo++;
 		} while (availableOutputBytes != 0);
 	}
-	ipe32lzw_free_decoder(decoder);
-
-	free(lzwbuf);
 	res.writtenBytes = outputBufLength-availableOutputBytes;
 	return res;
 }
 
-bool ipe32_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const int verbosity) {
+static void ipe32_bitmap_filename(char* szBitmapFilename, Ipe32PlanItem* item) {
+	if (item->iCopyNumber == 1) {
+		sprintf(szBitmapFilename, "%s.bmp", sanitize_filename(item->szName));
+	} else {
+		sprintf(szBitmapFilename, "%s__%d.bmp", sanitize_filename(item->szName), item->iCopyNumber);
+	}
+}
+
+static int ipe32_compare_plan_offset(const void* a, const void* b) {
+	const Ipe32PlanItem* x = *(const Ipe32PlanItem**)a;
+	const Ipe32PlanItem* y = *(const Ipe32PlanItem**)b;
+	if (x->peh.offset != y->peh.offset) return (x->peh.offset < y->peh.offset) ? -1 : 1;
+	// Keep the directory order for pictures sharing the same offset
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static int ipe32_compare_job_size(const void* a, const void* b) {
+	const Ipe32PlanItem* x = ((const Ipe32ExtractJob*)a)->item;
+	const Ipe32PlanItem* y = ((const Ipe32ExtractJob*)b)->item;
+	// Largest first, so that no big picture is left over at the end while the other threads are idle
+	if (x->peh.uncompressedSize != y->peh.uncompressedSize) return (x->peh.uncompressedSize > y->peh.uncompressedSize) ? -1 : 1;
+	if (x->peh.offset != y->peh.offset) return (x->peh.offset < y->peh.offset) ? -1 : 1;
+	return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// Adds a decoded picture (a bitmap without the file header) to the cache file.
+// The rows are stored top-down and without padding, the palette (if any) is converted from BGR to RGB.
+static bool ipe32_cache_picture(Ipe32ExtractContext* ctx, const Ipe32PlanItem* item, const unsigned char* bmp, const size_t bmpLen) {
+	BITMAPINFOHEADER bih;
+	if (bmpLen < sizeof(bih)) {
+		fprintf(stderr, "ERROR: Picture %s is too small for a bitmap\n", item->szName);
+		return false;
+	}
+	memcpy(&bih, bmp, sizeof(bih));
+	if ((bih.biSize < sizeof(bih)) || (bih.biCompression != BI_RGB) ||
+		((bih.biBitCount != 8) && (bih.biBitCount != 24) && (bih.biBitCount != 32)) ||
+		(bih.biWidth <= 0) || (bih.biHeight == 0) || (bih.biHeight == INT32_MIN)) {
+		fprintf(stderr, "ERROR: Picture %s is not an uncompressed 8, 24 or 32 bit bitmap and cannot be cached\n", item->szName);
+		return false;
+	}
+	const bool bTopDown = bih.biHeight < 0;
+	const uint32_t width = bih.biWidth;
+	const uint32_t height = bTopDown ? -bih.biHeight : bih.biHeight;
+	const uint32_t numColors = (bih.biBitCount != 8) ? 0 : (bih.biClrUsed > 0) ? bih.biClrUsed : IPE_CACHE_NUM_COLORS;
+	const uint64_t rowSize = ((uint64_t)width*bih.biBitCount + 31) / 32 * 4;
+	const uint64_t pixelOffset = bih.biSize + (uint64_t)numColors*sizeof(RGBQUAD);
+	if ((numColors > IPE_CACHE_NUM_COLORS) || (pixelOffset + rowSize*height > bmpLen)) {
+		fprintf(stderr, "ERROR: Bitmap data of %s is incomplete\n", item->szName);
+		return false;
+	}
+
+	IpeCacheEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	snprintf(entry.name, sizeof(entry.name), "%s", item->szName);
+	entry.width = width;
+	entry.height = height;
+	entry.stride = (uint32_t)((uint64_t)width*bih.biBitCount/8);
+	entry.numColors = numColors;
+	entry.bitsPerPixel = bih.biBitCount;
+
+	IpeCachePaletteEntry palette[IPE_CACHE_NUM_COLORS];
+	memset(palette, 0, sizeof(palette));
+	uint32_t i;
+	for (i=0; i<numColors; ++i) {
+		const RGBQUAD* color = (const RGBQUAD*)(bmp + bih.biSize) + i;
+		palette[i].r = color->rgbRed;
+		palette[i].g = color->rgbGreen;
+		palette[i].b = color->rgbBlue;
+	}
+
+	const unsigned char* pixels = bmp + pixelOffset;
+	if (bTopDown) {
+		return ipe_cache_write_picture(ctx->cache, item-ctx->plan, &entry, (numColors > 0) ? palette : NULL, pixels, rowSize);
+	} else {
+		return ipe_cache_write_picture(ctx->cache, item-ctx->plan, &entry, (numColors > 0) ? palette : NULL, pixels + rowSize*(height-1), -(int64_t)rowSize);
+	}
+}
+
+static bool ipe32_extract_picture_scratch(Ipe32ExtractContext* ctx, Ipe32WorkerScratch* scratch, Ipe32PlanItem* item) {
+	const char* szName = item->szName;
+	const int verbosity = ctx->verbosity;
+
+	if (item->peh.offset >= ctx->fileSize) {
+		fprintf(stderr, "ERROR: Error jumping to offset defined for %s\n", szName);
+		return false;
+	}
+
+	if (verbosity >= 2) fprintf(stdout, "Extracting %s (expected file size: %d bytes) ...\n", szName, item->peh.uncompressedSize);
+
+	// Read all chunks of the picture in one go
+	const size_t outputBufLen = item->peh.uncompressedSize;
+	unsigned char* blob = (unsigned char*)arena_alloc(&scratch->arena, item->storedSize);
+	unsigned char* lzwbuf = (unsigned char*)arena_alloc(&scratch->arena, 0x8000);
+	// With asynchronous output, the picture is decoded directly behind the bitmap file header, and the buffer is handed over to the output.
+	// With --dedup, the whole bitmap is needed as well, because it is compared with the bitmap it would be linked to.
+	const bool bAsyncOutput = ctx->output && (strlen(ctx->szDestFolder) > 0);
+	const bool bWholeBitmap = bAsyncOutput || (ctx->dedup && (strlen(ctx->szDestFolder) > 0));
+	unsigned char* bmpBuf = bWholeBitmap ? (unsigned char*)malloc(IPE32_BMP_FILE_HEADER_SIZE+outputBufLen) : NULL;
+	unsigned char* outputBuf = bWholeBitmap ? (bmpBuf ? bmpBuf+IPE32_BMP_FILE_HEADER_SIZE : NULL) : (unsigned char*)arena_alloc(&scratch->arena, outputBufLen);
+	#define FAIL_RETURN { free(bmpBuf); return false; }
+	if (!scratch->lzwDecoder) {
+		scratch->lzwDecoder = new_ipe32lzw_decoder();
+		if (scratch->lzwDecoder) ipe32lzw_init_decoder(scratch->lzwDecoder);
+	}
+	if (!blob || !lzwbuf || !outputBuf || !scratch->lzwDecoder) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for %s\n", szName);
+		FAIL_RETURN;
+	}
+	pthread_mutex_lock(&ctx->fileMutex);
+	if ((file_tell64(ctx->fibArt) != item->peh.offset) && !file_seek64(ctx->fibArt, item->peh.offset)) {
+		pthread_mutex_unlock(&ctx->fileMutex);
+		fprintf(stderr, "ERROR: Error jumping to offset defined for %s\n", szName);
+		FAIL_RETURN;
+	}
+	if ((item->storedSize > 0) && (fread(blob, item->storedSize, 1, ctx->fibArt) != 1)) {
+		pthread_mutex_unlock(&ctx->fileMutex);
+		fprintf(stderr, "ERROR: Cannot read picture data of %s\n", szName);
+		FAIL_RETURN;
+	}
+	pthread_mutex_unlock(&ctx->fileMutex);
+
+	item->res = ipe32_read_picture(scratch->lzwDecoder, lzwbuf, blob, item->storedSize, outputBuf, outputBufLen, verbosity >= 2);
+	if (item->res.writtenBytes != outputBufLen) {
+		fprintf(stderr, "FATAL: Error reading picture %s (compression failure?)\n", szName);
+		FAIL_RETURN;
+	}
+
+	if (ctx->bChecksums) item->checksum = checksum_xxh64(outputBuf, outputBufLen, 0);
+
+	if (ctx->cache && !ipe32_cache_picture(ctx, item, outputBuf, outputBufLen)) FAIL_RETURN;
+
+	const char* szDestFolder = ctx->szDestFolder;
+	if (strlen(szDestFolder) > 0) {
+		char szBitmapFilename[MAX_FILE];
+		ipe32_bitmap_filename(szBitmapFilename, item);
+
+		char szAbsoluteBitmapFilename[MAX_FILE+1];
+		sprintf(szAbsoluteBitmapFilename, "%s/%s", szDestFolder, szBitmapFilename);
+		if (bAsyncOutput) {
+			// If the bitmap cannot be written, the output resets bExtracted
+			item->bExtracted = true;
+			ipe32_fill_bmp_header(bmpBuf, outputBufLen);
+			async_output_write_file(ctx->output, &ctx->outputGroup, szAbsoluteBitmapFilename, bmpBuf, IPE32_BMP_FILE_HEADER_SIZE+outputBufLen, &item->bExtracted);
+			return true;
+		}
+		// The decoded picture contains the bitmap header, so its checksum covers the whole bitmap
+		if (ctx->dedup) {
+			ipe32_fill_bmp_header(bmpBuf, outputBufLen);
+			if (picture_dedup_link(ctx->dedup, item->checksum, bmpBuf, IPE32_BMP_FILE_HEADER_SIZE+outputBufLen, szAbsoluteBitmapFilename)) {
+				free(bmpBuf);
+				item->bExtracted = true;
+				return true;
+			}
+		}
+		FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
+		if (!fobBitmap) {
+			fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
+			FAIL_RETURN;
+		}
+		// The bitmap is only listed in index.txt if it was completely written
+		const bool bWritten = ipe32_write_bmp(fobBitmap, outputBuf, outputBufLen);
+		if ((fclose(fobBitmap) != 0) || !bWritten) {
+			fprintf(stderr, "ERROR: Cannot write %s\n", szAbsoluteBitmapFilename);
+			FAIL_RETURN;
+		}
+		if (ctx->dedup) picture_dedup_add(ctx->dedup, item->checksum, IPE32_BMP_FILE_HEADER_SIZE+outputBufLen, szAbsoluteBitmapFilename);
+	}
+
+	free(bmpBuf);
+	item->bExtracted = true;
+	return true;
+}
+
+static bool ipe32_extract_picture(Ipe32ExtractContext* ctx, Ipe32WorkerScratch* scratch, Ipe32PlanItem* item) {
+	const bool bOK = ipe32_extract_picture_scratch(ctx, scratch, item);
+	arena_reset(&scratch->arena);
+	return bOK;
+}
+
+static void ipe32_extract_job(void* arg, int workerId) {
+	Ipe32ExtractJob* job = (Ipe32ExtractJob*)arg;
+	if (job->nextItem) file_advise_willneed(job->ctx->fibArt, job->nextItem->peh.offset, job->nextItem->storedSize);
+	ipe32_extract_picture(job->ctx, &job->ctx->scratch[workerId], job->item);
+}
+
+// Determines the real stored size of a picture by following the chunk length words. The chunks are not decoded.
+static bool ipe32_measure_picture(FILE* fibArt, const Ipe32PlanItem* item, size_t* measuredSize, Ipe32ReadPictureResult* res) {
+	const uint64_t offset = item->peh.offset;
+	uint64_t pos = offset;
+	uint32_t remaining = item->peh.uncompressedSize;
+
+	res->numCompressedChunks = 0;
+	res->numRawChunks = 0;
+	res->writtenBytes = 0;
+	while (remaining > 0) {
+		uint16_t len;
+		if ((pos+sizeof(len)-offset > item->storedSize) || !file_seek64(fibArt, pos) || (fread(&len, sizeof(len), 1, fibArt) != 1)) {
+			fprintf(stderr, "ERROR: Chunk %d of %s is beyond the end of the picture data!\n", res->numCompressedChunks+res->numRawChunks, item->szName);
+			return false;
+		}
+		pos += sizeof(len);
+		if (len < 0x8000) {
+			// Each chunk (except the last one) has 0x3FFE bytes of uncompressed data
+			remaining -= (remaining > 0x3FFE) ? 0x3FFE : remaining;
+			res->numCompressedChunks++;
+		} else {
+			len &= 0x7FFF;
+			if (len > remaining) {
+				fprintf(stderr, "ERROR: Raw chunk %d of %s does not fit into the picture data!\n", res->numCompressedChunks+res->numRawChunks, item->szName);
+				return false;
+			}
+			remaining -= len;
+			res->numRawChunks++;
+		}
+		pos += len;
+		if (pos-offset > item->storedSize) {
+			fprintf(stderr, "ERROR: Chunk %d of %s is beyond the end of the picture data!\n", res->numCompressedChunks+res->numRawChunks-1, item->szName);
+			return false;
+		}
+	}
+	*measuredSize = pos-offset;
+	return true;
+}
+
+// Lists the pictures (-l). Only the directory and the chunk length words are read, the picture data is not decoded.
+static bool ipe32_list_pictures(FILE* fibArt, Ipe32PlanItem** order, const int numOrder, Ipe32PlanItem* plan, const int numPictures, const IpeUnpackOptions* options) {
+	bool bEverythingOK = true;
+
+	// The chunks are followed in the order the pictures are stored. storedSize is replaced by the measured size.
+	int i;
+	for (i=0; i<numOrder; ++i) {
+		Ipe32PlanItem* item = order[i];
+		size_t measuredSize;
+		if (!ipe32_measure_picture(fibArt, item, &measuredSize, &item->res)) {
+			bEverythingOK = false;
+			continue;
+		}
+		item->storedSize = measuredSize;
+		item->bExtracted = true;
+	}
+
+	// The listing is in directory order
+	IpeListing listing;
+	ipe_list_begin(&listing, options, "IPE32");
+	int iPicNo;
+	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
+		Ipe32PlanItem* item = &plan[iPicNo];
+		if (!item->bExtracted) continue;
+
+		char szBitmapFilename[MAX_FILE];
+		ipe32_bitmap_filename(szBitmapFilename, item);
+
+		IpeListEntry entry = {0};
+		entry.name = item->szName;
+		entry.filename = szBitmapFilename;
+		entry.offset = item->peh.offset;
+		entry.storedSize = item->storedSize;
+		sprintf(entry.compressionType, "%d(C) %d(R)", item->res.numCompressedChunks, item->res.numRawChunks);
+		entry.uncompressedSize = item->peh.uncompressedSize;
+		ipe_list_entry(&listing, &entry);
+	}
+	ipe_list_end(&listing);
+
+	return bEverythingOK;
+}
+
+Ipe32Extraction* ipe32_extract_begin(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options, ThreadPool* pool) {
 	bool bEverythingOK = true;
 
 	fseek(fibArt, 0, SEEK_SET);
@@ -94,104 +442,244 @@ bool ipe32_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const i
 	Ipe32FileHeader efh;
 	if (fread(&efh, sizeof(efh), 1, fibArt) != 1) {
 		fprintf(stderr, "FATAL: Cannot read Ipe32FileHeader. It is probably not an art file.\n");
-		return false;
+		return NULL;
 	}
 
 	// Check if the super header is correct
-	if ((memcmp(efh.magic, IPE32_MAGIC_ART, 8) != 0) || (efh.reserved != 0)) {
+	const uint64_t fileSize = file_size(fibArt);
+	if ((memcmp(efh.magic, IPE32_MAGIC_ART, 8) != 0) || (efh.reserved != 0) ||
+	    (efh.totalHeaderSize < sizeof(efh)) || (efh.totalHeaderSize > fileSize)) {
 		fprintf(stderr, "FATAL: Something does not seem to be correct with this art file's header. It is probably not an art file.\n");
-		return false;
+		return NULL;
 	}
 
-	FILE* fotIndex = NULL;
-	if (strlen(szDestFolder) > 0) {
-		char szIndexFilename[MAX_FILE];
-		sprintf(szIndexFilename, "%s/index.txt", szDestFolder);
-		fotIndex = fopen(szIndexFilename, "wt");
-		if (!fotIndex) {
-			fprintf(stderr, "FATAL: Cannot open %s for writing\n", szIndexFilename);
-			return false;
+	IpeIndexFile* index = NULL;
+	IpeIndexFile* hashes = NULL;
+	if ((strlen(szDestFolder) > 0) && (options->listFormat == IPE_LIST_NONE)) {
+		index = ipe_index_open(szDestFolder, "index.txt", options);
+		if (!index) return NULL;
+		hashes = ipe_index_open(szDestFolder, HASH_MANIFEST_FILENAME, options);
+		if (!hashes) {
+			ipe_index_close(index);
+			return NULL;
 		}
 	}
 
+	// Read the whole directory at once
 	const int numPictures = efh.totalHeaderSize/sizeof(efh) - 1;
-	char knownNames[numPictures][IPE32_NAME_SIZE];
-	memset(knownNames, 0, numPictures*IPE32_NAME_SIZE);
+	Ipe32PlanItem* plan = (Ipe32PlanItem*)calloc(numPictures+1, sizeof(Ipe32PlanItem));
+	Ipe32PlanItem** order = (Ipe32PlanItem**)malloc((numPictures+1)*sizeof(Ipe32PlanItem*));
+	Ipe32PictureEntryHeader* pehs = (Ipe32PictureEntryHeader*)malloc((numPictures+1)*sizeof(Ipe32PictureEntryHeader));
+	if (fread(pehs, sizeof(Ipe32PictureEntryHeader), numPictures, fibArt) != numPictures) {
+		fprintf(stderr, "FATAL: Cannot read Ipe32PictureEntryHeader.\n");
+		free(pehs);
+		free(order);
+		free(plan);
+		if (index) ipe_index_close(index);
+		if (hashes) ipe_index_close(hashes);
+		return NULL;
+	}
+
+	if (hashes) {
+		// The packer recognizes the ART file by its size and the checksum of its directory
+		ChecksumXxh64State directoryChecksum;
+		checksum_xxh64_reset(&directoryChecksum, 0);
+		checksum_xxh64_update(&directoryChecksum, &efh, sizeof(efh));
+		checksum_xxh64_update(&directoryChecksum, pehs, numPictures*sizeof(Ipe32PictureEntryHeader));
+		hash_manifest_write_header(hashes->fp, fileSize, checksum_xxh64_digest(&directoryChecksum));
+	}
+
+	NameCounter* knownNames = new_name_counter(IPE32_NAME_SIZE, numPictures);
+	// In batch mode, the name patterns are checked after all ART files are processed
+	bool* patternMatched = options->patternMatched ? options->patternMatched : (bool*)calloc(options->numNamePatterns+1, sizeof(bool));
 	int iPicNo;
 	for (iPicNo=0; iPicNo<numPictures; ++iPicNo) {
-		Ipe32PictureEntryHeader peh;
-		if (fread(&peh, sizeof(peh), 1, fibArt) != 1) {
-			fprintf(stderr, "FATAL: Cannot read Ipe32PictureEntryHeader.\n");
-			return false;
-		}
-
-		char szName[IPE32_NAME_SIZE+1]={0};
-		memcpy(szName, peh.name, IPE32_NAME_SIZE);
+		const Ipe32PictureEntryHeader* peh = &pehs[iPicNo];
 
 		// Begin duplicate check
 		// In ERASER, there are a few pictures which have the same identifier, in the same ART file!
-		memcpy(&knownNames[iPicNo][0], peh.name, IPE32_NAME_SIZE);
-		int iCopyNumber = 0;
-		int j;
-		for (j=0; j<=iPicNo; ++j) {
-			if (memcmp(&knownNames[j][0], peh.name, IPE32_NAME_SIZE) == 0) ++iCopyNumber;
+		const int iCopyNumber = knownNames ? name_counter_add(knownNames, peh->name) : 0;
+		if (iCopyNumber == 0) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for the picture names.\n");
+			del_name_counter(knownNames);
+			if (!options->patternMatched) free(patternMatched);
+			free(pehs);
+			free(order);
+			free(plan);
+			if (index) ipe_index_close(index);
+			if (hashes) ipe_index_close(hashes);
+			return NULL;
 		}
-		assert(iCopyNumber > 0);
 		// End duplicate check
 
-		if (verbosity >= 2) fprintf(stdout, "Extracting %s (expected file size: %d bytes) ...\n", szName, peh.uncompressedSize);
+		plan[iPicNo].peh = *peh;
+		memcpy(plan[iPicNo].szName, peh->name, IPE32_NAME_SIZE);
+		plan[iPicNo].iCopyNumber = iCopyNumber;
+		// Only the directory is needed to select the pictures. The data of the other pictures is not read at all.
+		plan[iPicNo].bSelected = ipe_unpack_name_selected(options, plan[iPicNo].szName, patternMatched);
+		order[iPicNo] = &plan[iPicNo];
+	}
+	del_name_counter(knownNames);
+	free(pehs);
 
-		size_t headersPos = ftell(fibArt);
-		#define FAIL_CONTINUE { bEverythingOK = false; fseek(fibArt, headersPos, SEEK_SET); continue; }
+	if (!options->patternMatched) {
+		if (!ipe_unpack_check_name_patterns(options, patternMatched)) bEverythingOK = false;
+		free(patternMatched);
+	}
 
-		if (fseek(fibArt, peh.offset, SEEK_SET) != 0) {
-			fprintf(stderr, "ERROR: Error jumping to offset defined for %s\n", szName);
-			FAIL_CONTINUE;
+	// Extract the pictures in the order they are stored, so that the data is read in one sequential pass
+	qsort(order, numPictures, sizeof(Ipe32PlanItem*), ipe32_compare_plan_offset);
+
+	// The directory does not contain the stored size of a picture, but it cannot exceed the next picture
+	uint64_t nextOffset = fileSize;
+	int i;
+	for (i=numPictures-1; i>=0; --i) {
+		const size_t offset = order[i]->peh.offset;
+		if ((i < numPictures-1) && (order[i+1]->peh.offset == offset)) {
+			// Pictures which share their data (packed with --dedup)
+			order[i]->storedSize = order[i+1]->storedSize;
+			continue;
 		}
+		order[i]->storedSize = (offset < nextOffset) ? nextOffset-offset : 0;
+		if (offset < nextOffset) nextOffset = offset;
+	}
 
-		int outputBufLen = peh.uncompressedSize;
-		unsigned char* outputBuf = (unsigned char*)malloc(outputBufLen);
+	// The stored sizes are derived from all pictures, but only the selected pictures are extracted
+	int numSelected = 0;
+	for (i=0; i<numPictures; ++i) {
+		if (order[i]->bSelected) order[numSelected++] = order[i];
+	}
+	if (numSelected == numPictures) file_advise_sequential(fibArt);
+
+	Ipe32Extraction* ex = (Ipe32Extraction*)calloc(1, sizeof(Ipe32Extraction));
+	ex->options = options;
+	ex->pool = pool;
+	ex->index = index;
+	ex->hashes = hashes;
+	ex->numPictures = numPictures;
+	ex->plan = plan;
+	ex->order = order;
+
+	if (options->listFormat != IPE_LIST_NONE) {
+		// The listing only needs the headers. It is done right away, so the listings of several ART files are not mixed.
+		if (!ipe32_list_pictures(fibArt, order, numSelected, plan, numPictures, options)) bEverythingOK = false;
+		ex->bListOnly = true;
+		ex->bEverythingOK = bEverythingOK;
+		return ex;
+	}
 
-		char szBitmapFilename[MAX_FILE];
-		if (iCopyNumber == 1) {
-			sprintf(szBitmapFilename, "%s.bmp", sanitize_filename(szName));
-		} else {
-			sprintf(szBitmapFilename, "%s__%d.bmp", sanitize_filename(szName), iCopyNumber);
-		}
+	ex->bChecksums = ipe_checksums_needed(options);
+	if (ex->bChecksums) ipe_checksum_report_begin(&ex->report, options);
+
+	// A single thread extracts the pictures in the order they are stored (see above).
+	// Several threads extract the largest pictures first, to avoid a long tail.
+	Ipe32ExtractJob* jobs = (Ipe32ExtractJob*)calloc(numSelected+1, sizeof(Ipe32ExtractJob));
+	for (i=0; i<numSelected; ++i) jobs[i].item = order[i];
+	if (options->numThreads > 1) qsort(jobs, numSelected, sizeof(Ipe32ExtractJob), ipe32_compare_job_size);
+
+	ex->jobs = jobs;
+	ex->numJobs = numSelected;
+
+	Ipe32ExtractContext* ctx = &ex->ctx;
+	ctx->fibArt = fibArt;
+	pthread_mutex_init(&ctx->fileMutex, NULL);
+	ctx->fileSize = fileSize;
+	ctx->szDestFolder = szDestFolder;
+	ctx->verbosity = options->verbosity;
+	ctx->bChecksums = ex->bChecksums || hashes;
+	ctx->output = options->output;
+	ctx->plan = plan;
+	ctx->dedup = options->dedup;
+	if (options->szCacheFile) {
+		ctx->cache = new_ipe_cache_writer(options->szCacheFile, fibArt, IPE_CACHE_FORMAT_IPE32, (options->numNamePatterns > 0) ? IPE_CACHE_FLAG_PARTIAL : 0, numPictures);
+		if (!ctx->cache) bEverythingOK = false;
+	}
+	ex->numSlots = thread_pool_num_slots(pool);
+	ctx->scratch = (Ipe32WorkerScratch*)calloc(ex->numSlots, sizeof(Ipe32WorkerScratch));
+
+	for (i=0; i<numSelected; ++i) {
+		jobs[i].ctx = ctx;
+		jobs[i].nextItem = (i+1 < numSelected) ? jobs[i+1].item : NULL;
+		if (options->szCacheFile && !ctx->cache) continue; // nothing to write to
+		thread_pool_submit(pool, &ex->group, ipe32_extract_job, &jobs[i]);
+	}
 
-		Ipe32ReadPictureResult res = ipe32_read_picture(fibArt, outputBuf, outputBufLen, verbosity >= 2);
-		if (res.writtenBytes != outputBufLen) {
-			fprintf(stderr, "FATAL: Error reading picture %s (compression failure?)\n", szName);
-			FAIL_CONTINUE;
-		}
+	ex->bEverythingOK = bEverythingOK;
+	return ex;
+}
 
-		if (strlen(szDestFolder) > 0) {
-			char szAbsoluteBitmapFilename[MAX_FILE+1];
-			sprintf(szAbsoluteBitmapFilename, "%s/%s", szDestFolder, szBitmapFilename);
-			FILE* fobBitmap = fopen(szAbsoluteBitmapFilename, "wb");
-			if (!fobBitmap) {
-				fprintf(stderr, "FATAL: Cannot open %s for writing\n", szAbsoluteBitmapFilename);
-				FAIL_CONTINUE;
-			}
-			ipe32_write_bmp(fobBitmap, outputBuf, outputBufLen);
-			fclose(fobBitmap);
+bool ipe32_extract_end(Ipe32Extraction* ex) {
+	bool bEverythingOK = ex->bEverythingOK;
+	const int verbosity = ex->options->verbosity;
+	FILE* fotIndex = ex->index ? ex->index->fp : NULL;
+	Ipe32PlanItem* plan = ex->plan;
+	int i, iPicNo;
+
+	if (ex->bListOnly) {
+		free(ex->order);
+		free(ex->plan);
+		free(ex);
+		return bEverythingOK;
+	}
+
+	thread_pool_wait(ex->pool, &ex->group);
+	if (ex->ctx.output) async_output_wait(ex->ctx.output, &ex->ctx.outputGroup);
+	if (ex->ctx.cache && !del_ipe_cache_writer(ex->ctx.cache)) bEverythingOK = false;
+
+	for (i=0; i<ex->numSlots; ++i) {
+		if (ex->ctx.scratch[i].lzwDecoder) {
+			ipe32lzw_free_decoder(ex->ctx.scratch[i].lzwDecoder);
+			free(ex->ctx.scratch[i].lzwDecoder);
 		}
+		arena_free(&ex->ctx.scratch[i].arena);
+	}
+	free(ex->ctx.scratch);
+	pthread_mutex_destroy(&ex->ctx.fileMutex);
+
+	for (i=0; i<ex->numJobs; ++i) {
+		if (!ex->jobs[i].item->bExtracted) bEverythingOK = false;
+	}
+	free(ex->jobs);
+
+	// The index is written in directory order, independent of the extraction order
+	for (iPicNo=0; iPicNo<ex->numPictures; ++iPicNo) {
+		Ipe32PlanItem* item = &plan[iPicNo];
+		if (!item->bSelected) continue;
+
+		char szBitmapFilename[MAX_FILE];
+		ipe32_bitmap_filename(szBitmapFilename, item);
 
-		free(outputBuf);
+		if (ex->bChecksums) ipe_checksum_report_picture(&ex->report, szBitmapFilename, item->bExtracted, item->checksum);
+		if (!item->bExtracted) continue;
+
+		if (ex->hashes) hash_manifest_write_entry(ex->hashes->fp, item->checksum, iPicNo, szBitmapFilename);
 
 		if (fotIndex) {
 			// We require this index file so that our packer tool can know what to pack
 			// The index file won't be written in simulation mode (when no output directory is defined)
-			fprintf(fotIndex, "%s %d(C) %d(R) %s\n", szName, res.numCompressedChunks, res.numRawChunks, szBitmapFilename);
+			fprintf(fotIndex, "%s %d(C) %d(R) %s\n", item->szName, item->res.numCompressedChunks, item->res.numRawChunks, szBitmapFilename);
 		}
 		if (verbosity >= 1) {
-			fprintf(stdout, "%s %d(C) %d(R) %s\n", szName, res.numCompressedChunks, res.numRawChunks, szBitmapFilename);
+			fprintf(stdout, "%s %d(C) %d(R) %s\n", item->szName, item->res.numCompressedChunks, item->res.numRawChunks, szBitmapFilename);
 		}
-
-		fseek(fibArt, headersPos, SEEK_SET); // we were already there, so we don't need to check for errors
 	}
 
-	if (strlen(szDestFolder) > 0) fclose(fotIndex);
+	if (ex->bChecksums && !ipe_checksum_report_end(&ex->report)) bEverythingOK = false;
+
+	free(ex->order);
+	free(ex->plan);
+
+	if (ex->index && !ipe_index_close(ex->index)) bEverythingOK = false;
+	if (ex->hashes && !ipe_index_close(ex->hashes)) bEverythingOK = false;
+
+	free(ex);
+	return bEverythingOK;
+}
 
+bool ipe32_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options) {
+	ThreadPool* pool = new_thread_pool(options->numThreads);
+	Ipe32Extraction* ex = ipe32_extract_begin(fibArt, szDestFolder, options, pool);
+	const bool bEverythingOK = ex ? ipe32_extract_end(ex) : false;
+	del_thread_pool(pool);
 	return bEverythingOK;
 }
@@ -13,6 +13,15 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-bool ipe32_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const int verbosity);
+#include "ipe_artfile_unpacker_common.h"
+#include "thread_pool.h"
+
+typedef struct tagIpe32Extraction Ipe32Extraction;
+
+bool ipe32_extract_art_to_folder(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options);
+
+// Two-phase variant for the batch mode (see ipe16_extract_begin())
+Ipe32Extraction* ipe32_extract_begin(FILE* fibArt, const char* szDestFolder, const IpeUnpackOptions* options, ThreadPool* pool);
+bool ipe32_extract_end(Ipe32Extraction* ex);
 
 #endif // #ifndef __inc__ipe_artfile_packer_ipe32
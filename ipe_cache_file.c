@@ -0,0 +1,290 @@
+/**
+ * Decoded-asset cache files for the ART file unpacker
+ * All pictures of an ART file, fully decoded in one file which can be memory mapped:
+ * A consumer gets a pointer to the pixels and the palette of every picture without parsing or decoding anything.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+// Required for mmap()
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "ipe_cache_file.h"
+#include "utils.h"
+
+static bool ipe_cache_write(IpeCacheWriter* cache, const void* data, const size_t len) {
+	if ((len > 0) && cache->bOK && (fwrite(data, len, 1, cache->fotCache) != 1)) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", cache->szTempFilename);
+		cache->bOK = false;
+	}
+	cache->pos += len;
+	return cache->bOK;
+}
+
+static bool ipe_cache_align(IpeCacheWriter* cache) {
+	const unsigned char padding[IPE_CACHE_ALIGNMENT] = {0};
+	return ipe_cache_write(cache, padding, (IPE_CACHE_ALIGNMENT - cache->pos%IPE_CACHE_ALIGNMENT) % IPE_CACHE_ALIGNMENT);
+}
+
+IpeCacheWriter* new_ipe_cache_writer(const char* szCacheFile, FILE* fibArt, const uint32_t sourceFormat, const uint32_t flags, const int numEntries) {
+	IpeCacheFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IPE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = IPE_CACHE_VERSION;
+	header.sourceFormat = sourceFormat;
+	header.flags = flags;
+	if (!file_stamp(fibArt, &header.sourceSize, &header.sourceMtime)) {
+		fprintf(stderr, "FATAL: Cannot determine the size and modification time of the ART file\n");
+		return NULL;
+	}
+
+	IpeCacheWriter* cache = (IpeCacheWriter*)calloc(1, sizeof(IpeCacheWriter));
+	if (!cache) return NULL;
+	cache->entries = (IpeCacheEntry*)calloc(numEntries+1, sizeof(IpeCacheEntry));
+	cache->bWritten = (bool*)calloc(numEntries+1, sizeof(bool));
+	cache->numEntries = numEntries;
+	snprintf(cache->szFilename, sizeof(cache->szFilename), "%s", szCacheFile);
+	snprintf(cache->szTempFilename, sizeof(cache->szTempFilename), "%s.tmp", szCacheFile);
+	if (!cache->entries || !cache->bWritten) {
+		fprintf(stderr, "FATAL: Cannot allocate memory for the cache directory\n");
+		free(cache->entries);
+		free(cache->bWritten);
+		free(cache);
+		return NULL;
+	}
+	cache->fotCache = fopen(cache->szTempFilename, "wb");
+	if (!cache->fotCache) {
+		fprintf(stderr, "FATAL: Cannot open %s for writing\n", cache->szTempFilename);
+		free(cache->entries);
+		free(cache->bWritten);
+		free(cache);
+		return NULL;
+	}
+	pthread_mutex_init(&cache->mutex, NULL);
+	cache->bOK = true;
+	ipe_cache_write(cache, &header, sizeof(header));
+	return cache;
+}
+
+// Writes the palette and aligns the pixels. The caller holds the mutex.
+static bool ipe_cache_write_picture_start(IpeCacheWriter* cache, IpeCacheEntry* entry, const IpeCachePaletteEntry* palette) {
+	entry->paletteOffset = 0;
+	if (palette) {
+		ipe_cache_align(cache);
+		entry->paletteOffset = cache->pos;
+		ipe_cache_write(cache, palette, IPE_CACHE_NUM_COLORS*sizeof(IpeCachePaletteEntry));
+	}
+	ipe_cache_align(cache);
+	entry->pixelOffset = cache->pos;
+	return cache->bOK;
+}
+
+bool ipe_cache_write_picture(IpeCacheWriter* cache, const int iEntry, const IpeCacheEntry* entry, const IpeCachePaletteEntry* palette, const unsigned char* pixels, const int64_t srcStride) {
+	IpeCacheEntry newEntry = *entry;
+	pthread_mutex_lock(&cache->mutex);
+	ipe_cache_write_picture_start(cache, &newEntry, palette);
+	if (srcStride == entry->stride) {
+		ipe_cache_write(cache, pixels, (size_t)entry->stride*entry->height);
+	} else {
+		uint32_t y;
+		for (y=0; y<entry->height; ++y) ipe_cache_write(cache, pixels + y*srcStride, entry->stride);
+	}
+	const bool bOK = cache->bOK;
+	if (bOK) {
+		cache->entries[iEntry] = newEntry;
+		cache->bWritten[iEntry] = true;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return bOK;
+}
+
+bool ipe_cache_begin_picture(IpeCacheWriter* cache, const IpeCacheEntry* entry, const IpeCachePaletteEntry* palette) {
+	pthread_mutex_lock(&cache->mutex);
+	cache->current = *entry;
+	cache->rowsLeft = entry->height;
+	return ipe_cache_write_picture_start(cache, &cache->current, palette);
+}
+
+bool ipe_cache_write_row(IpeCacheWriter* cache, const unsigned char* row) {
+	if (cache->rowsLeft == 0) return false;
+	cache->rowsLeft--;
+	return ipe_cache_write(cache, row, cache->current.stride);
+}
+
+bool ipe_cache_end_picture(IpeCacheWriter* cache, const int iEntry) {
+	const bool bOK = cache->bOK && (cache->rowsLeft == 0);
+	if (bOK) {
+		cache->entries[iEntry] = cache->current;
+		cache->bWritten[iEntry] = true;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return bOK;
+}
+
+static int ipe_cache_compare_entry_names(const void* a, const void* b) {
+	const IpeCacheEntry* ea = *(const IpeCacheEntry* const*)a;
+	const IpeCacheEntry* eb = *(const IpeCacheEntry* const*)b;
+	const int cmp = strcmp(ea->name, eb->name);
+	if (cmp != 0) return cmp;
+	return (ea > eb) - (ea < eb);
+}
+
+bool del_ipe_cache_writer(IpeCacheWriter* cache) {
+	// The directory only lists the pictures which were written, in directory order
+	int numPictures = 0;
+	int i;
+	for (i=0; i<cache->numEntries; ++i) {
+		if (cache->bWritten[i]) cache->entries[numPictures++] = cache->entries[i];
+	}
+
+	IpeCacheTrailer trailer;
+	memset(&trailer, 0, sizeof(trailer));
+	memcpy(trailer.magic, IPE_CACHE_TRAILER_MAGIC, sizeof(IPE_CACHE_TRAILER_MAGIC));
+	trailer.numPictures = numPictures;
+	ipe_cache_align(cache);
+	trailer.directoryOffset = cache->pos;
+	ipe_cache_write(cache, cache->entries, numPictures*sizeof(IpeCacheEntry));
+
+	const IpeCacheEntry** sorted = (const IpeCacheEntry**)malloc((numPictures+1)*sizeof(IpeCacheEntry*));
+	uint32_t* nameIndex = (uint32_t*)malloc((numPictures+1)*sizeof(uint32_t));
+	if (!sorted || !nameIndex) {
+		fprintf(stderr, "ERROR: Cannot allocate memory for the name index of %s\n", cache->szFilename);
+		cache->bOK = false;
+	} else {
+		for (i=0; i<numPictures; ++i) sorted[i] = &cache->entries[i];
+		qsort(sorted, numPictures, sizeof(IpeCacheEntry*), ipe_cache_compare_entry_names);
+		for (i=0; i<numPictures; ++i) nameIndex[i] = sorted[i]-cache->entries;
+		trailer.nameIndexOffset = cache->pos;
+		ipe_cache_write(cache, nameIndex, numPictures*sizeof(uint32_t));
+	}
+	free(sorted);
+	free(nameIndex);
+
+	// The trailer is at a fixed position relative to the end of the file
+	ipe_cache_align(cache);
+	trailer.totalFileSize = cache->pos + sizeof(trailer);
+	ipe_cache_write(cache, &trailer, sizeof(trailer));
+
+	if ((fclose(cache->fotCache) != 0) && cache->bOK) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", cache->szTempFilename);
+		cache->bOK = false;
+	}
+	bool bOK = cache->bOK;
+	if (bOK) {
+		if (!file_replace(cache->szTempFilename, cache->szFilename)) {
+			fprintf(stderr, "ERROR: Cannot rename %s to %s\n", cache->szTempFilename, cache->szFilename);
+			bOK = false;
+		}
+	}
+	if (!bOK) remove(cache->szTempFilename);
+
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->entries);
+	free(cache->bWritten);
+	free(cache);
+	return bOK;
+}
+
+bool ipe_cache_map(IpeCacheView* view, const char* szCacheFile) {
+	memset(view, 0, sizeof(*view));
+	FILE* fibCache = fopen(szCacheFile, "rb");
+	if (!fibCache) return false;
+	const uint64_t size = file_size(fibCache);
+	if ((size < sizeof(IpeCacheFileHeader)+sizeof(IpeCacheTrailer)) || (size > SIZE_MAX)) {
+		fclose(fibCache);
+		return false;
+	}
+
+	#ifdef _WIN32
+	// Without mmap(), the file is read into memory
+	unsigned char* base = (unsigned char*)malloc(size);
+	if (base && (fread(base, size, 1, fibCache) != 1)) {
+		free(base);
+		base = NULL;
+	}
+	fclose(fibCache);
+	if (!base) return false;
+	view->bMapped = false;
+	#else
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fibCache), 0);
+	fclose(fibCache);
+	if (mapping == MAP_FAILED) return false;
+	const unsigned char* base = (const unsigned char*)mapping;
+	view->bMapped = true;
+	#endif
+	view->base = base;
+	view->size = size;
+
+	// Only the structure is checked. The directory is used as it is.
+	view->header = (const IpeCacheFileHeader*)base;
+	view->trailer = (const IpeCacheTrailer*)(base + size - sizeof(IpeCacheTrailer));
+	const IpeCacheTrailer* trailer = view->trailer;
+	if ((memcmp(view->header->magic, IPE_CACHE_MAGIC, sizeof(view->header->magic)) != 0) ||
+		(view->header->version != IPE_CACHE_VERSION) ||
+		(memcmp(trailer->magic, IPE_CACHE_TRAILER_MAGIC, sizeof(IPE_CACHE_TRAILER_MAGIC)) != 0) ||
+		(trailer->totalFileSize != size) ||
+		(trailer->directoryOffset > size) ||
+		((uint64_t)trailer->numPictures*sizeof(IpeCacheEntry) > size-trailer->directoryOffset) ||
+		(trailer->nameIndexOffset > size) ||
+		((uint64_t)trailer->numPictures*sizeof(uint32_t) > size-trailer->nameIndexOffset)) {
+		ipe_cache_unmap(view);
+		return false;
+	}
+	view->entries = (const IpeCacheEntry*)(base + trailer->directoryOffset);
+	view->nameIndex = (const uint32_t*)(base + trailer->nameIndexOffset);
+	return true;
+}
+
+void ipe_cache_unmap(IpeCacheView* view) {
+	if (!view->base) return;
+	#ifdef _WIN32
+	free((void*)view->base);
+	#else
+	munmap((void*)view->base, view->size);
+	#endif
+	memset(view, 0, sizeof(*view));
+}
+
+bool ipe_cache_is_current(const IpeCacheView* view, FILE* fibArt) {
+	uint64_t size;
+	int64_t mtime;
+	if (!file_stamp(fibArt, &size, &mtime)) return false;
+	return (view->header->sourceSize == size) && (view->header->sourceMtime == mtime);
+}
+
+const IpeCacheEntry* ipe_cache_find(const IpeCacheView* view, const char* name) {
+	// Binary search in the name index. If a name appears more than once, the first picture of the directory is found.
+	uint32_t lo = 0, hi = view->trailer->numPictures;
+	while (lo < hi) {
+		const uint32_t mid = lo + (hi-lo)/2;
+		if (strncmp(view->entries[view->nameIndex[mid]].name, name, IPE_CACHE_NAME_SIZE) < 0) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo < view->trailer->numPictures) && (strncmp(view->entries[view->nameIndex[lo]].name, name, IPE_CACHE_NAME_SIZE) == 0)) {
+		return &view->entries[view->nameIndex[lo]];
+	}
+	return NULL;
+}
+
+const unsigned char* ipe_cache_pixels(const IpeCacheView* view, const IpeCacheEntry* entry) {
+	return view->base + entry->pixelOffset;
+}
+
+const IpeCachePaletteEntry* ipe_cache_palette(const IpeCacheView* view, const IpeCacheEntry* entry) {
+	if (entry->paletteOffset == 0) return NULL;
+	return (const IpeCachePaletteEntry*)(view->base + entry->paletteOffset);
+}
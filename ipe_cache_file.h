@@ -0,0 +1,129 @@
+/**
+ * Decoded-asset cache files for the ART file unpacker
+ * All pictures of an ART file, fully decoded in one file which can be memory mapped:
+ * A consumer gets a pointer to the pixels and the palette of every picture without parsing or decoding anything.
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__ipe_cache_file
+#define __inc__ipe_cache_file
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// File layout (little endian, written in one sequential pass):
+// - IpeCacheFileHeader at offset 0
+// - the pictures in the order they were decoded: palette (optional) and pixels, each aligned to IPE_CACHE_ALIGNMENT
+// - the directory: IpeCacheEntry for every picture, in the order of the ART file's directory (aligned)
+// - the name index: uint32_t entry numbers, sorted by name (strcmp)
+// - IpeCacheTrailer in the last IPE_CACHE_TRAILER_SIZE bytes
+
+#define IPE_CACHE_MAGIC "IPECACHE"
+#define IPE_CACHE_TRAILER_MAGIC "IPECDIR"
+#define IPE_CACHE_VERSION 1
+#define IPE_CACHE_ALIGNMENT 64
+#define IPE_CACHE_NAME_SIZE 24
+#define IPE_CACHE_NUM_COLORS 256
+#define IPE_CACHE_TRAILER_SIZE 64
+
+#define IPE_CACHE_FORMAT_IPE16 16
+#define IPE_CACHE_FORMAT_IPE32 32
+
+#define IPE_CACHE_FLAG_PARTIAL 1 // only the pictures selected by name patterns (-n) are in the cache
+
+#pragma pack(push, 1)
+
+typedef struct tagIpeCacheFileHeader {
+	char       magic[8];               // "IPECACHE"
+	uint32_t   version;                // IPE_CACHE_VERSION
+	uint32_t   sourceFormat;           // IPE_CACHE_FORMAT_*
+	uint64_t   sourceSize;             // invalidation stamp: size and modification time of the ART file
+	int64_t    sourceMtime;            // (seconds since 1970)
+	uint32_t   flags;                  // IPE_CACHE_FLAG_*
+	uint8_t    reserved[28];
+} IpeCacheFileHeader;
+
+typedef struct tagIpeCacheEntry {
+	char       name[IPE_CACHE_NAME_SIZE]; // zero terminated
+	uint64_t   paletteOffset;          // IPE_CACHE_NUM_COLORS IpeCachePaletteEntry, or 0 if the picture has no palette
+	uint64_t   pixelOffset;
+	uint32_t   width;
+	uint32_t   height;
+	uint32_t   stride;                 // bytes per row (without padding); the rows are top-down
+	uint32_t   numColors;              // used entries of the palette
+	uint16_t   bitsPerPixel;           // 8 = palette indices; 24 or 32 = BGR(A) (only IPE32)
+	uint16_t   offsetX;                // PiP only, unsigned like in the picture header
+	uint16_t   offsetY;
+	char       paletteType;            // IPE16 only ('X' or 'C')
+	char       compressionType;        // IPE16 only
+} IpeCacheEntry;
+
+typedef struct tagIpeCachePaletteEntry {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t reserved;
+} IpeCachePaletteEntry;
+
+typedef struct tagIpeCacheTrailer {
+	char       magic[8];               // "IPECDIR"
+	uint32_t   numPictures;
+	uint32_t   reserved1;
+	uint64_t   directoryOffset;
+	uint64_t   nameIndexOffset;
+	uint64_t   totalFileSize;
+	uint8_t    reserved2[24];
+} IpeCacheTrailer;
+
+#pragma pack(pop)
+
+// Writer (used by the unpacker). The pictures can be added by several threads, they are appended one after the other.
+// The file is written under a temporary name and renamed at the end, so that a consumer never maps a half-written file.
+typedef struct tagIpeCacheWriter {
+	FILE* fotCache;
+	char szFilename[1024];
+	char szTempFilename[1040];
+	pthread_mutex_t mutex;
+	uint64_t pos;
+	IpeCacheEntry* entries; // in directory order
+	bool* bWritten;
+	int numEntries;
+	IpeCacheEntry current;  // picture between ipe_cache_begin_picture() and ipe_cache_end_picture()
+	uint32_t rowsLeft;
+	bool bOK;
+} IpeCacheWriter;
+
+// fibArt is only used for the invalidation stamp. numEntries is the number of pictures in the directory of the ART file.
+IpeCacheWriter* new_ipe_cache_writer(const char* szCacheFile, FILE* fibArt, const uint32_t sourceFormat, const uint32_t flags, const int numEntries);
+// Adds a complete picture. The name, dimensions etc. are taken from entry, the offsets are set by the writer.
+// srcStride is the distance between two rows of pixels (negative if the rows are bottom-up, then pixels points to the top row).
+bool ipe_cache_write_picture(IpeCacheWriter* cache, const int iEntry, const IpeCacheEntry* entry, const IpeCachePaletteEntry* palette, const unsigned char* pixels, const int64_t srcStride);
+// Piecewise variant for huge pictures: All rows (top-down) must follow. Other threads wait until the picture is ended.
+bool ipe_cache_begin_picture(IpeCacheWriter* cache, const IpeCacheEntry* entry, const IpeCachePaletteEntry* palette);
+bool ipe_cache_write_row(IpeCacheWriter* cache, const unsigned char* row);
+bool ipe_cache_end_picture(IpeCacheWriter* cache, const int iEntry); // the picture is only listed if all rows were written
+// Writes the directory and closes the file. Returns false if something could not be written.
+bool del_ipe_cache_writer(IpeCacheWriter* cache);
+
+// Reader (for consumers)
+typedef struct tagIpeCacheView {
+	const unsigned char* base;
+	uint64_t size;
+	const IpeCacheFileHeader* header;
+	const IpeCacheTrailer* trailer;
+	const IpeCacheEntry* entries;  // in directory order
+	const uint32_t* nameIndex;
+	bool bMapped;                  // false if the file was read into memory (no mmap available)
+} IpeCacheView;
+
+bool ipe_cache_map(IpeCacheView* view, const char* szCacheFile); // false if it does not exist or is not a valid cache file
+void ipe_cache_unmap(IpeCacheView* view);
+bool ipe_cache_is_current(const IpeCacheView* view, FILE* fibArt); // compares the invalidation stamp
+const IpeCacheEntry* ipe_cache_find(const IpeCacheView* view, const char* name); // NULL if there is no picture with this name
+const unsigned char* ipe_cache_pixels(const IpeCacheView* view, const IpeCacheEntry* entry);
+const IpeCachePaletteEntry* ipe_cache_palette(const IpeCacheView* view, const IpeCacheEntry* entry); // NULL if the picture has no palette
+
+#endif // #ifndef __inc__ipe_cache_file
@@ -0,0 +1,65 @@
+/**
+ * Name counter for the ART file packer and unpacker
+ * Counts how often a (fixed size) picture name has been seen, e.g. to number duplicate names
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "name_counter.h"
+
+typedef struct tagNameCounterKey {
+	const char* name;
+	size_t keySize;
+} NameCounterKey;
+
+static uint32_t name_counter_hash(const char* name, const size_t keySize) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	size_t i;
+	for (i=0; i<keySize; ++i) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool name_counter_equal(const void* entry, const void* key) {
+	const NameCounterKey* k = (const NameCounterKey*)key;
+	return memcmp((const char*)entry + sizeof(int), k->name, k->keySize) == 0;
+}
+
+NameCounter* new_name_counter(const size_t keySize, const size_t expectedNames) {
+	NameCounter* nc = (NameCounter*)calloc(1, sizeof(NameCounter));
+	if (!nc) return NULL;
+	nc->keySize = keySize;
+
+	// The count stays aligned in every entry
+	const size_t entrySize = (sizeof(int) + keySize + sizeof(int)-1) / sizeof(int) * sizeof(int);
+	if (!hash_table_init(&nc->table, entrySize, expectedNames, name_counter_equal)) {
+		free(nc);
+		return NULL;
+	}
+	return nc;
+}
+
+void del_name_counter(NameCounter* nc) {
+	if (!nc) return;
+	hash_table_free(&nc->table);
+	free(nc);
+}
+
+int name_counter_add(NameCounter* nc, const char* name) {
+	NameCounterKey key;
+	key.name = name;
+	key.keySize = nc->keySize;
+	bool bNew;
+	int* count = (int*)hash_table_insert(&nc->table, name_counter_hash(name, nc->keySize), &key, &bNew);
+	if (!count) return 0;
+	if (bNew) memcpy(count+1, name, nc->keySize);
+	return ++*count;
+}
@@ -0,0 +1,26 @@
+/**
+ * Name counter for the ART file packer and unpacker
+ * Counts how often a (fixed size) picture name has been seen, e.g. to number duplicate names
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__name_counter
+#define __inc__name_counter
+
+#include <stdlib.h>
+
+#include "hash_table.h"
+
+typedef struct tagNameCounter {
+	size_t keySize;        // names are compared over exactly keySize bytes (like memcmp)
+	HashTable table;       // the entries are the count, followed by the name
+} NameCounter;
+
+NameCounter* new_name_counter(const size_t keySize, const size_t expectedNames);
+void del_name_counter(NameCounter* nc);
+
+// Returns: How often the name has been added (including this call), or 0 if out of memory
+int name_counter_add(NameCounter* nc, const char* name);
+
+#endif // #ifndef __inc__name_counter
@@ -0,0 +1,184 @@
+/**
+ * Cache of compressed pictures for the watch mode of the ART file packer (--watch)
+ * Every stored picture is kept in memory, together with the line of index.txt it was made from.
+ * When the ART file is packed again, a picture is only compressed again if its line or its bitmap changed.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pack_cache.h"
+#include "checksum.h"
+
+#define PACK_CACHE_EXPECTED_ENTRIES 32
+
+// Returns NULL if there is not enough memory
+static char* pack_cache_make_key(const IpePackIndexLine* line) {
+	size_t len = 1;
+	int i;
+	for (i=0; i<line->numFields; ++i) len += strlen(line->fields[i])+1;
+	char* szKey = (char*)malloc(len);
+	if (!szKey) return NULL;
+	szKey[0] = 0;
+	char* p = szKey;
+	for (i=0; i<line->numFields; ++i) {
+		if (i > 0) *p++ = '\t';
+		const size_t fieldLen = strlen(line->fields[i]);
+		memcpy(p, line->fields[i], fieldLen+1);
+		p += fieldLen;
+	}
+	return szKey;
+}
+
+static bool pack_cache_equal(const void* entry, const void* key) {
+	return strcmp(((const PackCacheEntry*)entry)->szKey, (const char*)key) == 0;
+}
+
+PackCache* new_pack_cache() {
+	PackCache* cache = (PackCache*)calloc(1, sizeof(PackCache));
+	if (!cache) return NULL;
+	if (!hash_table_init(&cache->table, sizeof(PackCacheEntry), PACK_CACHE_EXPECTED_ENTRIES, pack_cache_equal)) {
+		free(cache);
+		return NULL;
+	}
+	pthread_mutex_init(&cache->mutex, NULL);
+	return cache;
+}
+
+void del_pack_cache(PackCache* cache) {
+	if (!cache) return;
+	size_t i;
+	for (i=0; i<cache->table.capacity; ++i) {
+		PackCacheEntry* entry = (PackCacheEntry*)hash_table_entry(&cache->table, i);
+		if (!entry) continue;
+		free(entry->szKey);
+		free(entry->szBitmapFile);
+		free(entry->data);
+	}
+	hash_table_free(&cache->table);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+ArtWriter* pack_cache_get(PackCache* cache, const IpePackIndexLine* line, uint64_t* dataSize) {
+	char* szKey = pack_cache_make_key(line);
+	if (!szKey) return NULL;
+	const uint64_t hash = checksum_xxh64(szKey, strlen(szKey), 0);
+
+	ArtWriter* blob = NULL;
+	pthread_mutex_lock(&cache->mutex);
+	PackCacheEntry* entry = (PackCacheEntry*)hash_table_find(&cache->table, hash, szKey);
+	if (entry && entry->data) {
+		// The copy is made while the entry is locked, because the writer thread may replace the data
+		blob = new_art_writer_memory(entry->szBitmapFile, entry->size);
+		if (blob) {
+			art_writer_write(blob, entry->data, entry->size);
+			if (dataSize) *dataSize = entry->dataSize;
+			entry->bUsed = true;
+		}
+	}
+	if (blob) {
+		cache->numHits++;
+	} else {
+		cache->numMisses++;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	free(szKey);
+	return blob;
+}
+
+void pack_cache_put(PackCache* cache, const IpePackIndexLine* line, const char* szBitmapFile, const unsigned char* data, const size_t size, const uint64_t dataSize) {
+	char* szKey = pack_cache_make_key(line);
+	char* szBitmapFileCopy = (char*)malloc(strlen(szBitmapFile)+1);
+	unsigned char* copy = (unsigned char*)malloc(size > 0 ? size : 1);
+	if (!szKey || !szBitmapFileCopy || !copy) {
+		free(szKey);
+		free(szBitmapFileCopy);
+		free(copy);
+		return;
+	}
+	strcpy(szBitmapFileCopy, szBitmapFile);
+	memcpy(copy, data, size);
+	const uint64_t hash = checksum_xxh64(szKey, strlen(szKey), 0);
+
+	pthread_mutex_lock(&cache->mutex);
+	bool bNew;
+	PackCacheEntry* entry = (PackCacheEntry*)hash_table_insert(&cache->table, hash, szKey, &bNew);
+	if (!entry) {
+		pthread_mutex_unlock(&cache->mutex);
+		free(szKey);
+		free(szBitmapFileCopy);
+		free(copy);
+		return;
+	}
+	if (bNew) {
+		entry->szKey = szKey;
+		entry->szBitmapFile = szBitmapFileCopy;
+	} else {
+		free(szKey);
+		free(szBitmapFileCopy);
+		free(entry->data);
+	}
+	entry->data = copy;
+	entry->size = size;
+	entry->dataSize = dataSize;
+	entry->bUsed = true;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+int pack_cache_invalidate(PackCache* cache, const char* szBitmapFile) {
+	int numInvalidated = 0;
+	pthread_mutex_lock(&cache->mutex);
+	size_t i;
+	for (i=0; i<cache->table.capacity; ++i) {
+		PackCacheEntry* entry = (PackCacheEntry*)hash_table_entry(&cache->table, i);
+		if (!entry || !entry->data || (strcmp(entry->szBitmapFile, szBitmapFile) != 0)) continue;
+		free(entry->data);
+		entry->data = NULL;
+		numInvalidated++;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return numInvalidated;
+}
+
+void pack_cache_invalidate_all(PackCache* cache) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t i;
+	for (i=0; i<cache->table.capacity; ++i) {
+		PackCacheEntry* entry = (PackCacheEntry*)hash_table_entry(&cache->table, i);
+		if (!entry) continue;
+		free(entry->data);
+		entry->data = NULL;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+void pack_cache_begin_run(PackCache* cache) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t i;
+	for (i=0; i<cache->table.capacity; ++i) {
+		PackCacheEntry* entry = (PackCacheEntry*)hash_table_entry(&cache->table, i);
+		if (entry) entry->bUsed = false;
+	}
+	cache->numHits = 0;
+	cache->numMisses = 0;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+void pack_cache_end_run(PackCache* cache) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t i;
+	for (i=0; i<cache->table.capacity; ++i) {
+		PackCacheEntry* entry = (PackCacheEntry*)hash_table_entry(&cache->table, i);
+		if (!entry || entry->bUsed) continue;
+		free(entry->data);
+		entry->data = NULL;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
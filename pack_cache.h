@@ -0,0 +1,56 @@
+/**
+ * Cache of compressed pictures for the watch mode of the ART file packer (--watch)
+ * Every stored picture is kept in memory, together with the line of index.txt it was made from.
+ * When the ART file is packed again, a picture is only compressed again if its line or its bitmap changed.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__pack_cache
+#define __inc__pack_cache
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "ipe_artfile_packer_common.h"
+#include "art_writer.h"
+#include "hash_table.h"
+
+typedef struct tagPackCacheEntry {
+	char* szKey;           // all fields of the line of index.txt, separated by tabs
+	char* szBitmapFile;    // the bitmap of the line. The entry is invalidated if this file changes.
+	unsigned char* data;   // the stored picture, as it is written into the ART file. NULL if it was invalidated.
+	size_t size;
+	uint64_t dataSize;     // size of the bitmap data (needed for the directory of IPE32)
+	bool bUsed;            // by the current run
+} PackCacheEntry;
+
+// Thread safe, because the IPE16 packers look up the pictures in their worker threads
+typedef struct tagPackCache {
+	pthread_mutex_t mutex;
+	HashTable table;       // of PackCacheEntry, by the hash of the key. Entries are never removed, invalidated entries only lose their data.
+	int numHits;           // of the current run
+	int numMisses;
+} PackCache;
+
+PackCache* new_pack_cache();
+void del_pack_cache(PackCache* cache);
+
+// Returns a copy of the stored picture (memory mode), or NULL if the line is not in the cache or its bitmap changed.
+// dataSize may be NULL.
+ArtWriter* pack_cache_get(PackCache* cache, const IpePackIndexLine* line, uint64_t* dataSize);
+// Nothing is lost if the picture cannot be stored (not enough memory): it is just compressed again next time.
+void pack_cache_put(PackCache* cache, const IpePackIndexLine* line, const char* szBitmapFile, const unsigned char* data, const size_t size, const uint64_t dataSize);
+
+// The bitmap file was changed. Returns the number of pictures which have to be compressed again.
+int pack_cache_invalidate(PackCache* cache, const char* szBitmapFile);
+// Anything may have changed (e.g. changes were lost)
+void pack_cache_invalidate_all(PackCache* cache);
+
+// Resets the counters. After the run, the pictures which were not used (their lines were removed from index.txt) are freed.
+void pack_cache_begin_run(PackCache* cache);
+void pack_cache_end_run(PackCache* cache);
+
+#endif // #ifndef __inc__pack_cache
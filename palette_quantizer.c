@@ -0,0 +1,293 @@
+/**
+ * Reduces truecolor pictures to 256 colors, for the import of 24 and 32 bit bitmaps into the IPE16 games
+ * Median cut over a 5-6-5 histogram, and a lookup table from every used histogram cell to its nearest palette color.
+ * If the picture has 256 colors or less, they are taken exactly.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "palette_quantizer.h"
+
+// The histogram has 32 red, 64 green and 32 blue levels
+#define PQ_NUM_CELLS 65536
+#define PQ_CELL(r,g,b) ((((unsigned int)(r) >> 3) << 11) | (((unsigned int)(g) >> 2) << 5) | ((unsigned int)(b) >> 3))
+#define PQ_CELL_R(cell) ((cell) >> 11)
+#define PQ_CELL_G(cell) (((cell) >> 5) & 0x3F)
+#define PQ_CELL_B(cell) ((cell) & 0x1F)
+
+// The exact colors are collected in a small hash table, until there are more than 256 of them
+#define PQ_EXACT_SLOTS 1024
+#define PQ_EXACT_USED 0x80000000u
+
+typedef struct tagPqCell {
+	uint64_t count;
+	uint64_t sumR, sumG, sumB; // for the average color of the pixels in the cell
+} PqCell;
+
+// A box of the color space, in histogram levels (inclusive)
+typedef struct tagPqBox {
+	unsigned int lo[3];
+	unsigned int hi[3];
+	uint64_t count;
+} PqBox;
+
+typedef struct tagPqExactColors {
+	uint32_t slots[PQ_EXACT_SLOTS];       // 0x00RRGGBB | PQ_EXACT_USED, or 0 if the slot is free
+	unsigned char index[PQ_EXACT_SLOTS];  // palette index of the color in the slot
+	int numColors;                        // more than 256 means that the picture is quantized
+} PqExactColors;
+
+// Returns the slot of the color, or the free slot where it belongs
+static unsigned int pq_exact_find(const PqExactColors* exact, const uint32_t key) {
+	unsigned int slot = (key * 2654435761u) >> 22; // Knuth's multiplicative hash, 10 bits
+	while (exact->slots[slot] && (exact->slots[slot] != key)) slot = (slot+1) & (PQ_EXACT_SLOTS-1);
+	return slot;
+}
+
+static void pq_exact_add(PqExactColors* exact, const uint32_t key) {
+	const unsigned int slot = pq_exact_find(exact, key);
+	if (exact->slots[slot]) return;
+	if (exact->numColors < PALETTE_QUANTIZER_COLORS) {
+		exact->slots[slot] = key;
+		exact->index[slot] = exact->numColors;
+	}
+	exact->numColors++;
+}
+
+static unsigned int pq_box_level(const unsigned int cell, const int axis) {
+	return (axis == 0) ? PQ_CELL_R(cell) : (axis == 1) ? PQ_CELL_G(cell) : PQ_CELL_B(cell);
+}
+
+// Shrinks the box to the used cells inside it, and counts its pixels. Returns false if the box is empty.
+static bool pq_box_shrink(PqBox* box, const PqCell* cells) {
+	unsigned int lo[3] = { 0x3F, 0x3F, 0x3F };
+	unsigned int hi[3] = { 0, 0, 0 };
+	uint64_t count = 0;
+	unsigned int r, g, b;
+	for (r=box->lo[0]; r<=box->hi[0]; ++r) {
+		for (g=box->lo[1]; g<=box->hi[1]; ++g) {
+			for (b=box->lo[2]; b<=box->hi[2]; ++b) {
+				const PqCell* cell = &cells[(r << 11) | (g << 5) | b];
+				if (!cell->count) continue;
+				count += cell->count;
+				if (r < lo[0]) lo[0] = r;
+				if (r > hi[0]) hi[0] = r;
+				if (g < lo[1]) lo[1] = g;
+				if (g > hi[1]) hi[1] = g;
+				if (b < lo[2]) lo[2] = b;
+				if (b > hi[2]) hi[2] = b;
+			}
+		}
+	}
+	if (count == 0) return false;
+	memcpy(box->lo, lo, sizeof(lo));
+	memcpy(box->hi, hi, sizeof(hi));
+	box->count = count;
+	return true;
+}
+
+// Length of the longest side of the box in 8 bit color units. axis receives its direction.
+static unsigned int pq_box_longest_side(const PqBox* box, int* axis) {
+	const unsigned int sides[3] = { (box->hi[0]-box->lo[0]) << 3, (box->hi[1]-box->lo[1]) << 2, (box->hi[2]-box->lo[2]) << 3 };
+	*axis = 0;
+	if (sides[1] > sides[*axis]) *axis = 1;
+	if (sides[2] > sides[*axis]) *axis = 2;
+	return sides[*axis];
+}
+
+// Splits the box at the median of its pixels along its longest side. box keeps the lower part.
+static void pq_box_split(PqBox* box, PqBox* upper, const PqCell* cells) {
+	int axis;
+	pq_box_longest_side(box, &axis);
+
+	// Pixels per level along the axis
+	uint64_t levels[64] = {0};
+	unsigned int r, g, b;
+	for (r=box->lo[0]; r<=box->hi[0]; ++r) {
+		for (g=box->lo[1]; g<=box->hi[1]; ++g) {
+			for (b=box->lo[2]; b<=box->hi[2]; ++b) {
+				const unsigned int cell = (r << 11) | (g << 5) | b;
+				levels[pq_box_level(cell, axis)] += cells[cell].count;
+			}
+		}
+	}
+
+	// Both parts must contain pixels, because the levels at both ends are used (the box was shrunk)
+	uint64_t below = 0;
+	unsigned int level = box->lo[axis];
+	while (level < box->hi[axis]-1) {
+		below += levels[level];
+		if (2*below >= box->count) break;
+		level++;
+	}
+
+	*upper = *box;
+	box->hi[axis] = level;
+	upper->lo[axis] = level+1;
+	pq_box_shrink(box, cells);
+	pq_box_shrink(upper, cells);
+}
+
+static int pq_median_cut(const PqCell* cells, RGBQUAD palette[PALETTE_QUANTIZER_COLORS]) {
+	PqBox boxes[PALETTE_QUANTIZER_COLORS];
+	boxes[0].lo[0] = boxes[0].lo[1] = boxes[0].lo[2] = 0;
+	boxes[0].hi[0] = 0x1F;
+	boxes[0].hi[1] = 0x3F;
+	boxes[0].hi[2] = 0x1F;
+	if (!pq_box_shrink(&boxes[0], cells)) return 0;
+	int numBoxes = 1;
+
+	// The box with the most pixels times its longest side is split next, so that big and frequent color ranges get more colors
+	while (numBoxes < PALETTE_QUANTIZER_COLORS) {
+		int best = -1;
+		uint64_t bestScore = 0;
+		int i;
+		for (i=0; i<numBoxes; ++i) {
+			int axis;
+			const uint64_t score = boxes[i].count * pq_box_longest_side(&boxes[i], &axis);
+			if (score > bestScore) {
+				best = i;
+				bestScore = score;
+			}
+		}
+		if (best == -1) break; // every box is a single cell
+		pq_box_split(&boxes[best], &boxes[numBoxes], cells);
+		numBoxes++;
+	}
+
+	// Every box becomes the average color of its pixels
+	int i;
+	for (i=0; i<numBoxes; ++i) {
+		const PqBox* box = &boxes[i];
+		uint64_t sumR = 0, sumG = 0, sumB = 0;
+		unsigned int r, g, b;
+		for (r=box->lo[0]; r<=box->hi[0]; ++r) {
+			for (g=box->lo[1]; g<=box->hi[1]; ++g) {
+				for (b=box->lo[2]; b<=box->hi[2]; ++b) {
+					const PqCell* cell = &cells[(r << 11) | (g << 5) | b];
+					sumR += cell->sumR;
+					sumG += cell->sumG;
+					sumB += cell->sumB;
+				}
+			}
+		}
+		palette[i].rgbRed   = (sumR + box->count/2) / box->count;
+		palette[i].rgbGreen = (sumG + box->count/2) / box->count;
+		palette[i].rgbBlue  = (sumB + box->count/2) / box->count;
+	}
+	return numBoxes;
+}
+
+bool palette_quantize(const unsigned char* firstRow, const ptrdiff_t rowStride, const unsigned int width, const unsigned int height, const unsigned int bytesPerPixel,
+                      RGBQUAD palette[PALETTE_QUANTIZER_COLORS], unsigned char* indices) {
+	memset(palette, 0x00, PALETTE_QUANTIZER_COLORS*sizeof(RGBQUAD));
+
+	PqExactColors* exact = (PqExactColors*)calloc(1, sizeof(PqExactColors));
+	PqCell* cells = (PqCell*)calloc(PQ_NUM_CELLS, sizeof(PqCell));
+	if (!exact || !cells) {
+		free(exact);
+		free(cells);
+		return false;
+	}
+
+	// First pass: the histogram, and the exact colors as long as there are not more than 256
+	const unsigned char* row = firstRow;
+	unsigned int x, y;
+	for (y=0; y<height; ++y) {
+		const unsigned char* p = row;
+		uint32_t lastKey = 0;
+		for (x=0; x<width; ++x) {
+			PqCell* cell = &cells[PQ_CELL(p[2], p[1], p[0])];
+			cell->count++;
+			cell->sumR += p[2];
+			cell->sumG += p[1];
+			cell->sumB += p[0];
+			if (exact->numColors <= PALETTE_QUANTIZER_COLORS) {
+				// Neighbouring pixels often have the same color
+				const uint32_t key = PQ_EXACT_USED | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+				if (key != lastKey) pq_exact_add(exact, key);
+				lastKey = key;
+			}
+			p += bytesPerPixel;
+		}
+		row += rowStride;
+	}
+
+	if (exact->numColors <= PALETTE_QUANTIZER_COLORS) {
+		// No colors are lost
+		unsigned int slot;
+		for (slot=0; slot<PQ_EXACT_SLOTS; ++slot) {
+			if (!exact->slots[slot]) continue;
+			RGBQUAD* color = &palette[exact->index[slot]];
+			color->rgbRed   = (exact->slots[slot] >> 16) & 0xFF;
+			color->rgbGreen = (exact->slots[slot] >> 8) & 0xFF;
+			color->rgbBlue  = exact->slots[slot] & 0xFF;
+		}
+		row = firstRow;
+		for (y=0; y<height; ++y) {
+			const unsigned char* p = row;
+			unsigned char* out = indices + (size_t)y*width;
+			for (x=0; x<width; ++x) {
+				const uint32_t key = PQ_EXACT_USED | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+				out[x] = exact->index[pq_exact_find(exact, key)];
+				p += bytesPerPixel;
+			}
+			row += rowStride;
+		}
+		free(exact);
+		free(cells);
+		return true;
+	}
+	free(exact);
+
+	const int numColors = pq_median_cut(cells, palette);
+
+	// The lookup table is only computed for the used cells: the nearest palette color to the average color of the cell
+	unsigned char* lookup = (unsigned char*)malloc(PQ_NUM_CELLS);
+	if (!lookup) {
+		free(cells);
+		return false;
+	}
+	unsigned int c;
+	for (c=0; c<PQ_NUM_CELLS; ++c) {
+		const PqCell* cell = &cells[c];
+		if (!cell->count) continue;
+		const int r = (cell->sumR + cell->count/2) / cell->count;
+		const int g = (cell->sumG + cell->count/2) / cell->count;
+		const int b = (cell->sumB + cell->count/2) / cell->count;
+		int best = 0;
+		int bestDistance = 0x7FFFFFFF;
+		int i;
+		for (i=0; i<numColors; ++i) {
+			const int dr = r - palette[i].rgbRed;
+			const int dg = g - palette[i].rgbGreen;
+			const int db = b - palette[i].rgbBlue;
+			const int distance = dr*dr + dg*dg + db*db;
+			if (distance < bestDistance) {
+				best = i;
+				bestDistance = distance;
+			}
+		}
+		lookup[c] = best;
+	}
+	free(cells);
+
+	// Second pass: every pixel is mapped through the lookup table
+	row = firstRow;
+	for (y=0; y<height; ++y) {
+		const unsigned char* p = row;
+		unsigned char* out = indices + (size_t)y*width;
+		for (x=0; x<width; ++x) {
+			out[x] = lookup[PQ_CELL(p[2], p[1], p[0])];
+			p += bytesPerPixel;
+		}
+		row += rowStride;
+	}
+	free(lookup);
+	return true;
+}
@@ -0,0 +1,27 @@
+/**
+ * Reduces truecolor pictures to 256 colors, for the import of 24 and 32 bit bitmaps into the IPE16 games
+ * Median cut over a 5-6-5 histogram, and a lookup table from every used histogram cell to its nearest palette color.
+ * If the picture has 256 colors or less, they are taken exactly.
+ * ART file packer by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__palette_quantizer
+#define __inc__palette_quantizer
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bitmap.h"
+
+#define PALETTE_QUANTIZER_COLORS 256
+
+// firstRow: the top row of the picture, with blue, green, red (and an ignored 4th byte if bytesPerPixel is 4) per pixel.
+// rowStride is the distance to the next row below, negative for "bottom-up" bitmaps.
+// palette receives 256 colors (unused entries are black), indices receives width*height palette indices (top-down rows without padding).
+// Returns false if there is not enough memory.
+bool palette_quantize(const unsigned char* firstRow, const ptrdiff_t rowStride, const unsigned int width, const unsigned int height, const unsigned int bytesPerPixel,
+                      RGBQUAD palette[PALETTE_QUANTIZER_COLORS], unsigned char* indices);
+
+#endif // #ifndef __inc__palette_quantizer
@@ -0,0 +1,96 @@
+/**
+ * Deduplication of identical decoded pictures for the ART file unpacker
+ * Remembers the bitmap files which were written, by the hash of their content, so that an identical bitmap becomes a link to the first one
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "picture_dedup.h"
+#include "utils.h"
+
+#define PICTURE_DEDUP_EXPECTED_ENTRIES 32
+
+static bool picture_dedup_equal(const void* entry, const void* key) {
+	return ((const PictureDedupEntry*)entry)->size == *(const uint64_t*)key;
+}
+
+PictureDedup* new_picture_dedup() {
+	PictureDedup* dedup = (PictureDedup*)calloc(1, sizeof(PictureDedup));
+	if (!dedup) return NULL;
+	if (!hash_table_init(&dedup->table, sizeof(PictureDedupEntry), PICTURE_DEDUP_EXPECTED_ENTRIES, picture_dedup_equal)) {
+		free(dedup);
+		return NULL;
+	}
+	pthread_mutex_init(&dedup->mutex, NULL);
+	return dedup;
+}
+
+void del_picture_dedup(PictureDedup* dedup) {
+	if (!dedup) return;
+	size_t i;
+	for (i=0; i<dedup->table.capacity; ++i) {
+		const PictureDedupEntry* entry = (const PictureDedupEntry*)hash_table_entry(&dedup->table, i);
+		if (entry) free(entry->szFilename);
+	}
+	hash_table_free(&dedup->table);
+	pthread_mutex_destroy(&dedup->mutex);
+	free(dedup);
+}
+
+// Returns true if the file has exactly this content
+static bool picture_dedup_file_equal(const char* szFilename, const unsigned char* data, const uint64_t size) {
+	FILE* fp = fopen(szFilename, "rb");
+	if (!fp) return false;
+	unsigned char chunk[0x10000];
+	uint64_t pos = 0;
+	bool bEqual = true;
+	while (bEqual && (pos < size)) {
+		const size_t n = (size-pos < sizeof(chunk)) ? (size_t)(size-pos) : sizeof(chunk);
+		bEqual = (fread(chunk, 1, n, fp) == n) && (memcmp(chunk, data+pos, n) == 0);
+		pos += n;
+	}
+	bEqual = bEqual && (fgetc(fp) == EOF);
+	fclose(fp);
+	return bEqual;
+}
+
+bool picture_dedup_link(PictureDedup* dedup, const uint64_t hash, const unsigned char* bitmap, const uint64_t size, const char* szFilename) {
+	// An existing file must not be overwritten, because it might be a link from an earlier run
+	remove(szFilename);
+
+	// The file name of an entry does not change anymore, so the file is compared without holding the lock
+	pthread_mutex_lock(&dedup->mutex);
+	const PictureDedupEntry* entry = (const PictureDedupEntry*)hash_table_find(&dedup->table, hash, &size);
+	const char* szExisting = entry ? entry->szFilename : NULL;
+	pthread_mutex_unlock(&dedup->mutex);
+
+	// On a hash collision, or if the link cannot be created (e.g. FAT file system), the bitmap is written as usual
+	const bool bLinked = szExisting && picture_dedup_file_equal(szExisting, bitmap, size) && file_link(szExisting, szFilename);
+	if (bLinked) {
+		pthread_mutex_lock(&dedup->mutex);
+		dedup->numLinked++;
+		dedup->bytesSaved += size;
+		pthread_mutex_unlock(&dedup->mutex);
+	}
+	return bLinked;
+}
+
+void picture_dedup_add(PictureDedup* dedup, const uint64_t hash, const uint64_t size, const char* szFilename) {
+	pthread_mutex_lock(&dedup->mutex);
+	// Nothing is lost if the table cannot grow: the picture is just not deduplicated
+	bool bNew;
+	PictureDedupEntry* entry = (PictureDedupEntry*)hash_table_insert(&dedup->table, hash, &size, &bNew);
+	if (entry && !entry->szFilename) {
+		entry->size = size;
+		entry->szFilename = (char*)malloc(strlen(szFilename)+1);
+		if (entry->szFilename) strcpy(entry->szFilename, szFilename);
+	}
+	pthread_mutex_unlock(&dedup->mutex);
+}
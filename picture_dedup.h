@@ -0,0 +1,39 @@
+/**
+ * Deduplication of identical decoded pictures for the ART file unpacker
+ * Remembers the bitmap files which were written, by the hash of their content, so that an identical bitmap becomes a link to the first one
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__picture_dedup
+#define __inc__picture_dedup
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "hash_table.h"
+
+typedef struct tagPictureDedupEntry {
+	uint64_t size;         // of the bitmap file
+	char* szFilename;      // NULL if there was not enough memory
+} PictureDedupEntry;
+
+// Shared by all worker threads (and all ART files of the batch mode)
+typedef struct tagPictureDedup {
+	pthread_mutex_t mutex;
+	HashTable table;       // of PictureDedupEntry, by the hash of the decoded picture, including everything which ends up in the bitmap (dimensions, palette)
+	int numLinked;
+	uint64_t bytesSaved;
+} PictureDedup;
+
+PictureDedup* new_picture_dedup();
+void del_picture_dedup(PictureDedup* dedup);
+
+// If an identical bitmap (the whole bitmap file, size bytes) was already written, szFilename becomes a link to it and true is returned.
+// A hash match is only accepted if the file which was written has the same content.
+// Otherwise, the caller writes the bitmap and calls picture_dedup_add(). An existing file szFilename is removed in any case.
+bool picture_dedup_link(PictureDedup* dedup, const uint64_t hash, const unsigned char* bitmap, const uint64_t size, const char* szFilename);
+void picture_dedup_add(PictureDedup* dedup, const uint64_t hash, const uint64_t size, const char* szFilename);
+
+#endif // #ifndef __inc__picture_dedup
@@ -0,0 +1,328 @@
+/**
+ * POSIX ustar streams for the ART file packer and unpacker
+ * The unpacker can write the bitmaps and index.txt into a tar stream instead of a folder,
+ * and the packer can read its input folder from a tar stream (e.g. from a pipe).
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "tar_stream.h"
+
+// Layout of the ustar header block
+typedef struct tagTarHeader {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+} TarHeader;
+
+#define TAR_TYPE_REGULAR      '0'
+#define TAR_TYPE_REGULAR_OLD  '\0'
+#define TAR_TYPE_GNU_LONGNAME 'L'
+
+// The size field has 11 octal digits
+#define TAR_MAX_FILE_SIZE 077777777777ULL
+
+// Entries of the packer input are mostly bitmaps and index.txt, so no name should be near this limit
+#define TAR_MAX_NAME 4096
+
+static const char* tar_strip_dot_slash(const char* szName) {
+	while ((szName[0] == '.') && (szName[1] == '/')) szName += 2;
+	return szName;
+}
+
+static void tar_write_octal(char* field, const size_t fieldSize, uint64_t value) {
+	// Zero-padded, terminated by NUL
+	size_t i = fieldSize-1;
+	field[i] = 0;
+	while (i > 0) {
+		field[--i] = '0' + (value & 7);
+		value >>= 3;
+	}
+}
+
+static unsigned int tar_header_checksum(const TarHeader* header) {
+	// The checksum field itself is counted as spaces
+	const unsigned char* p = (const unsigned char*)header;
+	unsigned int sum = 0;
+	size_t i;
+	for (i=0; i<sizeof(TarHeader); ++i) {
+		const bool bChecksumField = (i >= offsetof(TarHeader, chksum)) && (i < offsetof(TarHeader, chksum)+sizeof(header->chksum));
+		sum += bChecksumField ? ' ' : p[i];
+	}
+	return sum;
+}
+
+// Splits long names at a slash into prefix (max 155 chars) and name (max 100 chars)
+static bool tar_set_name(TarHeader* header, const char* szName) {
+	const size_t len = strlen(szName);
+	if (len <= sizeof(header->name)) {
+		memcpy(header->name, szName, len);
+		return true;
+	}
+	const char* slash = szName + len;
+	while (slash > szName) {
+		--slash;
+		if (*slash != '/') continue;
+		const size_t prefixLen = slash-szName;
+		const size_t nameLen = len-prefixLen-1;
+		if (nameLen > sizeof(header->name)) return false;
+		if (prefixLen <= sizeof(header->prefix)) {
+			memcpy(header->prefix, szName, prefixLen);
+			memcpy(header->name, slash+1, nameLen);
+			return true;
+		}
+	}
+	return false;
+}
+
+void tar_writer_begin(TarWriter* tar, FILE* fotTar) {
+	tar->fotTar = fotTar;
+	tar->mtime = (uint32_t)time(NULL);
+	tar->bOK = true;
+}
+
+bool tar_write_file(TarWriter* tar, const char* szName, const unsigned char* data, size_t size) {
+	szName = tar_strip_dot_slash(szName);
+
+	TarHeader header;
+	memset(&header, 0, sizeof(header));
+	if (!tar_set_name(&header, szName)) {
+		fprintf(stderr, "ERROR: The name %s is too long for a tar stream\n", szName);
+		return false;
+	}
+	if (size > TAR_MAX_FILE_SIZE) {
+		fprintf(stderr, "ERROR: %s is too big for a tar stream\n", szName);
+		return false;
+	}
+	tar_write_octal(header.mode, sizeof(header.mode), 0644);
+	tar_write_octal(header.uid, sizeof(header.uid), 0);
+	tar_write_octal(header.gid, sizeof(header.gid), 0);
+	tar_write_octal(header.size, sizeof(header.size), size);
+	tar_write_octal(header.mtime, sizeof(header.mtime), tar->mtime);
+	header.typeflag = TAR_TYPE_REGULAR;
+	memcpy(header.magic, "ustar", 6);
+	memcpy(header.version, "00", 2);
+	tar_write_octal(header.chksum, 7, tar_header_checksum(&header));
+	header.chksum[7] = ' ';
+
+	const unsigned char padding[TAR_BLOCK_SIZE] = {0};
+	const size_t paddingSize = (TAR_BLOCK_SIZE - size%TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+	if ((fwrite(&header, sizeof(header), 1, tar->fotTar) != 1) ||
+		((size > 0) && (fwrite(data, size, 1, tar->fotTar) != 1)) ||
+		((paddingSize > 0) && (fwrite(padding, paddingSize, 1, tar->fotTar) != 1))) {
+		fprintf(stderr, "ERROR: Cannot write %s into the tar stream\n", szName);
+		tar->bOK = false;
+		return false;
+	}
+	return true;
+}
+
+bool tar_writer_end(TarWriter* tar) {
+	const unsigned char zeroBlocks[2*TAR_BLOCK_SIZE] = {0};
+	if (fwrite(zeroBlocks, sizeof(zeroBlocks), 1, tar->fotTar) != 1) tar->bOK = false;
+	if (fflush(tar->fotTar) != 0) tar->bOK = false;
+	if (!tar->bOK) fprintf(stderr, "ERROR: Cannot write the tar stream\n");
+	return tar->bOK;
+}
+
+static bool tar_parse_octal(const char* field, const size_t fieldSize, uint64_t* value) {
+	size_t i = 0;
+	while ((i < fieldSize) && (field[i] == ' ')) ++i;
+	*value = 0;
+	bool bDigits = false;
+	for (; (i < fieldSize) && (field[i] >= '0') && (field[i] <= '7'); ++i) {
+		*value = (*value << 3) | (field[i]-'0');
+		bDigits = true;
+	}
+	// Terminated by NUL or space (or the end of the field)
+	return bDigits && ((i == fieldSize) || (field[i] == 0) || (field[i] == ' '));
+}
+
+static bool tar_is_zero_block(const unsigned char* block) {
+	int i;
+	for (i=0; i<TAR_BLOCK_SIZE; ++i) {
+		if (block[i] != 0) return false;
+	}
+	return true;
+}
+
+// Reads the data of an entry and the padding to the next block.
+// extra bytes are allocated behind the data, e.g. for a terminating zero.
+static unsigned char* tar_read_data(FILE* fibTar, const uint64_t size, const size_t extra) {
+	unsigned char* data = (unsigned char*)malloc(size+extra > 0 ? size+extra : 1);
+	if (!data) return NULL;
+	if ((size > 0) && (fread(data, size, 1, fibTar) != 1)) {
+		free(data);
+		return NULL;
+	}
+	unsigned char padding[TAR_BLOCK_SIZE];
+	const size_t paddingSize = (TAR_BLOCK_SIZE - size%TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+	if ((paddingSize > 0) && (fread(padding, paddingSize, 1, fibTar) != 1)) {
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static bool tar_skip_data(FILE* fibTar, uint64_t size) {
+	// Pipes cannot seek
+	unsigned char buf[TAR_BLOCK_SIZE];
+	uint64_t remaining = (size + TAR_BLOCK_SIZE-1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+	while (remaining > 0) {
+		if (fread(buf, TAR_BLOCK_SIZE, 1, fibTar) != 1) return false;
+		remaining -= TAR_BLOCK_SIZE;
+	}
+	return true;
+}
+
+static int tar_compare_entries(const void* a, const void* b) {
+	const TarEntry* ea = (const TarEntry*)a;
+	const TarEntry* eb = (const TarEntry*)b;
+	const int cmp = strcmp(ea->szName, eb->szName);
+	if (cmp != 0) return cmp;
+	return (ea->index > eb->index) - (ea->index < eb->index);
+}
+
+static bool tar_add_entry(TarArchive* archive, const char* szName, unsigned char* data, const size_t size) {
+	if (archive->numEntries == archive->capacity) {
+		const int newCapacity = (archive->capacity == 0) ? 64 : archive->capacity*2;
+		TarEntry* newEntries = (TarEntry*)realloc(archive->entries, newCapacity*sizeof(TarEntry));
+		if (!newEntries) return false;
+		archive->entries = newEntries;
+		archive->capacity = newCapacity;
+	}
+	char* szNameCopy = (char*)malloc(strlen(szName)+1);
+	if (!szNameCopy) return false;
+	strcpy(szNameCopy, szName);
+
+	TarEntry* entry = &archive->entries[archive->numEntries];
+	entry->szName = szNameCopy;
+	entry->data = data;
+	entry->size = size;
+	entry->index = archive->numEntries++;
+	return true;
+}
+
+bool tar_read_archive(FILE* fibTar, const char* szTarName, TarArchive* archive) {
+	memset(archive, 0, sizeof(*archive));
+	char* szLongName = NULL; // GNU extension for names with more than 100 chars
+	#define TAR_FAIL_RETURN { free(szLongName); tar_free_archive(archive); return false; }
+
+	while (1) {
+		TarHeader header;
+		if (fread(&header, sizeof(header), 1, fibTar) != 1) {
+			fprintf(stderr, "FATAL: Unexpected end of the tar stream %s\n", szTarName);
+			TAR_FAIL_RETURN;
+		}
+		if (tar_is_zero_block((const unsigned char*)&header)) break; // end of archive (the second zero block is not needed)
+
+		uint64_t checksum, size;
+		if (!tar_parse_octal(header.chksum, sizeof(header.chksum), &checksum) || (checksum != tar_header_checksum(&header))) {
+			fprintf(stderr, "FATAL: %s is not a valid tar stream (header checksum mismatch)\n", szTarName);
+			TAR_FAIL_RETURN;
+		}
+		if (!tar_parse_octal(header.size, sizeof(header.size), &size) || (size > SIZE_MAX-TAR_BLOCK_SIZE)) {
+			fprintf(stderr, "FATAL: Invalid size in the tar stream %s\n", szTarName);
+			TAR_FAIL_RETURN;
+		}
+
+		if (header.typeflag == TAR_TYPE_GNU_LONGNAME) {
+			if (size >= TAR_MAX_NAME) {
+				fprintf(stderr, "FATAL: Invalid long name in the tar stream %s\n", szTarName);
+				TAR_FAIL_RETURN;
+			}
+			free(szLongName);
+			szLongName = (char*)tar_read_data(fibTar, size, 1);
+			if (!szLongName) {
+				fprintf(stderr, "FATAL: Unexpected end of the tar stream %s\n", szTarName);
+				TAR_FAIL_RETURN;
+			}
+			szLongName[size] = 0;
+			continue;
+		}
+
+		if ((header.typeflag != TAR_TYPE_REGULAR) && (header.typeflag != TAR_TYPE_REGULAR_OLD)) {
+			// Folders, links, pax headers etc.
+			free(szLongName);
+			szLongName = NULL;
+			if (!tar_skip_data(fibTar, size)) {
+				fprintf(stderr, "FATAL: Unexpected end of the tar stream %s\n", szTarName);
+				TAR_FAIL_RETURN;
+			}
+			continue;
+		}
+
+		char szName[sizeof(header.prefix)+1+sizeof(header.name)+1];
+		if (header.prefix[0] && (memcmp(header.magic, "ustar", 5) == 0)) {
+			snprintf(szName, sizeof(szName), "%.*s/%.*s", (int)sizeof(header.prefix), header.prefix, (int)sizeof(header.name), header.name);
+		} else {
+			snprintf(szName, sizeof(szName), "%.*s", (int)sizeof(header.name), header.name);
+		}
+
+		unsigned char* data = tar_read_data(fibTar, size, 0);
+		if (!data) {
+			fprintf(stderr, "FATAL: Cannot read %s from the tar stream %s\n", szName, szTarName);
+			TAR_FAIL_RETURN;
+		}
+		if (!tar_add_entry(archive, tar_strip_dot_slash(szLongName ? szLongName : szName), data, size)) {
+			free(data);
+			fprintf(stderr, "FATAL: Cannot allocate memory for the tar stream %s\n", szTarName);
+			TAR_FAIL_RETURN;
+		}
+		free(szLongName);
+		szLongName = NULL;
+	}
+
+	free(szLongName);
+	qsort(archive->entries, archive->numEntries, sizeof(TarEntry), tar_compare_entries);
+	return true;
+}
+
+const TarEntry* tar_find_entry(const TarArchive* archive, const char* szName) {
+	szName = tar_strip_dot_slash(szName);
+
+	// Binary search for the last entry with this name
+	int lo = 0, hi = archive->numEntries;
+	while (lo < hi) {
+		const int mid = lo + (hi-lo)/2;
+		if (strcmp(archive->entries[mid].szName, szName) <= 0) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo > 0) && (strcmp(archive->entries[lo-1].szName, szName) == 0)) return &archive->entries[lo-1];
+	return NULL;
+}
+
+void tar_free_archive(TarArchive* archive) {
+	int i;
+	for (i=0; i<archive->numEntries; ++i) {
+		free(archive->entries[i].szName);
+		free(archive->entries[i].data);
+	}
+	free(archive->entries);
+	memset(archive, 0, sizeof(*archive));
+}
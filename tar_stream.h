@@ -0,0 +1,50 @@
+/**
+ * POSIX ustar streams for the ART file packer and unpacker
+ * The unpacker can write the bitmaps and index.txt into a tar stream instead of a folder,
+ * and the packer can read its input folder from a tar stream (e.g. from a pipe).
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__tar_stream
+#define __inc__tar_stream
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TAR_BLOCK_SIZE 512
+
+// Writes regular files in the ustar format. The stream does not need to be seekable.
+typedef struct tagTarWriter {
+	FILE* fotTar;
+	uint32_t mtime;  // of all files
+	bool bOK;        // false after the first write error
+} TarWriter;
+
+// One regular file of a tar stream which was read into memory
+typedef struct tagTarEntry {
+	char* szName;          // "./" at the beginning is removed
+	unsigned char* data;
+	size_t size;
+	int index;             // position in the stream; if a name appears twice, the later file wins
+} TarEntry;
+
+typedef struct tagTarArchive {
+	int numEntries;
+	int capacity;
+	TarEntry* entries;     // sorted by name (and index)
+} TarArchive;
+
+void tar_writer_begin(TarWriter* tar, FILE* fotTar);
+// szName may contain folders (e.g. "FOO/index.txt"), "./" at the beginning is removed
+bool tar_write_file(TarWriter* tar, const char* szName, const unsigned char* data, size_t size);
+bool tar_writer_end(TarWriter* tar); // writes the end-of-archive marker
+
+// Reads all regular files of the stream into memory. Folders, links and extended headers are skipped, but GNU long names are supported.
+bool tar_read_archive(FILE* fibTar, const char* szTarName, TarArchive* archive);
+const TarEntry* tar_find_entry(const TarArchive* archive, const char* szName);
+void tar_free_archive(TarArchive* archive);
+
+#endif // #ifndef __inc__tar_stream
@@ -48,6 +48,176 @@ echo "DIFF Result (PiP): $RES"
 if [ -d out_test ]; then
 	rm -Rf out_test
 fi
+if [ -f pip_test.art ]; then
+	mkdir out_test
+	../ipe_artfile_unpacker -v -i pip_test.art -o out_test -n 'cces?S'
+fi
+diff pip_test/CCES2S.bmp out_test/CCES2S.bmp
+RES=$?
+echo "DIFF Result (PiP, -n): $RES"
+if [ -d out_test ]; then
+	rm -Rf out_test
+fi
+if [ -f pip_test.art ]; then
+	# The pictures are compressed in parallel, but the ART file must be the same
+	../ipe_artfile_packer -j 3 -i pip_test -o pip_test_j.art -t pip
+	cmp pip_test.art pip_test_j.art
+	RES=$?
+	echo "PARALLEL Result (PiP): $RES"
+	rm -f pip_test_j.art
+fi
+if [ -f pip_test.art ]; then
+	# Nothing changed since the extraction, so the picture is copied from the old ART file instead of being compressed again
+	mkdir out_test
+	../ipe_artfile_unpacker -i pip_test.art -o out_test > /dev/null
+	# The ART file is packed again in place: it is only replaced after it was read
+	cp pip_test.art pip_test_base.art
+	../ipe_artfile_packer -v -i out_test -o pip_test_base.art -t pip --base pip_test_base.art | grep -q "1 of 1 pictures were copied" && cmp pip_test.art pip_test_base.art
+	RES=$?
+	echo "BASE Result (PiP): $RES"
+	rm -f pip_test_base.art
+	rm -Rf out_test
+fi
+if [ -f pip_test.art ]; then
+	# No ART file is written, but its size is known
+	../ipe_artfile_packer -i pip_test -t pip | grep -q "^pip_test.ART: $(stat -c %s pip_test.art) bytes projected$"
+	RES=$?
+	echo "SIMULATE Result (PiP): $RES"
+fi
+if [ -f pip_test.art ]; then
+	# Only the picture and its directory entry are rewritten. Replacing it back and compacting gives the original file.
+	mkdir out_test
+	cp pip_test.art pip_test_replace.art
+	../ipe_artfile_packer -t pip --replace CCES2S=ba_test/MENU.bmp -o pip_test_replace.art && \
+	../ipe_artfile_unpacker -i pip_test_replace.art -o out_test > /dev/null && cmp ba_test/MENU.bmp out_test/CCES2S.bmp && \
+	../ipe_artfile_packer -t pip --replace CCES2S=pip_test/CCES2S.bmp --compact -o pip_test_replace.art && cmp pip_test.art pip_test_replace.art
+	RES=$?
+	echo "REPLACE Result (PiP): $RES"
+	rm -f pip_test_replace.art
+	rm -Rf out_test
+fi
+if [ -f pip_test.art ]; then
+	# Both directory entries point to the same data, so the ART file only grows by one directory entry
+	mkdir pip_dedup out_test
+	cp pip_test/CCES2S.bmp pip_dedup/
+	(cat pip_test/index.txt; echo "X Q CCES2T CCES2S.bmp 0 0") > pip_dedup/index.txt
+	../ipe_artfile_packer --dedup -i pip_dedup -o pip_dedup.art -t pip > /dev/null && \
+	[ "$(stat -c %s pip_dedup.art)" = "$(( $(stat -c %s pip_test.art) + 32 ))" ] && \
+	../ipe_artfile_unpacker -i pip_dedup.art -o out_test > /dev/null && cmp pip_test/CCES2S.bmp out_test/CCES2T.bmp
+	RES=$?
+	echo "PACK DEDUP Result (PiP): $RES"
+	rm -f pip_dedup.art
+	rm -Rf pip_dedup out_test
+fi
+if [ -f pip_test.art ]; then
+	# The cropped pictures are extracted with their new offsets, so packing them again without --crop gives the same ART file
+	mkdir out_test
+	../ipe_artfile_packer --crop -i pip_test -o pip_test_crop.art -t pip && \
+	../ipe_artfile_unpacker -i pip_test_crop.art -o out_test > /dev/null && \
+	../ipe_artfile_packer -i out_test -o pip_test_crop2.art -t pip && cmp pip_test_crop.art pip_test_crop2.art
+	RES=$?
+	echo "CROP Result (PiP): $RES"
+	rm -f pip_test_crop.art pip_test_crop2.art
+	rm -Rf out_test
+fi
+if [ -f pip_test.art ]; then
+	# 8x6 bitmap with the transparent index 0. The opaque pixels are at 5,2 6,2 and 2,4, row 3 is transparent.
+	# So 5x3 pixels at 2,2 are kept, and the offsets 3,4 become 5,6
+	mkdir crop_test out_test
+	(
+		printf 'BM\x66\x04\x00\x00\x00\x00\x00\x00\x36\x04\x00\x00'
+		printf '\x28\x00\x00\x00\x08\x00\x00\x00\x06\x00\x00\x00\x01\x00\x08\x00\x00\x00\x00\x00\x30\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00'
+		for i in $(seq 0 255); do printf "\\x$(printf %02x $i)\\x$(printf %02x $((255-i)))\\x00\\x00"; done
+		# The rows are stored bottom up
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00'
+		printf '\x00\x00\x09\x00\x00\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x07\x08\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00'
+	) > crop_test/CROP.bmp
+	echo "X Q CROP CROP.bmp 3 4" > crop_test/index.txt
+	../ipe_artfile_packer --crop -i crop_test -o crop_test.art -t pip && \
+	[ "$(../ipe_artfile_unpacker -l -f tsv -i crop_test.art | cut -f 8,9 | tail -n 1)" = "$(printf '5\t3')" ] && \
+	../ipe_artfile_unpacker -i crop_test.art -o out_test > /dev/null && \
+	grep -q "^X Q CROP CROP.bmp 5 6" out_test/index.txt
+	RES=$?
+	echo "CROP OFFSETS Result (PiP): $RES"
+	rm -f crop_test.art
+	rm -Rf crop_test out_test
+fi
+if [ -f pip_test.art ]; then
+	# 4x2 bitmaps with 5 colours: 24 bit, and 32 bit with BI_BITFIELDS. The palette is built from their colours,
+	# so the extracted 8 bit bitmaps must have exactly the same colours. Without an attached palette, they are rejected.
+	mkdir tc_test out_test
+	PIXELS='\x00\x00\xff\x00\xff\x00\xff\x00\x00\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\xff\x00\x80\x40\x20'
+	(
+		printf 'BM\x4e\x00\x00\x00\x00\x00\x00\x00\x36\x00\x00\x00'
+		printf '\x28\x00\x00\x00\x04\x00\x00\x00\x02\x00\x00\x00\x01\x00\x18\x00\x00\x00\x00\x00\x18\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+		printf "$PIXELS"
+	) > tc_test/TC24.bmp
+	(
+		printf 'BM\x62\x00\x00\x00\x00\x00\x00\x00\x42\x00\x00\x00'
+		printf '\x28\x00\x00\x00\x04\x00\x00\x00\x02\x00\x00\x00\x01\x00\x20\x00\x03\x00\x00\x00\x20\x00\x00\x00'
+		printf '\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+		printf '\x00\x00\xff\x00\x00\xff\x00\x00\xff\x00\x00\x00'
+		printf "$PIXELS" | od -An -v -tx1 -w3 | while read B G R; do printf "\\x$B\\x$G\\x$R\\xff"; done
+	) > tc_test/TC32.bmp
+	printf 'X Q TC24 TC24.bmp 0 0\nX Q TC32 TC32.bmp 0 0\n' > tc_test/index.txt
+	../ipe_artfile_packer -i tc_test -o tc_test.art -t pip && \
+	../ipe_artfile_unpacker -i tc_test.art -o out_test > /dev/null
+	RES=$?
+	for NAME in TC24 TC32; do
+		# The colour of every pixel of the extracted bitmap, looked up in its palette
+		BYTES=( $(od -An -v -tx1 out_test/$NAME.bmp) )
+		OFFSET=$(( 16#${BYTES[11]}${BYTES[10]} ))
+		COLORS=""
+		for I in $(seq $OFFSET $(( OFFSET+7 ))); do
+			PAL=$(( 54 + 4*16#${BYTES[$I]} ))
+			COLORS="$COLORS\\x${BYTES[$PAL]}\\x${BYTES[$(( PAL+1 ))]}\\x${BYTES[$(( PAL+2 ))]}"
+		done
+		[ "$COLORS" = "$PIXELS" ] || RES=1
+	done
+	echo "X Q TC24 TC24.bmp 0 0" > tc_test/index.txt
+	../ipe_artfile_packer -i tc_test -o tc_test.art -t pip > /dev/null && \
+	sed -i 's/^X/C/' tc_test/index.txt && \
+	! ../ipe_artfile_packer -i tc_test -o tc_test.art -t pip > /dev/null 2>&1 || RES=1
+	echo "TRUECOLOR Result (PiP): $RES"
+	rm -f tc_test.art
+	rm -Rf tc_test out_test
+fi
+if [ -f pip_test.art ]; then
+	# The stored picture is copied without compressing it again, and the duplicate name is dropped
+	# The output can be one of the inputs: it is only replaced after all inputs were read
+	cp pip_test.art pip_test_merge.art && \
+	../ipe_artfile_packer -t pip --merge --duplicates first -o pip_test_merge.art ./pip_test_merge.art pip_test.art && cmp pip_test.art pip_test_merge.art
+	RES=$?
+	echo "MERGE Result (PiP): $RES"
+	rm -f pip_test_merge.art
+fi
+if [ -f pip_test.art ]; then
+	# --watch keeps the compressed pictures: after one bitmap was saved again, only this picture is compressed again
+	mkdir watch_test
+	cp pip_test/CCES2S.bmp watch_test/CCES2S.bmp
+	cp pip_test/CCES2S.bmp watch_test/CCES2T.bmp
+	(cat pip_test/index.txt; echo "X Q CCES2T CCES2T.bmp 0 0") > watch_test/index.txt
+	../ipe_artfile_packer -i watch_test -o watch_test.art -t pip > /dev/null
+	../ipe_artfile_packer --watch -i watch_test -o watch_test_watch.art -t pip > watch_test.log 2>&1 &
+	WATCH_PID=$!
+	for I in $(seq 100); do grep -q "^Watching" watch_test.log && break; sleep 0.1; done
+	cp watch_test/CCES2T.bmp watch_test/CCES2T.tmp && mv watch_test/CCES2T.tmp watch_test/CCES2T.bmp
+	for I in $(seq 100); do [ "$(grep -c "^Watching" watch_test.log)" = "2" ] && break; sleep 0.1; done
+	kill -INT $WATCH_PID
+	wait $WATCH_PID
+	RES=$?
+	grep -q "(2 pictures compressed, 0 unchanged)" watch_test.log && \
+	grep -q "(1 pictures compressed, 1 unchanged)" watch_test.log && cmp watch_test.art watch_test_watch.art || RES=1
+	echo "WATCH Result (PiP): $RES"
+	rm -f watch_test.art watch_test_watch.art watch_test.log
+	rm -Rf watch_test
+fi
 if [ -f pip_test.art ]; then
 	rm -f pip_test.art
 fi
@@ -64,6 +234,71 @@ RES=$?
 #	exit
 #fi
 echo "DIFF Result (Eraser): $RES"
+if [ -f eraser_test.art ]; then
+	../ipe_artfile_unpacker -l -f tsv -i eraser_test.art | grep -q "CHRBDOSS"
+	RES=$?
+	echo "LIST Result (Eraser): $RES"
+	../ipe_artfile_unpacker --verify --save-checksums eraser_test.sum -i eraser_test.art > /dev/null
+	../ipe_artfile_unpacker --checksums eraser_test.sum -i eraser_test.art
+	RES=$?
+	echo "VERIFY Result (Eraser): $RES"
+	rm -f eraser_test.sum
+	../ipe_artfile_unpacker -o out_batch eraser_test.art eraser_test.art > /dev/null
+	diff -r out_test out_batch/eraser_test__2
+	RES=$?
+	echo "BATCH Result (Eraser): $RES"
+	rm -Rf out_batch
+	mkdir out_async
+	../ipe_artfile_unpacker --io-uring -j 2 -o out_async -i eraser_test.art > /dev/null
+	diff -r out_test out_async
+	RES=$?
+	echo "ASYNC Result (Eraser): $RES"
+	rm -Rf out_async
+	../ipe_artfile_packer -i out_test -o eraser_folder.art -t eraser > /dev/null
+	../ipe_artfile_unpacker --tar - -i eraser_test.art | ../ipe_artfile_packer --tar - -o eraser_tar.art -t eraser > /dev/null
+	cmp eraser_folder.art eraser_tar.art
+	RES=$?
+	echo "TAR Result (Eraser): $RES"
+	rm -f eraser_folder.art eraser_tar.art
+	../ipe_artfile_unpacker --cache eraser_test.cache -i eraser_test.art && ../ipe_artfile_unpacker -v --cache eraser_test.cache -i eraser_test.art | grep -q "up to date"
+	RES=$?
+	echo "CACHE Result (Eraser): $RES"
+	rm -f eraser_test.cache
+	../ipe_artfile_unpacker --dedup -o out_dedup eraser_test.art eraser_test.art > /dev/null
+	diff -r out_test out_dedup/eraser_test__2 && [ "$(stat -c %h out_dedup/eraser_test__2/CHRBDOSS.bmp)" = "2" ]
+	RES=$?
+	echo "DEDUP Result (Eraser): $RES"
+	rm -Rf out_dedup
+	cp eraser_test.art eraser_test_replace.art
+	../ipe_artfile_packer -t eraser --replace CHRBDOSS=ba_test/MENU.bmp -o eraser_test_replace.art && \
+	../ipe_artfile_packer -t eraser --replace CHRBDOSS=eraser_test/CHRBDOSS.bmp --compact -o eraser_test_replace.art && cmp eraser_test.art eraser_test_replace.art
+	RES=$?
+	echo "REPLACE Result (Eraser): $RES"
+	rm -f eraser_test_replace.art
+	mkdir eraser_dedup out_dedup
+	cp eraser_test/CHRBDOSS.bmp eraser_dedup/
+	(cat eraser_test/index.txt; echo "CHRBDOST 19(C) 0(R) CHRBDOSS.bmp") > eraser_dedup/index.txt
+	../ipe_artfile_packer --dedup -i eraser_dedup -o eraser_dedup.art -t eraser > /dev/null && \
+	[ "$(stat -c %s eraser_dedup.art)" = "$(( $(stat -c %s eraser_test.art) + 16 ))" ] && \
+	../ipe_artfile_unpacker -i eraser_dedup.art -o out_dedup > /dev/null && cmp eraser_test/CHRBDOSS.bmp out_dedup/CHRBDOST.bmp
+	RES=$?
+	echo "PACK DEDUP Result (Eraser): $RES"
+	rm -f eraser_dedup.art
+	rm -Rf eraser_dedup out_dedup
+	../ipe_artfile_packer -i eraser_test -t eraser | grep -q "^eraser_test.ART: $(stat -c %s eraser_test.art) bytes projected$"
+	RES=$?
+	echo "SIMULATE Result (Eraser): $RES"
+	../ipe_artfile_packer -t eraser --merge -o eraser_merge2.art eraser_test.art eraser_test.art && \
+	../ipe_artfile_packer -t eraser --merge -n 'CHRB*' --duplicates last -o eraser_merge.art eraser_merge2.art && cmp eraser_test.art eraser_merge.art
+	RES=$?
+	echo "MERGE Result (Eraser): $RES"
+	rm -f eraser_merge.art eraser_merge2.art
+	cp eraser_test.art eraser_test_base.art
+	../ipe_artfile_packer -v -i out_test -o eraser_test_base.art -t eraser --base eraser_test_base.art | grep -q "1 of 1 pictures were copied" && cmp eraser_test.art eraser_test_base.art
+	RES=$?
+	echo "BASE Result (Eraser): $RES"
+	rm -f eraser_test_base.art
+fi
 if [ -d out_test ]; then
 	rm -Rf out_test
 fi
@@ -5,6 +5,23 @@ cd "$DIR"
 
 gcc --std=c99 test_bitmap.c
 gcc --std=c99 test_utils.c
+gcc --std=c99 test_name_counter.c
+gcc --std=c99 test_thread_pool.c
+gcc --std=c99 test_checksum.c
+gcc --std=c99 test_arena.c
+gcc --std=c99 test_art_writer.c
+gcc --std=c99 test_ipe_artfile_packer_ipe16_common.c
+gcc --std=c99 test_hash_manifest.c
+gcc --std=c99 test_async_output.c
+gcc --std=c99 test_tar_stream.c
+gcc --std=c99 test_ipe_cache_file.c
+gcc --std=c99 test_picture_dedup.c
+gcc --std=c99 test_blob_dedup.c
+gcc --std=c99 test_hash_table.c
+gcc --std=c99 test_bmp_view.c
+gcc --std=c99 test_pack_cache.c
+gcc --std=c99 test_folder_watch.c
+gcc --std=c99 test_palette_quantizer.c
 gcc --std=c99 test_ipe16_artfile.c
 gcc --std=c99 test_ipe16_bmpexport.c
 gcc --std=c99 test_ipe16_bmpimport.c
@@ -18,7 +35,9 @@ gcc --std=c99 test_ipe32_lzw_decoder.c
 gcc --std=c99 test_ipe_artfile_packer_ipe16_ba.c
 gcc --std=c99 test_ipe_artfile_packer_ipe16_pip.c
 gcc --std=c99 test_ipe_artfile_packer_ipe32.c
+gcc --std=c99 test_ipe_artfile_packer_common.c
 gcc --std=c99 test_ipe_artfile_unpacker_ipe16.c
+gcc --std=c99 test_ipe_artfile_unpacker_common.c
 gcc --std=c99 test_ipe_artfile_unpacker_ipe32.c
 
 rm a.out
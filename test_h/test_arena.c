@@ -0,0 +1,4 @@
+#include "../arena.h"
+
+int main(int argc, char *argv[]) {
+}
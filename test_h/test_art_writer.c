@@ -0,0 +1,4 @@
+#include "../art_writer.h"
+
+int main(int argc, char *argv[]) {
+}
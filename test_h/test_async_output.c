@@ -0,0 +1,4 @@
+#include "../async_output.h"
+
+int main(int argc, char *argv[]) {
+}
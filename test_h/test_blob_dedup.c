@@ -0,0 +1,4 @@
+#include "../blob_dedup.h"
+
+int main(int argc, char *argv[]) {
+}
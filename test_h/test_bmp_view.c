@@ -0,0 +1,4 @@
+#include "../bmp_view.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../checksum.h"
+
+int main(int argc, char *argv[]) {
+}
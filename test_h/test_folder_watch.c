@@ -0,0 +1,4 @@
+#include "../folder_watch.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../hash_manifest.h"
+
+int main(int argc, char *argv[]) {
+}
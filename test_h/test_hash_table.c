@@ -0,0 +1,4 @@
+#include "../hash_table.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../ipe_artfile_packer_ipe16_common.h"
+
+int main(int argc, char *argv[]) {
+}
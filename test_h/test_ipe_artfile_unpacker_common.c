@@ -0,0 +1,5 @@
+#include "../ipe_artfile_unpacker_common.h"
+
+int main(int argc, char *argv[]) {
+}
+
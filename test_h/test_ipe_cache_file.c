@@ -0,0 +1,4 @@
+#include "../ipe_cache_file.h"
+
+int main(int argc, char *argv[]) {
+}
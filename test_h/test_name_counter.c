@@ -0,0 +1,5 @@
+#include "../name_counter.h"
+
+int main(int argc, char *argv[]) {
+}
+
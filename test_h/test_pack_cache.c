@@ -0,0 +1,4 @@
+#include "../pack_cache.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../palette_quantizer.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../picture_dedup.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,4 @@
+#include "../tar_stream.h"
+
+int main(int argc, char *argv[]) {
+}
@@ -0,0 +1,5 @@
+#include "../thread_pool.h"
+
+int main(int argc, char *argv[]) {
+}
+
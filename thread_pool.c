@@ -0,0 +1,139 @@
+/**
+ * Simple thread pool for the ART file packer and unpacker
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "thread_pool.h"
+
+// Must be called with the mutex locked
+static ThreadPoolJob* thread_pool_dequeue(ThreadPool* pool) {
+	ThreadPoolJob* job = pool->queueHead;
+	if (job) {
+		pool->queueHead = job->next;
+		if (!pool->queueHead) pool->queueTail = NULL;
+	}
+	return job;
+}
+
+// Must be called with the mutex locked. Unlocks the mutex while the job is running.
+static void thread_pool_run_job(ThreadPool* pool, ThreadPoolJob* job, const int workerId) {
+	pthread_mutex_unlock(&pool->mutex);
+	job->func(job->arg, workerId);
+	pthread_mutex_lock(&pool->mutex);
+
+	if (--job->group->pendingJobs == 0) pthread_cond_broadcast(&pool->jobDone);
+	free(job);
+}
+
+typedef struct tagThreadPoolWorkerArg {
+	ThreadPool* pool;
+	int workerId;
+} ThreadPoolWorkerArg;
+
+static void* thread_pool_worker(void* arg) {
+	ThreadPoolWorkerArg* workerArg = (ThreadPoolWorkerArg*)arg;
+	ThreadPool* pool = workerArg->pool;
+	const int workerId = workerArg->workerId;
+	free(workerArg);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		ThreadPoolJob* job = thread_pool_dequeue(pool);
+		if (job) {
+			thread_pool_run_job(pool, job, workerId);
+		} else if (pool->bShutdown) {
+			break;
+		} else {
+			pthread_cond_wait(&pool->jobAvailable, &pool->mutex);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+ThreadPool* new_thread_pool(const int numThreads) {
+	ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+	if (!pool) return NULL;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->jobAvailable, NULL);
+	pthread_cond_init(&pool->jobDone, NULL);
+
+	// The calling thread is the last "worker", see thread_pool_wait()
+	const int numWorkers = (numThreads > 1) ? numThreads-1 : 0;
+	pool->workers = (pthread_t*)malloc((numWorkers+1)*sizeof(pthread_t));
+	int i;
+	for (i=0; i<numWorkers; ++i) {
+		ThreadPoolWorkerArg* workerArg = (ThreadPoolWorkerArg*)malloc(sizeof(ThreadPoolWorkerArg));
+		workerArg->pool = pool;
+		workerArg->workerId = i;
+		if (pthread_create(&pool->workers[i], NULL, thread_pool_worker, workerArg) != 0) {
+			// Continue with the threads we have got so far
+			free(workerArg);
+			break;
+		}
+	}
+	pool->numWorkers = i;
+	return pool;
+}
+
+void del_thread_pool(ThreadPool* pool) {
+	if (!pool) return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->bShutdown = true;
+	pthread_cond_broadcast(&pool->jobAvailable);
+	pthread_mutex_unlock(&pool->mutex);
+
+	int i;
+	for (i=0; i<pool->numWorkers; ++i) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->jobDone);
+	pthread_cond_destroy(&pool->jobAvailable);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->workers);
+	free(pool);
+}
+
+int thread_pool_num_slots(const ThreadPool* pool) {
+	return pool->numWorkers+1;
+}
+
+void thread_pool_submit(ThreadPool* pool, ThreadPoolGroup* group, ThreadPoolJobFunc func, void* arg) {
+	ThreadPoolJob* job = (ThreadPoolJob*)malloc(sizeof(ThreadPoolJob));
+	job->func = func;
+	job->arg = arg;
+	job->group = group;
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	group->pendingJobs++;
+	if (pool->queueTail) {
+		pool->queueTail->next = job;
+	} else {
+		pool->queueHead = job;
+	}
+	pool->queueTail = job;
+	pthread_cond_signal(&pool->jobAvailable);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+void thread_pool_wait(ThreadPool* pool, ThreadPoolGroup* group) {
+	pthread_mutex_lock(&pool->mutex);
+	while (group->pendingJobs > 0) {
+		// Help instead of idling. The calling thread uses the last slot.
+		ThreadPoolJob* job = thread_pool_dequeue(pool);
+		if (job) {
+			thread_pool_run_job(pool, job, pool->numWorkers);
+		} else {
+			pthread_cond_wait(&pool->jobDone, &pool->mutex);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,51 @@
+/**
+ * Simple thread pool for the ART file packer and unpacker
+ * ART file packer and unpacker by Daniel Marschall, ViaThinkSoft (C) 2014-2018
+ * Revision: 2026-10-19
+ **/
+
+#ifndef __inc__thread_pool
+#define __inc__thread_pool
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// workerId is between 0 and thread_pool_num_slots()-1, so that the jobs can use per-worker scratch memory
+typedef void (*ThreadPoolJobFunc)(void* arg, int workerId);
+
+typedef struct tagThreadPoolJob {
+	ThreadPoolJobFunc func;
+	void* arg;
+	struct tagThreadPoolGroup* group;
+	struct tagThreadPoolJob* next;
+} ThreadPoolJob;
+
+// A group of jobs which can be waited for, e.g. all pictures of one ART file
+typedef struct tagThreadPoolGroup {
+	int pendingJobs;
+} ThreadPoolGroup;
+
+typedef struct tagThreadPool {
+	pthread_mutex_t mutex;
+	pthread_cond_t jobAvailable;
+	pthread_cond_t jobDone;
+	ThreadPoolJob* queueHead;
+	ThreadPoolJob* queueTail;
+	int numWorkers;
+	pthread_t* workers;
+	bool bShutdown;
+} ThreadPool;
+
+// numThreads includes the calling thread, which runs jobs while it waits in thread_pool_wait().
+// Therefore, numThreads=1 runs all jobs serially in the calling thread.
+ThreadPool* new_thread_pool(const int numThreads);
+void del_thread_pool(ThreadPool* pool);
+int thread_pool_num_slots(const ThreadPool* pool);
+
+// Jobs are started in the order they are submitted
+void thread_pool_submit(ThreadPool* pool, ThreadPoolGroup* group, ThreadPoolJobFunc func, void* arg);
+
+// Waits until all jobs of the group are done. Must not be called from inside a job.
+void thread_pool_wait(ThreadPool* pool, ThreadPoolGroup* group);
+
+#endif // #ifndef __inc__thread_pool
@@ -1,13 +1,65 @@
+
+// Required for fileno(), posix_fadvise(), fseeko(), ftello(), open_memstream() and clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include "utils.h"
 
-size_t file_size(FILE* fp) {
-	size_t pos = ftell(fp);
+uint64_t file_tell64(FILE* fp) {
+	// ftell() is limited to 2 GiB where long has 32 bits (e.g. Windows)
+	#ifdef _WIN32
+	return _ftelli64(fp);
+	#else
+	return ftello(fp);
+	#endif
+}
+
+bool file_seek64(FILE* fp, uint64_t offset) {
+	#ifdef _WIN32
+	return _fseeki64(fp, offset, SEEK_SET) == 0;
+	#else
+	return fseeko(fp, offset, SEEK_SET) == 0;
+	#endif
+}
+
+bool file_stamp(FILE* fp, uint64_t* size, int64_t* mtime) {
+	#ifdef _WIN32
+	struct __stat64 st;
+	if (_fstat64(_fileno(fp), &st) != 0) return false;
+	#else
+	struct stat st;
+	if (fstat(fileno(fp), &st) != 0) return false;
+	#endif
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return true;
+}
+
+uint64_t file_size(FILE* fp) {
+	uint64_t pos = file_tell64(fp);
 	fseek(fp, 0, SEEK_END);
-	size_t len = ftell(fp);
-	fseek(fp, pos, SEEK_SET);
+	uint64_t len = file_tell64(fp);
+	file_seek64(fp, pos);
 	return len;
 }
 
@@ -18,10 +70,8 @@ char* sanitize_filename(char* picname) {
 }
 
 void* app_zero_alloc(long bytes) {
-	char* ptr = (char*)malloc(bytes);
-	int i;
-	for (i=0; i<bytes; ++i) ptr[i] = 0;
-	return (void*)ptr;
+	// calloc() gets zeroed pages from the OS for big sizes, instead of clearing the memory byte by byte
+	return calloc(1, bytes);
 }
 
 unsigned char read_byte(FILE *file) {
@@ -31,3 +81,238 @@ unsigned char read_byte(FILE *file) {
 	return ch;
 }
 
+void file_set_binary_mode(FILE* fp) {
+	#ifdef _WIN32
+	_setmode(_fileno(fp), _O_BINARY);
+	#endif
+}
+
+void file_advise_sequential(FILE* fp) {
+	// Only a hint for the kernel's readahead. Silently ignored where not supported (e.g. Windows)
+	#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+	#endif
+}
+
+void file_advise_willneed(FILE* fp, size_t offset, size_t len) {
+	#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fileno(fp), offset, len, POSIX_FADV_WILLNEED);
+	#endif
+}
+
+int cpu_count() {
+	#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (si.dwNumberOfProcessors > 0) ? si.dwNumberOfProcessors : 1;
+	#elif defined(_SC_NPROCESSORS_ONLN)
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? n : 1;
+	#else
+	return 1;
+	#endif
+}
+
+uint64_t clock_ms() {
+	#ifdef _WIN32
+	return GetTickCount64();
+	#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+	#endif
+}
+
+bool wildcard_match(const char* pattern, const char* str) {
+	// Glob matching with '*', '?' and '[...]' (also '[!...]' and ranges like '[A-Z]'), case insensitive like the file names of DOS/Windows
+	// Backtracking only to the last '*', therefore linear in practice
+	const char* starPattern = NULL;
+	const char* starStr = NULL;
+	while (*str) {
+		if (*pattern == '*') {
+			starPattern = ++pattern;
+			starStr = str;
+			continue;
+		}
+		if (*pattern == '[') {
+			const char* p = pattern+1;
+			const bool bNegate = (*p == '!') || (*p == '^');
+			if (bNegate) ++p;
+			bool bFound = false;
+			const int c = toupper((unsigned char)*str);
+			do {
+				if (*p == 0) break;
+				int lo = toupper((unsigned char)*p);
+				int hi = lo;
+				if ((p[1] == '-') && (p[2] != 0) && (p[2] != ']')) {
+					hi = toupper((unsigned char)p[2]);
+					p += 2;
+				}
+				if ((c >= lo) && (c <= hi)) bFound = true;
+				++p;
+			} while (*p != ']');
+			if ((*p == ']') && (bFound != bNegate)) {
+				pattern = p+1;
+				++str;
+				continue;
+			}
+			// an unterminated '[' does not match anything
+		} else if ((*pattern == '?') || ((*pattern != 0) && (toupper((unsigned char)*pattern) == toupper((unsigned char)*str)))) {
+			++pattern;
+			++str;
+			continue;
+		}
+		if (!starPattern) return false;
+		pattern = starPattern;
+		str = ++starStr;
+	}
+	while (*pattern == '*') ++pattern;
+	return *pattern == 0;
+}
+
+bool make_directory(const char* szPath) {
+	#ifdef _WIN32
+	if (_mkdir(szPath) == 0) return true;
+	#else
+	if (mkdir(szPath, 0777) == 0) return true;
+	#endif
+	return errno == EEXIST;
+}
+
+bool file_link(const char* szExisting, const char* szNew) {
+	// An existing file must not be overwritten, because it might be a link to another file
+	remove(szNew);
+	#ifdef _WIN32
+	return CreateHardLinkA(szNew, szExisting, NULL) != 0;
+	#else
+	if (link(szExisting, szNew) == 0) return true;
+	#if defined(__linux__) && defined(FICLONE)
+	// If the file system does not support hard links, a reflink (Btrfs, XFS) still shares the data blocks
+	const int fdExisting = open(szExisting, O_RDONLY);
+	if (fdExisting < 0) return false;
+	const int fdNew = open(szNew, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (fdNew < 0) {
+		close(fdExisting);
+		return false;
+	}
+	const bool bCloned = ioctl(fdNew, FICLONE, fdExisting) == 0;
+	close(fdExisting);
+	if ((close(fdNew) != 0) || !bCloned) {
+		remove(szNew);
+		return false;
+	}
+	return true;
+	#else
+	return false;
+	#endif
+	#endif
+}
+
+bool file_replace(const char* szFrom, const char* szTo) {
+	#ifdef _WIN32
+	// rename() does not replace existing files on Windows
+	remove(szTo);
+	#endif
+	return rename(szFrom, szTo) == 0;
+}
+
+void path_stem(const char* szPath, const bool bStripExtension, char* szStem, const size_t size) {
+	// Last path component, without trailing slashes
+	size_t end = strlen(szPath);
+	while ((end > 1) && ((szPath[end-1] == '/') || (szPath[end-1] == '\\'))) --end;
+	size_t begin = end;
+	while ((begin > 0) && (szPath[begin-1] != '/') && (szPath[begin-1] != '\\')) --begin;
+
+	size_t len = end-begin;
+	if (bStripExtension) {
+		size_t i;
+		for (i=len; i>1; --i) {
+			if (szPath[begin+i-1] == '.') {
+				len = i-1;
+				break;
+			}
+		}
+	}
+	if (len >= size) len = size-1;
+	memcpy(szStem, szPath+begin, len);
+	szStem[len] = 0;
+}
+
+bool string_list_add(StringList* list, const char* str) {
+	if (list->numStrings == list->capacity) {
+		const int newCapacity = (list->capacity == 0) ? 16 : list->capacity*2;
+		char** newStrings = (char**)realloc(list->strings, newCapacity*sizeof(char*));
+		if (!newStrings) return false;
+		list->strings = newStrings;
+		list->capacity = newCapacity;
+	}
+	char* copy = (char*)malloc(strlen(str)+1);
+	if (!copy) return false;
+	strcpy(copy, str);
+	list->strings[list->numStrings++] = copy;
+	return true;
+}
+
+bool string_list_read_file(StringList* list, const char* szFilename) {
+	FILE* fitList = fopen(szFilename, "rt");
+	if (!fitList) {
+		fprintf(stderr, "FATAL: Cannot open %s\n", szFilename);
+		return false;
+	}
+	char line[1024];
+	while (fgets(line, sizeof(line), fitList)) {
+		line[strcspn(line, "\r\n")] = 0;
+		if (strlen(line) == 0) continue;
+		if (!string_list_add(list, line)) {
+			fprintf(stderr, "FATAL: Cannot allocate memory for the list of %s\n", szFilename);
+			fclose(fitList);
+			return false;
+		}
+	}
+	fclose(fitList);
+	return true;
+}
+
+void string_list_free(StringList* list) {
+	int i;
+	for (i=0; i<list->numStrings; ++i) free(list->strings[i]);
+	free(list->strings);
+	list->strings = NULL;
+	list->numStrings = 0;
+	list->capacity = 0;
+}
+
+bool memory_file_open(MemoryFile* mf) {
+	memset(mf, 0, sizeof(*mf));
+	#ifdef _WIN32
+	// There is no open_memstream() on Windows
+	mf->fp = tmpfile();
+	#else
+	mf->fp = open_memstream(&mf->data, &mf->size);
+	#endif
+	return mf->fp != NULL;
+}
+
+unsigned char* memory_file_close(MemoryFile* mf, size_t* size) {
+	unsigned char* data = NULL;
+	#ifdef _WIN32
+	const uint64_t len = file_size(mf->fp);
+	data = (unsigned char*)malloc(len > 0 ? len : 1);
+	if (data && (len > 0) && (!file_seek64(mf->fp, 0) || (fread(data, len, 1, mf->fp) != 1))) {
+		free(data);
+		data = NULL;
+	}
+	fclose(mf->fp);
+	*size = len;
+	#else
+	if (fclose(mf->fp) == 0) {
+		data = (unsigned char*)mf->data;
+	} else {
+		free(mf->data);
+	}
+	*size = mf->size;
+	#endif
+	mf->fp = NULL;
+	mf->data = NULL;
+	return data;
+}
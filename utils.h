@@ -2,11 +2,45 @@
 #define __inc__utils
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-size_t file_size(FILE* fp);
+// Growable list of strings (copies), e.g. the input files of the batch mode
+typedef struct tagStringList {
+	int numStrings;
+	int capacity;
+	char** strings;
+} StringList;
+
+// A stream which is written into memory, e.g. index.txt for a tar stream
+typedef struct tagMemoryFile {
+	FILE* fp;
+	char* data;  // only used by open_memstream()
+	size_t size;
+} MemoryFile;
+
+uint64_t file_size(FILE* fp);
+uint64_t file_tell64(FILE* fp);
+bool file_seek64(FILE* fp, uint64_t offset); // from the beginning of the file
+bool file_stamp(FILE* fp, uint64_t* size, int64_t* mtime); // size and modification time (seconds since 1970) of an open file
 char* sanitize_filename(char* picname);
 void* app_zero_alloc(long bytes);
 unsigned char read_byte(FILE *file);
+void file_advise_sequential(FILE* fp);
+void file_set_binary_mode(FILE* fp); // e.g. for stdin/stdout on Windows
+void file_advise_willneed(FILE* fp, size_t offset, size_t len);
+bool wildcard_match(const char* pattern, const char* str);
+int cpu_count();
+uint64_t clock_ms(); // monotonic clock in milliseconds, for measuring durations
+bool make_directory(const char* szPath); // also true if it already exists
+bool file_link(const char* szExisting, const char* szNew); // hard link (or reflink), replaces szNew. false if the file system supports neither
+bool file_replace(const char* szFrom, const char* szTo); // renames szFrom to szTo, also if szTo exists
+void path_stem(const char* szPath, const bool bStripExtension, char* szStem, const size_t size); // e.g. "dir/FOO.ART" => "FOO"
+bool string_list_add(StringList* list, const char* str);
+bool string_list_read_file(StringList* list, const char* szFilename); // one string per line, empty lines are ignored
+void string_list_free(StringList* list);
+bool memory_file_open(MemoryFile* mf);
+unsigned char* memory_file_close(MemoryFile* mf, size_t* size); // returns the written data (must be freed), or NULL on error
 
 #endif // #ifndef __inc__utils
 